@@ -30,6 +30,8 @@ int main(int argc, char *argv[]){
 
 	signal(SIGINT, signalHandler);
 	signal(SIGTERM, signalHandler);
+	// A peer gone mid-write (client socket, CGI stdin) is an error return, not a crash
+	signal(SIGPIPE, SIG_IGN);
 
 	try{
 		if (argc != 2){
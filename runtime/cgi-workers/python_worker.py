@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""Pooled CGI worker for webserv (cgi_pool_worker).
+
+Speaks FastCGI on its stdin, which is a socket to the server, and runs one
+request at a time: each Python script is compiled once and then executed
+in this process with the request's environment, body and output swapped
+in, which saves the interpreter start-up a fork-per-request CGI pays.
+Scripts should not keep state between runs. The worker exits when the
+server closes its end.
+"""
+
+import io
+import os
+import struct
+import sys
+import traceback
+
+FCGI_VERSION_1 = 1
+FCGI_BEGIN_REQUEST = 1
+FCGI_ABORT_REQUEST = 2
+FCGI_END_REQUEST = 3
+FCGI_PARAMS = 4
+FCGI_STDIN = 5
+FCGI_STDOUT = 6
+FCGI_STDERR = 7
+FCGI_MAX_CONTENT = 65535
+
+SERVER_FD = 0
+_compiled = {}   # path -> (mtime, code)
+_buffer = b""
+
+
+def read_record():
+    global _buffer
+    while True:
+        if len(_buffer) >= 8:
+            version, kind, request_id, length, padding = struct.unpack("!BBHHB", _buffer[:7])
+            if version != FCGI_VERSION_1:
+                sys.exit(1)
+            total = 8 + length + padding
+            if len(_buffer) >= total:
+                content = _buffer[8:8 + length]
+                _buffer = _buffer[total:]
+                return kind, request_id, content
+        data = os.read(SERVER_FD, 65536)
+        if not data:
+            return None
+        _buffer += data
+
+
+def write_all(data):
+    view = memoryview(data)
+    while view:
+        view = view[os.write(SERVER_FD, view):]
+
+
+def frame(kind, request_id, content):
+    out = []
+    for offset in range(0, max(len(content), 1), FCGI_MAX_CONTENT):
+        chunk = content[offset:offset + FCGI_MAX_CONTENT]
+        padding = (8 - len(chunk) % 8) % 8
+        out.append(struct.pack("!BBHHBx", FCGI_VERSION_1, kind, request_id, len(chunk), padding))
+        out.append(chunk + b"\0" * padding)
+    return b"".join(out)
+
+
+def parse_pairs(content):
+    pairs = {}
+    pos = 0
+
+    def length():
+        nonlocal pos
+        if content[pos] < 128:
+            pos += 1
+            return content[pos - 1]
+        pos += 4
+        return struct.unpack("!I", content[pos - 4:pos])[0] & 0x7fffffff
+
+    while pos < len(content):
+        name_length = length()
+        value_length = length()
+        name = content[pos:pos + name_length].decode("latin-1")
+        pairs[name] = content[pos + name_length:pos + name_length + value_length].decode("latin-1")
+        pos += name_length + value_length
+    return pairs
+
+
+def compiled(path):
+    mtime = os.stat(path).st_mtime_ns
+    cached = _compiled.get(path)
+    if cached and cached[0] == mtime:
+        return cached[1]
+    with open(path, "rb") as source:
+        code = compile(source.read(), path, "exec")
+    _compiled[path] = (mtime, code)
+    return code
+
+
+def run(params, body):
+    """The script's output and its error report, if it failed."""
+    script = params.get("SCRIPT_FILENAME", "")
+    output = io.BytesIO()
+    stdout = io.TextIOWrapper(output, encoding="utf-8", errors="surrogateescape", write_through=True)
+    saved = (os.environ.copy(), sys.stdin, sys.stdout, sys.argv, os.getcwd())
+    errors = b""
+    try:
+        os.environ.clear()
+        os.environ.update(params)
+        sys.stdin = io.TextIOWrapper(io.BytesIO(body), encoding="utf-8", errors="surrogateescape")
+        sys.stdout = stdout
+        sys.argv = [script]
+        os.chdir(os.path.dirname(script) or ".")
+        exec(compiled(script), {"__name__": "__main__", "__file__": script})
+    except SystemExit as exit_status:
+        if exit_status.code not in (None, 0):
+            errors = ("%s exited with %s\n" % (script, exit_status.code)).encode()
+    except BaseException:
+        errors = traceback.format_exc().encode("utf-8", "replace")
+    finally:
+        stdout.flush()
+        stdout.detach()   # closing the wrapper would close output
+        environ, sys.stdin, sys.stdout, sys.argv, cwd = saved
+        os.environ.clear()
+        os.environ.update(environ)
+        os.chdir(cwd)
+    result = output.getvalue()
+    if errors and not result:
+        result = b"Status: 500 Internal Server Error\r\nContent-Type: text/plain\r\n\r\nScript failed\n"
+    return result, errors
+
+
+def serve():
+    while True:
+        params = {}
+        param_data = b""
+        body = []
+        request_id = None
+        aborted = False
+        while True:
+            record = read_record()
+            if record is None:
+                return
+            kind, rid, content = record
+            if kind == FCGI_BEGIN_REQUEST:
+                request_id = rid
+            elif rid != request_id:
+                continue
+            elif kind == FCGI_ABORT_REQUEST:
+                aborted = True
+                break
+            elif kind == FCGI_PARAMS and content:
+                param_data += content
+            elif kind == FCGI_PARAMS:
+                params = parse_pairs(param_data)
+            elif kind == FCGI_STDIN and content:
+                body.append(content)
+            elif kind == FCGI_STDIN:
+                break
+        output, errors = (b"", b"") if aborted else run(params, b"".join(body))
+        reply = []
+        if output:
+            reply.append(frame(FCGI_STDOUT, request_id, output))
+        reply.append(frame(FCGI_STDOUT, request_id, b""))
+        if errors:
+            reply.append(frame(FCGI_STDERR, request_id, errors))
+        reply.append(frame(FCGI_END_REQUEST, request_id, struct.pack("!IB3x", 0, 0)))
+        write_all(b"".join(reply))
+
+
+if __name__ == "__main__":
+    try:
+        serve()
+    except (BrokenPipeError, ConnectionResetError, KeyboardInterrupt):
+        pass
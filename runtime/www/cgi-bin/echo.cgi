@@ -0,0 +1,10 @@
+#!/bin/sh
+# Echoes the CGI environment and the request body back
+printf 'Content-Type: text/plain\r\n\r\n'
+echo "method: $REQUEST_METHOD"
+echo "script: $SCRIPT_NAME"
+echo "path_info: $PATH_INFO"
+echo "query: $QUERY_STRING"
+echo "length: $CONTENT_LENGTH"
+echo "body:"
+cat
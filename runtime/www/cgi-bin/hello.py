@@ -0,0 +1,11 @@
+#!/usr/bin/env python3
+# Greets the caller; served forked from /cgi-bin and by a warm worker from /pool
+import os
+import sys
+
+body = sys.stdin.read()
+sys.stdout.write("Content-Type: text/plain\r\n\r\n")
+sys.stdout.write("hello from pid %d\n" % os.getpid())
+sys.stdout.write("query: %s\n" % os.environ.get("QUERY_STRING", ""))
+if body:
+    sys.stdout.write("body: %d bytes\n" % len(body))
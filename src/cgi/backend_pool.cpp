@@ -0,0 +1,39 @@
+#include "backend_pool.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <netdb.h>
+#include <sys/un.h>
+
+bool BackendPool::parseAddress(const std::string& address, struct sockaddr_storage& out, socklen_t& length) {
+
+	std::memset(&out, 0, sizeof(out));
+	if (address.compare(0, 5, "unix:") == 0) {
+		std::string path = address.substr(5);
+		struct sockaddr_un* unixAddress = reinterpret_cast<struct sockaddr_un*>(&out);
+		if (path.empty() || path.size() >= sizeof(unixAddress->sun_path))
+			return false;
+		unixAddress->sun_family = AF_UNIX;
+		std::memcpy(unixAddress->sun_path, path.c_str(), path.size() + 1);
+		length = sizeof(struct sockaddr_un);
+		return true;
+	}
+	size_t colon = address.rfind(':');
+	if (colon == std::string::npos || colon == 0 || colon + 1 == address.size())
+		return false;
+	std::string port = address.substr(colon + 1);
+	if (port.find_first_not_of("0123456789") != std::string::npos || std::atoi(port.c_str()) > 65535)
+		return false;
+
+	// Resolved once, like the listen addresses: never on the request path
+	struct addrinfo hints;
+	struct addrinfo* result = NULL;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(address.substr(0, colon).c_str(), port.c_str(), &hints, &result) != 0 || !result)
+		return false;
+	std::memcpy(&out, result->ai_addr, result->ai_addrlen);
+	length = result->ai_addrlen;
+	freeaddrinfo(result);
+	return true;
+}
@@ -0,0 +1,38 @@
+#ifndef BACKEND_POOL_HPP
+#define BACKEND_POOL_HPP
+
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+
+/*
+	Connections (or worker processes) shared by the backends of many
+	clients: a FastCGI application server, a cgi_pool, a proxy upstream
+	group. The Server polls its sockets next to the clients' and, after
+	each event, asks which clients have output waiting.
+*/
+class BackendPool {
+
+	public:
+		BackendPool() {}
+		virtual ~BackendPool() {}
+
+		virtual bool	owns(int fd) const = 0;
+		virtual bool	busy() const = 0;               // requests running or waiting
+		virtual bool	needsMaintenance() const = 0;   // maintain() has something to do, sooner or later
+		virtual void	addPollFds(std::vector<struct pollfd>& fds) const = 0;
+		virtual void	handleEvent(int fd, short revents) = 0;
+		// Client fds of the requests that got output or ended since the last call
+		virtual void	takeUpdated(std::vector<int>& owners) = 0;
+		virtual void	maintain() = 0;   // timeouts, idle connections, pool sizes
+
+		// "unix:/path" or "host:port", resolved once at startup
+		static bool	parseAddress(const std::string& address, struct sockaddr_storage& out, socklen_t& length);
+
+	private:
+		BackendPool(const BackendPool&);
+		BackendPool& operator=(const BackendPool&);
+};
+
+#endif
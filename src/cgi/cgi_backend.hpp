@@ -0,0 +1,66 @@
+#ifndef CGI_BACKEND_HPP
+#define CGI_BACKEND_HPP
+
+#include <string>
+#include <sys/types.h>
+
+// spliceOutput() results besides a byte count (> 0) and the end of the output (0)
+#define CGI_SPLICE_WAIT_OUTPUT	-1        // nothing to move until the backend writes more
+#define CGI_SPLICE_CLIENT_FULL	-2        // the client socket takes nothing more for now
+#define CGI_SPLICE_FAILED		-3        // errno tells; EINVAL: splice() does not work on these fds
+#define CGI_SPLICE_MAX			1048576   // bytes asked for per splice() call
+
+/*
+	What produces a CGI response for one client: a forked script
+	(CgiProcess), a request on a FastCGI connection (FastCgiRequest) or
+	one proxied to an HTTP upstream (ProxyRequest).
+	The Server feeds it the request body and relays its output the same
+	way for both; only backends with pipes of their own report them.
+
+	Once the head is relayed, a body that goes to the client unchanged
+	can skip user space: after startSplice() the Server moves it with
+	spliceOutput() from a kernel pipe straight into the client socket.
+*/
+class CgiBackend {
+
+	public:
+		CgiBackend() : headerBuffer(), headersSent(false), chunked(false), bodyLeft(-1), splicing(false),
+			spliceBlocked(false) {}
+		virtual ~CgiBackend() {}
+
+		virtual int		inputFd() const { return -1; }    // own pipes, polled by the Server
+		virtual int		outputFd() const { return -1; }
+
+		virtual void	queueInput(const char* data, size_t length) = 0;
+		virtual size_t	inputPending() const = 0;
+		virtual void	endInput() = 0;       // body complete
+		virtual void	writeInput() = 0;     // push queued input on
+		virtual ssize_t	readOutput(char* buffer, size_t size) = 0;   // > 0 data, 0 at the end, < 0 nothing yet
+		virtual bool	outputClosed() const = 0;   // no more output will come
+		virtual bool	failed() const { return false; }   // ended without a complete response
+		virtual bool	expired(unsigned long nowMs) const = 0;
+		virtual void	terminate() = 0;
+		virtual std::string	describe() const = 0;   // for the logs
+
+		// Zero-copy body relay (Linux splice()); false when this backend can't do it now
+		virtual bool	startSplice() { return false; }
+		virtual ssize_t	spliceOutput(int socketFd, size_t size) {   // > 0 moved, 0 at the end, CGI_SPLICE_* else
+			(void)socketFd;
+			(void)size;
+			return CGI_SPLICE_FAILED;
+		}
+
+		// Response being relayed, kept by the Server
+		std::string	headerBuffer;    // output until the header block is complete
+		bool		headersSent;
+		bool		chunked;         // body framed with Transfer-Encoding: chunked
+		long		bodyLeft;        // script's Content-Length still to come, -1 = none
+		bool		splicing;        // the body goes through spliceOutput()
+		bool		spliceBlocked;   // the last splice found the client socket full
+
+	private:
+		CgiBackend(const CgiBackend&);
+		CgiBackend& operator=(const CgiBackend&);
+};
+
+#endif
@@ -0,0 +1,333 @@
+#include "cgi_process.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
+
+std::vector<pid_t> CgiProcess::_orphans;
+
+size_t CgiHeaders::bodyStart(const std::string& data) {
+
+	size_t crlf = data.find("\r\n\r\n");
+	size_t lf = data.find("\n\n");
+	if (crlf != std::string::npos && (lf == std::string::npos || crlf < lf))
+		return crlf + 4;
+	if (lf != std::string::npos)
+		return lf + 2;
+	return std::string::npos;
+}
+
+bool CgiHeaders::parse(const std::string& block, CgiHeaders& out) {
+
+	bool statusSet = false;
+	bool location = false;
+	size_t pos = 0;
+	while (pos < block.size()) {
+		size_t end = block.find('\n', pos);
+		if (end == std::string::npos)
+			end = block.size();
+		std::string line = block.substr(pos, end - pos);
+		pos = end + 1;
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		if (line.empty())
+			break;
+
+		size_t colon = line.find(':');
+		if (colon == std::string::npos || colon == 0)
+			return false;
+		std::string name = line.substr(0, colon);
+		size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+		std::string value = valueStart == std::string::npos ? "" : line.substr(valueStart);
+		std::string lower = name;
+		std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+
+		if (lower == "status") {
+			char* rest = NULL;
+			long code = std::strtol(value.c_str(), &rest, 10);
+			if (rest == value.c_str() || code < 100 || code > 599)
+				return false;
+			out.status = static_cast<int>(code);
+			statusSet = true;
+		}
+		else if (lower == "content-length") {
+			char* rest = NULL;
+			long length = std::strtol(value.c_str(), &rest, 10);
+			if (rest == value.c_str() || *rest != '\0' || length < 0)
+				return false;
+			out.contentLength = length;
+		}
+		// Hop-by-hop: framing and persistence are decided by the server
+		else if (lower != "connection" && lower != "transfer-encoding" && lower != "keep-alive") {
+			if (lower == "location")
+				location = true;
+			out.headers.push_back(std::make_pair(name, value));
+		}
+	}
+	if (location && !statusSet)
+		out.status = 302;
+	return true;
+}
+
+CgiProcess::CgiProcess(unsigned long deadlineMs)
+	: CgiBackend(), _pid(-1), _in(-1), _out(-1),
+	_input(), _inputSent(0), _inputEnded(false), _deadline(deadlineMs), _outputDone(false) {}
+
+CgiProcess::~CgiProcess() {
+
+	closeInput();
+	if (_out >= 0)
+		close(_out);
+	if (_pid <= 0)
+		return;
+	if (waitpid(_pid, NULL, WNOHANG) != 0)
+		return;
+	// Cut off (client gone, timeout): stop it. A script that finished its
+	// output may still be exiting and is only reaped.
+	orphan(_pid, !_outputDone);
+}
+
+static void setNonBlocking(int fd) {
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+// Everything but stdio: listening sockets, clients, other scripts' pipes
+static void closeInheritedFds() {
+
+#if defined(__linux__) && defined(SYS_close_range)
+	if (syscall(SYS_close_range, 3U, ~0U, 0U) == 0)
+		return;
+#endif
+	long max = sysconf(_SC_OPEN_MAX);
+	if (max < 0 || max > 65536)
+		max = 65536;
+	for (int fd = 3; fd < max; fd++)
+		close(fd);
+}
+
+// Child side of fork(): stdio in place, nothing else inherited, its own process group
+static void execChild(const std::string& program, std::vector<char*>& argv, std::vector<char*>& envp,
+	int in, int out, const std::string& workDir) {
+
+	signal(SIGPIPE, SIG_DFL);
+	setpgid(0, 0);   // its own group, so a kill reaches what it spawned too
+	if (dup2(in, STDIN_FILENO) < 0 || dup2(out, STDOUT_FILENO) < 0)
+		_exit(127);
+	closeInheritedFds();
+	if (!workDir.empty() && chdir(workDir.c_str()) != 0)
+		_exit(127);
+	execve(program.c_str(), &argv[0], &envp[0]);
+	_exit(127);
+}
+
+static std::vector<char*> cStrings(const std::vector<std::string>& strings) {
+
+	std::vector<char*> out;
+	for (size_t i = 0; i < strings.size(); i++)
+		out.push_back(const_cast<char*>(strings[i].c_str()));
+	out.push_back(NULL);
+	return out;
+}
+
+bool CgiProcess::start(const std::string& program, const std::vector<std::string>& args,
+	const std::vector<std::string>& environment, const std::string& workDir) {
+
+	int inPipe[2];
+	int outPipe[2];
+	if (pipe(inPipe) != 0)
+		return false;
+	if (pipe(outPipe) != 0) {
+		close(inPipe[0]);
+		close(inPipe[1]);
+		return false;
+	}
+
+	// Built before fork(): the child may only make async-signal-safe calls
+	std::vector<char*> argv = cStrings(args);
+	std::vector<char*> envp = cStrings(environment);
+
+	_pid = fork();
+	if (_pid < 0) {
+		close(inPipe[0]);
+		close(inPipe[1]);
+		close(outPipe[0]);
+		close(outPipe[1]);
+		return false;
+	}
+	if (_pid == 0)
+		execChild(program, argv, envp, inPipe[0], outPipe[1], workDir);
+
+	setpgid(_pid, _pid);   // either side may run first
+	close(inPipe[0]);
+	close(outPipe[1]);
+	_in = inPipe[1];
+	_out = outPipe[0];
+	setNonBlocking(_in);
+	setNonBlocking(_out);
+	return true;
+}
+
+int CgiProcess::inputFd() const { return _in; }
+
+int CgiProcess::outputFd() const { return _out; }
+
+pid_t CgiProcess::pid() const { return _pid; }
+
+void CgiProcess::queueInput(const char* data, size_t length) {
+
+	if (_in < 0)
+		return;
+	if (_inputSent == _input.size()) {
+		_input.clear();
+		_inputSent = 0;
+	}
+	_input.append(data, length);
+}
+
+size_t CgiProcess::inputPending() const { return _input.size() - _inputSent; }
+
+void CgiProcess::endInput() {
+
+	_inputEnded = true;
+	if (inputPending() == 0)
+		closeInput();
+}
+
+void CgiProcess::writeInput() {
+
+	if (_in < 0)
+		return;
+	if (inputPending() > 0) {
+		ssize_t written = write(_in, _input.data() + _inputSent, inputPending());
+		if (written < 0 && errno != EAGAIN && errno != EINTR) {
+			// EPIPE: the script is done reading, the rest of the body is dropped
+			closeInput();
+			return;
+		}
+		if (written > 0)
+			_inputSent += written;
+	}
+	if (inputPending() == 0) {
+		_input.clear();
+		_inputSent = 0;
+		if (_inputEnded)
+			closeInput();
+	}
+}
+
+void CgiProcess::closeInput() {
+
+	if (_in >= 0)
+		close(_in);
+	_in = -1;
+	_input.clear();
+	_inputSent = 0;
+}
+
+ssize_t CgiProcess::readOutput(char* buffer, size_t size) {
+
+	if (_out < 0)
+		return 0;
+	ssize_t bytes = read(_out, buffer, size);
+	if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EINTR)) {
+		_outputDone = (bytes == 0);
+		close(_out);
+		_out = -1;
+	}
+	return bytes;
+}
+
+bool CgiProcess::outputClosed() const { return _out < 0; }
+
+#ifdef __linux__
+// stdout is a pipe already: its bytes can go to the socket as they are
+bool CgiProcess::startSplice() { return _out >= 0; }
+
+ssize_t CgiProcess::spliceOutput(int socketFd, size_t size) {
+
+	if (_out < 0)
+		return 0;
+	ssize_t moved = splice(_out, NULL, socketFd, NULL, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (moved > 0)
+		return moved;
+	if (moved == 0) {
+		_outputDone = true;
+		close(_out);
+		_out = -1;
+		return 0;
+	}
+	if (errno != EAGAIN && errno != EINTR)
+		return CGI_SPLICE_FAILED;
+	// Either end can be the one holding it up: bytes left in the pipe mean the socket is full
+	int waiting = 0;
+	if (ioctl(_out, FIONREAD, &waiting) == 0 && waiting > 0)
+		return CGI_SPLICE_CLIENT_FULL;
+	return CGI_SPLICE_WAIT_OUTPUT;
+}
+#else
+// No splice() here: the output is relayed with read() and send()
+bool CgiProcess::startSplice() { return false; }
+
+ssize_t CgiProcess::spliceOutput(int, size_t) { return CGI_SPLICE_FAILED; }
+#endif
+
+bool CgiProcess::expired(unsigned long nowMs) const { return nowMs > _deadline; }
+
+void CgiProcess::terminate() {
+
+	if (_pid > 0)
+		kill(-_pid, SIGKILL);
+	_outputDone = false;
+}
+
+std::string CgiProcess::describe() const {
+
+	std::ostringstream oss;
+	oss << "CGI pid " << _pid;
+	return oss.str();
+}
+
+pid_t CgiProcess::spawn(const std::vector<std::string>& args, const std::vector<std::string>& environment, int stdinFd) {
+
+	std::vector<char*> argv = cStrings(args);
+	std::vector<char*> envp = cStrings(environment);
+	pid_t pid = fork();
+	if (pid == 0)
+		execChild(args[0], argv, envp, stdinFd, STDOUT_FILENO, "");
+	if (pid > 0)
+		setpgid(pid, pid);
+	return pid;
+}
+
+void CgiProcess::orphan(pid_t pid, bool stop) {
+
+	if (pid <= 0)
+		return;
+	if (stop)
+		kill(-pid, SIGKILL);
+	_orphans.push_back(pid);
+}
+
+void CgiProcess::reapOrphans() {
+
+	for (size_t i = 0; i < _orphans.size();) {
+		pid_t result = waitpid(_orphans[i], NULL, WNOHANG);
+		if (result == 0) {
+			i++;
+			continue;
+		}
+		_orphans[i] = _orphans.back();
+		_orphans.pop_back();
+	}
+}
@@ -0,0 +1,82 @@
+#ifndef CGI_PROCESS_HPP
+#define CGI_PROCESS_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <sys/types.h>
+#include "cgi_backend.hpp"
+
+#define CGI_BUFFER_MAX		65536   // request body / script output held per direction before polling stops
+#define CGI_HEADERS_MAX		8192    // script header block, 502 beyond it
+#define CGI_CHECK_MS		1000    // poll() wake-up while scripts run, for their timeouts
+#define CGI_ENV_PATH		"PATH=/usr/local/bin:/usr/bin:/bin"   // lets scripts and workers use #!/usr/bin/env
+
+// Header block of a CGI response (RFC 3875 section 6)
+struct CgiHeaders {
+
+	CgiHeaders() : status(200), contentLength(-1), headers() {}
+
+	int		status;          // "Status:", 302 for a bare "Location:", else 200
+	long	contentLength;   // -1 when the script did not send one
+	std::vector<std::pair<std::string, std::string> >	headers;   // passed on to the client
+
+	// Offset of the first body byte once the blank line has arrived, npos before
+	static size_t	bodyStart(const std::string& data);
+	static bool		parse(const std::string& block, CgiHeaders& out);   // false when malformed
+};
+
+/*
+	Script started with fork/execve whose stdin and stdout are non-blocking
+	pipes polled next to the client sockets. The request body is queued and
+	written as the pipe accepts it; output is read as it comes. Nothing here
+	ever blocks: a script still alive when its CgiProcess goes away is killed
+	and reaped later by reapOrphans().
+*/
+class CgiProcess : public CgiBackend {
+
+	public:
+		explicit CgiProcess(unsigned long deadlineMs);
+		virtual ~CgiProcess();
+
+		bool	start(const std::string& program, const std::vector<std::string>& args,
+					const std::vector<std::string>& environment, const std::string& workDir);
+
+		virtual int		inputFd() const;    // -1 once closed
+		virtual int		outputFd() const;   // -1 once closed
+		pid_t			pid() const;
+
+		virtual void	queueInput(const char* data, size_t length);
+		virtual size_t	inputPending() const;
+		virtual void	endInput();        // stdin closes once drained
+		virtual void	writeInput();      // stdin writable; a script that stopped reading loses the rest
+		virtual ssize_t	readOutput(char* buffer, size_t size);   // read() on stdout, closed at EOF or error
+		virtual bool	outputClosed() const;
+		virtual bool	expired(unsigned long nowMs) const;
+		virtual void	terminate();
+		virtual std::string	describe() const;
+		virtual bool	startSplice();
+		virtual ssize_t	spliceOutput(int socketFd, size_t size);   // splice() from stdout, closed at EOF
+
+		// Long-lived child (a pooled worker) with stdinFd as its stdin; -1 on failure
+		static pid_t	spawn(const std::vector<std::string>& args, const std::vector<std::string>& environment,
+							int stdinFd);
+		static void		orphan(pid_t pid, bool stop);   // reaped by reapOrphans(), killed first if stop
+		static void		reapOrphans();
+
+	private:
+		void	closeInput();
+
+		pid_t			_pid;
+		int				_in;         // write end of the script's stdin
+		int				_out;        // read end of the script's stdout
+		std::string		_input;
+		size_t			_inputSent;
+		bool			_inputEnded;
+		unsigned long	_deadline;   // Clock::monotonicMs()
+		bool			_outputDone; // stdout reached EOF: the script is left to exit on its own
+
+		static std::vector<pid_t>	_orphans;   // killed, not reaped yet
+};
+
+#endif
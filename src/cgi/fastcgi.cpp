@@ -0,0 +1,137 @@
+#include "fastcgi.hpp"
+#include <algorithm>
+
+void FastCgi::appendRecord(std::string& out, unsigned char type, unsigned short requestId,
+	const char* data, size_t length) {
+
+	size_t padding = (8 - length % 8) % 8;
+	char header[FCGI_HEADER_LEN];
+	header[0] = FCGI_VERSION_1;
+	header[1] = static_cast<char>(type);
+	header[2] = static_cast<char>((requestId >> 8) & 0xff);
+	header[3] = static_cast<char>(requestId & 0xff);
+	header[4] = static_cast<char>((length >> 8) & 0xff);
+	header[5] = static_cast<char>(length & 0xff);
+	header[6] = static_cast<char>(padding);
+	header[7] = 0;
+	out.append(header, sizeof(header));
+	out.append(data, length);
+	out.append(padding, '\0');
+}
+
+void FastCgi::appendBeginRequest(std::string& out, unsigned short requestId, bool keepConnection) {
+
+	char body[8] = {0, FCGI_RESPONDER, 0, 0, 0, 0, 0, 0};
+	body[2] = keepConnection ? FCGI_KEEP_CONN : 0;
+	appendRecord(out, FCGI_BEGIN_REQUEST, requestId, body, sizeof(body));
+}
+
+// Lengths below 128 take one byte, the rest four with the top bit set
+void FastCgi::appendLength(std::string& out, size_t length) {
+
+	if (length < 128) {
+		out += static_cast<char>(length);
+		return;
+	}
+	out += static_cast<char>(((length >> 24) & 0x7f) | 0x80);
+	out += static_cast<char>((length >> 16) & 0xff);
+	out += static_cast<char>((length >> 8) & 0xff);
+	out += static_cast<char>(length & 0xff);
+}
+
+void FastCgi::appendParams(std::string& out, unsigned short requestId, const std::vector<std::string>& params) {
+
+	std::string pairs;
+	for (size_t i = 0; i < params.size(); i++) {
+		size_t equals = params[i].find('=');
+		if (equals == std::string::npos)
+			continue;
+		appendLength(pairs, equals);
+		appendLength(pairs, params[i].size() - equals - 1);
+		pairs.append(params[i], 0, equals);
+		pairs.append(params[i], equals + 1, std::string::npos);
+	}
+	// A pair may straddle two records: the stream is what counts
+	for (size_t offset = 0; offset < pairs.size(); offset += FCGI_MAX_CONTENT)
+		appendRecord(out, FCGI_PARAMS, requestId, pairs.data() + offset,
+			std::min(pairs.size() - offset, static_cast<size_t>(FCGI_MAX_CONTENT)));
+	appendRecord(out, FCGI_PARAMS, requestId, "", 0);
+}
+
+void FastCgi::appendStdin(std::string& out, unsigned short requestId, const char* data, size_t length) {
+
+	if (length == 0) {
+		appendRecord(out, FCGI_STDIN, requestId, "", 0);
+		return;
+	}
+	for (size_t offset = 0; offset < length; offset += FCGI_MAX_CONTENT)
+		appendRecord(out, FCGI_STDIN, requestId, data + offset,
+			std::min(length - offset, static_cast<size_t>(FCGI_MAX_CONTENT)));
+}
+
+void FastCgi::appendAbort(std::string& out, unsigned short requestId) {
+
+	appendRecord(out, FCGI_ABORT_REQUEST, requestId, "", 0);
+}
+
+int FastCgi::nextRecord(std::string& buffer, FastCgiRecord& record) {
+
+	if (buffer.size() < FCGI_HEADER_LEN)
+		return 0;
+	const unsigned char* header = reinterpret_cast<const unsigned char*>(buffer.data());
+	if (header[0] != FCGI_VERSION_1)
+		return -1;
+	size_t length = (static_cast<size_t>(header[4]) << 8) | header[5];
+	size_t total = FCGI_HEADER_LEN + length + header[6];
+	if (buffer.size() < total)
+		return 0;
+	record.type = header[1];
+	record.requestId = static_cast<unsigned short>((header[2] << 8) | header[3]);
+	record.content.assign(buffer, FCGI_HEADER_LEN, length);
+	buffer.erase(0, total);
+	return 1;
+}
+
+bool FastCgi::parseEndRequest(const std::string& content, unsigned char& protocolStatus) {
+
+	if (content.size() < 8)
+		return false;
+	protocolStatus = static_cast<unsigned char>(content[4]);
+	return true;
+}
+
+static bool readLength(const std::string& content, size_t& pos, size_t& length) {
+
+	if (pos >= content.size())
+		return false;
+	unsigned char first = static_cast<unsigned char>(content[pos]);
+	if (!(first & 0x80)) {
+		length = first;
+		pos++;
+		return true;
+	}
+	if (pos + 4 > content.size())
+		return false;
+	length = (static_cast<size_t>(first & 0x7f) << 24)
+		| (static_cast<size_t>(static_cast<unsigned char>(content[pos + 1])) << 16)
+		| (static_cast<size_t>(static_cast<unsigned char>(content[pos + 2])) << 8)
+		| static_cast<unsigned char>(content[pos + 3]);
+	pos += 4;
+	return true;
+}
+
+bool FastCgi::parsePairs(const std::string& content, std::map<std::string, std::string>& out) {
+
+	size_t pos = 0;
+	while (pos < content.size()) {
+		size_t nameLength;
+		size_t valueLength;
+		if (!readLength(content, pos, nameLength) || !readLength(content, pos, valueLength))
+			return false;
+		if (nameLength > content.size() - pos || valueLength > content.size() - pos - nameLength)
+			return false;
+		out[content.substr(pos, nameLength)] = content.substr(pos + nameLength, valueLength);
+		pos += nameLength + valueLength;
+	}
+	return true;
+}
@@ -0,0 +1,64 @@
+#ifndef FASTCGI_HPP
+#define FASTCGI_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+// FastCGI 1.0 record types and values (fastcgi.com specification)
+#define FCGI_VERSION_1				1
+#define FCGI_HEADER_LEN				8
+#define FCGI_MAX_CONTENT			65535
+
+#define FCGI_BEGIN_REQUEST			1
+#define FCGI_ABORT_REQUEST			2
+#define FCGI_END_REQUEST			3
+#define FCGI_PARAMS					4
+#define FCGI_STDIN					5
+#define FCGI_STDOUT					6
+#define FCGI_STDERR					7
+
+#define FCGI_RESPONDER				1
+#define FCGI_KEEP_CONN				1
+
+#define FCGI_REQUEST_COMPLETE		0
+#define FCGI_CANT_MPX_CONN			1
+#define FCGI_OVERLOADED				2
+
+struct FastCgiRecord {
+
+	FastCgiRecord() : type(0), requestId(0), content() {}
+
+	unsigned char	type;
+	unsigned short	requestId;
+	std::string		content;
+};
+
+/*
+	Record framing. Encoders append complete records to a connection's
+	output buffer, splitting content over FCGI_MAX_CONTENT and padding every
+	record to 8 bytes; the decoder takes records off the front of what has
+	been read so far.
+*/
+class FastCgi {
+
+	public:
+		static void	appendRecord(std::string& out, unsigned char type, unsigned short requestId,
+						const char* data, size_t length);
+		static void	appendBeginRequest(std::string& out, unsigned short requestId, bool keepConnection);
+		// "NAME=value" entries, as built for execve(), then the empty record ending the stream
+		static void	appendParams(std::string& out, unsigned short requestId, const std::vector<std::string>& params);
+		// Body bytes; length 0 ends the stream
+		static void	appendStdin(std::string& out, unsigned short requestId, const char* data, size_t length);
+		static void	appendAbort(std::string& out, unsigned short requestId);
+
+		// 1 = record taken off buffer's front, 0 = incomplete, -1 = not FastCGI
+		static int	nextRecord(std::string& buffer, FastCgiRecord& record);
+		static bool	parseEndRequest(const std::string& content, unsigned char& protocolStatus);
+		static bool	parsePairs(const std::string& content, std::map<std::string, std::string>& out);
+
+	private:
+		static void	appendLength(std::string& out, size_t length);
+};
+
+#endif
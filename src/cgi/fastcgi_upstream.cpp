@@ -0,0 +1,536 @@
+#include "fastcgi_upstream.hpp"
+#include "fastcgi.hpp"
+#include "cgi_process.hpp"
+#include "clock.hpp"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+FastCgiRequest::FastCgiRequest(FastCgiUpstream& upstream, const std::vector<std::string>& params,
+	int owner, unsigned long deadlineMs)
+	: CgiBackend(), _upstream(upstream), _connection(NULL), _id(0), _owner(owner), _params(params),
+	_begun(false), _input(), _inputEnded(false), _stdinClosed(false), _output(), _outputRead(0),
+	_ended(false), _failed(false), _deadline(deadlineMs) {
+
+	_upstream.enqueue(this);
+}
+
+FastCgiRequest::~FastCgiRequest() { _upstream.release(this); }
+
+int FastCgiRequest::owner() const { return _owner; }
+
+void FastCgiRequest::queueInput(const char* data, size_t length) {
+
+	if (!_ended)
+		_input.append(data, length);
+}
+
+size_t FastCgiRequest::inputPending() const { return _input.size(); }
+
+void FastCgiRequest::endInput() { _inputEnded = true; }
+
+void FastCgiRequest::writeInput() {
+
+	if (_connection)
+		_upstream.pump(*_connection);
+}
+
+size_t FastCgiRequest::outputHeld() const { return _output.size() - _outputRead; }
+
+ssize_t FastCgiRequest::readOutput(char* buffer, size_t size) {
+
+	size_t held = outputHeld();
+	if (held == 0) {
+		if (_ended)
+			return 0;
+		errno = EAGAIN;
+		return -1;
+	}
+	size_t length = std::min(held, size);
+	std::memcpy(buffer, _output.data() + _outputRead, length);
+	_outputRead += length;
+	if (_outputRead == _output.size()) {
+		_output.clear();
+		_outputRead = 0;
+	}
+	return static_cast<ssize_t>(length);
+}
+
+bool FastCgiRequest::outputClosed() const { return _ended && outputHeld() == 0; }
+
+bool FastCgiRequest::failed() const { return _failed; }
+
+bool FastCgiRequest::expired(unsigned long nowMs) const { return nowMs > _deadline; }
+
+// Nothing to kill: the abort goes out when the request is deleted
+void FastCgiRequest::terminate() {}
+
+std::string FastCgiRequest::describe() const {
+
+	std::ostringstream oss;
+	oss << "FastCGI " << _upstream.address() << " request " << _id;
+	return oss.str();
+}
+
+FastCgiUpstream::FastCgiUpstream(const std::string& address, size_t maxConnections, size_t multiplex)
+	: _address(address), _sockaddr(), _sockaddrLength(0), _command(), _minConnections(0),
+	_maxConnections(std::max<size_t>(maxConnections, 1)), _multiplex(std::max<size_t>(multiplex, 1)),
+	_maxRequests(0), _connections(), _waiting(), _updated(), _assigning(false), _respawnAfter(0) {
+
+	std::memset(&_sockaddr, 0, sizeof(_sockaddr));
+	if (!parseAddress(address, _sockaddr, _sockaddrLength)) {
+		_sockaddrLength = 0;
+		std::cout << "[ERROR] Cannot resolve fastcgi_pass address: " << address << std::endl;
+	}
+}
+
+FastCgiUpstream::FastCgiUpstream(const std::string& name, const std::vector<std::string>& command,
+	size_t minWorkers, size_t maxWorkers, size_t maxRequests)
+	: _address(name), _sockaddr(), _sockaddrLength(0), _command(command),
+	_minConnections(std::min(minWorkers, std::max<size_t>(maxWorkers, 1))), _maxConnections(std::max<size_t>(maxWorkers, 1)),
+	_multiplex(1), _maxRequests(maxRequests), _connections(), _waiting(), _updated(), _assigning(false), _respawnAfter(0) {
+
+	std::memset(&_sockaddr, 0, sizeof(_sockaddr));
+	maintain();
+}
+
+FastCgiUpstream::~FastCgiUpstream() {
+
+	while (!_connections.empty())
+		closeConnection(_connections.back());
+}
+
+const std::string& FastCgiUpstream::address() const { return _address; }
+
+bool FastCgiUpstream::owns(int fd) const {
+
+	for (size_t i = 0; i < _connections.size(); i++)
+		if (_connections[i]->fd == fd)
+			return true;
+	return false;
+}
+
+bool FastCgiUpstream::busy() const {
+
+	if (!_waiting.empty())
+		return true;
+	for (size_t i = 0; i < _connections.size(); i++)
+		if (!_connections[i]->requests.empty())
+			return true;
+	return false;
+}
+
+bool FastCgiUpstream::wantsWrite(const FastCgiConnection& connection) const {
+
+	if (connection.outSent < connection.out.size())
+		return true;
+	std::map<unsigned short, FastCgiRequest*>::const_iterator it = connection.requests.begin();
+	for (; it != connection.requests.end(); ++it) {
+		const FastCgiRequest* request = it->second;
+		if (request && (!request->_begun || !request->_input.empty() || (request->_inputEnded && !request->_stdinClosed)))
+			return true;
+	}
+	return false;
+}
+
+/*
+	Idle connections are read too, to notice the application server
+	closing them. A connection stops being read once every request on it
+	holds CGI_BUFFER_MAX bytes its client has not taken yet.
+*/
+void FastCgiUpstream::addPollFds(std::vector<struct pollfd>& fds) const {
+
+	for (size_t i = 0; i < _connections.size(); i++) {
+		const FastCgiConnection& connection = *_connections[i];
+		struct pollfd entry;
+		entry.fd = connection.fd;
+		entry.events = 0;
+		entry.revents = 0;
+		if (connection.connecting)
+			entry.events = POLLOUT;
+		else {
+			bool room = connection.requests.empty();
+			std::map<unsigned short, FastCgiRequest*>::const_iterator it = connection.requests.begin();
+			for (; it != connection.requests.end() && !room; ++it)
+				room = !it->second || it->second->outputHeld() < CGI_BUFFER_MAX;
+			if (room)
+				entry.events |= POLLIN;
+			if (wantsWrite(connection))
+				entry.events |= POLLOUT;
+		}
+		fds.push_back(entry);
+	}
+}
+
+void FastCgiUpstream::handleEvent(int fd, short revents) {
+
+	FastCgiConnection* connection = NULL;
+	for (size_t i = 0; i < _connections.size() && !connection; i++)
+		if (_connections[i]->fd == fd)
+			connection = _connections[i];
+	if (!connection)
+		return;
+
+	if (connection->connecting) {
+		int error = 0;
+		socklen_t length = sizeof(error);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+			std::cout << "[ERROR] FastCGI connect to " << _address << " failed: " << strerror(error) << std::endl;
+			closeConnection(connection);
+			assignWaiting();
+			return;
+		}
+		connection->connecting = false;
+		std::cout << "[DEBUG] FastCGI connected to " << _address << " (FD " << fd << ")" << std::endl;
+	}
+	if ((revents & (POLLIN | POLLHUP | POLLERR)) && !readFrom(*connection)) {
+		closeConnection(connection);
+		assignWaiting();
+		return;
+	}
+	if (connection->retiring && connection->requests.empty()) {
+		retire(connection);
+		maintain();
+	}
+	else
+		pump(*connection);
+	assignWaiting();
+}
+
+void FastCgiUpstream::takeUpdated(std::vector<int>& owners) {
+
+	for (size_t i = 0; i < _updated.size(); i++)
+		owners.push_back(_updated[i]->_owner);
+	_updated.clear();
+}
+
+void FastCgiUpstream::enqueue(FastCgiRequest* request) {
+
+	if (_command.empty() && _sockaddrLength == 0) {
+		finish(request, true);
+		return;
+	}
+	_waiting.push_back(request);
+	assignWaiting();
+}
+
+void FastCgiUpstream::release(FastCgiRequest* request) {
+
+	std::deque<FastCgiRequest*>::iterator waiting = std::find(_waiting.begin(), _waiting.end(), request);
+	if (waiting != _waiting.end())
+		_waiting.erase(waiting);
+	_updated.erase(std::remove(_updated.begin(), _updated.end(), request), _updated.end());
+
+	FastCgiConnection* connection = request->_connection;
+	if (!connection)
+		return;
+	std::map<unsigned short, FastCgiRequest*>::iterator it = connection->requests.find(request->_id);
+	if (!request->_begun) {
+		connection->requests.erase(it);
+		return;
+	}
+	if (_multiplex > 1) {
+		// The id stays taken until the server confirms with FCGI_END_REQUEST
+		it->second = NULL;
+		FastCgi::appendAbort(connection->out, request->_id);
+		pump(*connection);
+		return;
+	}
+	// One request per connection: records still coming for it would reach the next one
+	connection->requests.erase(it);
+	closeConnection(connection);
+	assignWaiting();
+}
+
+void FastCgiUpstream::assignWaiting() {
+
+	if (_assigning)
+		return;
+	_assigning = true;
+	while (!_waiting.empty() && assign(_waiting.front()))
+		_waiting.pop_front();
+	_assigning = false;
+}
+
+// A connection with a free slot, else a new one while under the limit; false = keep waiting
+bool FastCgiUpstream::assign(FastCgiRequest* request) {
+
+	FastCgiConnection* connection = NULL;
+	for (size_t i = 0; i < _connections.size() && !connection;) {
+		FastCgiConnection* candidate = _connections[i];
+		if (candidate->requests.size() >= _multiplex || candidate->retiring) {
+			i++;
+			continue;
+		}
+		if (candidate->requests.empty() && !candidate->connecting && !alive(*candidate)) {
+			closeConnection(candidate);
+			continue;
+		}
+		connection = candidate;
+	}
+	if (!connection) {
+		if (_connections.size() >= _maxConnections)
+			return false;
+		connection = openConnection();
+		if (!connection) {
+			finish(request, true);
+			return true;
+		}
+	}
+	unsigned short id;
+	do
+		id = ++connection->nextId;
+	while (id == 0 || connection->requests.count(id));
+	connection->requests[id] = request;
+	request->_id = id;
+	request->_connection = connection;
+	pump(*connection);
+	return true;
+}
+
+FastCgiConnection* FastCgiUpstream::openConnection() {
+
+	if (!_command.empty())
+		return spawnWorker();
+	int fd = socket(_sockaddr.ss_family, SOCK_STREAM, 0);
+	if (fd < 0)
+		return NULL;
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	if (_sockaddr.ss_family == AF_INET) {
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	}
+	int result = connect(fd, reinterpret_cast<struct sockaddr*>(&_sockaddr), _sockaddrLength);
+	if (result != 0 && errno != EINPROGRESS) {
+		std::cout << "[ERROR] FastCGI connect to " << _address << " failed: " << strerror(errno) << std::endl;
+		close(fd);
+		return NULL;
+	}
+	FastCgiConnection* connection = new FastCgiConnection();
+	connection->fd = fd;
+	connection->connecting = (result != 0);
+	connection->idleSince = Clock::monotonicMs();
+	_connections.push_back(connection);
+	std::cout << "[DEBUG] FastCGI connection to " << _address << " opened (FD " << fd << ", "
+			  << _connections.size() << "/" << _maxConnections << ")" << std::endl;
+	return connection;
+}
+
+// The worker gets its end of a socketpair as stdin and speaks FastCGI on it
+FastCgiConnection* FastCgiUpstream::spawnWorker() {
+
+	int sockets[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+		return NULL;
+	std::vector<std::string> environment(1, CGI_ENV_PATH);
+	pid_t pid = CgiProcess::spawn(_command, environment, sockets[1]);
+	close(sockets[1]);
+	if (pid < 0) {
+		std::cout << "[ERROR] Failed to start CGI worker " << _command[0] << ": " << strerror(errno) << std::endl;
+		close(sockets[0]);
+		return NULL;
+	}
+	fcntl(sockets[0], F_SETFL, fcntl(sockets[0], F_GETFL) | O_NONBLOCK);
+	fcntl(sockets[0], F_SETFD, FD_CLOEXEC);
+	FastCgiConnection* connection = new FastCgiConnection();
+	connection->fd = sockets[0];
+	connection->connecting = false;
+	connection->pid = pid;
+	connection->idleSince = Clock::monotonicMs();
+	_connections.push_back(connection);
+	std::cout << "[DEBUG] CGI worker pid " << pid << " started for " << _address << " (FD " << sockets[0] << ", "
+			  << _connections.size() << "/" << _maxConnections << ")" << std::endl;
+	return connection;
+}
+
+void FastCgiUpstream::maintain() {
+
+	unsigned long now = Clock::monotonicMs();
+	for (size_t i = 0; i < _connections.size();) {
+		FastCgiConnection* connection = _connections[i];
+		if (_connections.size() > _minConnections && connection->requests.empty() && !connection->connecting
+			&& now - connection->idleSince > FASTCGI_IDLE_MS) {
+			retire(connection);
+			continue;
+		}
+		i++;
+	}
+	// A worker that keeps dying before serving anything is not restarted in a loop
+	while (_connections.size() < _minConnections && now >= _respawnAfter && openConnection())
+		;
+}
+
+bool FastCgiUpstream::needsMaintenance() const { return _connections.size() != _minConnections; }
+
+// An idle keep-alive connection the server may have closed since it was polled
+bool FastCgiUpstream::alive(const FastCgiConnection& connection) const {
+
+	char byte;
+	ssize_t bytes = recv(connection.fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+	return bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+// Turns what the connection's requests have queued into records, bounded by FASTCGI_WRITE_MAX
+void FastCgiUpstream::frame(FastCgiConnection& connection) {
+
+	if (connection.outSent > FASTCGI_WRITE_MAX) {
+		connection.out.erase(0, connection.outSent);
+		connection.outSent = 0;
+	}
+	std::map<unsigned short, FastCgiRequest*>::iterator it = connection.requests.begin();
+	for (; it != connection.requests.end(); ++it) {
+		FastCgiRequest* request = it->second;
+		if (!request)
+			continue;
+		if (!request->_begun) {
+			FastCgi::appendBeginRequest(connection.out, it->first, true);
+			FastCgi::appendParams(connection.out, it->first, request->_params);
+			request->_params.clear();
+			request->_begun = true;
+		}
+		while (!request->_input.empty() && connection.out.size() - connection.outSent < FASTCGI_WRITE_MAX) {
+			size_t length = std::min(request->_input.size(), static_cast<size_t>(FCGI_MAX_CONTENT));
+			FastCgi::appendStdin(connection.out, it->first, request->_input.data(), length);
+			request->_input.erase(0, length);
+		}
+		if (request->_inputEnded && request->_input.empty() && !request->_stdinClosed) {
+			FastCgi::appendStdin(connection.out, it->first, "", 0);
+			request->_stdinClosed = true;
+		}
+	}
+}
+
+// Frames and writes until the socket is full or nothing is left; a write error closes the connection
+void FastCgiUpstream::pump(FastCgiConnection& connection) {
+
+	if (connection.connecting)
+		return;
+	for (;;) {
+		frame(connection);
+		if (connection.outSent == connection.out.size())
+			break;
+		ssize_t sent = send(connection.fd, connection.out.data() + connection.outSent,
+			connection.out.size() - connection.outSent, MSG_NOSIGNAL);
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			break;
+		if (sent <= 0) {
+			std::cout << "[ERROR] FastCGI write to " << _address << " failed: " << strerror(errno) << std::endl;
+			closeConnection(&connection);
+			return;
+		}
+		connection.outSent += sent;
+		if (connection.outSent == connection.out.size()) {
+			connection.out.clear();
+			connection.outSent = 0;
+		}
+	}
+}
+
+// false when the connection is done for: closed by the server or not speaking FastCGI
+bool FastCgiUpstream::readFrom(FastCgiConnection& connection) {
+
+	char buffer[32768];
+	ssize_t bytes = recv(connection.fd, buffer, sizeof(buffer), 0);
+	if (bytes < 0)
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	if (bytes == 0) {
+		std::cout << "[DEBUG] FastCGI connection FD " << connection.fd << " closed by " << _address << std::endl;
+		return false;
+	}
+	connection.in.append(buffer, bytes);
+	FastCgiRecord record;
+	int result;
+	while ((result = FastCgi::nextRecord(connection.in, record)) > 0)
+		if (!handleRecord(connection, record))
+			return false;
+	if (result < 0) {
+		std::cout << "[ERROR] Invalid FastCGI record from " << _address << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool FastCgiUpstream::handleRecord(FastCgiConnection& connection, const FastCgiRecord& record) {
+
+	std::map<unsigned short, FastCgiRequest*>::iterator it = connection.requests.find(record.requestId);
+	FastCgiRequest* request = (it == connection.requests.end()) ? NULL : it->second;
+	if (record.type == FCGI_STDOUT && request && !record.content.empty()) {
+		request->_output += record.content;
+		markUpdated(request);
+	}
+	else if (record.type == FCGI_STDERR && !record.content.empty())
+		std::cout << "[DEBUG] FastCGI stderr from " << _address << ": " << record.content << std::endl;
+	else if (record.type == FCGI_END_REQUEST && it != connection.requests.end()) {
+		unsigned char status;
+		if (!FastCgi::parseEndRequest(record.content, status))
+			return false;
+		connection.requests.erase(it);
+		connection.served++;
+		if (_maxRequests && connection.served >= _maxRequests)
+			connection.retiring = true;
+		if (connection.requests.empty())
+			connection.idleSince = Clock::monotonicMs();
+		if (status == FCGI_CANT_MPX_CONN && _multiplex > 1) {
+			std::cout << "[DEBUG] " << _address << " cannot multiplex, one request per connection" << std::endl;
+			_multiplex = 1;
+		}
+		if (request)
+			finish(request, status != FCGI_REQUEST_COMPLETE);
+	}
+	return true;
+}
+
+// Broken or cut off: its requests fail and a worker behind it is killed
+void FastCgiUpstream::closeConnection(FastCgiConnection* connection) {
+
+	std::map<unsigned short, FastCgiRequest*>::iterator it = connection->requests.begin();
+	for (; it != connection->requests.end(); ++it)
+		if (it->second)
+			finish(it->second, true);
+	connection->requests.clear();
+	if (connection->pid > 0) {
+		CgiProcess::orphan(connection->pid, true);
+		if (connection->served == 0)
+			_respawnAfter = Clock::monotonicMs() + CGI_CHECK_MS;
+		connection->pid = -1;
+	}
+	retire(connection);
+}
+
+// Idle and done with: a worker sees EOF on its stdin and exits on its own
+void FastCgiUpstream::retire(FastCgiConnection* connection) {
+
+	close(connection->fd);
+	if (connection->pid > 0) {
+		std::cout << "[DEBUG] CGI worker pid " << connection->pid << " retired after "
+				  << connection->served << " requests" << std::endl;
+		CgiProcess::orphan(connection->pid, false);
+	}
+	_connections.erase(std::find(_connections.begin(), _connections.end(), connection));
+	delete connection;
+}
+
+void FastCgiUpstream::finish(FastCgiRequest* request, bool failed) {
+
+	request->_ended = true;
+	request->_failed = failed;
+	request->_connection = NULL;
+	markUpdated(request);
+}
+
+void FastCgiUpstream::markUpdated(FastCgiRequest* request) {
+
+	if (std::find(_updated.begin(), _updated.end(), request) == _updated.end())
+		_updated.push_back(request);
+}
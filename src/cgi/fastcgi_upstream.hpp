@@ -0,0 +1,151 @@
+#ifndef FASTCGI_UPSTREAM_HPP
+#define FASTCGI_UPSTREAM_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include "cgi_backend.hpp"
+#include "backend_pool.hpp"
+
+#define FASTCGI_WRITE_MAX	65536   // framed bytes queued per connection before bodies wait
+#define FASTCGI_IDLE_MS		30000   // idle connections (workers) above the minimum are closed after it
+
+class FastCgiUpstream;
+struct FastCgiConnection;
+
+/*
+	One request on a FastCGI application server. Created by the Server in
+	place of a CgiProcess: it waits for a pooled connection, its body is
+	framed into FCGI_STDIN records as the connection takes it, and the
+	FCGI_STDOUT content collected by the upstream is read back through
+	readOutput(). Deleting it before FCGI_END_REQUEST aborts it.
+*/
+class FastCgiRequest : public CgiBackend {
+
+	public:
+		FastCgiRequest(FastCgiUpstream& upstream, const std::vector<std::string>& params,
+			int owner, unsigned long deadlineMs);
+		virtual ~FastCgiRequest();
+
+		int		owner() const;   // client fd
+
+		virtual void	queueInput(const char* data, size_t length);
+		virtual size_t	inputPending() const;
+		virtual void	endInput();
+		virtual void	writeInput();
+		virtual ssize_t	readOutput(char* buffer, size_t size);
+		virtual bool	outputClosed() const;
+		virtual bool	failed() const;
+		virtual bool	expired(unsigned long nowMs) const;
+		virtual void	terminate();
+		virtual std::string	describe() const;
+
+	private:
+		friend class FastCgiUpstream;
+
+		size_t	outputHeld() const;
+
+		FastCgiUpstream&			_upstream;
+		FastCgiConnection*			_connection;   // NULL while waiting for one and once ended
+		unsigned short				_id;
+		int							_owner;
+		std::vector<std::string>	_params;       // sent with FCGI_BEGIN_REQUEST
+		bool						_begun;
+		std::string					_input;        // body not framed yet
+		bool						_inputEnded;
+		bool						_stdinClosed;  // empty FCGI_STDIN sent
+		std::string					_output;       // FCGI_STDOUT content
+		size_t						_outputRead;
+		bool						_ended;        // FCGI_END_REQUEST received, or the connection lost
+		bool						_failed;
+		unsigned long				_deadline;     // Clock::monotonicMs()
+};
+
+struct FastCgiConnection {
+
+	FastCgiConnection() : fd(-1), connecting(true), out(), outSent(0), in(), requests(), nextId(0),
+		pid(-1), served(0), retiring(false), idleSince(0) {}
+
+	int				fd;
+	bool			connecting;
+	std::string		out;
+	size_t			outSent;
+	std::string		in;
+	std::map<unsigned short, FastCgiRequest*>	requests;   // NULL once aborted, until its FCGI_END_REQUEST
+	unsigned short	nextId;
+	pid_t			pid;         // pooled worker at the other end, -1 for fastcgi_pass
+	unsigned long	served;      // requests completed
+	bool			retiring;    // took its last request: closed once that is done
+	unsigned long	idleSince;   // Clock::monotonicMs()
+};
+
+/*
+	Pool of keep-alive connections to one fastcgi_pass address. At most
+	maxConnections are open; each carries up to multiplex requests at once
+	(1 for servers that cannot multiplex, like php-fpm). Requests beyond
+	that wait in FIFO order for a slot. Connections are polled by the event
+	loop next to the client sockets and never block.
+
+	Built from a worker command instead (cgi_pool), every connection is a
+	socketpair to a worker process spawned for it, which serves one
+	request at a time on its stdin. minWorkers are kept warm, idle ones
+	above that are let go, and a worker is replaced once it has served
+	maxRequests.
+*/
+class FastCgiUpstream : public BackendPool {
+
+	public:
+		FastCgiUpstream(const std::string& address, size_t maxConnections, size_t multiplex);
+		FastCgiUpstream(const std::string& name, const std::vector<std::string>& command,
+			size_t minWorkers, size_t maxWorkers, size_t maxRequests);
+		virtual ~FastCgiUpstream();
+
+		const std::string&	address() const;
+		virtual bool	owns(int fd) const;
+		virtual bool	busy() const;
+		virtual bool	needsMaintenance() const;
+		virtual void	addPollFds(std::vector<struct pollfd>& fds) const;
+		virtual void	handleEvent(int fd, short revents);
+		virtual void	takeUpdated(std::vector<int>& owners);
+		virtual void	maintain();   // workers up to the minimum, idle surplus closed
+
+	private:
+		FastCgiUpstream(const FastCgiUpstream&);
+		FastCgiUpstream& operator=(const FastCgiUpstream&);
+
+		friend class FastCgiRequest;
+
+		void	enqueue(FastCgiRequest* request);
+		void	release(FastCgiRequest* request);
+		void	assignWaiting();
+		bool	assign(FastCgiRequest* request);
+		FastCgiConnection*	openConnection();
+		FastCgiConnection*	spawnWorker();
+		bool	alive(const FastCgiConnection& connection) const;
+		bool	wantsWrite(const FastCgiConnection& connection) const;
+		void	frame(FastCgiConnection& connection);
+		void	pump(FastCgiConnection& connection);
+		bool	readFrom(FastCgiConnection& connection);
+		bool	handleRecord(FastCgiConnection& connection, const struct FastCgiRecord& record);
+		void	closeConnection(FastCgiConnection* connection);
+		void	retire(FastCgiConnection* connection);
+		void	finish(FastCgiRequest* request, bool failed);
+		void	markUpdated(FastCgiRequest* request);
+
+		std::string							_address;
+		struct sockaddr_storage				_sockaddr;
+		socklen_t							_sockaddrLength;   // 0 = address did not resolve
+		std::vector<std::string>			_command;          // pooled workers, empty for fastcgi_pass
+		size_t								_minConnections;
+		size_t								_maxConnections;
+		size_t								_multiplex;
+		size_t								_maxRequests;      // per connection, 0 = no limit
+		std::vector<FastCgiConnection*>		_connections;
+		std::deque<FastCgiRequest*>			_waiting;
+		std::vector<FastCgiRequest*>		_updated;
+		bool								_assigning;
+		unsigned long						_respawnAfter;     // Clock::monotonicMs()
+};
+
+#endif
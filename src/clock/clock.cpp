@@ -0,0 +1,40 @@
+#include "clock.hpp"
+#include <sys/time.h>
+
+bool			Clock::_initialized = false;
+unsigned long	Clock::_monotonicMs = 0;
+time_t			Clock::_now = 0;
+std::string		Clock::_httpDate;
+std::string		Clock::_logDate;
+
+void Clock::update() {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	_monotonicMs = static_cast<unsigned long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+
+	time_t wall = time(NULL);
+	if (_initialized && wall == _now)
+		return;
+	_now = wall;
+	_initialized = true;
+
+	struct tm tmBuf;
+	char buffer[64];
+	strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&wall, &tmBuf));
+	_httpDate = buffer;
+	strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", localtime_r(&wall, &tmBuf));
+	_logDate = buffer;
+}
+
+// Values are valid even before the event loop starts (config parsing, tests)
+void Clock::ensureInitialized() {
+
+	if (!_initialized)
+		update();
+}
+
+unsigned long Clock::monotonicMs() { ensureInitialized(); return _monotonicMs; }
+time_t Clock::now() { ensureInitialized(); return _now; }
+const std::string& Clock::httpDate() { ensureInitialized(); return _httpDate; }
+const std::string& Clock::logDate() { ensureInitialized(); return _logDate; }
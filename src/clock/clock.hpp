@@ -0,0 +1,35 @@
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+
+#include <string>
+#include <ctime>
+
+/*
+	Process-wide cached clock. The event loop calls update() once per
+	iteration; everything on the hot path reads the cached values instead
+	of calling time()/gmtime()/strftime() per request or per log line.
+	The formatted strings are only rebuilt when the wall-clock second changes.
+*/
+class Clock {
+
+	public:
+		static void					update();
+
+		static unsigned long		monotonicMs();     // CLOCK_MONOTONIC in milliseconds
+		static time_t				now();             // wall clock, seconds
+		static const std::string&	httpDate();        // "Sun, 06 Nov 1994 08:49:37 GMT"
+		static const std::string&	logDate();         // "1994-11-06 09:49:37" (local time)
+
+	private:
+		Clock();
+
+		static void			ensureInitialized();
+
+		static bool			_initialized;
+		static unsigned long	_monotonicMs;
+		static time_t		_now;
+		static std::string	_httpDate;
+		static std::string	_logDate;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "compression.hpp"
+#include <zlib.h>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+// Parses "gzip;q=0.8" style elements; missing q means 1.0
+static void parseCoding(const std::string& element, std::string& coding, double& quality) {
+
+	size_t semicolon = element.find(';');
+	coding = element.substr(0, semicolon);
+	size_t start = coding.find_first_not_of(" \t");
+	size_t end = coding.find_last_not_of(" \t");
+	coding = (start == std::string::npos) ? "" : coding.substr(start, end - start + 1);
+	std::transform(coding.begin(), coding.end(), coding.begin(), ::tolower);
+
+	quality = 1.0;
+	if (semicolon == std::string::npos)
+		return;
+	size_t q = element.find("q=", semicolon);
+	if (q != std::string::npos)
+		quality = std::strtod(element.c_str() + q + 2, NULL);
+}
+
+// q-value the header gives to a coding: its own entry, else the "*" entry,
+// else -1 when the coding is not mentioned at all
+static double codingQuality(const std::string& acceptEncoding, const std::string& wanted) {
+
+	double explicitQ = -1;
+	double wildcardQ = -1;
+
+	size_t pos = 0;
+	while (pos < acceptEncoding.length()) {
+		size_t comma = acceptEncoding.find(',', pos);
+		if (comma == std::string::npos) comma = acceptEncoding.length();
+
+		std::string coding;
+		double quality;
+		parseCoding(acceptEncoding.substr(pos, comma - pos), coding, quality);
+		if (coding == wanted || (wanted == "gzip" && coding == "x-gzip")) explicitQ = quality;
+		else if (coding == "*") wildcardQ = quality;
+		pos = comma + 1;
+	}
+	return explicitQ >= 0 ? explicitQ : wildcardQ;
+}
+
+ContentEncoding negotiateEncoding(const std::string& acceptEncoding) {
+
+	double gzipQ = codingQuality(acceptEncoding, "gzip");
+	double deflateQ = codingQuality(acceptEncoding, "deflate");
+
+	if (gzipQ > 0 && gzipQ >= deflateQ) return ENCODING_GZIP;
+	if (deflateQ > 0) return ENCODING_DEFLATE;
+	return ENCODING_IDENTITY;
+}
+
+bool acceptsEncoding(const std::string& acceptEncoding, ContentEncoding encoding) {
+
+	if (encoding == ENCODING_IDENTITY)
+		return true;
+	return codingQuality(acceptEncoding, encodingName(encoding)) > 0;
+}
+
+const char* encodingName(ContentEncoding encoding) {
+
+	switch (encoding) {
+		case ENCODING_GZIP: return "gzip";
+		case ENCODING_DEFLATE: return "deflate";
+		case ENCODING_BROTLI: return "br";
+		default: return "identity";
+	}
+}
+
+bool compressData(const char* data, size_t length, ContentEncoding encoding, int level, std::string& out) {
+
+	if (encoding != ENCODING_GZIP && encoding != ENCODING_DEFLATE)
+		return false;
+
+	z_stream stream;
+	std::memset(&stream, 0, sizeof(stream));
+	// windowBits + 16 selects the gzip wrapper, plain 15 the zlib one (HTTP "deflate")
+	int windowBits = (encoding == ENCODING_GZIP) ? 15 + 16 : 15;
+	if (deflateInit2(&stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+
+	out.resize(deflateBound(&stream, length));
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+	stream.avail_in = length;
+	stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+	stream.avail_out = out.size();
+
+	int ret = deflate(&stream, Z_FINISH);
+	out.resize(stream.total_out);
+	deflateEnd(&stream);
+	return ret == Z_STREAM_END;
+}
+
+bool CompressionKey::operator<(const CompressionKey& other) const {
+
+	if (ino != other.ino) return ino < other.ino;
+	if (dev != other.dev) return dev < other.dev;
+	if (encoding != other.encoding) return encoding < other.encoding;
+	if (level != other.level) return level < other.level;
+	return etag < other.etag;
+}
+
+CompressionCache::CompressionCache(size_t maxBytes)
+	: _entries(), _index(), _bytes(0), _maxBytes(maxBytes) {}
+
+CompressionCache::~CompressionCache() {}
+
+const std::string* CompressionCache::find(const CompressionKey& key) {
+
+	EntryIndex::iterator it = _index.find(key);
+	if (it == _index.end())
+		return NULL;
+	// Move to the front (most recently used)
+	_entries.splice(_entries.begin(), _entries, it->second);
+	return &it->second->second;
+}
+
+const std::string* CompressionCache::insert(const CompressionKey& key, const std::string& data) {
+
+	if (data.size() > maxEntrySize())
+		return NULL;
+
+	EntryIndex::iterator it = _index.find(key);
+	if (it != _index.end()) {
+		_bytes -= it->second->second.size();
+		_entries.erase(it->second);
+		_index.erase(it);
+	}
+	evict(data.size());
+
+	_entries.push_front(std::make_pair(key, data));
+	_index[key] = _entries.begin();
+	_bytes += data.size();
+	return &_entries.front().second;
+}
+
+void CompressionCache::evict(size_t needed) {
+
+	while (!_entries.empty() && _bytes + needed > _maxBytes) {
+		_bytes -= _entries.back().second.size();
+		_index.erase(_entries.back().first);
+		_entries.pop_back();
+	}
+}
+
+size_t CompressionCache::maxEntrySize() const { return _maxBytes / 4; }
+size_t CompressionCache::size() const { return _entries.size(); }
+size_t CompressionCache::bytes() const { return _bytes; }
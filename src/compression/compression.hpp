@@ -0,0 +1,71 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <string>
+#include <list>
+#include <map>
+#include <sys/types.h>
+
+enum ContentEncoding {
+	ENCODING_IDENTITY,
+	ENCODING_GZIP,
+	ENCODING_DEFLATE,
+	ENCODING_BROTLI     // only served from precompressed .br files
+};
+
+// Picks the best encoding we can produce from an Accept-Encoding value,
+// honoring q-values ("gzip;q=0", "*;q=0.5"). Ties prefer gzip.
+ContentEncoding	negotiateEncoding(const std::string& acceptEncoding);
+bool			acceptsEncoding(const std::string& acceptEncoding, ContentEncoding encoding);
+const char*		encodingName(ContentEncoding encoding);
+
+// One-shot zlib compression of a whole buffer (gzip or zlib/"deflate" framing).
+bool			compressData(const char* data, size_t length, ContentEncoding encoding, int level, std::string& out);
+
+// Identity of one compressed variant: the file (device + inode), its ETag,
+// so edits never hit a stale entry, and the encoding/level it was built with.
+struct CompressionKey {
+	CompressionKey(dev_t d, ino_t i, const std::string& e, ContentEncoding enc, int l)
+		: dev(d), ino(i), etag(e), encoding(enc), level(l) {}
+
+	dev_t			dev;
+	ino_t			ino;
+	std::string		etag;
+	ContentEncoding	encoding;
+	int				level;
+
+	bool operator<(const CompressionKey& other) const;
+};
+
+/*
+	Bounded LRU cache of compressed file bodies so each static file is
+	compressed once per (ETag, encoding). Bounded by total bytes; entries
+	larger than a quarter of the budget are never admitted.
+	Returned pointers stay valid until the next insert().
+*/
+class CompressionCache {
+
+	public:
+		CompressionCache(size_t maxBytes);
+		~CompressionCache();
+
+		const std::string*	find(const CompressionKey& key);
+		const std::string*	insert(const CompressionKey& key, const std::string& data);
+
+		size_t	maxEntrySize() const;
+		size_t	size() const;
+		size_t	bytes() const;
+
+	private:
+		typedef std::list<std::pair<CompressionKey, std::string> >	EntryList;
+		typedef std::map<CompressionKey, EntryList::iterator>		EntryIndex;
+
+		void	evict(size_t needed);
+
+		EntryList	_entries;       // most recently used first
+		EntryIndex	_index;
+		size_t		_bytes;
+		size_t		_maxBytes;
+};
+
+#endif
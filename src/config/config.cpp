@@ -3,12 +3,14 @@
 #include "config_exceptions.hpp"
 #include "logger.hpp"
 #include "directives_parsers.tpp"
+#include "regex_set.hpp"
 
 #include <fstream>
 #include <iostream>
 #include <algorithm>
 #include <unistd.h>
 #include <sstream>
+#include <cstdlib>
 
 //parseConfigFile reads each line, extracts the key and tokens, and calls parseServerConfigField and parseCommonConfigField.
 //parseServerConfigField handles server-level directives. For a location block, it parses its contents, calling both parseCommonConfigField and parseLocationConfigField for each directive inside the block.
@@ -23,6 +25,7 @@ Config::Config()
 
 LocationConfig::LocationConfig()
     : path(""),
+      match(LOCATION_PREFIX),
       autoindex(false),
       index(""),
       root(""),
@@ -31,10 +34,42 @@ LocationConfig::LocationConfig()
       client_max_body_size(0),
       cgi_path(),
       cgi_ext(),
+      cgi_timeout(0),
+      fastcgi_pass(""),
+      fastcgi_connections(0),
+      fastcgi_multiplex(0),
+      cgi_pool_worker(""),
+      cgi_pool_min(-1),
+      cgi_pool_max(-1),
+      cgi_pool_requests(-1),
+      proxy_pass(""),
+      proxy_upstream(""),
+      proxy_uri(""),
+      proxy_cache(""),
+      proxy_cache_valid(-1),
+      proxy_cache_max_size(0),
       upload_enabled(false),
       upload_store(""),
+      upload_durability(UPLOAD_DURABILITY_NONE),
       redirect(""),
-      redirect_code(0) {}
+      redirect_code(0),
+      gzip(-1),
+      gzip_types(),
+      gzip_min_length(-1),
+      gzip_comp_level(0),
+      gzip_static(-1),
+      brotli_static(-1),
+      cache(),
+      cache_types() {}
+
+CachePolicy::CachePolicy()
+    : expires_mode(EXPIRES_UNSET),
+      expires(0),
+      cache_control() {}
+
+bool CachePolicy::configured() const {
+    return expires_mode != EXPIRES_UNSET || !cache_control.empty();
+}
 
 ConfigData::ConfigData()
     :
@@ -52,60 +87,47 @@ ConfigData::ConfigData()
       client_max_body_size(0),
       cgi_path(),
       cgi_ext(),
+      cgi_timeout(0),
+      gzip(false),
+      gzip_types(),
+      gzip_min_length(-1),
+      gzip_comp_level(0),
+      gzip_cache_size(DEFAULT_GZIP_CACHE_SIZE),
+      gzip_static(false),
+      brotli_static(false),
+      cache(),
+      cache_types(),
+      types_file(""),
+      types(),
       access_log(""),
       error_log(""),
+      upstreams(),
       locations() {}
 
-std::vector<ConfigData> Config::getServers() const {
-    return _servers;
+UpstreamServerConfig::UpstreamServerConfig()
+    : address(""),
+      weight(DEFAULT_UPSTREAM_WEIGHT),
+      max_fails(DEFAULT_UPSTREAM_MAX_FAILS),
+      fail_timeout(DEFAULT_UPSTREAM_FAIL_TIMEOUT) {}
+
+UpstreamConfig::UpstreamConfig()
+    : name(""),
+      servers(),
+      balance(BALANCE_ROUND_ROBIN),
+      hash_key(""),
+      keepalive(DEFAULT_UPSTREAM_KEEPALIVE) {}
+
+const UpstreamConfig* ConfigData::findUpstream(const std::string& name) const {
+    for (size_t i = 0; i < upstreams.size(); ++i)
+        if (upstreams[i].name == name)
+            return &upstreams[i];
+    return NULL;
 }
 
-const LocationConfig* ConfigData::findMatchingLocation(const std::string& requestPath) const {
-
-    std::cout << "[DEBUG] RequestPath: " << requestPath << std::endl;
-
-    const LocationConfig* bestMatch = NULL;
-    size_t longestMatch = 0;
-
-    for (size_t i = 0; i < locations.size(); i++) {
-
-        std::cout << "[DEBUG] Checking location: " << locations[i].path << std::endl;
-        size_t pathLen = locations[i].path.length();
-
-        // Check if request path starts with this location path
-        if (requestPath.compare(0, pathLen, locations[i].path) == 0) {
-
-            // For root location "/", always matches
-            if (locations[i].path == "/") {
-                // Only use root if we haven't found a longer match
-                if (pathLen > longestMatch) {
-                    bestMatch = &locations[i];
-                    longestMatch = pathLen;
-                    std::cout << "[DEBUG] Root location matches (length: " << pathLen << ")" << std::endl;
-                }
-            }
-            // For non-root locations, ensure proper path boundary
-            else if (requestPath.length() == pathLen || requestPath[pathLen] == '/') {
-                // This is a valid match - use it if it's longer than current best
-                if (pathLen > longestMatch) {
-                    bestMatch = &locations[i];
-                    longestMatch = pathLen;
-                    std::cout << "[DEBUG] Location matches (length: " << pathLen << ")" << std::endl;
-                }
-            }
-        }
-    }
-
-    if (bestMatch) {
-        std::cout << "[DEBUG] Best match: " << bestMatch->path << " (root: " << bestMatch->root << ")" << std::endl;
-    } else {
-        std::cout << "[DEBUG] No matching location found" << std::endl;
-    }
-
-    return bestMatch;
+std::vector<ConfigData> Config::getServers() const {
+    return _servers;
 }
 
-
 // }
 // Validates that the given key is in the list of known directives
 void Config::validateDirective(const char* const* directives, size_t count, const std::string& key) {
@@ -149,6 +171,14 @@ void Config::validateConfig(ConfigData& config) {
         config.allow_methods.push_back("GET");
         std::cout << "Info: No allow_methods specified, defaulting to GET" << std::endl;
     }
+    if (config.gzip_types.empty())
+        config.gzip_types.assign(DEFAULT_GZIP_TYPES, DEFAULT_GZIP_TYPES + DEFAULT_GZIP_TYPES_COUNT);
+    if (config.gzip_min_length < 0)
+        config.gzip_min_length = DEFAULT_GZIP_MIN_LENGTH;
+    if (config.gzip_comp_level <= 0)
+        config.gzip_comp_level = DEFAULT_GZIP_COMP_LEVEL;
+    if (config.cgi_timeout <= 0)
+        config.cgi_timeout = DEFAULT_CGI_TIMEOUT;
     // --- Each location ---
     for (size_t i = 0; i < config.locations.size(); ++i)
     {
@@ -175,23 +205,76 @@ void Config::validateConfig(ConfigData& config) {
           loc.cgi_ext = config.cgi_ext;
         if (loc.cgi_path.empty())
           loc.cgi_path = config.cgi_path;
+        if (loc.cgi_timeout <= 0)
+          loc.cgi_timeout = config.cgi_timeout;
+        if (loc.fastcgi_connections <= 0)
+          loc.fastcgi_connections = DEFAULT_FASTCGI_CONNECTIONS;
+        if (loc.fastcgi_multiplex <= 0)
+          loc.fastcgi_multiplex = 1;
+        if (loc.cgi_pool_min < 0)
+          loc.cgi_pool_min = DEFAULT_CGI_POOL_MIN;
+        if (loc.cgi_pool_max < 0)
+          loc.cgi_pool_max = std::max(DEFAULT_CGI_POOL_MAX, loc.cgi_pool_min);
+        if (loc.cgi_pool_requests < 0)
+          loc.cgi_pool_requests = DEFAULT_CGI_POOL_REQUESTS;
+        if (loc.proxy_cache_valid < 0)
+          loc.proxy_cache_valid = 0;
+        if (loc.proxy_cache_max_size == 0)
+          loc.proxy_cache_max_size = DEFAULT_PROXY_CACHE_MAX_SIZE;
+        // Inherit compression settings from server if not set in location
+        if (loc.gzip < 0)
+            loc.gzip = config.gzip;
+        if (loc.gzip_types.empty())
+            loc.gzip_types = config.gzip_types;
+        if (loc.gzip_min_length < 0)
+            loc.gzip_min_length = config.gzip_min_length;
+        if (loc.gzip_comp_level <= 0)
+            loc.gzip_comp_level = config.gzip_comp_level;
+        if (loc.gzip_static < 0)
+            loc.gzip_static = config.gzip_static;
+        if (loc.brotli_static < 0)
+            loc.brotli_static = config.brotli_static;
+        // Inherit caching headers: the default policy as a whole, MIME overrides one by one
+        if (!loc.cache.configured())
+            loc.cache = config.cache;
+        for (std::map<std::string, CachePolicy>::const_iterator it = config.cache_types.begin();
+             it != config.cache_types.end(); ++it)
+        {
+            if (loc.cache_types.find(it->first) == loc.cache_types.end())
+                loc.cache_types[it->first] = it->second;
+        }
         // Validations
-		if (loc.path.empty() || loc.path[0] != '/')
+		if (!loc.isRegex() && (loc.path.empty() || loc.path[0] != '/'))
     		throw ConfigParseException("Invalid location config: path must start with '/': " + loc.path);
+        // The request URI is not split at a prefix there, so there is nothing for a URI to replace
+        if (loc.isRegex() && !loc.proxy_uri.empty())
+            throw ConfigParseException("proxy_pass cannot have a URI in regex location: " + loc.path);
 		if (loc.root.empty())
     		throw ConfigParseException("Missing required location config: root");
 		if (!isValidPath(loc.root, R_OK | X_OK))
     		throw ConfigParseException("Inaccessible root path for location " + loc.path + ": " + loc.root);
-        if (loc.index.empty() && loc.autoindex == false)
+        if (loc.index.empty() && loc.autoindex == false && loc.proxy_pass.empty())
             throw ConfigParseException("Missing index and autoindex is off in location: " + loc.path);
         if (loc.allow_methods.empty())
             throw ConfigParseException("Missing required location config: allow_methods");
         if (loc.client_max_body_size <= 0)
             throw ConfigParseException("Missing required location config: client_max_body_size");
-        if (!loc.cgi_ext.empty() && loc.cgi_path.empty())
+        if (!loc.cgi_ext.empty() && loc.cgi_path.empty() && loc.cgi_pool_worker.empty())
             throw ConfigParseException("Missing required location config: cgi_path for CGI");
         if (!loc.cgi_path.empty() && loc.cgi_ext.empty())
             throw ConfigParseException("Missing required location config: cgi_ext for CGI");
+        if (!loc.cgi_pool_worker.empty() && loc.cgi_ext.empty())
+            throw ConfigParseException("cgi_pool_worker needs cgi_ext in location: " + loc.path);
+        if (!loc.cgi_pool_worker.empty() && !loc.fastcgi_pass.empty())
+            throw ConfigParseException("cgi_pool_worker and fastcgi_pass both set in location: " + loc.path);
+        if (!loc.proxy_pass.empty() && (!loc.fastcgi_pass.empty() || !loc.cgi_pool_worker.empty()))
+            throw ConfigParseException("proxy_pass cannot be combined with fastcgi_pass or cgi_pool_worker in location: " + loc.path);
+        // Not an upstream block: a single server, which needs a port
+        if (!loc.proxy_pass.empty() && !config.findUpstream(loc.proxy_upstream) && !isValidHostPort(loc.proxy_upstream))
+            throw ConfigParseException("Unknown upstream in proxy_pass: " + loc.proxy_upstream);
+        // Only responses of a backend are stored
+        if (!loc.proxy_cache.empty() && loc.proxy_pass.empty() && loc.fastcgi_pass.empty() && loc.cgi_ext.empty())
+            throw ConfigParseException("proxy_cache needs proxy_pass, fastcgi_pass or CGI in location: " + loc.path);
         if (loc.upload_enabled)
         {
     		if (loc.upload_store.empty())
@@ -211,10 +294,43 @@ void Config::validateConfig(ConfigData& config) {
     }
 }
 
+// "=", "^~", "~" or "~*" before the path; index of the path token
+size_t Config::parseLocationMatch(const std::vector<std::string>& tokens, LocationMatch& match) {
+    match = LOCATION_PREFIX;
+    if (tokens.empty())
+        return 0;
+    if (tokens[0] == "=")
+        match = LOCATION_EXACT;
+    else if (tokens[0] == "^~")
+        match = LOCATION_PREFIX_NO_REGEX;
+    else if (tokens[0] == "~")
+        match = LOCATION_REGEX;
+    else if (tokens[0] == "~*")
+        match = LOCATION_REGEX_CASELESS;
+    else
+        return 0;
+    return 1;
+}
+
+bool LocationConfig::isRegex() const {
+    return match == LOCATION_REGEX || match == LOCATION_REGEX_CASELESS;
+}
+
 void Config::parseLocationBlock(ConfigData& config, std::ifstream& file, const std::vector<std::string>& tokens) {
   	inLocationBlock = true;
     LocationConfig loc;
-    loc.path = tokens[0];
+    size_t pathToken = parseLocationMatch(tokens, loc.match);
+    if (pathToken >= tokens.size() || tokens[pathToken] == "{")
+        throw ConfigParseException("Missing location path");
+    loc.path = tokens[pathToken];
+    if (loc.isRegex())
+    {
+        // Compiled here only to reject it early; the server compiles all of them together
+        RegexSet regex;
+        std::string error;
+        if (!regex.add(loc.path, loc.match == LOCATION_REGEX_CASELESS, error))
+            throw ConfigParseException("Invalid regex in location " + loc.path + ": " + error);
+    }
 
     // Check for '{' at end of line or next line
     bool foundBrace = false;
@@ -249,10 +365,12 @@ void Config::parseLocationBlock(ConfigData& config, std::ifstream& file, const s
         parseLocationConfigField(loc, lkey, ltokens);
         if (blockEnd) break;
     }
-    // Check for duplicate location paths
+    // Check for duplicate location paths: "= /a" and "/a" may both exist, "^~ /a" and "/a" may not
 	for (size_t i = 0; i < config.locations.size(); ++i)
     {
-    if (config.locations[i].path == loc.path)
+    const LocationConfig& other = config.locations[i];
+    if (other.path == loc.path && other.isRegex() == loc.isRegex()
+        && (other.match == LOCATION_EXACT) == (loc.match == LOCATION_EXACT))
         throw ConfigParseException("Duplicate location path: " + loc.path);
     }
 
@@ -261,6 +379,103 @@ void Config::parseLocationBlock(ConfigData& config, std::ifstream& file, const s
 }
 
 
+// Parses "types { text/html html htm; ... }": one MIME type per line followed by its extensions
+void Config::parseTypesBlock(ConfigData& config, std::ifstream& file, const std::vector<std::string>& tokens) {
+    std::string line;
+    if (tokens.back() != "{")
+    {
+        if (!std::getline(file, line))
+            throw ConfigParseException("Expected '{' after types");
+        std::istringstream brace_iss(line);
+        std::string maybeBrace;
+        if (!(brace_iss >> maybeBrace) || maybeBrace != "{")
+            throw ConfigParseException("Expected '{' after types");
+    }
+    while (std::getline(file, line))
+    {
+        size_t closePos = line.find('}');
+        bool blockEnd = (closePos != std::string::npos);
+        std::istringstream liss(blockEnd ? line.substr(0, closePos) : line);
+        std::vector<std::string> ltokens = readValues(liss);
+        if (!ltokens.empty())
+        {
+            if (ltokens.size() < 2 || ltokens[0].find('/') == std::string::npos)
+                throw ConfigParseException("Invalid types entry: " + ltokens[0]);
+            for (size_t i = 1; i < ltokens.size(); ++i)
+                config.types.push_back(std::make_pair(ltokens[0], ltokens[i]));
+        }
+        if (blockEnd) return;
+    }
+    throw ConfigParseException("Unterminated types block");
+}
+
+/*
+    "upstream <name> {" then, one per line:
+        server <host:port> [weight=N] [max_fails=N] [fail_timeout=N]
+        least_conn | hash <key>        (round robin without either)
+        keepalive <n>
+    "}"
+*/
+void Config::parseUpstreamBlock(ConfigData& config, std::ifstream& file, const std::vector<std::string>& tokens) {
+    UpstreamConfig upstream;
+    upstream.name = tokens[0];
+    if (upstream.name == "{" || config.findUpstream(upstream.name))
+        throw ConfigParseException("Missing or duplicate upstream name: " + upstream.name);
+    std::string line;
+    if (tokens.back() != "{")
+    {
+        if (!std::getline(file, line))
+            throw ConfigParseException("Expected '{' after upstream");
+        std::istringstream brace_iss(line);
+        std::string maybeBrace;
+        if (!(brace_iss >> maybeBrace) || maybeBrace != "{")
+            throw ConfigParseException("Expected '{' after upstream");
+    }
+    bool balanceSet = false;
+    bool keepaliveSet = false;
+    while (std::getline(file, line))
+    {
+        size_t closePos = line.find('}');
+        bool blockEnd = (closePos != std::string::npos);
+        std::istringstream liss(blockEnd ? line.substr(0, closePos) : line);
+        std::string ukey;
+        if (liss >> ukey)
+        {
+            std::vector<std::string> utokens = readValues(liss);
+            if (ukey == "server")
+                parseUpstreamServer(upstream, utokens);
+            else if ((ukey == "least_conn" && utokens.empty()) || (ukey == "hash" && utokens.size() == 1))
+            {
+                if (balanceSet)
+                    throw ConfigParseException("Duplicate balancing method in upstream: " + upstream.name);
+                balanceSet = true;
+                upstream.balance = (ukey == "hash") ? BALANCE_HASH : BALANCE_LEAST_CONN;
+                if (ukey == "hash")
+                    upstream.hash_key = utokens[0];
+            }
+            else if (ukey == "keepalive" && utokens.size() == 1 && !keepaliveSet)
+            {
+                char* rest = NULL;
+                long number = std::strtol(utokens[0].c_str(), &rest, 10);
+                if (*rest != '\0' || utokens[0].empty() || number < 0 || number > 1024)
+                    throw ConfigParseException("Invalid keepalive value: " + utokens[0]);
+                upstream.keepalive = static_cast<int>(number);
+                keepaliveSet = true;
+            }
+            else
+                throw ConfigParseException("Invalid directive in upstream " + upstream.name + ": " + ukey);
+        }
+        if (blockEnd)
+        {
+            if (upstream.servers.empty())
+                throw ConfigParseException("Upstream without servers: " + upstream.name);
+            config.upstreams.push_back(upstream);
+            return;
+        }
+    }
+    throw ConfigParseException("Unterminated upstream block");
+}
+
 // Parsing of the location-specific config fields
 void Config::parseLocationConfigField(LocationConfig& config, const std::string& key, const std::vector<std::string>& tokens) {
 	if (!tokens.empty())
@@ -269,6 +484,28 @@ void Config::parseLocationConfigField(LocationConfig& config, const std::string&
    			parseUploadEnabled(config, tokens);
 		else if (key == "upload_store")
    			parseUploadStore(config, tokens);
+		else if (key == "upload_durability")
+   			parseUploadDurability(config, tokens);
+		else if (key == "fastcgi_pass")
+   			parseFastCgiPass(config, tokens);
+		else if (key == "fastcgi_connections")
+   			parseFastCgiLimit(config.fastcgi_connections, key, tokens);
+		else if (key == "fastcgi_multiplex")
+   			parseFastCgiLimit(config.fastcgi_multiplex, key, tokens);
+		else if (key == "cgi_pool_worker")
+   			parseCgiPoolWorker(config, tokens);
+		else if (key == "cgi_pool_size")
+   			parseCgiPoolSize(config, tokens);
+		else if (key == "cgi_pool_requests")
+   			parseCgiPoolRequests(config, tokens);
+		else if (key == "proxy_pass")
+   			parseProxyPass(config, tokens);
+		else if (key == "proxy_cache")
+   			parseProxyCache(config, tokens);
+		else if (key == "proxy_cache_valid")
+   			parseProxyCacheValid(config, tokens);
+		else if (key == "proxy_cache_max_size")
+   			parseProxyCacheMaxSize(config, tokens);
 		else if (key == "redirect")
     		parseRedirect(config, tokens);
 	}
@@ -296,6 +533,14 @@ void Config::parseServerConfigField(ConfigData& config, const std::string& key,
         parseKeepaliveTimeoutDirective(config, tokens[0]);
     else if (key == "keepalive_max_requests")
         parseKeepaliveRequestsDirective(config, tokens[0]);
+    else if (key == "gzip_cache_size")
+        parseGzipCacheSizeDirective(config, tokens[0]);
+    else if (key == "types")
+        parseTypesBlock(config, file, tokens);
+    else if (key == "upstream")
+        parseUpstreamBlock(config, file, tokens);
+    else if (key == "types_file")
+        parseTypesFileDirective(config, tokens[0]);
     else if (key == "error_log")
         assignLogFile(config.error_log, tokens[0]);
     else if (key == "access_log")
@@ -18,13 +18,18 @@ static const char *AUTOINDEX_VALUES[] = {"on", "off", "true", "false", "1", "0"}
 static const size_t AUTOINDEX_VALUES_COUNT = sizeof(AUTOINDEX_VALUES) / sizeof(AUTOINDEX_VALUES[0]);
 
 // Valid HTTP methods
-static const char *HTTP_METHODS[] = {"GET", "POST", "DELETE"};
+static const char *HTTP_METHODS[] = {"GET", "POST", "DELETE", "HEAD", "OPTIONS", "PURGE"};
 static const size_t HTTP_METHODS_COUNT = sizeof(HTTP_METHODS) / sizeof(HTTP_METHODS[0]);
 
 //Valid location directives (used in config.cpp)
 static const char *LOCATION_DIRECTIVES[] = {
 	"autoindex", "root", "index", "allow_methods", "cgi_ext", "cgi_path",
-	"upload_enabled", "upload_store", "redirect", "error_page", "client_max_body_size"
+	"upload_enabled", "upload_store", "redirect", "error_page", "client_max_body_size",
+	"gzip", "gzip_types", "gzip_min_length", "gzip_comp_level", "gzip_static", "brotli_static",
+	"expires", "cache_control", "upload_durability", "cgi_timeout",
+	"fastcgi_pass", "fastcgi_connections", "fastcgi_multiplex",
+	"cgi_pool_worker", "cgi_pool_size", "cgi_pool_requests", "proxy_pass",
+	"proxy_cache", "proxy_cache_valid", "proxy_cache_max_size"
 };
 static const size_t LOCATION_DIRECTIVES_COUNT = sizeof(LOCATION_DIRECTIVES) / sizeof(LOCATION_DIRECTIVES[0]);
 
@@ -33,10 +38,48 @@ static const char *SERVER_DIRECTIVES[] = {
 	"location", "listen", "server_name", "backlog", "max_clients",
 	"access_log", "error_log", "autoindex", "index", "root",
 	"allow_methods", "error_page", "cgi_ext", "cgi_path",
-	"client_max_body_size", "keepalive_timeout", "keepalive_max_requests"
+	"client_max_body_size", "keepalive_timeout", "keepalive_max_requests",
+	"gzip", "gzip_types", "gzip_min_length", "gzip_comp_level", "gzip_cache_size",
+	"gzip_static", "brotli_static", "types", "types_file", "expires", "cache_control", "cgi_timeout",
+	"upstream"
 };
 static const size_t SERVER_DIRECTIVES_COUNT = sizeof(SERVER_DIRECTIVES) / sizeof(SERVER_DIRECTIVES[0]);
 
+// Compression defaults (gzip_* directives)
+static const char *DEFAULT_GZIP_TYPES[] = {
+	"text/html", "text/plain", "text/css", "text/javascript", "application/javascript", "application/json"
+};
+static const size_t DEFAULT_GZIP_TYPES_COUNT = sizeof(DEFAULT_GZIP_TYPES) / sizeof(DEFAULT_GZIP_TYPES[0]);
+const int DEFAULT_GZIP_MIN_LENGTH = 20;
+const int DEFAULT_GZIP_COMP_LEVEL = 6;
+const size_t DEFAULT_GZIP_CACHE_SIZE = 16 * 1024 * 1024; // 16MB
+
+// Valid cache_control directives (value-less ones; "max-age" comes from expires)
+static const char *CACHE_CONTROL_DIRECTIVES[] = {
+	"public", "private", "no-cache", "no-store", "no-transform", "must-revalidate",
+	"proxy-revalidate", "immutable"
+};
+static const size_t CACHE_CONTROL_DIRECTIVES_COUNT = sizeof(CACHE_CONTROL_DIRECTIVES) / sizeof(CACHE_CONTROL_DIRECTIVES[0]);
+// ... and the ones taking seconds ("s-maxage=600")
+static const char *CACHE_CONTROL_SECONDS_DIRECTIVES[] = {"s-maxage", "stale-while-revalidate", "stale-if-error"};
+static const size_t CACHE_CONTROL_SECONDS_DIRECTIVES_COUNT = sizeof(CACHE_CONTROL_SECONDS_DIRECTIVES) / sizeof(CACHE_CONTROL_SECONDS_DIRECTIVES[0]);
+
+// Seconds a CGI script may run before it is killed (cgi_timeout)
+const int DEFAULT_CGI_TIMEOUT = 30;
+// Keep-alive connections per fastcgi_pass address (fastcgi_connections)
+const int DEFAULT_FASTCGI_CONNECTIONS = 8;
+// Pre-spawned interpreter workers per location (cgi_pool_size) and requests each serves (cgi_pool_requests)
+const int DEFAULT_CGI_POOL_MIN = 1;
+const int DEFAULT_CGI_POOL_MAX = 8;
+const int DEFAULT_CGI_POOL_REQUESTS = 1000;
+// Upstream block defaults (nginx's): server weight, max_fails, fail_timeout seconds; idle connections kept per server
+const int DEFAULT_UPSTREAM_WEIGHT = 1;
+const int DEFAULT_UPSTREAM_MAX_FAILS = 1;
+const int DEFAULT_UPSTREAM_FAIL_TIMEOUT = 10;
+const int DEFAULT_UPSTREAM_KEEPALIVE = 8;
+// Bytes a proxy_cache directory may hold before its least recently used responses go (proxy_cache_max_size)
+const size_t DEFAULT_PROXY_CACHE_MAX_SIZE = 256 * 1024 * 1024; // 256MB
+
 // Default error pages
 #define DEFAULT_ERROR_PAGE_404 "runtime/www/errors/404.html"
 #define DEFAULT_ERROR_PAGE_500 "runtime/www/errors/500.html"
@@ -44,12 +87,81 @@ static const size_t SERVER_DIRECTIVES_COUNT = sizeof(SERVER_DIRECTIVES) / sizeof
 #define DEFAULT_ERROR_PAGE_413 "runtime/www/errors/400.html"
 
 
+enum ExpiresMode {
+	EXPIRES_UNSET,
+	EXPIRES_OFF,      // expires off
+	EXPIRES_EPOCH,    // expires epoch: already expired, no-cache
+	EXPIRES_MAX,      // expires max: ~10 years
+	EXPIRES_SECONDS   // expires <time>, negative = no-cache
+};
+
+// What an upload must reach before it is answered (upload_durability)
+enum UploadDurability {
+	UPLOAD_DURABILITY_NONE,       // renamed into place, written back whenever the kernel likes
+	UPLOAD_DURABILITY_FDATASYNC,  // file data and directory entry synced before the response
+	UPLOAD_DURABILITY_BATCH       // synced in groups shortly after the response
+};
+
+// How an upstream block picks a server for each request
+enum UpstreamBalance {
+	BALANCE_ROUND_ROBIN,   // weighted round robin (default)
+	BALANCE_LEAST_CONN,    // fewest requests in flight for its weight (least_conn)
+	BALANCE_HASH           // consistent hash of a request key (hash <key>)
+};
+
+// How a location's path is matched: the modifier in front of it, nginx's
+enum LocationMatch {
+	LOCATION_PREFIX,            // location /path
+	LOCATION_PREFIX_NO_REGEX,   // location ^~ /path: as the longest prefix, regex locations are not tried
+	LOCATION_EXACT,             // location = /path
+	LOCATION_REGEX,             // location ~ pattern
+	LOCATION_REGEX_CASELESS     // location ~* pattern
+};
+
+// "server <host:port> [weight=N] [max_fails=N] [fail_timeout=N]" in an upstream block
+struct UpstreamServerConfig
+{
+	UpstreamServerConfig();
+
+	std::string address; // host:port
+	int weight;
+	int max_fails; // failures within fail_timeout that take it out of rotation, 0 = never
+	int fail_timeout; // seconds: the failure window, and how long it stays out
+};
+
+// "upstream <name> { ... }": a group of servers proxy_pass can name
+struct UpstreamConfig
+{
+	UpstreamConfig();
+
+	std::string name;
+	std::vector<UpstreamServerConfig> servers;
+	UpstreamBalance balance;
+	std::string hash_key; // "$request_uri", "$remote_addr", ... for BALANCE_HASH
+	int keepalive; // idle connections kept open per server
+};
+
+// expires / cache_control settings for one MIME type, or the default one
+struct CachePolicy
+{
+	CachePolicy();
+
+	bool configured() const;
+
+	ExpiresMode expires_mode;
+	long expires; // seconds from now (EXPIRES_SECONDS)
+	std::vector<std::string> cache_control; // extra Cache-Control directives
+};
+
 struct LocationConfig
 {
 	LocationConfig();
 
 	// URL matching
-	std::string path;
+	std::string path; // prefix, exact path or regex, as match says
+	LocationMatch match;
+
+	bool isRegex() const;
 
 	// File serving
 	bool autoindex;
@@ -64,24 +176,51 @@ struct LocationConfig
 	// CGI configuration
 	std::vector<std::string> cgi_path; // cgi_interpreters
 	std::vector<std::string> cgi_ext; // cgi_extensions
-
+	int cgi_timeout; // seconds, 0 = inherit
+	std::string fastcgi_pass; // "unix:/path" or "host:port", empty = fork scripts
+	int fastcgi_connections; // pooled connections to fastcgi_pass
+	int fastcgi_multiplex; // requests in flight per connection
+	std::string cgi_pool_worker; // FastCGI-on-stdin interpreter, empty = fork per request
+	int cgi_pool_min; // workers kept warm, -1 = unset
+	int cgi_pool_max;
+	int cgi_pool_requests; // per worker before it is replaced, 0 = no limit, -1 = unset
+
+	// Reverse proxy
+	std::string proxy_pass; // "http://<upstream name or host:port>[/uri]"
+	std::string proxy_upstream; // upstream name or host:port from proxy_pass
+	std::string proxy_uri; // replaces the location path when set, else the request URI goes as is
+
+	// Response cache (proxy, FastCGI and CGI responses)
+	std::string proxy_cache; // cache directory, empty = responses are not stored
+	long proxy_cache_valid; // seconds for responses without Cache-Control/Expires, -1 = unset (not stored)
+	size_t proxy_cache_max_size; // bytes, 0 = unset
 
 	// File uploads
 	bool upload_enabled;
 	std::string upload_store; // upload_directory
+	UploadDurability upload_durability;
 
 	// Redirects
 	std::string redirect; // redirect_url
 	int redirect_code; // redirect_status_code
+
+	// Compression
+	int gzip; // -1 = inherit, 0 = off, 1 = on
+	std::vector<std::string> gzip_types; // compressible MIME types ("*" = all)
+	int gzip_min_length; // bytes, -1 = inherit
+	int gzip_comp_level; // 1-9, 0 = inherit
+	int gzip_static; // serve file.gz next to file when accepted, -1 = inherit
+	int brotli_static; // serve file.br next to file when accepted, -1 = inherit
+
+	// Caching headers
+	CachePolicy cache; // expires / cache_control without MIME types
+	std::map<std::string, CachePolicy> cache_types; // per MIME type ("image/*" allowed)
 };
 
 struct ConfigData
 {
 	ConfigData();
 
-	// Find location that matches the given request path
-	const LocationConfig* findMatchingLocation(const std::string& requestPath) const;
-
 	// Network binding
 	std::vector<std::pair<std::string, unsigned short> > listeners; // listen_addresses
 	std::vector<std::string> server_names;
@@ -107,11 +246,33 @@ struct ConfigData
 	// CGI configuration
 	std::vector<std::string> cgi_path; // cgi_interpreters
 	std::vector<std::string> cgi_ext; // cgi_extensions;
+	int cgi_timeout; // seconds
+
+	// Compression
+	bool gzip;
+	std::vector<std::string> gzip_types;
+	int gzip_min_length;
+	int gzip_comp_level;
+	size_t gzip_cache_size; // bytes of compressed variants kept in memory
+	bool gzip_static;
+	bool brotli_static;
+
+	// Caching headers
+	CachePolicy cache;
+	std::map<std::string, CachePolicy> cache_types;
+
+	// MIME types (added on top of the built-in table)
+	std::string types_file; // mime.types path
+	std::vector<std::pair<std::string, std::string> > types; // (type, extension) from types {}
 
 	// Logging
 	std::string access_log; // access_log_path
 	std::string error_log; // error_log_path
 
+	// Upstream groups for proxy_pass
+	std::vector<UpstreamConfig> upstreams;
+	const UpstreamConfig* findUpstream(const std::string& name) const;
+
 	// Location blocks
 	std::vector<LocationConfig> locations;
 };
@@ -145,6 +306,9 @@ private:
 	template<typename ConfigT>
 	void parseCgiExt(ConfigT &config, const std::vector<std::string> &tokens);
 
+	template<typename ConfigT>
+	void parseCgiTimeout(ConfigT &config, const std::vector<std::string> &tokens);
+
 	template<typename ConfigT>
 	void parseErrorPage(ConfigT &config, const std::vector<std::string> &tokens);
 
@@ -163,11 +327,44 @@ private:
 	template<typename ConfigT>
 	void parseRoot(ConfigT &config, const std::vector<std::string> &tokens);
 
+	template<typename ConfigT>
+	void parseGzip(ConfigT &config, const std::vector<std::string> &tokens);
+
+	template<typename ConfigT>
+	void parseGzipStatic(ConfigT &config, const std::vector<std::string> &tokens);
+
+	template<typename ConfigT>
+	void parseBrotliStatic(ConfigT &config, const std::vector<std::string> &tokens);
+
+	template<typename ConfigT>
+	void parseGzipTypes(ConfigT &config, const std::vector<std::string> &tokens);
+
+	template<typename ConfigT>
+	void parseGzipMinLength(ConfigT &config, const std::vector<std::string> &tokens);
+
+	template<typename ConfigT>
+	void parseGzipCompLevel(ConfigT &config, const std::vector<std::string> &tokens);
+
+	template<typename ConfigT>
+	void parseExpires(ConfigT &config, const std::vector<std::string> &tokens);
+
+	template<typename ConfigT>
+	void parseCacheControl(ConfigT &config, const std::vector<std::string> &tokens);
+
+	template<typename ConfigT>
+	std::vector<CachePolicy*> cachePolicyTargets(ConfigT &config, const std::vector<std::string> &types);
+
 	void parseServerConfigField(ConfigData &config, const std::string &key, const std::vector<std::string> &tokens,
 								std::ifstream &file);
 
 	void parseLocationBlock(ConfigData &config, std::ifstream &file, const std::vector<std::string> &tokens);
 
+	size_t parseLocationMatch(const std::vector<std::string> &tokens, LocationMatch &match);
+
+	void parseTypesBlock(ConfigData &config, std::ifstream &file, const std::vector<std::string> &tokens);
+
+	void parseTypesFileDirective(ConfigData &config, const std::string &value);
+
 	void parseListenDirective(ConfigData &config, const std::string &value);
 
 	void parseBacklogDirective(ConfigData &config, const std::string &value);
@@ -178,12 +375,38 @@ private:
 
 	void parseKeepaliveRequestsDirective(ConfigData &config, const std::string &value);
 
+	void parseGzipCacheSizeDirective(ConfigData &config, const std::string &value);
+
 	void parseRedirect(LocationConfig &config, const std::vector<std::string> &tokens);
 
 	void parseUploadStore(LocationConfig &config, const std::vector<std::string> &tokens);
 
 	void parseUploadEnabled(LocationConfig &config, const std::vector<std::string> &tokens);
 
+	void parseUploadDurability(LocationConfig &config, const std::vector<std::string> &tokens);
+
+	void parseFastCgiPass(LocationConfig &config, const std::vector<std::string> &tokens);
+
+	void parseFastCgiLimit(int &value, const std::string &key, const std::vector<std::string> &tokens);
+
+	void parseCgiPoolWorker(LocationConfig &config, const std::vector<std::string> &tokens);
+
+	void parseCgiPoolSize(LocationConfig &config, const std::vector<std::string> &tokens);
+
+	void parseCgiPoolRequests(LocationConfig &config, const std::vector<std::string> &tokens);
+
+	void parseProxyPass(LocationConfig &config, const std::vector<std::string> &tokens);
+
+	void parseProxyCache(LocationConfig &config, const std::vector<std::string> &tokens);
+
+	void parseProxyCacheValid(LocationConfig &config, const std::vector<std::string> &tokens);
+
+	void parseProxyCacheMaxSize(LocationConfig &config, const std::vector<std::string> &tokens);
+
+	void parseUpstreamBlock(ConfigData &config, std::ifstream &file, const std::vector<std::string> &tokens);
+
+	void parseUpstreamServer(UpstreamConfig &upstream, const std::vector<std::string> &tokens);
+
 	void validateDirective(const char *const*directives, size_t count, const std::string &key);
 
 	void strictCheckAfterServerBlock(std::ifstream &file, std::string line);
@@ -2,6 +2,7 @@
 #include "../exceptions/config_exceptions.hpp"
 #include "../helpers/helpers.hpp"
 #include <sstream>
+#include <cstdlib>
 #include <unistd.h>
 
 void Config::parseBacklogDirective(ConfigData& config, const std::string& value) {
@@ -36,6 +37,22 @@ void Config::parseKeepaliveRequestsDirective(ConfigData& config, const std::stri
     config.keepalive_max_requests = keepalive_max_requests;
 }
 
+void Config::parseGzipCacheSizeDirective(ConfigData& config, const std::string& value) {
+    long size = 0;
+    std::istringstream valStream(value);
+    if (!(valStream >> size) || size < 0 || static_cast<size_t>(size) > MAX_CLIENT_BODY_SIZE)
+        throw ConfigParseException("Invalid gzip_cache_size value: " + value);
+    config.gzip_cache_size = static_cast<size_t>(size);
+}
+
+void Config::parseTypesFileDirective(ConfigData& config, const std::string& value) {
+    if (!config.types_file.empty())
+        throw ConfigParseException("Duplicate types_file directive");
+    if (!isValidFile(value, R_OK))
+        throw ConfigParseException("Invalid or inaccessible types_file: " + value);
+    config.types_file = value;
+}
+
 void Config::parseListenDirective(ConfigData& config, const std::string& value) {
     size_t colon = value.find(':');
     std::string host = "0.0.0.0";
@@ -91,12 +108,159 @@ void Config::parseUploadStore(LocationConfig& config, const std::vector<std::str
     config.upload_store = normalizePath(tokens[0]);
 }
 
+void Config::parseUploadDurability(LocationConfig& config, const std::vector<std::string>& tokens) {
+    const std::string& val = tokens[0];
+    if (val == "none")
+        config.upload_durability = UPLOAD_DURABILITY_NONE;
+    else if (val == "fdatasync")
+        config.upload_durability = UPLOAD_DURABILITY_FDATASYNC;
+    else if (val == "batch")
+        config.upload_durability = UPLOAD_DURABILITY_BATCH;
+    else
+        throw ConfigParseException("Invalid upload_durability value: " + val);
+}
+
+// "unix:/run/php-fpm.sock" or "127.0.0.1:9000"; resolved when the server starts
+void Config::parseFastCgiPass(LocationConfig& config, const std::vector<std::string>& tokens) {
+    if (!config.fastcgi_pass.empty())
+        throw ConfigParseException("Duplicate fastcgi_pass directive");
+    const std::string& val = tokens[0];
+    if (val.compare(0, 5, "unix:") == 0) {
+        if (val.size() == 5)
+            throw ConfigParseException("Invalid fastcgi_pass address: " + val);
+    } else {
+        size_t colon = val.rfind(':');
+        std::string port = (colon == std::string::npos) ? "" : val.substr(colon + 1);
+        if (colon == 0 || port.empty() || port.find_first_not_of("0123456789") != std::string::npos
+            || std::atoi(port.c_str()) <= 0 || std::atoi(port.c_str()) > 65535)
+            throw ConfigParseException("Invalid fastcgi_pass address: " + val);
+    }
+    config.fastcgi_pass = val;
+}
+
+void Config::parseFastCgiLimit(int& value, const std::string& key, const std::vector<std::string>& tokens) {
+    if (value > 0)
+        throw ConfigParseException("Duplicate " + key + " directive");
+    char* rest = NULL;
+    long number = std::strtol(tokens[0].c_str(), &rest, 10);
+    if (*rest != '\0' || number < 1 || number > 1024)
+        throw ConfigParseException("Invalid " + key + " value: " + tokens[0]);
+    value = static_cast<int>(number);
+}
+
+// Interpreter speaking FastCGI on its stdin, started ahead of requests
+void Config::parseCgiPoolWorker(LocationConfig& config, const std::vector<std::string>& tokens) {
+    if (!config.cgi_pool_worker.empty())
+        throw ConfigParseException("Duplicate cgi_pool_worker directive");
+    if (!isValidFile(tokens[0], X_OK))
+        throw ConfigParseException("Invalid or non-executable cgi_pool_worker: " + tokens[0]);
+    config.cgi_pool_worker = tokens[0];
+}
+
+// "cgi_pool_size <min> <max>": workers kept warm, and the most run at once
+void Config::parseCgiPoolSize(LocationConfig& config, const std::vector<std::string>& tokens) {
+    if (config.cgi_pool_max >= 0)
+        throw ConfigParseException("Duplicate cgi_pool_size directive");
+    if (tokens.size() != 2)
+        throw ConfigParseException("cgi_pool_size requires a minimum and a maximum");
+    char* minRest = NULL;
+    char* maxRest = NULL;
+    long minimum = std::strtol(tokens[0].c_str(), &minRest, 10);
+    long maximum = std::strtol(tokens[1].c_str(), &maxRest, 10);
+    if (*minRest != '\0' || *maxRest != '\0' || minimum < 0 || maximum < 1 || maximum > 1024 || minimum > maximum)
+        throw ConfigParseException("Invalid cgi_pool_size values: " + tokens[0] + " " + tokens[1]);
+    config.cgi_pool_min = static_cast<int>(minimum);
+    config.cgi_pool_max = static_cast<int>(maximum);
+}
+
+void Config::parseCgiPoolRequests(LocationConfig& config, const std::vector<std::string>& tokens) {
+    if (config.cgi_pool_requests >= 0)
+        throw ConfigParseException("Duplicate cgi_pool_requests directive");
+    char* rest = NULL;
+    long number = std::strtol(tokens[0].c_str(), &rest, 10);
+    if (*rest != '\0' || tokens[0].empty() || number < 0 || number > 1000000)
+        throw ConfigParseException("Invalid cgi_pool_requests value: " + tokens[0]);
+    config.cgi_pool_requests = static_cast<int>(number);
+}
+
+// "http://<upstream or host:port>[/uri]"; the upstream is looked up once the server block is read
+void Config::parseProxyPass(LocationConfig& config, const std::vector<std::string>& tokens) {
+    if (!config.proxy_pass.empty())
+        throw ConfigParseException("Duplicate proxy_pass directive");
+    const std::string& val = tokens[0];
+    if (val.compare(0, 7, "http://") != 0 || val.size() == 7)
+        throw ConfigParseException("Invalid proxy_pass (only http:// is supported): " + val);
+    size_t slash = val.find('/', 7);
+    config.proxy_upstream = val.substr(7, slash == std::string::npos ? std::string::npos : slash - 7);
+    config.proxy_uri = (slash == std::string::npos) ? "" : val.substr(slash);
+    if (config.proxy_upstream.empty())
+        throw ConfigParseException("Invalid proxy_pass: " + val);
+    config.proxy_pass = val;
+}
+
+void Config::parseUpstreamServer(UpstreamConfig& upstream, const std::vector<std::string>& tokens) {
+    if (tokens.empty() || !isValidHostPort(tokens[0]))
+        throw ConfigParseException("Invalid server in upstream " + upstream.name + ": " + (tokens.empty() ? "" : tokens[0]));
+    UpstreamServerConfig server;
+    server.address = tokens[0];
+    for (size_t i = 1; i < tokens.size(); ++i)
+    {
+        size_t equals = tokens[i].find('=');
+        std::string name = tokens[i].substr(0, equals);
+        std::string value = (equals == std::string::npos) ? "" : tokens[i].substr(equals + 1);
+        char* rest = NULL;
+        long number = std::strtol(value.c_str(), &rest, 10);
+        if (value.empty() || *rest != '\0' || number < 0 || number > 100000)
+            throw ConfigParseException("Invalid server parameter in upstream " + upstream.name + ": " + tokens[i]);
+        if (name == "weight" && number > 0)
+            server.weight = static_cast<int>(number);
+        else if (name == "max_fails")
+            server.max_fails = static_cast<int>(number);
+        else if (name == "fail_timeout" && number > 0)
+            server.fail_timeout = static_cast<int>(number);
+        else
+            throw ConfigParseException("Invalid server parameter in upstream " + upstream.name + ": " + tokens[i]);
+    }
+    upstream.servers.push_back(server);
+}
+
 void Config::parseRedirect(LocationConfig& config, const std::vector<std::string>& tokens) {
     if (tokens.size() != 2)
         throw ConfigParseException("Redirect directive requires exactly 2 arguments: status code and target path/URL");
     int code = std::atoi(tokens[0].c_str());
-    if (!isValidHttpStatusCode(code) || (code != 301 && code != 302 && code != 303))
+    if (!isValidHttpStatusCode(code) || (code != 301 && code != 302 && code != 303 && code != 307 && code != 308))
         throw ConfigParseException("Invalid redirect status code: " + tokens[0]);
     config.redirect_code = code;
     config.redirect = tokens[1];
 }
+
+// Directory the location's responses are stored in; it may be shared between locations
+void Config::parseProxyCache(LocationConfig& config, const std::vector<std::string>& tokens) {
+    if (!config.proxy_cache.empty())
+        throw ConfigParseException("Duplicate proxy_cache directive");
+    if (!isValidPath(tokens[0], W_OK | X_OK))
+        throw ConfigParseException("Invalid or inaccessible proxy_cache path: " + tokens[0]);
+    config.proxy_cache = normalizePath(tokens[0]);
+    if (config.proxy_cache.size() > 1 && config.proxy_cache[config.proxy_cache.size() - 1] == '/')
+        config.proxy_cache.erase(config.proxy_cache.size() - 1);
+}
+
+// "10m": how long responses without Cache-Control or Expires are fresh
+void Config::parseProxyCacheValid(LocationConfig& config, const std::vector<std::string>& tokens) {
+    if (config.proxy_cache_valid >= 0)
+        throw ConfigParseException("Duplicate proxy_cache_valid directive");
+    long seconds = 0;
+    if (!parseTimeValue(tokens[0], seconds) || seconds < 0)
+        throw ConfigParseException("Invalid proxy_cache_valid value: " + tokens[0]);
+    config.proxy_cache_valid = seconds;
+}
+
+void Config::parseProxyCacheMaxSize(LocationConfig& config, const std::vector<std::string>& tokens) {
+    if (config.proxy_cache_max_size > 0)
+        throw ConfigParseException("Duplicate proxy_cache_max_size directive");
+    char* rest = NULL;
+    long size = std::strtol(tokens[0].c_str(), &rest, 10);
+    if (*rest != '\0' || tokens[0].empty() || size < 1)
+        throw ConfigParseException("Invalid proxy_cache_max_size value: " + tokens[0]);
+    config.proxy_cache_max_size = static_cast<size_t>(size);
+}
@@ -91,6 +91,17 @@ void Config::parseCgiExt(ConfigT& config, const std::vector<std::string>& tokens
     }
 }
 
+template<typename ConfigT>
+void Config::parseCgiTimeout(ConfigT& config, const std::vector<std::string>& tokens) {
+    if (config.cgi_timeout > 0)
+        throw ConfigParseException("Duplicate cgi_timeout directive");
+    std::istringstream iss(tokens[0]);
+    int seconds = 0;
+    if (!(iss >> seconds) || !iss.eof() || seconds <= 0)
+        throw ConfigParseException("Invalid cgi_timeout value: " + tokens[0]);
+    config.cgi_timeout = seconds;
+}
+
 template<typename ConfigT>
 void Config::parseCgiPath(ConfigT& config, const std::vector<std::string>& tokens) {
     for (size_t i = 0; i < tokens.size(); ++i)
@@ -101,6 +112,120 @@ void Config::parseCgiPath(ConfigT& config, const std::vector<std::string>& token
   }
 }
 
+template<typename ConfigT>
+void Config::parseGzip(ConfigT& config, const std::vector<std::string>& tokens) {
+    if (!isValidAutoindexValue(tokens[0]))
+        throw ConfigParseException("Invalid gzip value: " + tokens[0]);
+    config.gzip = (tokens[0] == "on" || tokens[0] == "true" || tokens[0] == "1");
+}
+
+template<typename ConfigT>
+void Config::parseGzipStatic(ConfigT& config, const std::vector<std::string>& tokens) {
+    if (!isValidAutoindexValue(tokens[0]))
+        throw ConfigParseException("Invalid gzip_static value: " + tokens[0]);
+    config.gzip_static = (tokens[0] == "on" || tokens[0] == "true" || tokens[0] == "1");
+}
+
+template<typename ConfigT>
+void Config::parseBrotliStatic(ConfigT& config, const std::vector<std::string>& tokens) {
+    if (!isValidAutoindexValue(tokens[0]))
+        throw ConfigParseException("Invalid brotli_static value: " + tokens[0]);
+    config.brotli_static = (tokens[0] == "on" || tokens[0] == "true" || tokens[0] == "1");
+}
+
+template<typename ConfigT>
+void Config::parseGzipTypes(ConfigT& config, const std::vector<std::string>& tokens) {
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+        if (tokens[i] != "*" && tokens[i].find('/') == std::string::npos)
+            throw ConfigParseException("Invalid MIME type in gzip_types: " + tokens[i]);
+        addUnique(config.gzip_types, tokens[i]);
+    }
+}
+
+template<typename ConfigT>
+void Config::parseGzipMinLength(ConfigT& config, const std::vector<std::string>& tokens) {
+    if (config.gzip_min_length >= 0)
+        throw ConfigParseException("Duplicate gzip_min_length directive");
+    std::istringstream iss(tokens[0]);
+    int length = 0;
+    if (!(iss >> length) || length < 0)
+        throw ConfigParseException("Invalid gzip_min_length value: " + tokens[0]);
+    config.gzip_min_length = length;
+}
+
+template<typename ConfigT>
+void Config::parseGzipCompLevel(ConfigT& config, const std::vector<std::string>& tokens) {
+    if (config.gzip_comp_level > 0)
+        throw ConfigParseException("Duplicate gzip_comp_level directive");
+    std::istringstream iss(tokens[0]);
+    int level = 0;
+    if (!(iss >> level) || level < 1 || level > 9)
+        throw ConfigParseException("Invalid gzip_comp_level value (1-9): " + tokens[0]);
+    config.gzip_comp_level = level;
+}
+
+// Policies a directive applies to: the default one, or one per MIME type argument
+template<typename ConfigT>
+std::vector<CachePolicy*> Config::cachePolicyTargets(ConfigT& config, const std::vector<std::string>& types) {
+    std::vector<CachePolicy*> targets;
+    if (types.empty())
+        targets.push_back(&config.cache);
+    for (size_t i = 0; i < types.size(); ++i)
+        targets.push_back(&config.cache_types[types[i]]);
+    return targets;
+}
+
+// expires <time>|epoch|max|off [mime/type ...]
+template<typename ConfigT>
+void Config::parseExpires(ConfigT& config, const std::vector<std::string>& tokens) {
+    ExpiresMode mode = EXPIRES_SECONDS;
+    long seconds = 0;
+    if (tokens[0] == "off")
+        mode = EXPIRES_OFF;
+    else if (tokens[0] == "epoch")
+        mode = EXPIRES_EPOCH;
+    else if (tokens[0] == "max")
+        mode = EXPIRES_MAX;
+    else if (!parseTimeValue(tokens[0], seconds))
+        throw ConfigParseException("Invalid expires value: " + tokens[0]);
+
+    std::vector<std::string> types(tokens.begin() + 1, tokens.end());
+    for (size_t i = 0; i < types.size(); ++i)
+        if (types[i].find('/') == std::string::npos)
+            throw ConfigParseException("Invalid MIME type in expires: " + types[i]);
+    std::vector<CachePolicy*> targets = cachePolicyTargets(config, types);
+    for (size_t i = 0; i < targets.size(); ++i)
+    {
+        if (targets[i]->expires_mode != EXPIRES_UNSET)
+            throw ConfigParseException("Duplicate expires directive");
+        targets[i]->expires_mode = mode;
+        targets[i]->expires = seconds;
+    }
+}
+
+// cache_control <directive> ... [mime/type ...]
+template<typename ConfigT>
+void Config::parseCacheControl(ConfigT& config, const std::vector<std::string>& tokens) {
+    std::vector<std::string> directives;
+    std::vector<std::string> types;
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+        if (tokens[i].find('/') != std::string::npos)
+            types.push_back(tokens[i]);
+        else if (isValidCacheControlDirective(tokens[i]))
+            directives.push_back(tokens[i]);
+        else
+            throw ConfigParseException("Invalid cache_control directive: " + tokens[i]);
+    }
+    if (directives.empty())
+        throw ConfigParseException("cache_control requires at least one directive");
+    std::vector<CachePolicy*> targets = cachePolicyTargets(config, types);
+    for (size_t i = 0; i < targets.size(); ++i)
+        for (size_t j = 0; j < directives.size(); ++j)
+            addUnique(targets[i]->cache_control, directives[j]);
+}
+
 // Helper to parse common config fields
 template<typename ConfigT>
 void Config::parseCommonConfigField(ConfigT& config, const std::string& key, const std::vector<std::string>& tokens) {
@@ -120,6 +245,24 @@ void Config::parseCommonConfigField(ConfigT& config, const std::string& key, con
         parseCgiExt(config, tokens);
     else if (key == "cgi_path")
         parseCgiPath(config, tokens);
+    else if (key == "cgi_timeout")
+        parseCgiTimeout(config, tokens);
     else if (key == "error_page")
         parseErrorPage(config, tokens);
+    else if (key == "gzip")
+        parseGzip(config, tokens);
+    else if (key == "gzip_types")
+        parseGzipTypes(config, tokens);
+    else if (key == "expires")
+        parseExpires(config, tokens);
+    else if (key == "cache_control")
+        parseCacheControl(config, tokens);
+    else if (key == "gzip_min_length")
+        parseGzipMinLength(config, tokens);
+    else if (key == "gzip_comp_level")
+        parseGzipCompLevel(config, tokens);
+    else if (key == "gzip_static")
+        parseGzipStatic(config, tokens);
+    else if (key == "brotli_static")
+        parseBrotliStatic(config, tokens);
 }
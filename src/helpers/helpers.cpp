@@ -3,6 +3,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <climits>
+#include <cstdlib>
 #include <sstream>
 
 // Helper to read all values from iss, stripping trailing semicolons
@@ -95,6 +96,17 @@ bool isValidHost(const std::string& host) {
     return true;
 }
 
+bool isValidHostPort(const std::string& value) {
+    size_t colon = value.rfind(':');
+    if (colon == std::string::npos || !isValidHost(value.substr(0, colon)))
+        return false;
+    std::string port = value.substr(colon + 1);
+    if (port.empty() || port.size() > 5 || port.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    int number = std::atoi(port.c_str());
+    return number > 0 && number <= 65535;
+}
+
 // Helper to validate CGI extensions
 bool isValidCgiExt(const std::string& ext) {
     for (size_t i = 0; i < VALID_CGI_EXTENSIONS_COUNT; ++i)
@@ -115,4 +127,65 @@ bool isValidAutoindexValue(const std::string& value) {
     return false;
 }
 
+// Helper to validate cache_control directives ("immutable", "s-maxage=600", ...)
+bool isValidCacheControlDirective(const std::string& directive) {
+    for (size_t i = 0; i < CACHE_CONTROL_DIRECTIVES_COUNT; ++i)
+    {
+        if (directive == CACHE_CONTROL_DIRECTIVES[i])
+            return true;
+    }
+    size_t eq = directive.find('=');
+    if (eq == std::string::npos)
+        return false;
+    std::string name = directive.substr(0, eq);
+    std::string value = directive.substr(eq + 1);
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    for (size_t i = 0; i < CACHE_CONTROL_SECONDS_DIRECTIVES_COUNT; ++i)
+    {
+        if (name == CACHE_CONTROL_SECONDS_DIRECTIVES[i])
+            return true;
+    }
+    return false;
+}
+
+// Helper to parse nginx-style time values into seconds
+bool parseTimeValue(const std::string& value, long& seconds) {
+    std::string digits = value;
+    bool negative = false;
+    if (!digits.empty() && digits[0] == '-')
+    {
+        negative = true;
+        digits.erase(0, 1);
+    }
+    long unit = 1;
+    if (!digits.empty())
+    {
+        switch (digits[digits.size() - 1])
+        {
+            case 's': unit = 1; break;
+            case 'm': unit = 60; break;
+            case 'h': unit = 3600; break;
+            case 'd': unit = 86400; break;
+            case 'w': unit = 604800; break;
+            case 'M': unit = 2592000; break;
+            case 'y': unit = 31536000; break;
+            default: unit = 0;
+        }
+        if (unit)
+            digits.erase(digits.size() - 1);
+        else
+            unit = 1;
+    }
+    if (digits.empty() || digits.size() > 9 || digits.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    std::istringstream iss(digits);
+    long n = 0;
+    iss >> n;
+    if (n > 10L * 31536000L / unit)
+        return false;
+    seconds = negative ? -n * unit : n * unit;
+    return true;
+}
+
 
@@ -14,8 +14,13 @@ bool isValidHttpMethod(const std::string& method);
 bool isValidHttpStatusCode(int code);
 bool isValidIPv4(const std::string& ip);
 bool isValidHost(const std::string& host);
+bool isValidHostPort(const std::string& value); // "host:port", port required
 bool isValidCgiExt(const std::string& ext);
 bool isValidAutoindexValue(const std::string& value);
+bool isValidCacheControlDirective(const std::string& directive);
+
+// "90", "30s", "15m", "12h", "30d", "2w", "-1h" -> seconds
+bool parseTimeValue(const std::string& value, long& seconds);
 
 // Vector utility
 template<typename T>
@@ -24,7 +24,7 @@ Critical HTTP parsing test scenarios
 */
 
 HttpRequest::HttpRequest()
-	: _requestLine(), _body(), _method(), _path(), _version(), _contentLength(),_headers(), _isValid(true){
+	: _requestLine(), _body(), _method(), _path(), _query(), _version(), _contentLength(),_headers(), _isValid(true){
 }
 HttpRequest::~HttpRequest(){}
 
@@ -87,6 +87,9 @@ Methods stringToEnum(const std::string& method) {
 	if (method == "GET") return GET;
 	if (method == "POST") return POST;
 	if (method == "DELETE") return DELETE;
+	if (method == "HEAD") return HEAD;
+	if (method == "OPTIONS") return OPTIONS;
+	if (method == "PURGE") return PURGE;
 	throw std::invalid_argument("Unknown method");
 }
 void HttpRequest::parseRequestLine(){
@@ -101,6 +104,7 @@ void HttpRequest::parseRequestLine(){
 	iss >> _method;
 	iss >> _path;
 	iss >> _version;
+	parseQuery();
 
 	std::cout << "_method: " << _method << std::endl
 			<< "_path: " << _path << std::endl
@@ -111,7 +115,8 @@ void HttpRequest::parseRequestLine(){
 		_isValid = false;
 		return;
 	}
-	if (_method != "GET" && _method != "POST" && _method != "DELETE") {
+	if (_method != "GET" && _method != "POST" && _method != "DELETE" && _method != "HEAD" && _method != "OPTIONS"
+		&& _method != "PURGE") {
 		std::cout << " Error: Unknown HTTP method: " << _method << std::endl;
 		_isValid = false;
 		return;
@@ -123,6 +128,15 @@ void HttpRequest::parseRequestLine(){
 	}
 	_methodEnum = stringToEnum(_method);
 }
+// Splits "/dir/?page=2" into _path "/dir/" and _query "page=2"
+void HttpRequest::parseQuery(){
+
+	size_t question = _path.find('?');
+	if (question == std::string::npos)
+		return;
+	_query = _path.substr(question + 1);
+	_path.erase(question);
+}
 void HttpRequest::parseHeaders(){
 
 /*
@@ -197,7 +211,7 @@ void HttpRequest::setBody(std::string body) {_body = body;}
 void HttpRequest::setRawHeaders(std::string rawHeaders) {_rawHeaders = rawHeaders;}
 
 std::string HttpRequest::getRequstLine() const {return _requestLine;}
-std::string HttpRequest::getBody() const {return _body;}
+const std::string& HttpRequest::getBody() const {return _body;}
 std::string HttpRequest::getRawHeaders() const {return _rawHeaders;}
 unsigned long HttpRequest::getBodyLength() const {return _body.length();}
 
@@ -210,6 +224,7 @@ void HttpRequest::setContentLength(unsigned long contentLength){_contentLength =
 std::string HttpRequest::getMethod() const { return _method;}
 Methods HttpRequest::getMethodEnum() const {return _methodEnum;}
 std::string HttpRequest::getPath() const {return _path;}
+const std::string& HttpRequest::getQuery() const {return _query;}
 std::string HttpRequest::getVersion() const {return _version;}
 unsigned long HttpRequest::getContentLength() const {return _contentLength;}
 const std::map<std::string, std::string>& HttpRequest::getHeaders() const {return _headers;}
@@ -24,9 +24,14 @@
 enum Methods {
 	GET,
 	POST,
-	DELETE
+	DELETE,
+	HEAD,
+	OPTIONS,
+	PURGE     // drops an entry from a location's proxy_cache
 };
 
+Methods stringToEnum(const std::string& method);   // std::invalid_argument for anything else
+
 class HttpRequest{
 
 	public:
@@ -49,7 +54,7 @@ class HttpRequest{
 
 		//extract (get, set)
 		std::string getRequstLine() const;
-		std::string getBody() const;
+		const std::string& getBody() const;
 		std::string getRawHeaders() const;
 		unsigned long getContentLength() const;
 		unsigned long getBodyLength() const;
@@ -62,6 +67,7 @@ class HttpRequest{
 		//parse (get, set)
 		std::string getMethod() const;
 		std::string getPath() const;
+		const std::string& getQuery() const;
 		std::string getVersion() const;
 		std::string getContenType() const;
 		std::string getConnectionType() const;
@@ -85,12 +91,12 @@ class HttpRequest{
 		std::string		_method;
 		Methods			_methodEnum;
 		std::string		_path;
+		std::string		_query;   // after '?', without it
 		std::string		_version;
 		unsigned long	_contentLength;
 
 		//headers
 		std::map<std::string, std::string>	_headers;
-		// std::string query;
 		bool _isValid;
 };
 #endif
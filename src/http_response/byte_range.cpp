@@ -0,0 +1,181 @@
+#include "byte_range.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+static bool isSpace(char c) { return c == ' ' || c == '\t'; }
+
+static std::string trim(const std::string& s) {
+
+	size_t start = 0;
+	size_t end = s.length();
+	while (start < end && isSpace(s[start])) start++;
+	while (end > start && isSpace(s[end - 1])) end--;
+	return s.substr(start, end - start);
+}
+
+// Parses a non-empty run of digits. Rejects signs, spaces and overflow.
+static bool parseOffset(const std::string& s, off_t& out) {
+
+	if (s.empty()) return false;
+	off_t value = 0;
+	for (size_t i = 0; i < s.length(); i++) {
+		if (!std::isdigit(static_cast<unsigned char>(s[i]))) return false;
+		off_t digit = s[i] - '0';
+		if (value > (std::numeric_limits<off_t>::max() - digit) / 10) return false;
+		value = value * 10 + digit;
+	}
+	out = value;
+	return true;
+}
+
+static bool compareFirst(const ByteRange& a, const ByteRange& b) { return a.first < b.first; }
+
+// Merges overlapping or adjacent ranges. Request order is kept unless two
+// ranges overlap, in which case the list is sorted first.
+static void coalesceRanges(std::vector<ByteRange>& ranges) {
+
+	bool overlap = false;
+	for (size_t i = 0; i < ranges.size() && !overlap; i++) {
+		for (size_t j = i + 1; j < ranges.size(); j++) {
+			if (ranges[i].first <= ranges[j].last + 1 && ranges[j].first <= ranges[i].last + 1) {
+				overlap = true;
+				break;
+			}
+		}
+	}
+	if (!overlap) return;
+
+	std::sort(ranges.begin(), ranges.end(), compareFirst);
+	std::vector<ByteRange> merged;
+	merged.push_back(ranges[0]);
+	for (size_t i = 1; i < ranges.size(); i++) {
+		ByteRange& back = merged.back();
+		if (ranges[i].first <= back.last + 1)
+			back.last = std::max(back.last, ranges[i].last);
+		else
+			merged.push_back(ranges[i]);
+	}
+	ranges.swap(merged);
+}
+
+RangeStatus parseRangeHeader(const std::string& header, off_t fileSize, std::vector<ByteRange>& ranges) {
+
+	ranges.clear();
+
+	std::string value = trim(header);
+	if (value.compare(0, 6, "bytes=") != 0)
+		return RANGE_NONE;
+	value = value.substr(6);
+
+	size_t specCount = 0;
+	size_t pos = 0;
+	while (pos <= value.length()) {
+
+		size_t comma = value.find(',', pos);
+		if (comma == std::string::npos) comma = value.length();
+		std::string spec = trim(value.substr(pos, comma - pos));
+		pos = comma + 1;
+
+		// Empty list elements are allowed by the grammar ("bytes=0-1,,5-6")
+		if (spec.empty()) continue;
+		if (++specCount > MAX_BYTE_RANGES) {
+			ranges.clear();
+			return RANGE_NONE;
+		}
+
+		size_t dash = spec.find('-');
+		if (dash == std::string::npos) {
+			ranges.clear();
+			return RANGE_NONE;
+		}
+		std::string firstStr = trim(spec.substr(0, dash));
+		std::string lastStr = trim(spec.substr(dash + 1));
+		off_t first = 0;
+		off_t last = 0;
+
+		if (firstStr.empty()) {
+			// Suffix range: last N bytes
+			if (!parseOffset(lastStr, last)) {
+				ranges.clear();
+				return RANGE_NONE;
+			}
+			if (last == 0 || fileSize == 0) continue;
+			first = (last >= fileSize) ? 0 : fileSize - last;
+			last = fileSize - 1;
+		}
+		else {
+			if (!parseOffset(firstStr, first)) {
+				ranges.clear();
+				return RANGE_NONE;
+			}
+			if (lastStr.empty())
+				last = fileSize - 1;
+			else if (!parseOffset(lastStr, last) || last < first) {
+				ranges.clear();
+				return RANGE_NONE;
+			}
+			if (first >= fileSize) continue;   // unsatisfiable on its own
+			if (last >= fileSize) last = fileSize - 1;
+		}
+		ranges.push_back(ByteRange(first, last));
+	}
+
+	if (specCount == 0)
+		return RANGE_NONE;
+	if (ranges.empty())
+		return RANGE_UNSATISFIABLE;
+	coalesceRanges(ranges);
+	return RANGE_SATISFIABLE;
+}
+
+static bool isWeak(const char* etag) { return std::strncmp(etag, "W/", 2) == 0; }
+
+static const char* opaqueTag(const char* etag) { return isWeak(etag) ? etag + 2 : etag; }
+
+bool ifRangeMatches(const std::string& ifRange, const char* etag, const char* lastModified) {
+
+	std::string value = trim(ifRange);
+	if (value.empty()) return true;
+
+	// Weak validators never match for If-Range
+	if (value.compare(0, 2, "W/") == 0) return false;
+	if (value[0] == '"')
+		return etag[0] && !isWeak(etag) && value == etag;
+	return lastModified[0] && value == lastModified;
+}
+
+bool notModified(const std::map<std::string, std::string>& headers, const char* etag,
+	const char* lastModified) {
+
+	// Looked up on every GET: keys built once, not per call
+	static const std::string ifNoneMatch("if-none-match");
+	static const std::string ifModifiedSince("if-modified-since");
+
+	std::map<std::string, std::string>::const_iterator it = headers.find(ifNoneMatch);
+	if (it != headers.end()) {
+		const char* current = opaqueTag(etag);
+		const std::string& list = it->second;
+		for (size_t pos = 0; pos < list.length(); ) {
+			size_t comma = list.find(',', pos);
+			if (comma == std::string::npos)
+				comma = list.length();
+			std::string tag = trim(list.substr(pos, comma - pos));
+			if (tag == "*" || (current[0] && std::strcmp(opaqueTag(tag.c_str()), current) == 0))
+				return true;
+			pos = comma + 1;
+		}
+		return false;
+	}
+	it = headers.find(ifModifiedSince);
+	return it != headers.end() && lastModified[0] && trim(it->second) == lastModified;
+}
+
+std::string formatContentRange(const ByteRange& range, off_t fileSize) {
+
+	std::ostringstream oss;
+	oss << "bytes " << range.first << "-" << range.last << "/" << fileSize;
+	return oss.str();
+}
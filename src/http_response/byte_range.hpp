@@ -0,0 +1,58 @@
+#ifndef BYTE_RANGE_HPP
+#define BYTE_RANGE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/types.h>
+
+// Upper bound on ranges accepted in one Range header; longer lists are
+// answered with the full representation instead (RFC 9110 14.2 allows this).
+#define MAX_BYTE_RANGES 32
+
+// Inclusive byte range inside a representation of known size.
+struct ByteRange {
+	ByteRange() : first(0), last(0) {}
+	ByteRange(off_t f, off_t l) : first(f), last(l) {}
+
+	off_t	first;
+	off_t	last;
+
+	off_t	length() const { return last - first + 1; }
+};
+
+enum RangeStatus {
+	RANGE_NONE,            // no usable Range header: send 200 with the full body
+	RANGE_SATISFIABLE,     // send 206 with the ranges in the output vector
+	RANGE_UNSATISFIABLE    // send 416 with Content-Range: bytes */size
+};
+
+/*
+	Parses a "Range: bytes=..." header value against a representation of
+	fileSize bytes. Handles the three spec forms:
+		bytes=0-499      first 500 bytes
+		bytes=500-       everything from offset 500
+		bytes=-500       last 500 bytes
+	Syntactically invalid headers or unknown units yield RANGE_NONE so the
+	request falls back to a normal 200. Overlapping ranges are coalesced.
+*/
+RangeStatus	parseRangeHeader(const std::string& header, off_t fileSize, std::vector<ByteRange>& ranges);
+
+// If-Range check: true when the validator still matches the current ETag
+// (strong comparison) or Last-Modified date, i.e. the range may be honored.
+bool		ifRangeMatches(const std::string& ifRange, const char* etag, const char* lastModified);
+
+/*
+	If-None-Match / If-Modified-Since check: true when the client's copy is
+	current and a 304 answers it. If-None-Match wins when both are sent; it
+	compares weakly (a W/ prefix is ignored on either side) against a list
+	or "*". If-Modified-Since must equal Last-Modified, as nginx's default
+	"if_modified_since exact": clients send back the date they were given.
+*/
+bool		notModified(const std::map<std::string, std::string>& headers, const char* etag,
+				const char* lastModified);
+
+// "bytes first-last/size" value for a Content-Range header.
+std::string	formatContentRange(const ByteRange& range, off_t fileSize);
+
+#endif
@@ -0,0 +1,86 @@
+#include "cache_headers.hpp"
+#include "http_response.hpp"
+#include "clock.hpp"
+#include <sstream>
+
+const std::string& CacheHeaderTemplate::expiresHeader() const {
+
+	if (!fixedExpires.empty())
+		return fixedExpires;
+	time_t now = Clock::now();
+	if (expiresValue.empty() || renderedFor != now) {
+		char date[HTTP_DATE_SIZE];
+		expiresValue.assign(date, HttpResponse::formatHttpDate(now + expiresOffset, date));
+		renderedFor = now;
+	}
+	return expiresValue;
+}
+
+CacheHeaders::CacheHeaders() : _hasDefault(false), _default(), _byType() {}
+
+CacheHeaders::~CacheHeaders() {}
+
+CacheHeaderTemplate CacheHeaders::compile(const CachePolicy& policy, const CachePolicy& fallback) {
+
+	ExpiresMode mode = policy.expires_mode != EXPIRES_UNSET ? policy.expires_mode : fallback.expires_mode;
+	long seconds = policy.expires_mode != EXPIRES_UNSET ? policy.expires : fallback.expires;
+	const std::vector<std::string>& extra = !policy.cache_control.empty() ? policy.cache_control : fallback.cache_control;
+
+	CacheHeaderTemplate tmpl;
+	std::ostringstream cacheControl;
+	switch (mode) {
+		case EXPIRES_EPOCH:
+			tmpl.expires = true;
+			tmpl.fixedExpires = EXPIRES_EPOCH_DATE;
+			cacheControl << "no-cache";
+			break;
+		case EXPIRES_MAX:
+			tmpl.expires = true;
+			tmpl.fixedExpires = EXPIRES_MAX_DATE;
+			cacheControl << "max-age=" << EXPIRES_MAX_SECONDS;
+			break;
+		case EXPIRES_SECONDS:
+			tmpl.expires = true;
+			tmpl.expiresOffset = seconds;
+			if (seconds < 0)
+				cacheControl << "no-cache";
+			else
+				cacheControl << "max-age=" << seconds;
+			break;
+		default:
+			break;
+	}
+	for (size_t i = 0; i < extra.size(); i++) {
+		if (cacheControl.tellp() > 0)
+			cacheControl << ", ";
+		cacheControl << extra[i];
+	}
+	tmpl.cacheControl = cacheControl.str();
+	return tmpl;
+}
+
+void CacheHeaders::build(const CachePolicy& defaults, const std::map<std::string, CachePolicy>& byType) {
+
+	CachePolicy none;
+	_hasDefault = defaults.configured();
+	_default = compile(defaults, none);
+	_byType.clear();
+	for (std::map<std::string, CachePolicy>::const_iterator it = byType.begin(); it != byType.end(); ++it)
+		_byType[it->first] = compile(it->second, defaults);
+}
+
+const CacheHeaderTemplate* CacheHeaders::find(const std::string& contentType) const {
+
+	if (!_byType.empty()) {
+		std::map<std::string, CacheHeaderTemplate>::const_iterator it = _byType.find(contentType);
+		if (it == _byType.end()) {
+			std::string type = contentType.substr(0, contentType.find(';'));
+			it = _byType.find(type);
+			if (it == _byType.end())
+				it = _byType.find(type.substr(0, type.find('/')) + "/*");
+		}
+		if (it != _byType.end())
+			return &it->second;
+	}
+	return _hasDefault ? &_default : NULL;
+}
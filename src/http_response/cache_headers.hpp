@@ -0,0 +1,58 @@
+#ifndef CACHE_HEADERS_HPP
+#define CACHE_HEADERS_HPP
+
+#include <string>
+#include <map>
+#include <ctime>
+#include "config.hpp"
+
+// Seconds behind "expires max", and the fixed dates nginx uses for epoch/max
+#define EXPIRES_MAX_SECONDS	315360000
+#define EXPIRES_EPOCH_DATE	"Thu, 01 Jan 1970 00:00:01 GMT"
+#define EXPIRES_MAX_DATE	"Thu, 31 Dec 2037 23:55:55 GMT"
+
+/*
+	Caching headers of one policy, rendered at startup. Cache-Control never
+	changes; a relative Expires is re-rendered at most once per second from
+	the cached Clock.
+*/
+struct CacheHeaderTemplate {
+	CacheHeaderTemplate() : cacheControl(), expires(false), expiresOffset(0), fixedExpires(),
+		renderedFor(0), expiresValue() {}
+
+	std::string		cacheControl;     // Cache-Control value, empty = not sent
+	bool			expires;          // send Expires
+	long			expiresOffset;    // seconds from now (when fixedExpires is empty)
+	std::string		fixedExpires;     // epoch / max
+
+	const std::string&	expiresHeader() const;
+
+	private:
+		mutable time_t		renderedFor;
+		mutable std::string	expiresValue;
+};
+
+/*
+	expires / cache_control of one location compiled into templates: the
+	default policy plus one per configured MIME type ("text/css" or
+	"image/" wildcard). A type policy falls back to the default field by field.
+*/
+class CacheHeaders {
+
+	public:
+		CacheHeaders();
+		~CacheHeaders();
+
+		void						build(const CachePolicy& defaults, const std::map<std::string, CachePolicy>& byType);
+		// Template for a Content-Type value, NULL when nothing applies
+		const CacheHeaderTemplate*	find(const std::string& contentType) const;
+
+		static CacheHeaderTemplate	compile(const CachePolicy& policy, const CachePolicy& fallback);
+
+	private:
+		bool										_hasDefault;
+		CacheHeaderTemplate							_default;
+		std::map<std::string, CacheHeaderTemplate>	_byType;
+};
+
+#endif
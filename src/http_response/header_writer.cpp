@@ -0,0 +1,95 @@
+#include "header_writer.hpp"
+#include "http_response.hpp"
+#include <cstring>
+
+#define STATUS_CODE_MIN	100
+#define STATUS_CODE_MAX	599
+
+// "HTTP/1.1 <code> <reason>\r\n" for every code, rendered on first use
+static const std::string& statusLineFor(int statusCode) {
+
+	static std::string lines[STATUS_CODE_MAX - STATUS_CODE_MIN + 1];
+	static bool rendered = false;
+
+	if (!rendered) {
+		for (int code = STATUS_CODE_MIN; code <= STATUS_CODE_MAX; code++) {
+			char digits[ULONG_DIGITS_MAX];
+			size_t length = HeaderWriter::formatUnsigned(code, digits);
+			std::string& line = lines[code - STATUS_CODE_MIN];
+			line.append("HTTP/1.1 ");
+			line.append(digits, length);
+			line.append(" ");
+			line.append(HttpResponse::reasonPhrase(code));
+			line.append("\r\n");
+		}
+		rendered = true;
+	}
+	if (statusCode < STATUS_CODE_MIN || statusCode > STATUS_CODE_MAX)
+		statusCode = 500;
+	return lines[statusCode - STATUS_CODE_MIN];
+}
+
+HeaderWriter::HeaderWriter(std::string& out) : _out(out) {
+
+	_out.clear();
+}
+
+HeaderWriter::~HeaderWriter() {}
+
+size_t HeaderWriter::formatUnsigned(unsigned long value, char* buffer) {
+
+	char reversed[ULONG_DIGITS_MAX];
+	size_t length = 0;
+	do {
+		reversed[length++] = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value);
+	for (size_t i = 0; i < length; i++)
+		buffer[i] = reversed[length - 1 - i];
+	buffer[length] = '\0';
+	return length;
+}
+
+void HeaderWriter::statusLine(int statusCode) {
+
+	_out.append(statusLineFor(statusCode));
+}
+
+void HeaderWriter::nameSeparator(const char* name) {
+
+	_out.append(name, std::strlen(name));
+	_out.append(": ", 2);
+}
+
+void HeaderWriter::header(const char* name, const char* value) {
+
+	nameSeparator(name);
+	_out.append(value, std::strlen(value));
+	_out.append("\r\n", 2);
+}
+
+void HeaderWriter::header(const char* name, const std::string& value) {
+
+	nameSeparator(name);
+	_out.append(value);
+	_out.append("\r\n", 2);
+}
+
+void HeaderWriter::header(const char* name, unsigned long value) {
+
+	char digits[ULONG_DIGITS_MAX];
+	size_t length = formatUnsigned(value, digits);
+	nameSeparator(name);
+	_out.append(digits, length);
+	_out.append("\r\n", 2);
+}
+
+void HeaderWriter::lines(const std::string& rendered) {
+
+	_out.append(rendered);
+}
+
+void HeaderWriter::end() {
+
+	_out.append("\r\n", 2);
+}
@@ -0,0 +1,44 @@
+#ifndef HEADER_WRITER_HPP
+#define HEADER_WRITER_HPP
+
+#include <string>
+
+// Longest decimal form of an unsigned long (64-bit) plus terminator
+#define ULONG_DIGITS_MAX 21
+
+/*
+	Serializes a response head into a caller-owned buffer. The buffer is
+	cleared but keeps its capacity, so a per-connection buffer that already
+	grew to a typical header size is reused without touching the heap:
+
+		HeaderWriter writer(client.responseData);
+		writer.statusLine(200);
+		writer.header("Content-Length", fileSize);
+		writer.end();
+
+	Status lines come from a table rendered once, numbers are formatted
+	on the stack.
+*/
+class HeaderWriter {
+
+	public:
+		explicit HeaderWriter(std::string& out);
+		~HeaderWriter();
+
+		void statusLine(int statusCode);
+		void header(const char* name, const char* value);
+		void header(const char* name, const std::string& value);
+		void header(const char* name, unsigned long value);
+		void lines(const std::string& rendered);   // "Name: value\r\n" lines rendered beforehand
+		void end();
+
+		// Writes value in decimal into buffer (>= ULONG_DIGITS_MAX bytes), returns the length
+		static size_t formatUnsigned(unsigned long value, char* buffer);
+
+	private:
+		void nameSeparator(const char* name);
+
+		std::string& _out;
+};
+
+#endif
@@ -11,6 +11,10 @@
 /* ************************************************************************** */
 
 #include "http_response.hpp"
+#include "header_writer.hpp"
+#include "clock.hpp"
+#include <cstdio>
+#include <cstring>
 
 /*
 	Here's a typical HTTP response structure:
@@ -57,127 +61,179 @@
   Each line ends with \r\n (carriage return + line feed).
 */
 
-HttpResponse::HttpResponse(HttpRequest request)
-	:_request(request), _method(), _protocolVer("HTTP/1.1 "),
-	_serverName("WebServ"), _serverVersion(1.0f){}
-
-HttpResponse::~HttpResponse(){}
+HttpResponse::HttpResponse(const HttpRequest& request)
+	:_request(request), _method(), _mimeTypes(NULL), _protocolVer("HTTP/1.1 "), _filePath(NULL),
+	_cacheControl(NULL), _expires(NULL), _acceptRanges(false){
 
+	_etag[0] = '\0';
+	_lastModified[0] = '\0';
+}
 
-fileExtentions HttpResponse::extractFileExtension(std::string filePath){
+HttpResponse::~HttpResponse(){}
 
-	size_t dotPos = filePath.find_last_of('.');
-	if (dotPos == std::string::npos || dotPos == filePath.length() - 1) {
-		return UNKNOWN;
-	}
-	std::string extension = filePath.substr(dotPos + 1);
-	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
 
-	if (extension == "html" || extension == "htm") return HTML;
-	else if (extension == "pdf") return PDF;
-	else if (extension == "jpg" || extension == "jpeg") return JPEG;
-	else if (extension == "txt") return TXT;
-	else if (extension == "png") return PNG;
-	else if (extension == "js") return JS;
+// An explicit type, else the registry's type for the path (a reference into it)
+const std::string& HttpResponse::getContentType() const {
 
-	else return UNKNOWN;
+	if (!_contentType.empty())
+		return _contentType;
+	const MimeTypes& mimeTypes = _mimeTypes ? *_mimeTypes : MimeTypes::builtin();
+	return mimeTypes.typeForPath(getPath());
 }
 
-std::string HttpResponse::getContentType() {
-
-	fileExtentions extention = extractFileExtension(_filePath);
+const char* HttpResponse::getReasonPhrase() const {
 
-	switch (extention) {
-		case JPEG: return "image/jpeg";
-		case HTML: return "text/html";
-		case TXT: return "text/plain";
-		case JS: return "text/javascript";
-		case PNG: return "image/png";
-		case PDF: return "application/pdf";
-		default: return "application/octet-stream";
-	}
+	return reasonPhrase(_statusCode);
 }
 
-std::string HttpResponse::getReasonPhrase() {
+const char* HttpResponse::reasonPhrase(int statusCode) {
 
-	switch (_statusCode) {
+	switch (statusCode) {
 		// Success
 		case 200: return "OK";
 		case 204: return "No Content";
+		case 206: return "Partial Content";
 		// Redirection
 		case 301: return "Moved Permanently";
+		case 302: return "Found";
+		case 303: return "See Other";
 		case 304: return "Not Modified";
+		case 307: return "Temporary Redirect";
+		case 308: return "Permanent Redirect";
 		// Client Error
 		case 400: return "Bad Request";
 		case 403: return "Forbidden";
 		case 404: return "Not Found";
 		case 405: return "Method Not Allowed";
+		case 408: return "Request Timeout";
 		case 413: return "Payload Too Large";
 		case 414: return "URI Too Long";
+		case 415: return "Unsupported Media Type";
+		case 416: return "Range Not Satisfiable";
+		case 417: return "Expectation Failed";
 		// Server Error
 		case 500: return "Internal Server Error";
 		case 501: return "Not Implemented";
+		case 502: return "Bad Gateway";
 		case 503: return "Service Unavailable";
+		case 504: return "Gateway Timeout";
+		case 505: return "HTTP Version Not Supported";
 		default: return "Unknown";
 	}
 }
 
-std::string HttpResponse::getTimeNow() {
+const std::string& HttpResponse::connectionType() const {
+
+	static const std::string keepAlive("keep-alive");
+	const std::map<std::string, std::string>& headers = _request.getHeaders();
+	std::map<std::string, std::string>::const_iterator it = headers.find("connection");
+	return it != headers.end() ? it->second : keepAlive;
+}
+
+size_t HttpResponse::formatHttpDate(time_t time, char* buffer) {
+
+	struct tm gmtTime;
+	return strftime(buffer, HTTP_DATE_SIZE, "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&time, &gmtTime));
+}
+
+// Strong validator in nginx format: "<mtime hex>-<size hex>"
+size_t HttpResponse::formatETag(time_t mtime, off_t size, char* buffer) {
+
+	return std::sprintf(buffer, "\"%lx-%lx\"", static_cast<unsigned long>(mtime), static_cast<unsigned long>(size));
+}
 
-	time_t now = time(0);
-	struct tm* gmtTime = gmtime(&now);
-	char buffer[100];
-	strftime(buffer, 100, "%a, %d %b %Y %H:%M:%S GMT", gmtTime);
-	std::string httpTime = buffer;
-	return httpTime;
+/*
+	Status line and headers, written into out without intermediate strings:
+	the date comes from the per-iteration Clock cache, the content type is a
+	reference into the MIME registry and the per-file headers sit in fixed
+	slots, so a warm buffer is never reallocated.
+*/
+void HttpResponse::writeHead(std::string& out) const {
+
+	HeaderWriter writer(out);
+	writer.statusLine(_statusCode);
+	writer.header("Date", Clock::httpDate());
+	writer.header("Server", SERVER_SOFTWARE);
+	writer.header("Content-Type", getContentType());
+	if (_statusCode != 204 && _statusCode != 304)
+		writer.header("Content-Length", _contentLength);
+	if (_etag[0])
+		writer.header("ETag", _etag);
+	if (_lastModified[0])
+		writer.header("Last-Modified", _lastModified);
+	if (_cacheControl)
+		writer.header("Cache-Control", *_cacheControl);
+	if (_expires)
+		writer.header("Expires", *_expires);
+	if (_acceptRanges)
+		writer.header("Accept-Ranges", "bytes");
+	for (std::map<std::string, std::string>::const_iterator it = _headers.begin(); it != _headers.end(); ++it)
+		writer.header(it->first.c_str(), it->second);
+	writer.header("Connection", connectionType());
+	writer.end();
 }
 
 void HttpResponse::generatePostResponse(){
 
-	std::ostringstream oss;
-	oss << _protocolVer << _statusCode << " " << _reasonPhrase << "\r\n"
-		<< "Date: " << _date << "\r\n"
-		<< "Server: " << _serverName << _serverVersion << "\r\n"
-		<< "Content-Type: " << _contentType << "\r\n"
-		<< "Content-Length: " << _contentLength << "\r\n"
-		<< "Connection: " << _connectionType << "\r\n\r\n"
-		<< _body;
-	_response = oss.str();
+	writeHead(_response);
+	_response.append(_body);
 }
 
 void HttpResponse::generateGetResponse() {
 
-	std::ostringstream oss;
-	oss << _protocolVer << _statusCode << " " << _reasonPhrase << "\r\n"
-		<< "Date: " << _date << "\r\n"
-		<< "Server: " << _serverName << _serverVersion << "\r\n"
-		<< "Content-Type: " << _contentType << "\r\n"
-		<< "Content-Length: " << _contentLength << "\r\n"
-		<< "Connection: " << _connectionType << "\r\n\r\n"
-		<< _body;
-	_response = oss.str();
+	writeHead(_response);
+	_response.append(_body);
 }
 
 void HttpResponse::generateDeleteResponse() {
 
+	writeHead(_response);
+}
+
+std::string HttpResponse::defaultErrorBody(int statusCode) {
+
 	std::ostringstream oss;
-	oss << _protocolVer << _statusCode << " " << _reasonPhrase << "\r\n"
-		<< "Date: " << _date << "\r\n"
-		<< "Server: " << _serverName << _serverVersion << "\r\n"
-		<< "Content-Type: " << _contentType << "\r\n"
-		<< "Content-Length: " << _contentLength << "\r\n"
-		<< "Connection: " << _connectionType << "\r\n\r\n";
-	_response = oss.str();
+	oss << statusCode << " " << reasonPhrase(statusCode);
+	std::string title = oss.str();
+	return "<html>\r\n<head><title>" + title + "</title></head>\r\n<body>\r\n<center><h1>" + title
+		+ "</h1></center>\r\n<hr><center>" + SERVER_NAME + "</center>\r\n</body>\r\n</html>\r\n";
 }
 
-void generateErrorResponse() {}
+// Fallback for callers without access to the server's pre-rendered
+// error pages (see ErrorPages): built-in body, rendered per request.
+void HttpResponse::generateErrorResponse() {
+
+	_body = defaultErrorBody(_statusCode);
+	_contentType = "text/html";
+	_contentLength = _body.length();
+
+	writeHead(_response);
+	_response.append(_body);
+}
+
+/*
+	Builds the status line and headers only. Used when the body is streamed
+	from a file after the header block (sendfile), so contentLength is the
+	size of what follows rather than of _body. The out overload serializes
+	straight into a per-connection buffer (ClientInfo::responseData).
+*/
+void HttpResponse::generateHeaders(int statusCode, unsigned long contentLength) {
+
+	generateHeaders(statusCode, contentLength, _response);
+}
+
+void HttpResponse::generateHeaders(int statusCode, unsigned long contentLength, std::string& out) {
+
+	_statusCode = statusCode;
+	_contentLength = contentLength;
+	writeHead(out);
+}
 
 void HttpResponse::generateResponse(int statusCode) {
 
 	_method = _request.getMethodEnum();
 	_statusCode = statusCode;
 	_reasonPhrase = getReasonPhrase(); //change to map
-	_date = getTimeNow();
 
 	if(_statusCode >= 400){
 		generateErrorResponse();
@@ -187,7 +243,6 @@ void HttpResponse::generateResponse(int statusCode) {
 	_body = extractBody();
 	_contentType = getContentType();
 	_contentLength = getContentLength();
-	_connectionType = _request.getConnectionType();
 
 	switch (_method)
 	{
@@ -205,7 +260,7 @@ void HttpResponse::generateResponse(int statusCode) {
 	}
 }
 std::string HttpResponse::extractBody() {
-	std::ifstream file(_filePath.c_str(), std::ios::binary);
+	std::ifstream file(getPath().c_str(), std::ios::binary);
 	std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 	file.close();
 	return content;
@@ -214,17 +269,45 @@ std::string HttpResponse::extractBody() {
 
 void HttpResponse::setBody(std::string body) {_body = body;}
 void HttpResponse::setReasonPhrase(std::string reasonPhrase){_reasonPhrase = reasonPhrase;}
-void HttpResponse::setVersion(float version) {_serverVersion = version;}
 void HttpResponse::setStatusCode(int statusCode) {_statusCode = statusCode;}
-void HttpResponse::setPath(std::string path) {_filePath = path;}
+void HttpResponse::setPath(const std::string& path) {_filePath = &path;}
+void HttpResponse::setMimeTypes(const MimeTypes* mimeTypes) {_mimeTypes = mimeTypes;}
+void HttpResponse::setHeader(const std::string& key, const std::string& value) {_headers[key] = value;}
+void HttpResponse::setContentType(const std::string& contentType) {_contentType = contentType;}
+void HttpResponse::setAcceptRanges() {_acceptRanges = true;}
+
+// A weak ETag (W/ prefix) marks a representation that is not byte-identical to the file
+void HttpResponse::setETag(const char* etag, bool weak) {
+
+	_etag[0] = '\0';
+	if (weak)
+		std::strcat(_etag, "W/");
+	std::strncat(_etag, etag, ETAG_SIZE - 3);
+}
+
+void HttpResponse::setLastModified(const char* date) {
+
+	_lastModified[0] = '\0';
+	std::strncat(_lastModified, date, HTTP_DATE_SIZE - 1);
+}
+
+// Both point into the location's CacheHeaderTemplate, which outlives the response
+void HttpResponse::setCacheHeaders(const std::string* cacheControl, const std::string* expires) {
+
+	_cacheControl = cacheControl;
+	_expires = expires;
+}
 
 
 unsigned long HttpResponse::getContentLength() const {return _body.length();}
-std::string HttpResponse::getBody() const {return _body;}
-std::string HttpResponse::getPath()const {return _filePath;}
-float HttpResponse::getVersion() const {return _serverVersion;}
+const std::string& HttpResponse::getBody() const {return _body;}
+const std::string& HttpResponse::getPath()const {
+
+	static const std::string none;
+	return _filePath ? *_filePath : none;
+}
 int HttpResponse::getStatusCode() const {return _statusCode;}
-std::string HttpResponse::getResponse() const {return _response;}
+const std::string& HttpResponse::getResponse() const {return _response;}
 
 /*
   HTTP/1.1 200 OK
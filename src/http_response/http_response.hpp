@@ -19,39 +19,53 @@
 #include <string>
 #include <map>
 #include <algorithm>
+#include <ctime>
+#include <sys/types.h>
 #include "http_request.hpp"
+#include "mime_types.hpp"
 
-enum fileExtentions{
-	HTML,
-	PDF,
-	JPEG,
-	TXT,
-	PNG,
-	JS,
-	UNKNOWN
-};
+#define SERVER_NAME		"WebServ"
+#define SERVER_VERSION	"1.0"
+// The one Server header value every response path sends
+#define SERVER_SOFTWARE	SERVER_NAME "/" SERVER_VERSION
+
+#define HTTP_DATE_SIZE	30   // "Sun, 06 Nov 1994 08:49:37 GMT" plus terminator
+#define ETAG_SIZE		40   // W/"<mtime hex>-<size hex>" plus terminator
 
 class HttpResponse {
 
 	public:
-		HttpResponse(HttpRequest request);
+		HttpResponse(const HttpRequest& request);
 		~HttpResponse();
 
 		void generateResponse(int statusCode);
+		void generateHeaders(int statusCode, unsigned long contentLength);
+		void generateHeaders(int statusCode, unsigned long contentLength, std::string& out);
 
 		void setBody(std::string body);
 		void setReasonPhrase(std::string reasonPhrase);
-		void setVersion(float version);
 		void setStatusCode(int code);
-		void setHeader(std::string header);
-		void setPath(std::string path);
-
-		std::string		getBody() const;
-		std::string		getPath() const;
-		float			getVersion() const;
+		void setHeader(const std::string& key, const std::string& value);
+		void setContentType(const std::string& contentType);
+		void setPath(const std::string& path);
+		void setMimeTypes(const MimeTypes* mimeTypes);
+		void setETag(const char* etag, bool weak);
+		void setLastModified(const char* date);
+		void setCacheHeaders(const std::string* cacheControl, const std::string* expires);
+		void setAcceptRanges();
+
+		const std::string&	getBody() const;
+		const std::string&	getPath() const;
 		int				getStatusCode() const;
 		unsigned long	getContentLength() const;
-		std::string		getResponse() const;
+		const std::string&	getResponse() const;
+		const std::string&	getContentType() const;
+
+		static const char*	reasonPhrase(int statusCode);
+		static std::string	defaultErrorBody(int statusCode);
+		// Both write into a caller buffer (HTTP_DATE_SIZE / ETAG_SIZE) and return the length
+		static size_t		formatHttpDate(time_t time, char* buffer);
+		static size_t		formatETag(time_t mtime, off_t size, char* buffer);
 
 
 	private:
@@ -59,15 +73,16 @@ class HttpResponse {
 		void generateGetResponse();
 		void generatePostResponse();
 		void generateDeleteResponse();
+		void generateErrorResponse();
+		void writeHead(std::string& out) const;
 
 		std::string extractBody();
-		std::string	getTimeNow();
-		fileExtentions	extractFileExtension(std::string filePath);
-		std::string	getReasonPhrase();
-		std::string	getContentType();
+		const std::string&	connectionType() const;
+		const char*	getReasonPhrase() const;
 
-		HttpRequest _request;
+		const HttpRequest& _request;
 		Methods		_method;
+		const MimeTypes*	_mimeTypes;   // server registry, NULL = built-in table
 
 		//status line
 		std::string		_protocolVer;
@@ -75,15 +90,19 @@ class HttpResponse {
 		std::string		_reasonPhrase;
 
 		//headers
-		std::string		_date;
-		std::string		_serverName;
-		float			_serverVersion;
-		std::string		_filePath;
+		const std::string*	_filePath;    // not copied: the handler's path outlives the response
 		std::string		_contentType;
 		unsigned long	_contentLength;
-		std:: string	_connectionType;
 		std::map<std::string, std::string> _headers;
 
+		// Headers every file response carries, in fixed slots instead of _headers
+		// so a plain GET head is built without touching the heap
+		char			_etag[ETAG_SIZE];              // "" = not sent
+		char			_lastModified[HTTP_DATE_SIZE];
+		const std::string*	_cacheControl;   // location templates (CacheHeaders), NULL = not sent
+		const std::string*	_expires;
+		bool			_acceptRanges;
+
 		//body
 		std::string	_body;
 
@@ -0,0 +1,81 @@
+#include "static_response.hpp"
+#include "http_response.hpp"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+// Codes the server produces itself; each gets a built-in page if unconfigured
+static const int BUILTIN_ERROR_CODES[] = {
+	400, 403, 404, 405, 408, 413, 414, 415, 417, 500, 501, 502, 503, 504, 505
+};
+static const size_t BUILTIN_ERROR_CODES_COUNT = sizeof(BUILTIN_ERROR_CODES) / sizeof(BUILTIN_ERROR_CODES[0]);
+
+StaticResponse renderStaticResponse(int statusCode, const std::string& extraHeaders,
+	const std::string& contentType, const std::string& body) {
+
+	std::ostringstream oss;
+	oss << "HTTP/1.1 " << statusCode << " " << HttpResponse::reasonPhrase(statusCode) << "\r\n"
+		<< "Server: " << SERVER_SOFTWARE << "\r\n";
+	if (!contentType.empty())
+		oss << "Content-Type: " << contentType << "\r\n";
+	// 204 and 304 responses must not carry a Content-Length
+	if (statusCode != 204 && statusCode != 304)
+		oss << "Content-Length: " << body.length() << "\r\n";
+	oss << extraHeaders;
+
+	StaticResponse response;
+	response.statusCode = statusCode;
+	response.head = oss.str();
+	response.body = body;
+	return response;
+}
+
+RedirectResponse renderRedirectResponse(int statusCode, const std::string& target) {
+
+	RedirectResponse redirect;
+	size_t variable = target.find(REQUEST_URI_VARIABLE);
+	std::string body = HttpResponse::defaultErrorBody(statusCode);
+
+	if (variable == std::string::npos) {
+		redirect.rendered = renderStaticResponse(statusCode, "Location: " + target + "\r\n", "text/html", body);
+		return redirect;
+	}
+	redirect.dynamic = true;
+	redirect.before = target.substr(0, variable);
+	redirect.after = target.substr(variable + std::string(REQUEST_URI_VARIABLE).length());
+	redirect.rendered.statusCode = statusCode;
+	redirect.rendered.body = body;
+	return redirect;
+}
+
+ErrorPages::ErrorPages() : _responses() {}
+
+ErrorPages::~ErrorPages() {}
+
+void ErrorPages::build(const std::map<int, std::string>& configured) {
+
+	_responses.clear();
+
+	for (std::map<int, std::string>::const_iterator it = configured.begin(); it != configured.end(); ++it) {
+		std::ifstream file(it->second.c_str(), std::ios::binary);
+		if (!file.is_open()) {
+			std::cerr << "[ERROR] Cannot read error_page " << it->first << ": " << it->second
+					  << ", using built-in page" << std::endl;
+			continue;
+		}
+		std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		_responses[it->first] = renderStaticResponse(it->first, "", "text/html", content);
+	}
+
+	for (size_t i = 0; i < BUILTIN_ERROR_CODES_COUNT; i++) {
+		int code = BUILTIN_ERROR_CODES[i];
+		if (_responses.find(code) == _responses.end())
+			_responses[code] = renderStaticResponse(code, "", "text/html", HttpResponse::defaultErrorBody(code));
+	}
+}
+
+const StaticResponse* ErrorPages::find(int statusCode) const {
+
+	std::map<int, StaticResponse>::const_iterator it = _responses.find(statusCode);
+	return it != _responses.end() ? &it->second : NULL;
+}
@@ -0,0 +1,64 @@
+#ifndef STATIC_RESPONSE_HPP
+#define STATIC_RESPONSE_HPP
+
+#include <string>
+#include <map>
+
+/*
+	Immutable response rendered once at startup. Only the Date and
+	Connection lines differ between requests; they are written between
+	head and body at send time (see Server::sendStaticResponse), so
+	serving one costs a pointer assignment and no disk I/O.
+
+	head: status line + fixed headers, each ending in CRLF, no blank line
+	body: complete payload (Content-Length already in head)
+*/
+struct StaticResponse {
+	StaticResponse() : statusCode(0), head(), body() {}
+
+	int			statusCode;
+	std::string	head;
+	std::string	body;
+};
+
+StaticResponse	renderStaticResponse(int statusCode, const std::string& extraHeaders,
+					const std::string& contentType, const std::string& body);
+
+/*
+	3xx response of a location with a redirect directive. A target without
+	$request_uri is rendered completely at startup; with it, only the two
+	literal halves around the variable are kept and the Location header is
+	assembled per request.
+*/
+struct RedirectResponse {
+	RedirectResponse() : dynamic(false), rendered(), before(), after() {}
+
+	bool			dynamic;
+	StaticResponse	rendered;   // complete response (body too when dynamic)
+	std::string		before;     // target text before $request_uri
+	std::string		after;      // target text after $request_uri
+};
+
+#define REQUEST_URI_VARIABLE "$request_uri"
+
+RedirectResponse	renderRedirectResponse(int statusCode, const std::string& target);
+
+/*
+	Error responses of one location (or of the server itself): every
+	error_page from the config plus built-in pages for the other codes
+	the server can emit.
+*/
+class ErrorPages {
+
+	public:
+		ErrorPages();
+		~ErrorPages();
+
+		void					build(const std::map<int, std::string>& configured);
+		const StaticResponse*	find(int statusCode) const;
+
+	private:
+		std::map<int, StaticResponse>	_responses;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #include "logger.hpp"
 #include "../exceptions/config_exceptions.hpp"
 #include "../helpers/helpers.hpp"
+#include "../clock/clock.hpp"
 #include <unistd.h>
 //Instructions: Implement a simple logging system that writes access and error logs to specified files.
 //usage:
@@ -27,12 +28,9 @@ Logger::Logger(const std::string& accessPath, const std::string& errorPath)
       _errorLog(errorPath.c_str(), std::ios::app) {}
 
 
-// Get current timestamp in YYYY-MM-DD HH:MM:SS format
-std::string Logger::getTimestamp() const {
-    time_t now = time(0);
-    char buf[32];
-    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    return buf;
+// Current timestamp in YYYY-MM-DD HH:MM:SS format, cached per second by Clock
+const std::string& Logger::getTimestamp() const {
+    return Clock::logDate();
 }
 
 // Log an access entry. Format: [timestamp] clientIp "METHOD URL" status size
@@ -15,7 +15,7 @@ public:
 private:
     std::ofstream _accessLog;
     std::ofstream _errorLog;
-    std::string getTimestamp() const;
+    const std::string& getTimestamp() const;
 };
 
 bool assignLogFile(std::string& logField, const std::string& path);
@@ -0,0 +1,235 @@
+#include "mime_types.hpp"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#define MIME_TABLE_MIN_CAPACITY 64
+
+// Built-in table; a types_file or types {} block adds to / overrides it
+static const char* BUILTIN_MIME_TYPES[][2] = {
+	{"text/html", "html"}, {"text/html", "htm"}, {"text/html", "shtml"},
+	{"text/css", "css"},
+	{"text/xml", "xml"},
+	{"text/plain", "txt"},
+	{"text/csv", "csv"},
+	{"text/markdown", "md"},
+	{"text/javascript", "js"}, {"text/javascript", "mjs"},
+	{"application/json", "json"},
+	{"application/manifest+json", "webmanifest"},
+	{"application/wasm", "wasm"},
+	{"application/pdf", "pdf"},
+	{"application/zip", "zip"},
+	{"application/gzip", "gz"},
+	{"application/x-tar", "tar"},
+	{"application/rtf", "rtf"},
+	{"application/rss+xml", "rss"},
+	{"application/atom+xml", "atom"},
+	{"application/xhtml+xml", "xhtml"},
+	{"application/msword", "doc"},
+	{"application/vnd.ms-excel", "xls"},
+	{"application/vnd.openxmlformats-officedocument.wordprocessingml.document", "docx"},
+	{"application/vnd.openxmlformats-officedocument.spreadsheetml.sheet", "xlsx"},
+	{"application/octet-stream", "bin"}, {"application/octet-stream", "exe"},
+	{"application/octet-stream", "dll"}, {"application/octet-stream", "iso"},
+	{"image/gif", "gif"},
+	{"image/jpeg", "jpg"}, {"image/jpeg", "jpeg"},
+	{"image/png", "png"},
+	{"image/webp", "webp"},
+	{"image/avif", "avif"},
+	{"image/svg+xml", "svg"}, {"image/svg+xml", "svgz"},
+	{"image/x-icon", "ico"},
+	{"image/bmp", "bmp"},
+	{"image/tiff", "tif"}, {"image/tiff", "tiff"},
+	{"font/woff", "woff"},
+	{"font/woff2", "woff2"},
+	{"font/ttf", "ttf"},
+	{"font/otf", "otf"},
+	{"audio/mpeg", "mp3"},
+	{"audio/ogg", "ogg"},
+	{"audio/wav", "wav"},
+	{"audio/webm", "weba"},
+	{"video/mp4", "mp4"},
+	{"video/webm", "webm"},
+	{"video/mpeg", "mpeg"}, {"video/mpeg", "mpg"},
+	{"video/quicktime", "mov"},
+	{"video/x-msvideo", "avi"}
+};
+static const size_t BUILTIN_MIME_TYPES_COUNT = sizeof(BUILTIN_MIME_TYPES) / sizeof(BUILTIN_MIME_TYPES[0]);
+
+static char toLower(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c; }
+
+static std::string lowercase(const std::string& s) {
+
+	std::string result(s);
+	for (size_t i = 0; i < result.length(); i++)
+		result[i] = toLower(result[i]);
+	return result;
+}
+
+MimeTypes::MimeTypes() : _byExtension(), _byType() {}
+
+MimeTypes::~MimeTypes() {}
+
+const MimeTypes& MimeTypes::builtin() {
+
+	static MimeTypes types;
+	if (types.size() == 0)
+		types.addDefaults();
+	return types;
+}
+
+// FNV-1a over the lowercased key
+size_t MimeTypes::hash(const char* key, size_t length) {
+
+	unsigned long h = 2166136261ul;
+	for (size_t i = 0; i < length; i++) {
+		h ^= static_cast<unsigned char>(toLower(key[i]));
+		h *= 16777619ul;
+	}
+	return static_cast<size_t>(h);
+}
+
+// Stored keys are lowercase already
+bool MimeTypes::equals(const std::string& key, const char* other, size_t length) {
+
+	if (key.length() != length)
+		return false;
+	for (size_t i = 0; i < length; i++)
+		if (key[i] != toLower(other[i]))
+			return false;
+	return true;
+}
+
+// Returns entry index + 1, or 0 when absent
+size_t MimeTypes::find(const Table& table, const char* key, size_t length) {
+
+	if (table.slots.empty())
+		return 0;
+	size_t mask = table.slots.size() - 1;
+	for (size_t i = hash(key, length) & mask; table.slots[i]; i = (i + 1) & mask) {
+		if (equals(table.entries[table.slots[i] - 1].key, key, length))
+			return table.slots[i];
+	}
+	return 0;
+}
+
+void MimeTypes::rehash(Table& table, size_t capacity) {
+
+	table.slots.assign(capacity, 0);
+	size_t mask = capacity - 1;
+	for (size_t e = 0; e < table.entries.size(); e++) {
+		const std::string& key = table.entries[e].key;
+		size_t i = hash(key.data(), key.length()) & mask;
+		while (table.slots[i])
+			i = (i + 1) & mask;
+		table.slots[i] = e + 1;
+	}
+}
+
+void MimeTypes::insert(Table& table, const std::string& key, const std::string& value, bool replace) {
+
+	size_t found = find(table, key.data(), key.length());
+	if (found) {
+		if (replace)
+			table.entries[found - 1].value = value;
+		return;
+	}
+	Entry entry;
+	entry.key = key;
+	entry.value = value;
+	table.entries.push_back(entry);
+
+	size_t capacity = table.slots.empty() ? MIME_TABLE_MIN_CAPACITY : table.slots.size();
+	while (capacity < table.entries.size() * 2)
+		capacity *= 2;
+	if (capacity != table.slots.size()) {
+		rehash(table, capacity);
+		return;
+	}
+	size_t mask = capacity - 1;
+	size_t i = hash(key.data(), key.length()) & mask;
+	while (table.slots[i])
+		i = (i + 1) & mask;
+	table.slots[i] = table.entries.size();
+}
+
+void MimeTypes::add(const std::string& type, const std::string& extension) {
+
+	if (type.empty() || extension.empty())
+		return;
+	std::string lowerType = lowercase(type);
+	std::string lowerExtension = lowercase(extension);
+	insert(_byExtension, lowerExtension, lowerType, true);
+	insert(_byType, lowerType, lowerExtension, false);
+}
+
+void MimeTypes::addDefaults() {
+
+	for (size_t i = 0; i < BUILTIN_MIME_TYPES_COUNT; i++)
+		add(BUILTIN_MIME_TYPES[i][0], BUILTIN_MIME_TYPES[i][1]);
+}
+
+bool MimeTypes::loadFile(const std::string& path) {
+
+	std::ifstream file(path.c_str());
+	if (!file.is_open()) {
+		std::cerr << "[ERROR] Cannot open mime types file: " << path << std::endl;
+		return false;
+	}
+	std::string line;
+	while (std::getline(file, line)) {
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		for (size_t i = 0; i < line.length(); i++) {
+			if (line[i] == ';' || line[i] == '{' || line[i] == '}')
+				line[i] = ' ';
+		}
+		std::istringstream iss(line);
+		std::string type;
+		if (!(iss >> type) || type == "types" || type.find('/') == std::string::npos)
+			continue;
+		std::string extension;
+		while (iss >> extension)
+			add(type, extension);
+	}
+	return true;
+}
+
+const std::string* MimeTypes::typeForExtension(const char* extension, size_t length) const {
+
+	size_t found = find(_byExtension, extension, length);
+	return found ? &_byExtension.entries[found - 1].value : NULL;
+}
+
+const std::string& MimeTypes::typeForPath(const std::string& path) const {
+
+	static const std::string defaultType(DEFAULT_MIME_TYPE);
+
+	size_t dot = path.find_last_of("./");
+	if (dot == std::string::npos || path[dot] != '.' || dot == path.length() - 1)
+		return defaultType;
+	const std::string* type = typeForExtension(path.data() + dot + 1, path.length() - dot - 1);
+	return type ? *type : defaultType;
+}
+
+// Accepts a full Content-Type value; parameters (";charset=...") are ignored
+const std::string* MimeTypes::extensionForType(const std::string& contentType) const {
+
+	size_t start = 0;
+	size_t end = contentType.find(';');
+	if (end == std::string::npos)
+		end = contentType.length();
+	while (start < end && (contentType[start] == ' ' || contentType[start] == '\t'))
+		start++;
+	while (end > start && (contentType[end - 1] == ' ' || contentType[end - 1] == '\t'))
+		end--;
+
+	size_t found = find(_byType, contentType.data() + start, end - start);
+	return found ? &_byType.entries[found - 1].value : NULL;
+}
+
+size_t MimeTypes::size() const {
+
+	return _byExtension.entries.size();
+}
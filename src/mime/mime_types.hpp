@@ -0,0 +1,64 @@
+#ifndef MIME_TYPES_HPP
+#define MIME_TYPES_HPP
+
+#include <string>
+#include <vector>
+
+#define DEFAULT_MIME_TYPE "application/octet-stream"
+
+/*
+	Extension <-> MIME type registry, built once per server at startup from
+	the built-in table, an optional mime.types file (types_file) and the
+	types {} block of the config. Both directions are open-addressing hash
+	tables (linear probing, load <= 1/2) keyed case-insensitively, so a
+	lookup is O(1) and never allocates:
+
+		typeForPath("/img/Logo.SVG")              -> "image/svg+xml"
+		extensionForType("image/png; q=1")        -> "png"
+
+	When an extension is listed twice the later entry wins; the extension
+	reported for a type is the first one listed for it (as in mime.types).
+*/
+class MimeTypes {
+
+	public:
+		MimeTypes();
+		~MimeTypes();
+
+		void	add(const std::string& type, const std::string& extension);
+		void	addDefaults();
+
+		// nginx ("types { text/html html htm; }") or Apache ("text/html html htm") syntax
+		bool	loadFile(const std::string& path);
+
+		const std::string*	typeForExtension(const char* extension, size_t length) const;
+		const std::string&	typeForPath(const std::string& path) const;
+		const std::string*	extensionForType(const std::string& contentType) const;
+		size_t				size() const;
+
+		// Registry with only the built-in table, for callers without a server
+		static const MimeTypes&	builtin();
+
+	private:
+		struct Entry {
+			std::string	key;
+			std::string	value;
+		};
+
+		// One direction: entries plus slots holding entry index + 1 (0 = empty)
+		struct Table {
+			std::vector<Entry>	entries;
+			std::vector<size_t>	slots;
+		};
+
+		static size_t	hash(const char* key, size_t length);
+		static bool		equals(const std::string& key, const char* other, size_t length);
+		static size_t	find(const Table& table, const char* key, size_t length);
+		static void		insert(Table& table, const std::string& key, const std::string& value, bool replace);
+		static void		rehash(Table& table, size_t capacity);
+
+		Table	_byExtension;
+		Table	_byType;
+};
+
+#endif
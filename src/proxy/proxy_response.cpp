@@ -0,0 +1,215 @@
+#include "proxy_response.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+ProxyResponse::ProxyResponse(bool headRequest)
+	: _headRequest(headRequest), _state(STATUS_LINE), _pending(), _headers(), _headerBytes(0), _status(0),
+	_http11(false), _keepAlive(false), _chunked(false), _contentLength(-1), _left(0), _started(false) {}
+
+bool ProxyResponse::started() const { return _started; }
+
+bool ProxyResponse::complete() const { return _state == DONE; }
+
+bool ProxyResponse::reusable() const { return _state == DONE && _keepAlive; }
+
+void ProxyResponse::closed() {
+
+	_keepAlive = false;
+	if (_state == UNTIL_CLOSE)
+		_state = DONE;
+}
+
+unsigned long ProxyResponse::rawBodyLeft() const {
+
+	if (_state == UNTIL_CLOSE)
+		return ~0UL;
+	return (_state == BODY) ? _left : 0;
+}
+
+void ProxyResponse::rawBodyMoved(size_t length) {
+
+	if (_state != BODY)
+		return;
+	_left -= std::min(static_cast<unsigned long>(length), _left);
+	if (_left == 0)
+		_state = DONE;
+}
+
+// One line off _pending, without its line ending; false while it is incomplete
+bool ProxyResponse::takeLine(std::string& line) {
+
+	size_t end = _pending.find('\n');
+	if (end == std::string::npos)
+		return false;
+	line.assign(_pending, 0, end);
+	_pending.erase(0, end + 1);
+	if (!line.empty() && line[line.size() - 1] == '\r')
+		line.erase(line.size() - 1);
+	return true;
+}
+
+bool ProxyResponse::feed(const char* data, size_t length, std::string& out) {
+
+	if (length > 0)
+		_started = true;
+	size_t pos = 0;
+	while (pos < length) {
+		if (_state == BODY || _state == CHUNK_DATA || _state == UNTIL_CLOSE) {
+			size_t take = length - pos;
+			if (_state != UNTIL_CLOSE)
+				take = std::min(take, static_cast<size_t>(_left));
+			out.append(data + pos, take);
+			pos += take;
+			if (_state == UNTIL_CLOSE)
+				continue;
+			_left -= take;
+			if (_left == 0)
+				_state = (_state == BODY) ? DONE : CHUNK_END;
+			continue;
+		}
+		if (_state == DONE) {
+			_keepAlive = false;   // bytes past the response: the connection is out of step
+			return true;
+		}
+
+		// Line-based states: complete lines only, and bounded while incomplete
+		const char* newline = static_cast<const char*>(std::memchr(data + pos, '\n', length - pos));
+		size_t end = newline ? static_cast<size_t>(newline - data) + 1 : length;
+		_pending.append(data + pos, end - pos);
+		pos = end;
+		std::string line;
+		if (!takeLine(line)) {
+			if (_pending.size() > PROXY_HEADERS_MAX)
+				return false;
+			continue;
+		}
+		switch (_state) {
+			case STATUS_LINE:
+				if (!parseStatusLine(line))
+					return false;
+				break;
+			case HEADERS:
+				_headerBytes += line.size() + 2;
+				if (_headerBytes > PROXY_HEADERS_MAX)
+					return false;
+				if (line.empty() ? !endHeaders(out) : !parseHeader(line))
+					return false;
+				break;
+			case CHUNK_SIZE: {
+				std::string size = line.substr(0, line.find(';'));
+				size.erase(size.find_last_not_of(" \t") + 1);
+				char* rest = NULL;
+				unsigned long chunk = std::strtoul(size.c_str(), &rest, 16);
+				if (size.empty() || *rest != '\0' || size.size() > 15)
+					return false;
+				_left = chunk;
+				_state = chunk ? CHUNK_DATA : TRAILERS;
+				break;
+			}
+			case CHUNK_END:
+				if (!line.empty())
+					return false;
+				_state = CHUNK_SIZE;
+				break;
+			case TRAILERS:
+				if (line.empty())
+					_state = DONE;
+				break;
+			default:
+				break;
+		}
+	}
+	return true;
+}
+
+bool ProxyResponse::parseStatusLine(const std::string& line) {
+
+	if (line.compare(0, 7, "HTTP/1.") != 0 || line.size() < 12 || line[8] != ' ')
+		return false;
+	char* rest = NULL;
+	long status = std::strtol(line.c_str() + 9, &rest, 10);
+	if (rest != line.c_str() + 12 || (*rest != '\0' && *rest != ' ') || status < 100 || status > 599)
+		return false;
+	_status = static_cast<int>(status);
+	_http11 = (line[7] == '1');
+	_keepAlive = _http11;
+	_chunked = false;
+	_contentLength = -1;
+	_headers.clear();
+	_headerBytes = line.size() + 2;
+	_state = HEADERS;
+	return true;
+}
+
+/*
+	Hop-by-hop headers stop here; so do Date and Server, which the relay
+	writes itself. Content-Length is kept aside: it only counts when the
+	body is not chunked.
+*/
+bool ProxyResponse::parseHeader(const std::string& line) {
+
+	size_t colon = line.find(':');
+	if (colon == std::string::npos || colon == 0 || line[0] == ' ' || line[0] == '\t')
+		return false;
+	std::string name = line.substr(0, colon);
+	size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+	std::string value = (valueStart == std::string::npos) ? "" : line.substr(valueStart);
+	value.erase(value.find_last_not_of(" \t") + 1);
+	std::string lower = name;
+	std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+	std::string lowerValue = value;
+	std::transform(lowerValue.begin(), lowerValue.end(), lowerValue.begin(), ::tolower);
+
+	if (lower == "content-length") {
+		char* rest = NULL;
+		long contentLength = std::strtol(value.c_str(), &rest, 10);
+		if (value.empty() || *rest != '\0' || contentLength < 0
+			|| (_contentLength >= 0 && contentLength != _contentLength))
+			return false;
+		_contentLength = contentLength;
+	}
+	else if (lower == "transfer-encoding")
+		_chunked = lowerValue.size() >= 7 && lowerValue.compare(lowerValue.size() - 7, 7, "chunked") == 0;
+	else if (lower == "connection") {
+		if (lowerValue.find("close") != std::string::npos)
+			_keepAlive = false;
+		else if (lowerValue.find("keep-alive") != std::string::npos)
+			_keepAlive = true;
+	}
+	else if (lower != "keep-alive" && lower != "proxy-connection" && lower != "te" && lower != "trailer"
+		&& lower != "upgrade" && lower != "date" && lower != "server" && lower != "status")
+		_headers += name + ": " + value + "\r\n";
+	return true;
+}
+
+bool ProxyResponse::endHeaders(std::string& out) {
+
+	if (_status == 101)
+		return false;   // no protocol switches through the proxy
+	if (_status < 200) {
+		_state = STATUS_LINE;   // interim response: the real one follows
+		return true;
+	}
+	std::ostringstream head;
+	head << "Status: " << _status << "\r\n";
+	if (_contentLength >= 0 && !_chunked)
+		head << "Content-Length: " << _contentLength << "\r\n";
+	out += head.str() + _headers + "\r\n";
+	_headers.clear();
+
+	if (_headRequest || _status == 204 || _status == 304)
+		_state = DONE;
+	else if (_chunked)
+		_state = CHUNK_SIZE;
+	else if (_contentLength >= 0) {
+		_left = static_cast<unsigned long>(_contentLength);
+		_state = _left ? BODY : DONE;
+	}
+	else {
+		_keepAlive = false;
+		_state = UNTIL_CLOSE;
+	}
+	return true;
+}
@@ -0,0 +1,55 @@
+#ifndef PROXY_RESPONSE_HPP
+#define PROXY_RESPONSE_HPP
+
+#include <string>
+
+#define PROXY_HEADERS_MAX	8192   // upstream status line and headers, malformed beyond it
+
+/*
+	Reads an upstream's HTTP/1.x response as it arrives and turns it into
+	what the CGI relay takes: a "Status:" header block with the end-to-end
+	headers, then the body with its chunked framing removed. Interim 1xx
+	responses are skipped. The relay frames the body again for the client.
+*/
+class ProxyResponse {
+
+	public:
+		explicit ProxyResponse(bool headRequest);
+
+		// Upstream bytes in, relay input appended to out; false = not a valid response
+		bool	feed(const char* data, size_t length, std::string& out);
+		// The upstream closed its end: ends a body delimited by the close
+		void	closed();
+
+		// Body bytes that go to the relay as they are from here: the rest of a
+		// Content-Length body, ~0 for one delimited by the close, 0 otherwise
+		unsigned long	rawBodyLeft() const;
+		void			rawBodyMoved(size_t length);   // that many went on without feed()
+
+		bool	started() const;    // any byte received
+		bool	complete() const;
+		bool	reusable() const;   // the connection can carry another request once complete
+
+	private:
+		enum State { STATUS_LINE, HEADERS, BODY, CHUNK_SIZE, CHUNK_DATA, CHUNK_END, TRAILERS, UNTIL_CLOSE, DONE };
+
+		bool	parseStatusLine(const std::string& line);
+		bool	parseHeader(const std::string& line);
+		bool	endHeaders(std::string& out);
+		bool	takeLine(std::string& line);
+
+		bool			_headRequest;
+		State			_state;
+		std::string		_pending;      // bytes of an incomplete line
+		std::string		_headers;      // relay header block being built
+		size_t			_headerBytes;
+		int				_status;
+		bool			_http11;
+		bool			_keepAlive;
+		bool			_chunked;
+		long			_contentLength;   // -1 = none
+		unsigned long	_left;            // of the body or the current chunk
+		bool			_started;
+};
+
+#endif
@@ -0,0 +1,696 @@
+#include "proxy_upstream.hpp"
+#include "cgi_process.hpp"
+#include "clock.hpp"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+#define PROXY_READ_SIZE	32768
+
+ProxyRequest::ProxyRequest(ProxyUpstream& upstream, const std::string& head, const std::string& hashKey,
+	bool headRequest, int owner, unsigned long timeoutMs)
+	: CgiBackend(), _upstream(upstream), _connection(NULL), _owner(owner), _head(head), _hashKey(hashKey),
+	_input(), _replay(), _replayable(true), _inputEnded(false), _response(headRequest), _output(), _outputRead(0),
+	_splicing(false), _pipeSize(0), _piped(0), _ended(false), _failed(false), _tried(upstream.serverCount(), false),
+	_server(), _timeout(timeoutMs), _lastActivity(Clock::monotonicMs()) {
+
+	_pipe[0] = -1;
+	_pipe[1] = -1;
+	_upstream.dispatch(this);
+}
+
+ProxyRequest::~ProxyRequest() {
+
+	_upstream.release(this);
+	if (_pipe[0] >= 0) {
+		close(_pipe[0]);
+		close(_pipe[1]);
+	}
+}
+
+int ProxyRequest::owner() const { return _owner; }
+
+void ProxyRequest::queueInput(const char* data, size_t length) {
+
+	if (!_ended)
+		_input.append(data, length);
+}
+
+size_t ProxyRequest::inputPending() const { return _input.size(); }
+
+void ProxyRequest::endInput() { _inputEnded = true; }
+
+void ProxyRequest::writeInput() {
+
+	if (_connection)
+		_upstream.pump(*_connection);
+}
+
+size_t ProxyRequest::outputHeld() const { return _output.size() - _outputRead; }
+
+bool ProxyRequest::outputFull() const {
+
+	return outputHeld() >= CGI_BUFFER_MAX || (_pipe[0] >= 0 && _piped >= _pipeSize);
+}
+
+ssize_t ProxyRequest::readOutput(char* buffer, size_t size) {
+
+	size_t held = outputHeld();
+	if (held == 0 && _piped > 0) {
+		// Splicing given up on: what is in the pipe is read back
+		ssize_t bytes = read(_pipe[0], buffer, std::min(size, _piped));
+		if (bytes > 0) {
+			_piped -= bytes;
+			_lastActivity = Clock::monotonicMs();
+		}
+		return bytes;
+	}
+	if (held == 0) {
+		if (_ended)
+			return 0;
+		errno = EAGAIN;
+		return -1;
+	}
+	size_t length = std::min(held, size);
+	std::memcpy(buffer, _output.data() + _outputRead, length);
+	_outputRead += length;
+	if (_outputRead == _output.size()) {
+		_output.clear();
+		_outputRead = 0;
+	}
+	_lastActivity = Clock::monotonicMs();
+	return static_cast<ssize_t>(length);
+}
+
+bool ProxyRequest::outputClosed() const { return _ended && outputHeld() == 0 && _piped == 0; }
+
+bool ProxyRequest::failed() const { return _failed; }
+
+// Time without progress, not the whole exchange: long downloads keep going
+bool ProxyRequest::expired(unsigned long nowMs) const { return !_ended && nowMs - _lastActivity > _timeout; }
+
+// Nothing to kill: the connection is closed when the request is deleted
+void ProxyRequest::terminate() {}
+
+#ifdef __linux__
+bool ProxyRequest::startSplice() {
+
+	if (_ended || _response.rawBodyLeft() == 0)
+		return false;
+	if (_pipe[0] < 0) {
+		if (pipe(_pipe) != 0) {
+			_pipe[0] = -1;
+			_pipe[1] = -1;
+			return false;
+		}
+		for (int i = 0; i < 2; i++) {
+			fcntl(_pipe[i], F_SETFL, fcntl(_pipe[i], F_GETFL) | O_NONBLOCK);
+			fcntl(_pipe[i], F_SETFD, FD_CLOEXEC);
+		}
+		int size = 0;
+# ifdef F_GETPIPE_SZ
+		size = fcntl(_pipe[1], F_GETPIPE_SZ);
+# endif
+		_pipeSize = (size > 0) ? static_cast<size_t>(size) : 4096;
+	}
+	_splicing = true;
+	return true;
+}
+#else
+// No splice() here: the body keeps going through _output
+bool ProxyRequest::startSplice() { return false; }
+#endif
+
+// Body bytes parsed along with the head go first, then those the pipe holds
+ssize_t ProxyRequest::spliceOutput(int socketFd, size_t size) {
+
+	size_t held = outputHeld();
+	ssize_t moved;
+	if (held > 0)
+		moved = send(socketFd, _output.data() + _outputRead, std::min(held, size), MSG_NOSIGNAL);
+#ifdef __linux__
+	else if (_piped > 0)
+		moved = splice(_pipe[0], NULL, socketFd, NULL, std::min(_piped, size), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+#endif
+	else
+		return _ended ? 0 : CGI_SPLICE_WAIT_OUTPUT;
+	if (moved < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? CGI_SPLICE_CLIENT_FULL : CGI_SPLICE_FAILED;
+	if (held > 0) {
+		_outputRead += moved;
+		if (_outputRead == _output.size()) {
+			_output.clear();
+			_outputRead = 0;
+		}
+	}
+	else
+		_piped -= moved;
+	_lastActivity = Clock::monotonicMs();
+	return moved;
+}
+
+std::string ProxyRequest::describe() const {
+
+	std::ostringstream oss;
+	oss << "proxy " << _upstream.name();
+	if (!_server.empty())
+		oss << " (" << _server << ")";
+	return oss.str();
+}
+
+ProxyUpstream::ProxyUpstream(const UpstreamConfig& config)
+	: _name(config.name), _servers(), _balance(config.balance), _keepalive(config.keepalive), _ring(),
+	_next(0), _connections(), _updated() {
+
+	for (size_t i = 0; i < config.servers.size(); i++) {
+		ProxyServer server;
+		server.address = config.servers[i].address;
+		server.weight = std::max(config.servers[i].weight, 1);
+		server.maxFails = config.servers[i].max_fails;
+		server.failTimeout = static_cast<unsigned long>(config.servers[i].fail_timeout) * 1000;
+		std::memset(&server.sockaddr, 0, sizeof(server.sockaddr));
+		if (!parseAddress(server.address, server.sockaddr, server.sockaddrLength)) {
+			server.sockaddrLength = 0;
+			std::cout << "[ERROR] Cannot resolve upstream " << _name << " server: " << server.address << std::endl;
+		}
+		_servers.push_back(server);
+	}
+	if (_balance == BALANCE_HASH) {
+		for (size_t i = 0; i < _servers.size(); i++)
+			for (int point = 0; point < _servers[i].weight * PROXY_HASH_POINTS; point++) {
+				std::ostringstream key;
+				key << _servers[i].address << "-" << point;
+				_ring.push_back(std::make_pair(hash(key.str()), i));
+			}
+		std::sort(_ring.begin(), _ring.end());
+	}
+}
+
+ProxyUpstream::~ProxyUpstream() {
+
+	while (!_connections.empty())
+		closeConnection(_connections.back());
+}
+
+const std::string& ProxyUpstream::name() const { return _name; }
+
+size_t ProxyUpstream::serverCount() const { return _servers.size(); }
+
+bool ProxyUpstream::serverDown(size_t index) const {
+
+	return index < _servers.size() && !available(_servers[index], Clock::monotonicMs());
+}
+
+bool ProxyUpstream::owns(int fd) const {
+
+	for (size_t i = 0; i < _connections.size(); i++)
+		if (_connections[i]->fd == fd)
+			return true;
+	return false;
+}
+
+bool ProxyUpstream::busy() const {
+
+	for (size_t i = 0; i < _connections.size(); i++)
+		if (_connections[i]->request)
+			return true;
+	return false;
+}
+
+// Idle connections close after PROXY_IDLE_MS, connects time out
+bool ProxyUpstream::needsMaintenance() const { return !_connections.empty(); }
+
+/*
+	Idle connections are read too, to notice the server closing them. A
+	connection stops being read while its request holds CGI_BUFFER_MAX
+	bytes its client has not taken yet, or a full pipe of them.
+*/
+void ProxyUpstream::addPollFds(std::vector<struct pollfd>& fds) const {
+
+	for (size_t i = 0; i < _connections.size(); i++) {
+		const ProxyConnection& connection = *_connections[i];
+		struct pollfd entry;
+		entry.fd = connection.fd;
+		entry.events = 0;
+		entry.revents = 0;
+		if (connection.connecting)
+			entry.events = POLLOUT;
+		else {
+			if (!connection.request || !connection.request->outputFull())
+				entry.events |= POLLIN;
+			if (connection.outSent < connection.out.size()
+				|| (connection.request && !connection.request->_input.empty()))
+				entry.events |= POLLOUT;
+		}
+		fds.push_back(entry);
+	}
+}
+
+void ProxyUpstream::handleEvent(int fd, short revents) {
+
+	ProxyConnection* connection = NULL;
+	for (size_t i = 0; i < _connections.size() && !connection; i++)
+		if (_connections[i]->fd == fd)
+			connection = _connections[i];
+	if (!connection)
+		return;
+
+	if (connection->connecting) {
+		int error = 0;
+		socklen_t length = sizeof(error);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+			std::cout << "[ERROR] Connect to upstream " << _name << " server "
+					  << _servers[connection->server].address << " failed: " << strerror(error) << std::endl;
+			connectionError(connection);
+			return;
+		}
+		connection->connecting = false;
+	}
+	if ((revents & POLLOUT) && !pump(*connection))
+		return;
+	if (revents & (POLLIN | POLLHUP | POLLERR))
+		readFrom(connection);
+}
+
+void ProxyUpstream::takeUpdated(std::vector<int>& owners) {
+
+	for (size_t i = 0; i < _updated.size(); i++)
+		owners.push_back(_updated[i]->_owner);
+	_updated.clear();
+}
+
+void ProxyUpstream::maintain() {
+
+	unsigned long now = Clock::monotonicMs();
+	for (size_t i = 0; i < _connections.size();) {
+		ProxyConnection* connection = _connections[i];
+		if (connection->connecting && now - connection->since > PROXY_CONNECT_TIMEOUT_MS) {
+			std::cout << "[ERROR] Connect to upstream " << _name << " server "
+					  << _servers[connection->server].address << " timed out" << std::endl;
+			connectionError(connection);
+			continue;
+		}
+		if (!connection->request && now - connection->since > PROXY_IDLE_MS) {
+			closeConnection(connection);
+			continue;
+		}
+		i++;
+	}
+}
+
+/*
+	Sends the request to the next server: an idle connection to it when
+	one is still open, else a new one. A server that cannot even be
+	connected to counts as failed and the next one is tried.
+*/
+void ProxyUpstream::dispatch(ProxyRequest* request) {
+
+	while (true) {
+		int index = choose(*request);
+		if (index < 0) {
+			std::cout << "[ERROR] No live server in upstream " << _name << std::endl;
+			finish(request, true);
+			return;
+		}
+		request->_tried[index] = true;
+		request->_server = _servers[index].address;
+		ProxyConnection* connection = idleConnection(index);
+		if (!connection)
+			connection = openConnection(index);
+		if (!connection) {
+			serverFailed(index);
+			continue;
+		}
+		connection->request = request;
+		connection->out = request->_head;
+		connection->outSent = 0;
+		request->_connection = connection;
+		_servers[index].active++;
+		pump(*connection);
+		return;
+	}
+}
+
+void ProxyUpstream::release(ProxyRequest* request) {
+
+	_updated.erase(std::remove(_updated.begin(), _updated.end(), request), _updated.end());
+	ProxyConnection* connection = request->_connection;
+	if (!connection)
+		return;
+	// Still in flight: the client left or the server stopped answering
+	if (request->expired(Clock::monotonicMs()))
+		serverFailed(connection->server);
+	closeConnection(connection);
+}
+
+// Index of the server for the request among those up and not tried yet; -1 = none left
+int ProxyUpstream::choose(const ProxyRequest& request) {
+
+	unsigned long now = Clock::monotonicMs();
+	std::vector<bool> candidate(_servers.size(), false);
+	bool any = false;
+	for (size_t i = 0; i < _servers.size(); i++) {
+		candidate[i] = !request._tried[i] && available(_servers[i], now);
+		any = any || candidate[i];
+	}
+	if (!any)
+		return -1;
+
+	if (_balance == BALANCE_HASH) {
+		// The first point clockwise of the key; later points when that server is out
+		std::vector<std::pair<unsigned int, size_t> >::const_iterator it
+			= std::lower_bound(_ring.begin(), _ring.end(), std::make_pair(hash(request._hashKey), static_cast<size_t>(0)));
+		for (size_t step = 0; step < _ring.size(); step++, ++it) {
+			if (it == _ring.end())
+				it = _ring.begin();
+			if (candidate[it->second])
+				return static_cast<int>(it->second);
+		}
+		return -1;
+	}
+
+	int best = -1;
+	if (_balance == BALANCE_LEAST_CONN) {
+		for (size_t step = 0; step < _servers.size(); step++) {
+			size_t i = (_next + step) % _servers.size();
+			if (candidate[i] && (best < 0 || _servers[i].active * _servers[best].weight
+				< _servers[best].active * _servers[i].weight))
+				best = static_cast<int>(i);
+		}
+		_next = (best + 1) % _servers.size();
+		return best;
+	}
+
+	// Smooth weighted round robin: interleaves servers in proportion to their weights
+	int total = 0;
+	for (size_t i = 0; i < _servers.size(); i++) {
+		if (!candidate[i])
+			continue;
+		_servers[i].currentWeight += _servers[i].weight;
+		total += _servers[i].weight;
+		if (best < 0 || _servers[i].currentWeight > _servers[best].currentWeight)
+			best = static_cast<int>(i);
+	}
+	_servers[best].currentWeight -= total;
+	return best;
+}
+
+// A group of one is always tried: there is nothing better to send the request to
+bool ProxyUpstream::available(const ProxyServer& server, unsigned long now) const {
+
+	return _servers.size() == 1 || server.maxFails == 0 || now >= server.downUntil;
+}
+
+// An idle keep-alive connection to the server, dropping those it closed meanwhile
+ProxyConnection* ProxyUpstream::idleConnection(size_t server) {
+
+	for (size_t i = _connections.size(); i > 0; i--) {
+		ProxyConnection* connection = _connections[i - 1];
+		if (connection->request || connection->connecting || connection->server != server)
+			continue;
+		char byte;
+		ssize_t bytes = recv(connection->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+		if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return connection;
+		closeConnection(connection);
+	}
+	return NULL;
+}
+
+ProxyConnection* ProxyUpstream::openConnection(size_t server) {
+
+	const ProxyServer& target = _servers[server];
+	if (target.sockaddrLength == 0)
+		return NULL;
+	int fd = socket(target.sockaddr.ss_family, SOCK_STREAM, 0);
+	if (fd < 0)
+		return NULL;
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	if (target.sockaddr.ss_family == AF_INET) {
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	}
+	int result = connect(fd, reinterpret_cast<const struct sockaddr*>(&target.sockaddr), target.sockaddrLength);
+	if (result != 0 && errno != EINPROGRESS) {
+		std::cout << "[ERROR] Connect to upstream " << _name << " server " << target.address
+				  << " failed: " << strerror(errno) << std::endl;
+		close(fd);
+		return NULL;
+	}
+	ProxyConnection* connection = new ProxyConnection();
+	connection->fd = fd;
+	connection->server = server;
+	connection->connecting = (result != 0);
+	connection->since = Clock::monotonicMs();
+	_connections.push_back(connection);
+	std::cout << "[DEBUG] Upstream " << _name << " connection to " << target.address
+			  << " opened (FD " << fd << ")" << std::endl;
+	return connection;
+}
+
+/*
+	Moves the request body on, at most PROXY_WRITE_MAX bytes queued at a
+	time, and keeps a copy of it while it fits PROXY_REPLAY_MAX so the
+	request can still go to another server.
+*/
+bool ProxyUpstream::pump(ProxyConnection& connection) {
+
+	if (connection.connecting)
+		return true;
+	ProxyRequest* request = connection.request;
+	while (request && !request->_input.empty() && connection.out.size() - connection.outSent < PROXY_WRITE_MAX) {
+		size_t take = std::min<size_t>(request->_input.size(), PROXY_WRITE_MAX);
+		if (request->_replayable && request->_replay.size() + take <= PROXY_REPLAY_MAX)
+			request->_replay.append(request->_input, 0, take);
+		else if (request->_replayable) {
+			request->_replayable = false;
+			std::string().swap(request->_replay);
+		}
+		connection.out.append(request->_input, 0, take);
+		request->_input.erase(0, take);
+	}
+	while (connection.outSent < connection.out.size()) {
+		ssize_t sent = send(connection.fd, connection.out.data() + connection.outSent,
+			connection.out.size() - connection.outSent, MSG_NOSIGNAL);
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (sent <= 0) {
+			connectionError(&connection);
+			return false;
+		}
+		connection.outSent += sent;
+		if (request)
+			request->_lastActivity = Clock::monotonicMs();
+	}
+	if (connection.outSent == connection.out.size()) {
+		connection.out.clear();
+		connection.outSent = 0;
+	}
+	return true;
+}
+
+void ProxyUpstream::readFrom(ProxyConnection* connection) {
+
+	ProxyRequest* request = connection->request;
+	if (request && request->_splicing && request->_response.rawBodyLeft() > 0 && spliceFrom(connection))
+		return;
+	char buffer[PROXY_READ_SIZE];
+	ssize_t bytes = recv(connection->fd, buffer, sizeof(buffer), 0);
+	if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return;
+	if (!request) {
+		// Closed while idle, or bytes no request asked for
+		closeConnection(connection);
+		return;
+	}
+	if (bytes <= 0) {
+		endOfStream(connection);
+		return;
+	}
+	request->_lastActivity = Clock::monotonicMs();
+	size_t held = request->_output.size();
+	if (!request->_response.feed(buffer, bytes, request->_output)) {
+		std::cout << "[ERROR] Invalid response from upstream " << _name << " server "
+				  << _servers[connection->server].address << std::endl;
+		serverFailed(connection->server);
+		closeConnection(connection);
+		finish(request, true);
+		return;
+	}
+	if (request->_output.size() != held)
+		markUpdated(request);
+	if (request->_response.complete())
+		complete(connection);
+}
+
+/*
+	Body bytes of a spliced request go from the socket into its pipe
+	unparsed, as many as the response still has and the pipe has room
+	for. Sockets splice() does not work on are read as usual instead.
+*/
+#ifdef __linux__
+bool ProxyUpstream::spliceFrom(ProxyConnection* connection) {
+
+	ProxyRequest* request = connection->request;
+	if (request->_piped >= request->_pipeSize)
+		return true;
+	size_t length = std::min<unsigned long>(request->_pipeSize - request->_piped, request->_response.rawBodyLeft());
+	ssize_t moved = splice(connection->fd, NULL, request->_pipe[1], NULL, length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (moved < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return true;
+	if (moved < 0 && errno == EINVAL) {
+		request->_splicing = false;
+		return false;
+	}
+	if (moved <= 0) {
+		endOfStream(connection);
+		return true;
+	}
+	request->_lastActivity = Clock::monotonicMs();
+	request->_piped += moved;
+	request->_response.rawBodyMoved(moved);
+	markUpdated(request);
+	if (request->_response.complete())
+		complete(connection);
+	return true;
+}
+#else
+bool ProxyUpstream::spliceFrom(ProxyConnection* connection) {
+
+	connection->request->_splicing = false;
+	return false;
+}
+#endif
+
+// The server closed the connection, or it broke, in the middle of a response
+void ProxyUpstream::endOfStream(ProxyConnection* connection) {
+
+	connection->request->_response.closed();
+	if (connection->request->_response.complete())
+		complete(connection);
+	else
+		connectionError(connection);
+}
+
+// The response is in: the connection goes back to the idle ones when it can carry another
+void ProxyUpstream::complete(ProxyConnection* connection) {
+
+	ProxyRequest* request = connection->request;
+	ProxyServer& server = _servers[connection->server];
+	bool reusable = request->_response.reusable() && request->_inputEnded && request->_input.empty()
+		&& connection->outSent == connection->out.size();
+	server.fails = 0;
+	server.active--;
+	connection->request = NULL;
+	connection->served++;
+	connection->since = Clock::monotonicMs();
+	request->_connection = NULL;
+	finish(request, false);
+
+	size_t idle = 0;
+	for (size_t i = 0; i < _connections.size(); i++)
+		if (!_connections[i]->request && _connections[i]->server == connection->server)
+			idle++;
+	if (!reusable || idle > _keepalive)
+		closeConnection(connection);
+}
+
+/*
+	The connection broke or could not be made. Before any of the response
+	came, the request goes to the next server if its body can be sent
+	again; a reused keep-alive connection the server had just closed is
+	not the server's fault and may be retried on the same one.
+*/
+void ProxyUpstream::connectionError(ProxyConnection* connection) {
+
+	ProxyRequest* request = connection->request;
+	size_t server = connection->server;
+	bool stale = connection->served > 0 && !connection->connecting;
+	closeConnection(connection);
+	if (!request)
+		return;
+	bool started = request->_response.started();
+	if (!stale || started)
+		serverFailed(server);
+	if (started || !request->_replayable) {
+		finish(request, true);
+		return;
+	}
+	if (stale)
+		request->_tried[server] = false;
+	request->_input.insert(0, request->_replay);
+	request->_replay.clear();
+	dispatch(request);
+}
+
+void ProxyUpstream::closeConnection(ProxyConnection* connection) {
+
+	std::vector<ProxyConnection*>::iterator it = std::find(_connections.begin(), _connections.end(), connection);
+	if (it != _connections.end())
+		_connections.erase(it);
+	if (connection->request) {
+		connection->request->_connection = NULL;
+		_servers[connection->server].active--;
+	}
+	close(connection->fd);
+	delete connection;
+}
+
+void ProxyUpstream::finish(ProxyRequest* request, bool failed) {
+
+	request->_ended = true;
+	request->_failed = failed || !request->_response.complete();
+	std::string().swap(request->_replay);
+	markUpdated(request);
+}
+
+// max_fails failures within fail_timeout take the server out of rotation for fail_timeout
+void ProxyUpstream::serverFailed(size_t index) {
+
+	ProxyServer& server = _servers[index];
+	unsigned long now = Clock::monotonicMs();
+	if (server.maxFails == 0)
+		return;
+	if (server.fails == 0 || now - server.failedSince > server.failTimeout) {
+		server.fails = 0;
+		server.failedSince = now;
+	}
+	server.fails++;
+	if (server.fails >= server.maxFails && _servers.size() > 1) {
+		server.downUntil = now + server.failTimeout;
+		server.fails = 0;
+		std::cout << "[DEBUG] Upstream " << _name << " server " << server.address << " marked down for "
+				  << server.failTimeout / 1000 << "s" << std::endl;
+	}
+}
+
+void ProxyUpstream::markUpdated(ProxyRequest* request) {
+
+	if (std::find(_updated.begin(), _updated.end(), request) == _updated.end())
+		_updated.push_back(request);
+}
+
+// FNV-1a, with a final mix so nearby keys spread over the ring
+unsigned int ProxyUpstream::hash(const std::string& key) {
+
+	unsigned int value = 2166136261u;
+	for (size_t i = 0; i < key.size(); i++) {
+		value ^= static_cast<unsigned char>(key[i]);
+		value *= 16777619u;
+	}
+	value ^= value >> 16;
+	value *= 0x85ebca6bu;
+	value ^= value >> 13;
+	return value;
+}
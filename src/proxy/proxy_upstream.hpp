@@ -0,0 +1,179 @@
+#ifndef PROXY_UPSTREAM_HPP
+#define PROXY_UPSTREAM_HPP
+
+#include <string>
+#include <vector>
+#include "cgi_backend.hpp"
+#include "backend_pool.hpp"
+#include "proxy_response.hpp"
+#include "config.hpp"
+
+#define PROXY_WRITE_MAX				65536   // request bytes queued per connection before the client is read again
+#define PROXY_REPLAY_MAX			65536   // request body kept to send it again to another server
+#define PROXY_CONNECT_TIMEOUT_MS	5000
+#define PROXY_IDLE_MS				60000   // idle keep-alive connections are closed after it
+#define PROXY_HASH_POINTS			160     // points on the hash ring per unit of weight
+
+class ProxyUpstream;
+struct ProxyConnection;
+
+/*
+	One request proxied to an upstream group, created by the Server in
+	place of a CgiProcess. The group picks a server and a connection for
+	it; the request head goes out first, then the body as the client sends
+	it. The response is turned into relay input (see ProxyResponse) and
+	read back through readOutput(). A request that fails before any of the
+	response arrived is sent to the next server, as long as the part of
+	its body already sent was kept (PROXY_REPLAY_MAX).
+
+	Once spliced (startSplice()), the rest of a body the relay takes as it
+	is goes from the upstream socket into a pipe of the request and from
+	there to the client socket, without ever being copied to user space.
+*/
+class ProxyRequest : public CgiBackend {
+
+	public:
+		ProxyRequest(ProxyUpstream& upstream, const std::string& head, const std::string& hashKey,
+			bool headRequest, int owner, unsigned long timeoutMs);
+		virtual ~ProxyRequest();
+
+		int		owner() const;   // client fd
+
+		virtual void	queueInput(const char* data, size_t length);
+		virtual size_t	inputPending() const;
+		virtual void	endInput();
+		virtual void	writeInput();
+		virtual ssize_t	readOutput(char* buffer, size_t size);
+		virtual bool	outputClosed() const;
+		virtual bool	failed() const;
+		virtual bool	expired(unsigned long nowMs) const;
+		virtual void	terminate();
+		virtual std::string	describe() const;
+		virtual bool	startSplice();
+		virtual ssize_t	spliceOutput(int socketFd, size_t size);
+
+	private:
+		friend class ProxyUpstream;
+
+		size_t	outputHeld() const;
+		bool	outputFull() const;   // the upstream is not read meanwhile
+
+		ProxyUpstream&		_upstream;
+		ProxyConnection*	_connection;   // NULL before one is assigned and once ended
+		int					_owner;
+		std::string			_head;         // request line and headers
+		std::string			_hashKey;
+		std::string			_input;        // body not sent yet
+		std::string			_replay;       // body sent so far, while _replayable
+		bool				_replayable;
+		bool				_inputEnded;
+		ProxyResponse		_response;
+		std::string			_output;       // relay input
+		size_t				_outputRead;
+		bool				_splicing;     // body bytes go into _pipe instead of _output
+		int					_pipe[2];      // opened by startSplice()
+		size_t				_pipeSize;
+		size_t				_piped;        // bytes in _pipe
+		bool				_ended;
+		bool				_failed;
+		std::vector<bool>	_tried;        // by server index
+		std::string			_server;       // address of the last server tried
+		unsigned long		_timeout;
+		unsigned long		_lastActivity; // Clock::monotonicMs(): bytes moved either way
+};
+
+struct ProxyConnection {
+
+	ProxyConnection() : fd(-1), server(0), connecting(true), out(), outSent(0), request(NULL), served(0), since(0) {}
+
+	int				fd;
+	size_t			server;
+	bool			connecting;
+	std::string		out;
+	size_t			outSent;
+	ProxyRequest*	request;   // NULL while idle
+	unsigned long	served;    // responses completed
+	unsigned long	since;     // Clock::monotonicMs() of the connect, or of going idle
+};
+
+struct ProxyServer {
+
+	ProxyServer() : address(), sockaddr(), sockaddrLength(0), weight(1), currentWeight(0), maxFails(1),
+		failTimeout(0), fails(0), failedSince(0), downUntil(0), active(0) {}
+
+	std::string				address;
+	struct sockaddr_storage	sockaddr;
+	socklen_t				sockaddrLength;   // 0 = did not resolve
+	int						weight;
+	int						currentWeight;    // smooth weighted round robin
+	int						maxFails;
+	unsigned long			failTimeout;      // ms
+	int						fails;            // within the current window
+	unsigned long			failedSince;      // start of that window
+	unsigned long			downUntil;        // out of rotation until then
+	size_t					active;           // requests in flight
+};
+
+/*
+	An upstream group (or the single server a proxy_pass names). Servers
+	are picked by weighted round robin, least connections, or a consistent
+	hash ring of the request key, skipping servers marked down: max_fails
+	errors or timeouts within fail_timeout take a server out of rotation
+	for fail_timeout (passive health checks, as nginx does). Up to
+	keepalive idle connections per server are kept for the next requests.
+	All sockets are non-blocking and polled by the event loop.
+*/
+class ProxyUpstream : public BackendPool {
+
+	public:
+		explicit ProxyUpstream(const UpstreamConfig& config);
+		virtual ~ProxyUpstream();
+
+		const std::string&	name() const;
+		size_t	serverCount() const;
+		bool	serverDown(size_t index) const;
+
+		virtual bool	owns(int fd) const;
+		virtual bool	busy() const;
+		virtual bool	needsMaintenance() const;
+		virtual void	addPollFds(std::vector<struct pollfd>& fds) const;
+		virtual void	handleEvent(int fd, short revents);
+		virtual void	takeUpdated(std::vector<int>& owners);
+		virtual void	maintain();   // connect timeouts, idle connections
+
+	private:
+		ProxyUpstream(const ProxyUpstream&);
+		ProxyUpstream& operator=(const ProxyUpstream&);
+
+		friend class ProxyRequest;
+
+		void	dispatch(ProxyRequest* request);
+		void	release(ProxyRequest* request);
+		int		choose(const ProxyRequest& request);
+		bool	available(const ProxyServer& server, unsigned long now) const;
+		ProxyConnection*	idleConnection(size_t server);
+		ProxyConnection*	openConnection(size_t server);
+		bool	pump(ProxyConnection& connection);   // false = connection gone
+		void	readFrom(ProxyConnection* connection);
+		bool	spliceFrom(ProxyConnection* connection);   // false when splice() can't read the socket
+		void	endOfStream(ProxyConnection* connection);
+		void	complete(ProxyConnection* connection);
+		void	connectionError(ProxyConnection* connection);
+		void	closeConnection(ProxyConnection* connection);
+		void	finish(ProxyRequest* request, bool failed);
+		void	serverFailed(size_t index);
+		void	markUpdated(ProxyRequest* request);
+
+		static unsigned int	hash(const std::string& key);
+
+		std::string									_name;
+		std::vector<ProxyServer>					_servers;
+		UpstreamBalance								_balance;
+		size_t										_keepalive;
+		std::vector<std::pair<unsigned int, size_t> >	_ring;   // hash point -> server, sorted
+		size_t										_next;   // least_conn tie-break rotation
+		std::vector<ProxyConnection*>				_connections;
+		std::vector<ProxyRequest*>					_updated;
+};
+
+#endif
@@ -0,0 +1,432 @@
+#include "response_cache.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Statuses a response with explicit freshness may be stored for (RFC 9110 "cacheable by default")
+static const int CACHEABLE_STATUSES[] = {200, 203, 204, 300, 301, 308, 404, 405, 410, 414, 501};
+// ... and the ones proxy_cache_valid applies to, as nginx's default
+static const int DEFAULT_VALID_STATUSES[] = {200, 301, 302};
+
+static bool statusIn(int status, const int* statuses, size_t count) {
+
+	return std::find(statuses, statuses + count, status) != statuses + count;
+}
+
+static std::string lowercase(std::string value) {
+
+	std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+	return value;
+}
+
+// "Sun, 06 Nov 1994 08:49:37 GMT"; false for anything else
+static bool parseHttpDate(const std::string& value, time_t& out) {
+
+	struct tm parsed;
+	std::memset(&parsed, 0, sizeof(parsed));
+	const char* rest = strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S", &parsed);
+	if (!rest || std::strcmp(rest, " GMT") != 0)
+		return false;
+	out = timegm(&parsed);
+	return out != static_cast<time_t>(-1);
+}
+
+// Whole seconds, or -1
+static long parseSeconds(const std::string& value) {
+
+	std::string digits = value;
+	if (digits.size() >= 2 && digits[0] == '"' && digits[digits.size() - 1] == '"')
+		digits = digits.substr(1, digits.size() - 2);
+	if (digits.empty() || digits.size() > 10 || digits.find_first_not_of("0123456789") != std::string::npos)
+		return -1;
+	return std::strtol(digits.c_str(), NULL, 10);
+}
+
+static bool writeAll(int fd, const char* data, size_t length) {
+
+	while (length > 0) {
+		ssize_t written = ::write(fd, data, length);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+		data += written;
+		length -= written;
+	}
+	return true;
+}
+
+CacheFill::CacheFill(int fd, const std::string& path, const CacheEntry& entry, size_t limit)
+	: _fd(fd), _path(path), _entry(entry), _limit(limit), _failed(false) {}
+
+CacheFill::~CacheFill() {
+
+	if (_fd >= 0)
+		close(_fd);
+}
+
+bool CacheFill::failed() const { return _failed; }
+
+bool CacheFill::write(const char* data, size_t length) {
+
+	if (_failed)
+		return false;
+	if (_entry.bodyOffset + _entry.bodyLength + length > _limit || !writeAll(_fd, data, length)) {
+		_failed = true;
+		return false;
+	}
+	_entry.bodyLength += length;
+	return true;
+}
+
+ResponseCache::ResponseCache(const std::string& directory, size_t maxSize)
+	: _directory(directory), _maxSize(maxSize), _size(0), _entries(), _lru(), _fills(), _passes(), _nextTemp(0) {
+
+	if (!_directory.empty() && _directory[_directory.size() - 1] == '/')
+		_directory.erase(_directory.size() - 1);
+	load();
+}
+
+ResponseCache::~ResponseCache() {}
+
+size_t ResponseCache::size() const { return _size; }
+
+size_t ResponseCache::count() const { return _entries.size(); }
+
+// FNV-1a of the key in hex (64-bit on LP64): fixed length, nothing a path could trip over
+std::string ResponseCache::fileName(const std::string& key) {
+
+	unsigned long hash = 14695981039346656037UL;
+	for (size_t i = 0; i < key.size(); i++) {
+		hash ^= static_cast<unsigned char>(key[i]);
+		hash *= 1099511628211UL;
+	}
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016lx", hash);
+	return name;
+}
+
+/*
+	What the directory holds from an earlier run: complete entries are
+	indexed again, leftover temporary files and entries past any use are
+	deleted.
+*/
+void ResponseCache::load() {
+
+	DIR* dir = opendir(_directory.c_str());
+	if (!dir)
+		return;
+	time_t now = time(NULL);
+	std::vector<std::string> names;
+	while (struct dirent* item = readdir(dir))
+		names.push_back(item->d_name);
+	closedir(dir);
+
+	for (size_t i = 0; i < names.size(); i++) {
+		const std::string& name = names[i];
+		if (name.compare(0, 5, ".tmp_") == 0) {
+			unlink((_directory + "/" + name).c_str());
+			continue;
+		}
+		if (name.size() != 16 || name.find_first_not_of("0123456789abcdef") != std::string::npos)
+			continue;
+		CacheEntry entry;
+		if (!readEntry(name, entry) || entry.staleUntil <= now || fileName(entry.key) != name) {
+			unlink((_directory + "/" + name).c_str());
+			continue;
+		}
+		index(name, entry);
+	}
+	evict();
+	if (!_entries.empty())
+		std::cout << "[DEBUG] Response cache " << _directory << ": " << _entries.size() << " entries, "
+				  << _size << " bytes" << std::endl;
+}
+
+// "WSCACHE1\n<key>\n<status> <date> <expires> <stale until>\n<headers>\r\n<body>"
+bool ResponseCache::readEntry(const std::string& name, CacheEntry& entry) const {
+
+	entry.file = _directory + "/" + name;
+	int fd = ::open(entry.file.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	std::string head;
+	char buffer[4096];
+	ssize_t bytes = 0;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		while (head.size() < RESPONSE_CACHE_HEAD_MAX && (bytes = read(fd, buffer, sizeof(buffer))) > 0)
+			head.append(buffer, bytes);
+	}
+	close(fd);
+
+	size_t keyStart = head.find('\n');
+	size_t keyEnd = (keyStart == std::string::npos) ? keyStart : head.find('\n', keyStart + 1);
+	size_t metaEnd = (keyEnd == std::string::npos) ? keyEnd : head.find('\n', keyEnd + 1);
+	if (metaEnd == std::string::npos || head.compare(0, keyStart, RESPONSE_CACHE_MAGIC) != 0)
+		return false;
+	size_t headersEnd = (head.compare(metaEnd + 1, 2, "\r\n") == 0) ? metaEnd + 1 : head.find("\r\n\r\n", metaEnd + 1);
+	if (headersEnd == std::string::npos)
+		return false;
+	if (headersEnd > metaEnd + 1)
+		headersEnd += 2;
+
+	long date = 0, expires = 0, staleUntil = 0;
+	std::istringstream meta(head.substr(keyEnd + 1, metaEnd - keyEnd - 1));
+	if (!(meta >> entry.status >> date >> expires >> staleUntil) || entry.status < 200 || entry.status > 599)
+		return false;
+	entry.key = head.substr(keyStart + 1, keyEnd - keyStart - 1);
+	entry.headers = head.substr(metaEnd + 1, headersEnd - metaEnd - 1);
+	entry.bodyOffset = static_cast<off_t>(headersEnd + 2);
+	if (st.st_size < entry.bodyOffset)
+		return false;
+	entry.bodyLength = static_cast<size_t>(st.st_size - entry.bodyOffset);
+	entry.date = static_cast<time_t>(date);
+	entry.expires = static_cast<time_t>(expires);
+	entry.staleUntil = static_cast<time_t>(staleUntil);
+	return true;
+}
+
+// Replaces whatever the file name indexed before (its file is the one being indexed now)
+void ResponseCache::index(const std::string& name, CacheEntry& entry) {
+
+	std::map<std::string, CacheEntry>::iterator old = _entries.find(name);
+	if (old != _entries.end())
+		remove(old, false);
+	_lru.push_front(name);
+	entry.lru = _lru.begin();
+	_size += entry.bodyOffset + entry.bodyLength;
+	_entries[name] = entry;
+}
+
+void ResponseCache::remove(std::map<std::string, CacheEntry>::iterator it, bool unlinkFile) {
+
+	if (unlinkFile)
+		unlink(it->second.file.c_str());
+	_size -= it->second.bodyOffset + it->second.bodyLength;
+	_lru.erase(it->second.lru);
+	_entries.erase(it);
+}
+
+void ResponseCache::evict() {
+
+	while (_size > _maxSize && !_lru.empty()) {
+		std::map<std::string, CacheEntry>::iterator it = _entries.find(_lru.back());
+		std::cout << "[DEBUG] Response cache evicts " << it->second.key << std::endl;
+		remove(it, true);
+	}
+}
+
+const CacheEntry* ResponseCache::find(const std::string& key, time_t now) {
+
+	std::map<std::string, CacheEntry>::iterator it = _entries.find(fileName(key));
+	if (it == _entries.end() || it->second.key != key)
+		return NULL;
+	if (it->second.staleUntil <= now) {
+		remove(it, true);
+		return NULL;
+	}
+	_lru.splice(_lru.begin(), _lru, it->second.lru);
+	return &it->second;
+}
+
+bool ResponseCache::purge(const std::string& key) {
+
+	std::map<std::string, CacheEntry>::iterator it = _entries.find(fileName(key));
+	if (it == _entries.end() || it->second.key != key)
+		return false;
+	remove(it, true);
+	return true;
+}
+
+bool ResponseCache::lock(const std::string& key) {
+
+	if (_fills.count(key))
+		return false;
+	_fills[key];
+	return true;
+}
+
+bool ResponseCache::locked(const std::string& key) const { return _fills.count(key) != 0; }
+
+void ResponseCache::wait(const std::string& key, int owner) {
+
+	_fills[key].push_back(owner);
+}
+
+void ResponseCache::stopWaiting(int owner) {
+
+	for (std::map<std::string, std::vector<int> >::iterator it = _fills.begin(); it != _fills.end(); ++it)
+		it->second.erase(std::remove(it->second.begin(), it->second.end(), owner), it->second.end());
+}
+
+void ResponseCache::unlock(const std::string& key, std::vector<int>& waiters) {
+
+	std::map<std::string, std::vector<int> >::iterator it = _fills.find(key);
+	if (it == _fills.end())
+		return;
+	waiters.insert(waiters.end(), it->second.begin(), it->second.end());
+	_fills.erase(it);
+}
+
+void ResponseCache::pass(const std::string& key, time_t now) {
+
+	if (_passes.size() >= RESPONSE_CACHE_PASS_MAX) {
+		for (std::map<std::string, time_t>::iterator it = _passes.begin(); it != _passes.end();) {
+			if (it->second <= now)
+				_passes.erase(it++);
+			else
+				++it;
+		}
+		if (_passes.size() >= RESPONSE_CACHE_PASS_MAX)
+			_passes.clear();
+	}
+	_passes[key] = now + RESPONSE_CACHE_PASS_SECONDS;
+}
+
+bool ResponseCache::passing(const std::string& key, time_t now) {
+
+	std::map<std::string, time_t>::iterator it = _passes.find(key);
+	if (it == _passes.end())
+		return false;
+	if (it->second > now)
+		return true;
+	_passes.erase(it);
+	return false;
+}
+
+CacheFill* ResponseCache::open(const std::string& key, int status, const CacheHeaderList& headers,
+	time_t now, time_t expires, time_t staleUntil) {
+
+	CacheEntry entry;
+	entry.key = key;
+	entry.file = _directory + "/" + fileName(key);
+	entry.status = status;
+	entry.date = now;
+	entry.expires = expires;
+	entry.staleUntil = staleUntil;
+	for (size_t i = 0; i < headers.size(); i++) {
+		// Age is the cache's to send
+		if (lowercase(headers[i].first) != "age")
+			entry.headers += headers[i].first + ": " + headers[i].second + "\r\n";
+	}
+
+	std::ostringstream head;
+	head << RESPONSE_CACHE_MAGIC << "\n" << key << "\n" << status << " " << static_cast<long>(now) << " "
+		 << static_cast<long>(expires) << " " << static_cast<long>(staleUntil) << "\n"
+		 << entry.headers << "\r\n";
+	std::string data = head.str();
+	if (data.size() > RESPONSE_CACHE_HEAD_MAX || key.find('\n') != std::string::npos)
+		return NULL;
+	entry.bodyOffset = static_cast<off_t>(data.size());
+
+	std::ostringstream path;
+	path << _directory << "/.tmp_" << fileName(key) << "_" << ++_nextTemp;
+	int fd = ::open(path.str().c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		std::cout << "[ERROR] Response cache: cannot create " << path.str() << ": " << strerror(errno) << std::endl;
+		return NULL;
+	}
+	CacheFill* fill = new CacheFill(fd, path.str(), entry, _maxSize);
+	if (!writeAll(fd, data.data(), data.size())) {
+		abort(fill);
+		return NULL;
+	}
+	return fill;
+}
+
+bool ResponseCache::commit(CacheFill* fill) {
+
+	if (fill->_failed || close(fill->_fd) != 0 || rename(fill->_path.c_str(), fill->_entry.file.c_str()) != 0) {
+		fill->_fd = -1;
+		abort(fill);
+		return false;
+	}
+	fill->_fd = -1;
+	index(fileName(fill->_entry.key), fill->_entry);
+	delete fill;
+	evict();
+	return true;
+}
+
+void ResponseCache::abort(CacheFill* fill) {
+
+	unlink(fill->_path.c_str());
+	delete fill;
+}
+
+bool ResponseCache::freshness(int status, const CacheHeaderList& headers, time_t now, long defaultTtl,
+	time_t& expires, time_t& staleUntil) {
+
+	long maxAge = -1;
+	long sharedMaxAge = -1;
+	long staleWhileRevalidate = 0;
+	bool hasExpires = false;
+	time_t expiresAt = 0;
+	time_t date = now;
+	for (size_t i = 0; i < headers.size(); i++) {
+		std::string name = lowercase(headers[i].first);
+		if (name == "set-cookie" || name == "vary")
+			return false;
+		if (name == "date")
+			parseHttpDate(headers[i].second, date);
+		else if (name == "expires") {
+			// An invalid date means already expired
+			hasExpires = true;
+			if (!parseHttpDate(headers[i].second, expiresAt))
+				expiresAt = 0;
+		}
+		else if (name == "cache-control") {
+			std::istringstream directives(headers[i].second);
+			std::string directive;
+			while (std::getline(directives, directive, ',')) {
+				size_t start = directive.find_first_not_of(" \t");
+				if (start == std::string::npos)
+					continue;
+				directive = directive.substr(start);
+				directive.erase(directive.find_last_not_of(" \t") + 1);
+				size_t equals = directive.find('=');
+				std::string key = lowercase(directive.substr(0, equals));
+				std::string value = (equals == std::string::npos) ? "" : directive.substr(equals + 1);
+				if (key == "no-store" || key == "private" || key == "no-cache")
+					return false;
+				if (key == "max-age")
+					maxAge = parseSeconds(value);
+				else if (key == "s-maxage")
+					sharedMaxAge = parseSeconds(value);
+				else if (key == "stale-while-revalidate")
+					staleWhileRevalidate = std::max(0L, parseSeconds(value));
+			}
+		}
+	}
+
+	long ttl;
+	if (sharedMaxAge >= 0 || maxAge >= 0 || hasExpires) {
+		if (sharedMaxAge >= 0)
+			ttl = sharedMaxAge;
+		else if (maxAge >= 0)
+			ttl = maxAge;
+		else
+			ttl = static_cast<long>(expiresAt - date);
+		if (!statusIn(status, CACHEABLE_STATUSES, sizeof(CACHEABLE_STATUSES) / sizeof(CACHEABLE_STATUSES[0])))
+			return false;
+	}
+	else if (statusIn(status, DEFAULT_VALID_STATUSES, sizeof(DEFAULT_VALID_STATUSES) / sizeof(DEFAULT_VALID_STATUSES[0])))
+		ttl = defaultTtl;
+	else
+		return false;
+	if (ttl <= 0)
+		return false;
+	expires = now + ttl;
+	staleUntil = expires + staleWhileRevalidate;
+	return true;
+}
@@ -0,0 +1,129 @@
+#ifndef RESPONSE_CACHE_HPP
+#define RESPONSE_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <ctime>
+#include <sys/types.h>
+
+#define RESPONSE_CACHE_MAGIC		"WSCACHE1"
+#define RESPONSE_CACHE_HEAD_MAX		65536   // key, status line and headers of a stored response
+#define RESPONSE_CACHE_PASS_SECONDS	10      // an uncacheable response sends its key straight to the backend this long
+#define RESPONSE_CACHE_PASS_MAX		4096    // such keys remembered at once
+
+typedef std::vector<std::pair<std::string, std::string> >	CacheHeaderList;
+
+// A stored response, indexed in memory; the file holds the head and the body
+struct CacheEntry {
+
+	CacheEntry() : key(), file(), status(200), headers(), bodyOffset(0), bodyLength(0), date(0), expires(0),
+		staleUntil(0), lru() {}
+
+	std::string		key;
+	std::string		file;         // path in the cache directory
+	int				status;
+	std::string		headers;      // "Name: value\r\n" lines as the backend sent them, without framing
+	off_t			bodyOffset;   // of the body in the file
+	size_t			bodyLength;
+	time_t			date;         // stored at
+	time_t			expires;      // fresh until
+	time_t			staleUntil;   // may still be served while being refreshed until (stale-while-revalidate)
+	std::list<std::string>::iterator	lru;
+};
+
+// A response on its way into the cache, written to a temporary file as it is relayed
+class CacheFill {
+
+	public:
+		~CacheFill();
+
+		bool	write(const char* data, size_t length);   // false once it failed or grew past the cache size
+		bool	failed() const;
+
+	private:
+		friend class ResponseCache;
+
+		CacheFill(int fd, const std::string& path, const CacheEntry& entry, size_t limit);
+		CacheFill(const CacheFill&);
+		CacheFill& operator=(const CacheFill&);
+
+		int			_fd;
+		std::string	_path;
+		CacheEntry	_entry;
+		size_t		_limit;
+		bool		_failed;
+};
+
+/*
+	proxy_cache: responses of CGI, FastCGI and proxied locations kept in a
+	directory, one file per key, and indexed in memory. Files are written
+	under a temporary name and renamed into place once complete, so the
+	directory only ever holds whole responses; it is read back at startup.
+	The least recently used entries go when max_size is exceeded.
+
+	Misses for a key are coalesced: the first one locks it and goes to the
+	backend, the others wait for it and are answered from what it stored.
+	While a stale entry is being refreshed it keeps being served.
+*/
+class ResponseCache {
+
+	public:
+		ResponseCache(const std::string& directory, size_t maxSize);
+		~ResponseCache();
+
+		// An entry fresh or still usable stale at now, NULL otherwise
+		const CacheEntry*	find(const std::string& key, time_t now);
+		bool				purge(const std::string& key);
+
+		// One request per key goes to the backend; the rest wait for it
+		bool	lock(const std::string& key);   // false when already locked
+		bool	locked(const std::string& key) const;
+		void	wait(const std::string& key, int owner);
+		void	stopWaiting(int owner);
+		void	unlock(const std::string& key, std::vector<int>& waiters);
+
+		// Keys whose last response could not be stored skip the lock for a while
+		void	pass(const std::string& key, time_t now);
+		bool	passing(const std::string& key, time_t now);
+
+		// NULL when the temporary file could not be created
+		CacheFill*	open(const std::string& key, int status, const CacheHeaderList& headers,
+						time_t now, time_t expires, time_t staleUntil);
+		bool		commit(CacheFill* fill);   // deletes fill; false when it was dropped instead
+		void		abort(CacheFill* fill);    // deletes fill
+
+		size_t	size() const;    // bytes of stored files
+		size_t	count() const;
+
+		/*
+			Whether a response may be stored and until when: s-maxage, max-age,
+			or Expires against Date; without any, defaultTtl for 200/301/302.
+			no-store, private, no-cache, Set-Cookie and Vary keep it out.
+		*/
+		static bool	freshness(int status, const CacheHeaderList& headers, time_t now, long defaultTtl,
+						time_t& expires, time_t& staleUntil);
+		static std::string	fileName(const std::string& key);
+
+	private:
+		ResponseCache(const ResponseCache&);
+		ResponseCache& operator=(const ResponseCache&);
+
+		void	load();
+		bool	readEntry(const std::string& name, CacheEntry& entry) const;
+		void	index(const std::string& name, CacheEntry& entry);
+		void	remove(std::map<std::string, CacheEntry>::iterator it, bool unlinkFile);
+		void	evict();
+
+		std::string								_directory;
+		size_t									_maxSize;
+		size_t									_size;
+		std::map<std::string, CacheEntry>		_entries;   // by file name
+		std::list<std::string>					_lru;       // file names, most recently used first
+		std::map<std::string, std::vector<int> >	_fills;     // locked keys -> waiting owners
+		std::map<std::string, time_t>			_passes;    // key -> passed until
+		unsigned long							_nextTemp;
+};
+
+#endif
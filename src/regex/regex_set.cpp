@@ -0,0 +1,616 @@
+#include "regex_set.hpp"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+const int RegexSet::NONE = INT_MAX;
+
+// Recursive descent over one pattern into Nodes; the first error stops it
+class RegexSet::Parser {
+
+	public:
+		Parser(const std::string& pattern, std::vector<Node>& nodes)
+			: _pattern(pattern), _pos(0), _depth(0), _nodes(nodes), _error(), _caseless(false) {}
+
+		size_t parse() {
+			if (_pattern.compare(0, 4, "(?i)") == 0) {
+				_caseless = true;
+				_pos = 4;
+			}
+			size_t root = alternation();
+			if (_error.empty() && _pos < _pattern.size())
+				fail("unmatched )");
+			return root;
+		}
+
+		const std::string&	error() const { return _error; }
+		bool				caseless() const { return _caseless; }
+
+	private:
+		size_t alternation() {
+			Node node;
+			node.type = NODE_ALT;
+			node.children.push_back(sequence());
+			while (_error.empty() && _pos < _pattern.size() && _pattern[_pos] == '|') {
+				_pos++;
+				node.children.push_back(sequence());
+			}
+			return (node.children.size() == 1) ? node.children[0] : add(node);
+		}
+
+		size_t sequence() {
+			Node node;
+			node.type = NODE_CONCAT;
+			while (_error.empty() && _pos < _pattern.size() && _pattern[_pos] != '|' && _pattern[_pos] != ')')
+				node.children.push_back(repetition());
+			if (node.children.empty())
+				node.type = NODE_EMPTY;
+			return (node.children.size() == 1) ? node.children[0] : add(node);
+		}
+
+		size_t repetition() {
+			size_t atomNode = atom();
+			if (!_error.empty() || _pos >= _pattern.size())
+				return atomNode;
+			int min = 0;
+			int max = -1;
+			char c = _pattern[_pos];
+			if (c == '*' || c == '+' || c == '?') {
+				min = (c == '+') ? 1 : 0;
+				max = (c == '?') ? 1 : -1;
+				_pos++;
+			}
+			else if (c != '{' || !quantifier(min, max))
+				return atomNode;
+			if (!_error.empty())
+				return 0;
+			if (_nodes[atomNode].type == NODE_BEGIN || _nodes[atomNode].type == NODE_END)
+				return fail("nothing to repeat");
+			if (_pos < _pattern.size() && _pattern[_pos] == '?')
+				_pos++;   // lazy: same language, and only whether it matches counts here
+			else if (_pos < _pattern.size() && _pattern[_pos] == '+')
+				return fail("possessive quantifiers are not supported");
+			if (_pos < _pattern.size() && std::strchr("*+?", _pattern[_pos]))
+				return fail("nothing to repeat");
+			Node node;
+			node.type = NODE_REPEAT;
+			node.children.push_back(atomNode);
+			node.min = min;
+			node.max = max;
+			return add(node);
+		}
+
+		size_t atom() {
+			Node node;
+			node.type = NODE_SET;
+			char c = _pattern[_pos++];
+			switch (c) {
+				case '(':
+					return group();
+				case '[':
+					if (!bracket(node.bytes))
+						return 0;
+					break;
+				case '.':
+					node.bytes.set();
+					node.bytes.reset('\n');
+					break;
+				case '^':
+					node.type = NODE_BEGIN;
+					break;
+				case '$':
+					node.type = NODE_END;
+					break;
+				case '\\':
+					if (!escape(node.bytes))
+						return 0;
+					break;
+				case '*': case '+': case '?':
+					return fail("nothing to repeat");
+				default:
+					node.bytes.set(static_cast<unsigned char>(c));
+			}
+			return add(node);
+		}
+
+		size_t group() {
+			if (_pattern.compare(_pos, 2, "?:") == 0)
+				_pos += 2;
+			else if (_pattern.compare(_pos, 2, "?'") == 0 || _pattern.compare(_pos, 3, "?P<") == 0
+				|| (_pattern.compare(_pos, 2, "?<") == 0 && _pattern.compare(_pos, 3, "?<=") != 0
+					&& _pattern.compare(_pos, 3, "?<!") != 0)) {
+				// Named capture: nothing is captured here, so it is a plain group
+				char close = (_pattern[_pos + 1] == '\'') ? '\'' : '>';
+				size_t end = _pattern.find(close, _pos + 2);
+				if (end == std::string::npos)
+					return fail("unterminated group name");
+				_pos = end + 1;
+			}
+			else if (_pos < _pattern.size() && _pattern[_pos] == '?')
+				return fail("unsupported group (" + _pattern.substr(_pos, 2));
+			if (++_depth > REGEX_NESTING_MAX)
+				return fail("groups nested too deep");
+			size_t inner = alternation();
+			_depth--;
+			if (!_error.empty())
+				return 0;
+			if (_pos >= _pattern.size() || _pattern[_pos] != ')')
+				return fail("missing )");
+			_pos++;
+			return inner;
+		}
+
+		// {n}, {n,} or {n,m} at _pos; anything else leaves the '{' a literal
+		bool quantifier(int& min, int& max) {
+			size_t pos = _pos + 1;
+			if (!number(pos, min))
+				return false;
+			max = min;
+			if (pos < _pattern.size() && _pattern[pos] == ',') {
+				pos++;
+				if (!number(pos, max))
+					max = -1;
+			}
+			if (pos >= _pattern.size() || _pattern[pos] != '}')
+				return false;
+			_pos = pos + 1;
+			if (min > REGEX_REPEAT_MAX || max > REGEX_REPEAT_MAX)
+				fail("repetition bound too large");
+			else if (max >= 0 && max < min)
+				fail("repetition bounds out of order");
+			return true;
+		}
+
+		bool number(size_t& pos, int& value) {
+			size_t start = pos;
+			value = 0;
+			for (; pos < _pattern.size() && std::isdigit(static_cast<unsigned char>(_pattern[pos])); pos++)
+				value = std::min(value * 10 + (_pattern[pos] - '0'), REGEX_REPEAT_MAX + 1);
+			return pos > start;
+		}
+
+		// After a backslash, inside a class or out
+		bool escape(std::bitset<256>& bytes) {
+			if (_pos >= _pattern.size()) {
+				fail("trailing backslash");
+				return false;
+			}
+			char c = _pattern[_pos++];
+			switch (c) {
+				case 'd': bytes |= byteClass(std::isdigit); break;
+				case 'D': bytes |= ~byteClass(std::isdigit); break;
+				case 's': bytes |= byteClass(std::isspace); break;
+				case 'S': bytes |= ~byteClass(std::isspace); break;
+				case 'w': bytes |= byteClass(std::isalnum).set('_'); break;
+				case 'W': bytes |= ~byteClass(std::isalnum).set('_'); break;
+				case 'n': bytes.set('\n'); break;
+				case 'r': bytes.set('\r'); break;
+				case 't': bytes.set('\t'); break;
+				case 'f': bytes.set('\f'); break;
+				case 'v': bytes.set('\v'); break;
+				case 'e': bytes.set(0x1b); break;
+				case 'x': {
+					int value = 0;
+					for (int i = 0; i < 2; i++) {
+						if (_pos >= _pattern.size() || !std::isxdigit(static_cast<unsigned char>(_pattern[_pos]))) {
+							fail("\\x takes two hex digits");
+							return false;
+						}
+						char digit = std::tolower(_pattern[_pos++]);
+						value = value * 16 + (std::isdigit(digit) ? digit - '0' : digit - 'a' + 10);
+					}
+					bytes.set(value);
+					break;
+				}
+				default:
+					if (std::isdigit(static_cast<unsigned char>(c))) {
+						fail("backreferences are not supported");
+						return false;
+					}
+					if (std::isalpha(static_cast<unsigned char>(c))) {
+						fail(std::string("unsupported escape \\") + c);
+						return false;
+					}
+					bytes.set(static_cast<unsigned char>(c));
+			}
+			return true;
+		}
+
+		// After '[': items and ranges up to the closing ']', which may itself come first
+		bool bracket(std::bitset<256>& bytes) {
+			bool negate = (_pos < _pattern.size() && _pattern[_pos] == '^');
+			if (negate)
+				_pos++;
+			for (bool first = true; ; first = false) {
+				if (_pos >= _pattern.size()) {
+					fail("missing ]");
+					return false;
+				}
+				if (_pattern[_pos] == ']' && !first) {
+					_pos++;
+					break;
+				}
+				if (_pattern.compare(_pos, 2, "[:") == 0) {
+					if (!posixClass(bytes))
+						return false;
+					continue;
+				}
+				int low = item(bytes);
+				if (low == -2)
+					return false;
+				if (low < 0 || _pos + 1 >= _pattern.size() || _pattern[_pos] != '-' || _pattern[_pos + 1] == ']') {
+					if (low >= 0)
+						bytes.set(low);
+					continue;
+				}
+				_pos++;
+				std::bitset<256> ignored;
+				int high = item(ignored);
+				if (high == -2)
+					return false;
+				if (high < low) {
+					fail("bad range in []");
+					return false;
+				}
+				for (int byte = low; byte <= high; byte++)
+					bytes.set(byte);
+			}
+			if (negate)
+				bytes.flip();
+			return true;
+		}
+
+		// One byte of a class, returned to be a range end, or a class escape added to bytes (-1); -2 = error
+		int item(std::bitset<256>& bytes) {
+			if (_pattern[_pos] != '\\')
+				return static_cast<unsigned char>(_pattern[_pos++]);
+			_pos++;
+			std::bitset<256> escaped;
+			if (!escape(escaped))
+				return -2;
+			if (escaped.count() != 1) {
+				bytes |= escaped;
+				return -1;
+			}
+			int byte = 0;
+			while (!escaped.test(byte))
+				byte++;
+			return byte;
+		}
+
+		bool posixClass(std::bitset<256>& bytes) {
+			static const struct { const char* name; int (*test)(int); } classes[] = {
+				{ "alpha", std::isalpha }, { "digit", std::isdigit }, { "alnum", std::isalnum },
+				{ "space", std::isspace }, { "upper", std::isupper }, { "lower", std::islower },
+				{ "punct", std::ispunct }, { "xdigit", std::isxdigit }, { "print", std::isprint },
+				{ "cntrl", std::iscntrl }, { "graph", std::isgraph }
+			};
+			size_t end = _pattern.find(":]", _pos + 2);
+			std::string name = (end == std::string::npos) ? "" : _pattern.substr(_pos + 2, end - _pos - 2);
+			for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+				if (name == classes[i].name) {
+					bytes |= byteClass(classes[i].test);
+					_pos = end + 2;
+					return true;
+				}
+			}
+			fail("unknown class [:" + name + ":]");
+			return false;
+		}
+
+		static std::bitset<256> byteClass(int (*test)(int)) {
+			std::bitset<256> bytes;
+			for (int byte = 0; byte < 128; byte++)
+				if (test(byte))
+					bytes.set(byte);
+			return bytes;
+		}
+
+		size_t add(const Node& node) {
+			_nodes.push_back(node);
+			return _nodes.size() - 1;
+		}
+
+		size_t fail(const std::string& reason) {
+			if (_error.empty())
+				_error = reason + " at offset " + offset();
+			_pos = _pattern.size();
+			return 0;
+		}
+
+		std::string offset() const {
+			char buffer[24];
+			std::snprintf(buffer, sizeof(buffer), "%lu", static_cast<unsigned long>(_pos));
+			return buffer;
+		}
+
+		const std::string&	_pattern;
+		size_t				_pos;
+		int					_depth;
+		std::vector<Node>&	_nodes;
+		std::string			_error;
+		bool				_caseless;   // (?i) in front
+};
+
+RegexSet::RegexSet() : _nfa(), _start(0), _patterns(0), _compiled(false), _classes(1), _dfa(), _table() {
+
+	// The shared start: every pattern, or any byte and back, so a match may begin anywhere
+	_start = newState(STATE_EPSILON);
+	int any = newState(STATE_SET);
+	_nfa[any].bytes.set();
+	_nfa[any].out = _start;
+	link(_start, any);
+	std::memset(_classOf, 0, sizeof(_classOf));
+}
+
+bool RegexSet::add(const std::string& pattern, bool caseless, std::string& error) {
+
+	std::vector<Node> nodes;
+	Parser parser(pattern, nodes);
+	size_t root = parser.parse();
+	if (!parser.error().empty()) {
+		error = parser.error();
+		return false;
+	}
+	if (cost(nodes, root) > REGEX_NFA_STATES_MAX) {
+		error = "pattern too large once its repetitions are unrolled";
+		return false;
+	}
+	if (caseless || parser.caseless()) {
+		for (size_t i = 0; i < nodes.size(); i++) {
+			for (int byte = 'a'; byte <= 'z'; byte++) {
+				if (nodes[i].bytes.test(byte) || nodes[i].bytes.test(std::toupper(byte))) {
+					nodes[i].bytes.set(byte);
+					nodes[i].bytes.set(std::toupper(byte));
+				}
+			}
+		}
+	}
+	Fragment fragment = build(nodes, root);
+	int accept = newState(STATE_ACCEPT);
+	_nfa[accept].pattern = static_cast<int>(_patterns++);
+	link(fragment.last, accept);
+	link(_start, fragment.first);
+	_compiled = false;
+	return true;
+}
+
+void RegexSet::compile() {
+
+	_compiled = true;
+	if (!buildDfa()) {
+		_dfa.clear();
+		_table.clear();
+	}
+}
+
+int RegexSet::match(const std::string& subject) const {
+
+	if (!_compiled || _dfa.empty())
+		return simulate(subject);
+	int state = 0;
+	int best = _dfa[0].accept;
+	for (size_t i = 0; i < subject.size() && best != 0; i++) {
+		state = _table[state * _classes + _classOf[static_cast<unsigned char>(subject[i])]];
+		best = std::min(best, _dfa[state].accept);
+	}
+	best = std::min(best, _dfa[state].acceptAtEnd);
+	return (best == NONE) ? -1 : best;
+}
+
+size_t RegexSet::size() const { return _patterns; }
+
+bool RegexSet::deterministic() const { return !_dfa.empty(); }
+
+int RegexSet::newState(StateType type) {
+
+	_nfa.push_back(State());
+	_nfa.back().type = type;
+	return static_cast<int>(_nfa.size() - 1);
+}
+
+void RegexSet::link(int from, int to) { _nfa[from].next.push_back(to); }
+
+RegexSet::Fragment RegexSet::build(const std::vector<Node>& nodes, size_t index) {
+
+	const Node& node = nodes[index];
+	Fragment fragment;
+	switch (node.type) {
+		case NODE_SET:
+		case NODE_BEGIN:
+		case NODE_END: {
+			StateType type = (node.type == NODE_SET) ? STATE_SET : (node.type == NODE_BEGIN) ? STATE_BEGIN : STATE_END;
+			fragment.first = newState(type);
+			fragment.last = newState(STATE_EPSILON);
+			_nfa[fragment.first].bytes = node.bytes;
+			_nfa[fragment.first].out = fragment.last;
+			break;
+		}
+		case NODE_EMPTY:
+			fragment.first = fragment.last = newState(STATE_EPSILON);
+			break;
+		case NODE_CONCAT:
+			fragment = build(nodes, node.children[0]);
+			for (size_t i = 1; i < node.children.size(); i++) {
+				Fragment next = build(nodes, node.children[i]);
+				link(fragment.last, next.first);
+				fragment.last = next.last;
+			}
+			break;
+		case NODE_ALT:
+			fragment.first = newState(STATE_EPSILON);
+			fragment.last = newState(STATE_EPSILON);
+			for (size_t i = 0; i < node.children.size(); i++) {
+				Fragment branch = build(nodes, node.children[i]);
+				link(fragment.first, branch.first);
+				link(branch.last, fragment.last);
+			}
+			break;
+		case NODE_REPEAT: {
+			// min copies in a row, then a loop for an open bound or max - min skippable copies
+			fragment.first = fragment.last = newState(STATE_EPSILON);
+			for (int i = 0; i < node.min; i++) {
+				Fragment copy = build(nodes, node.children[0]);
+				link(fragment.last, copy.first);
+				fragment.last = copy.last;
+			}
+			int exit = newState(STATE_EPSILON);
+			if (node.max < 0) {
+				Fragment loop = build(nodes, node.children[0]);
+				link(fragment.last, loop.first);
+				link(loop.last, fragment.last);
+			}
+			for (int i = node.min; i < node.max; i++) {
+				Fragment copy = build(nodes, node.children[0]);
+				link(fragment.last, copy.first);
+				link(fragment.last, exit);
+				fragment.last = copy.last;
+			}
+			link(fragment.last, exit);
+			fragment.last = exit;
+			break;
+		}
+	}
+	return fragment;
+}
+
+// NFA states build() will create for a node, saturating instead of overflowing
+unsigned long RegexSet::cost(const std::vector<Node>& nodes, size_t index) {
+
+	const unsigned long cap = REGEX_NFA_STATES_MAX + 1;
+	const Node& node = nodes[index];
+	unsigned long total = 2;
+	for (size_t i = 0; i < node.children.size() && node.type != NODE_REPEAT; i++)
+		total = std::min(total + cost(nodes, node.children[i]), cap);
+	if (node.type == NODE_REPEAT) {
+		unsigned long copies = static_cast<unsigned long>((node.max < 0) ? node.min + 1 : node.max);
+		total = std::min(total + copies * cost(nodes, node.children[0]), cap);
+	}
+	return total;
+}
+
+/*
+	Replaces seed states with everything reachable from them without
+	consuming a byte, keeping the states that matter to what comes next:
+	byte sets, accepts and assertions that do not hold here. ^ holds only
+	at the start of the subject and $ only at its end.
+*/
+void RegexSet::closure(std::vector<int>& states, bool atBegin, bool atEnd) const {
+
+	std::vector<char> seen(_nfa.size(), 0);
+	std::vector<int> stack;
+	stack.swap(states);
+	while (!stack.empty()) {
+		int index = stack.back();
+		stack.pop_back();
+		if (seen[index])
+			continue;
+		seen[index] = 1;
+		const State& state = _nfa[index];
+		if (state.type == STATE_EPSILON)
+			stack.insert(stack.end(), state.next.begin(), state.next.end());
+		else if (state.type == STATE_BEGIN) {
+			if (atBegin)
+				stack.push_back(state.out);
+		}
+		else if (state.type == STATE_END && atEnd)
+			stack.push_back(state.out);
+		else
+			states.push_back(index);
+	}
+	std::sort(states.begin(), states.end());
+}
+
+int RegexSet::lowestAccept(const std::vector<int>& states) const {
+
+	int lowest = NONE;
+	for (size_t i = 0; i < states.size(); i++)
+		if (_nfa[states[i]].type == STATE_ACCEPT)
+			lowest = std::min(lowest, _nfa[states[i]].pattern);
+	return lowest;
+}
+
+// The NFA run directly, a set of states per byte; for sets too large for a DFA
+int RegexSet::simulate(const std::string& subject) const {
+
+	std::vector<int> current(1, _start);
+	closure(current, true, false);
+	int best = lowestAccept(current);
+	std::vector<int> next;
+	for (size_t i = 0; i < subject.size() && best != 0; i++) {
+		unsigned char byte = static_cast<unsigned char>(subject[i]);
+		next.clear();
+		for (size_t j = 0; j < current.size(); j++)
+			if (_nfa[current[j]].type == STATE_SET && _nfa[current[j]].bytes.test(byte))
+				next.push_back(_nfa[current[j]].out);
+		closure(next, false, false);
+		current.swap(next);
+		best = std::min(best, lowestAccept(current));
+	}
+	closure(current, subject.empty(), true);
+	best = std::min(best, lowestAccept(current));
+	return (best == NONE) ? -1 : best;
+}
+
+// Subset construction; false when the DFA would outgrow REGEX_DFA_STATES_MAX
+bool RegexSet::buildDfa() {
+
+	// Byte classes: bytes no byte set of any pattern tells apart share a column
+	std::vector<int> classOf(256, 0);
+	_classes = 1;
+	for (size_t i = 0; i < _nfa.size(); i++) {
+		if (_nfa[i].type != STATE_SET)
+			continue;
+		std::map<std::pair<int, bool>, int> split;
+		for (int byte = 0; byte < 256; byte++) {
+			std::pair<int, bool> key(classOf[byte], _nfa[i].bytes.test(byte));
+			std::map<std::pair<int, bool>, int>::iterator it = split.find(key);
+			if (it == split.end())
+				it = split.insert(std::make_pair(key, static_cast<int>(split.size()))).first;
+			classOf[byte] = it->second;
+		}
+		_classes = split.size();
+	}
+	std::vector<int> representative(_classes, 0);
+	for (int byte = 255; byte >= 0; byte--) {
+		_classOf[byte] = static_cast<unsigned char>(classOf[byte]);
+		representative[classOf[byte]] = byte;
+	}
+
+	// The start state stays out of the index: ^ holds only there, even if a later set looks the same
+	std::vector<std::vector<int> > sets(1, std::vector<int>(1, _start));
+	closure(sets[0], true, false);
+	std::map<std::vector<int>, int> index;
+	_dfa.clear();
+	_table.clear();
+	std::vector<int> next;
+	for (size_t i = 0; i < sets.size(); i++) {
+		DfaState state;
+		state.accept = lowestAccept(sets[i]);
+		next = sets[i];
+		closure(next, i == 0, true);
+		state.acceptAtEnd = lowestAccept(next);
+		_dfa.push_back(state);
+		for (size_t byteClass = 0; byteClass < _classes; byteClass++) {
+			next.clear();
+			for (size_t j = 0; j < sets[i].size(); j++) {
+				const State& nfaState = _nfa[sets[i][j]];
+				if (nfaState.type == STATE_SET && nfaState.bytes.test(representative[byteClass]))
+					next.push_back(nfaState.out);
+			}
+			closure(next, false, false);
+			std::map<std::vector<int>, int>::iterator it = index.find(next);
+			if (it == index.end()) {
+				if (sets.size() >= REGEX_DFA_STATES_MAX)
+					return false;
+				it = index.insert(std::make_pair(next, static_cast<int>(sets.size()))).first;
+				sets.push_back(next);
+			}
+			_table.push_back(it->second);
+		}
+	}
+	return true;
+}
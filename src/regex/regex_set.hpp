@@ -0,0 +1,105 @@
+#ifndef REGEX_SET_HPP
+#define REGEX_SET_HPP
+
+#include <string>
+#include <vector>
+#include <bitset>
+
+#define REGEX_DFA_STATES_MAX	4096   // past it the set is run as an NFA instead
+#define REGEX_REPEAT_MAX		255    // largest bound of a {n,m} repetition
+#define REGEX_NFA_STATES_MAX	65536  // per pattern, once repetitions are unrolled
+#define REGEX_NESTING_MAX		64     // groups inside groups
+
+/*
+	A set of regular expressions compiled into a single automaton, for the
+	"location ~" blocks of a server: a subject is run through it once and
+	the result is the first pattern, in the order they were added, found
+	anywhere in it.
+
+	The syntax is the part of PCRE nginx configurations use: literals and
+	escapes, ., [classes] with ranges and [:posix:] names, \d \w \s and
+	their negations, groups (non-capturing and named ones too), |, the
+	quantifiers * + ? {n} {n,} {n,m} (their lazy forms match the same),
+	^ and $. Backreferences, lookaround and word boundaries are refused.
+
+	Each pattern becomes a Thompson NFA; they share one start state that
+	loops over any byte, so a pattern may begin anywhere. Subset
+	construction over byte classes then turns the whole set into one DFA
+	whose states know the first pattern they accept, there or at the end
+	of the subject ($). A set that needs more than REGEX_DFA_STATES_MAX
+	states is simulated as its NFA, still in a single pass.
+*/
+class RegexSet {
+
+	public:
+		RegexSet();
+
+		// Appends a pattern; false with a reason when it is malformed or unsupported
+		bool	add(const std::string& pattern, bool caseless, std::string& error);
+		void	compile();   // after the last add()
+
+		int		match(const std::string& subject) const;   // index of the first pattern found, -1 = none
+		size_t	size() const;
+		bool	deterministic() const;   // compiled to a DFA
+
+	private:
+		enum NodeType { NODE_SET, NODE_BEGIN, NODE_END, NODE_EMPTY, NODE_CONCAT, NODE_ALT, NODE_REPEAT };
+		enum StateType { STATE_EPSILON, STATE_SET, STATE_BEGIN, STATE_END, STATE_ACCEPT };
+
+		// Parsed pattern, built into NFA states as many times as repetitions need
+		struct Node {
+			Node() : type(NODE_EMPTY), bytes(), children(), min(0), max(0) {}
+
+			NodeType			type;
+			std::bitset<256>	bytes;      // NODE_SET
+			std::vector<size_t>	children;
+			int					min;        // NODE_REPEAT
+			int					max;        // -1 = unbounded
+		};
+
+		struct State {
+			State() : type(STATE_EPSILON), bytes(), out(-1), next(), pattern(-1) {}
+
+			StateType			type;
+			std::bitset<256>	bytes;      // STATE_SET
+			int					out;        // after the byte or assertion
+			std::vector<int>	next;       // STATE_EPSILON
+			int					pattern;    // STATE_ACCEPT
+		};
+
+		// NFA states from first to last, where last is an epsilon state not linked on yet
+		struct Fragment {
+			int	first;
+			int	last;
+		};
+
+		struct DfaState {
+			int	accept;        // lowest pattern accepted on reaching it, NONE if none
+			int	acceptAtEnd;   // the same when the subject ends there
+		};
+
+		class Parser;
+
+		int			newState(StateType type);
+		void		link(int from, int to);
+		Fragment	build(const std::vector<Node>& nodes, size_t node);
+		void		closure(std::vector<int>& states, bool atBegin, bool atEnd) const;
+		int			lowestAccept(const std::vector<int>& states) const;
+		int			simulate(const std::string& subject) const;
+		bool		buildDfa();
+
+		static unsigned long	cost(const std::vector<Node>& nodes, size_t node);
+
+		static const int	NONE;
+
+		std::vector<State>		_nfa;
+		int						_start;       // the shared loop over any byte
+		size_t					_patterns;
+		bool					_compiled;
+		unsigned char			_classOf[256];
+		size_t					_classes;
+		std::vector<DfaState>	_dfa;         // empty when run as the NFA
+		std::vector<int>		_table;       // _dfa.size() x _classes transitions
+};
+
+#endif
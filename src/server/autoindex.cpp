@@ -0,0 +1,291 @@
+#include "autoindex.hpp"
+#include "http_response.hpp"
+#include "clock.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static bool compareEntries(const DirectoryEntry& a, const DirectoryEntry& b) {
+
+	if (a.isDirectory != b.isDirectory)
+		return a.isDirectory;
+	return a.name < b.name;
+}
+
+static std::string htmlEscape(const std::string& s) {
+
+	std::string out;
+	for (size_t i = 0; i < s.length(); i++) {
+		switch (s[i]) {
+			case '&': out += "&amp;"; break;
+			case '<': out += "&lt;"; break;
+			case '>': out += "&gt;"; break;
+			case '"': out += "&quot;"; break;
+			default: out += s[i];
+		}
+	}
+	return out;
+}
+
+static std::string jsonEscape(const std::string& s) {
+
+	static const char hex[] = "0123456789abcdef";
+	std::string out;
+	for (size_t i = 0; i < s.length(); i++) {
+		unsigned char c = static_cast<unsigned char>(s[i]);
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += static_cast<char>(c);
+		}
+		else if (c < 0x20) {
+			out += "\\u00";
+			out += hex[c >> 4];
+			out += hex[c & 0xf];
+		}
+		else
+			out += static_cast<char>(c);
+	}
+	return out;
+}
+
+// Percent-encodes everything outside the RFC 3986 unreserved set
+static std::string urlEncode(const std::string& s) {
+
+	static const char hex[] = "0123456789ABCDEF";
+	std::string out;
+	for (size_t i = 0; i < s.length(); i++) {
+		unsigned char c = static_cast<unsigned char>(s[i]);
+		if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+			out += static_cast<char>(c);
+		else {
+			out += '%';
+			out += hex[c >> 4];
+			out += hex[c & 0xf];
+		}
+	}
+	return out;
+}
+
+static std::string directoryUrl(const std::string& requestPath) {
+
+	if (!requestPath.empty() && requestPath[requestPath.length() - 1] == '/')
+		return requestPath;
+	return requestPath + "/";
+}
+
+static size_t pageCount(size_t total, size_t limit) {
+
+	return total == 0 ? 1 : (total + limit - 1) / limit;
+}
+
+static size_t parseCount(const std::string& value, size_t fallback) {
+
+	if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos || value.length() > 9)
+		return fallback;
+	size_t n = static_cast<size_t>(std::atol(value.c_str()));
+	return n == 0 ? fallback : n;
+}
+
+AutoindexPage parseAutoindexQuery(const std::string& query, bool preferJson) {
+
+	AutoindexPage page;
+	page.format = preferJson ? AUTOINDEX_JSON : AUTOINDEX_HTML;
+	page.page = 1;
+	page.limit = AUTOINDEX_DEFAULT_LIMIT;
+
+	size_t pos = 0;
+	while (pos < query.length()) {
+		size_t amp = query.find('&', pos);
+		if (amp == std::string::npos) amp = query.length();
+		std::string pair = query.substr(pos, amp - pos);
+		pos = amp + 1;
+
+		size_t eq = pair.find('=');
+		std::string key = pair.substr(0, eq);
+		std::string value = (eq == std::string::npos) ? "" : pair.substr(eq + 1);
+		if (key == "page")
+			page.page = parseCount(value, 1);
+		else if (key == "limit")
+			page.limit = std::min(parseCount(value, AUTOINDEX_DEFAULT_LIMIT), static_cast<size_t>(AUTOINDEX_MAX_LIMIT));
+		else if (key == "format")
+			page.format = (value == "json") ? AUTOINDEX_JSON : AUTOINDEX_HTML;
+	}
+	return page;
+}
+
+std::string renderAutoindexHtml(const DirectorySnapshot& snapshot, const std::string& requestPath,
+	const AutoindexPage& page) {
+
+	std::string base = directoryUrl(requestPath);
+	std::string href = htmlEscape(base);   // the request path as sent, only made safe inside the attribute
+	std::string title = "Index of " + href;
+	size_t total = snapshot.entries.size();
+	size_t pages = pageCount(total, page.limit);
+	size_t first = std::min((page.page - 1) * page.limit, total);
+	size_t last = std::min(first + page.limit, total);
+
+	std::ostringstream oss;
+	oss << "<html>\r\n<head><title>" << title << "</title></head>\r\n<body>\r\n"
+		<< "<h1>" << title << "</h1><hr><pre>";
+	if (base != "/")
+		oss << "<a href=\"../\">../</a>\r\n";
+	for (size_t i = first; i < last; i++) {
+		const DirectoryEntry& entry = snapshot.entries[i];
+		std::string name = entry.name + (entry.isDirectory ? "/" : "");
+		oss << "<a href=\"" << href << urlEncode(entry.name) << (entry.isDirectory ? "/" : "") << "\">"
+			<< htmlEscape(name) << "</a>";
+		size_t pad = name.length() < 50 ? 51 - name.length() : 1;
+		char date[HTTP_DATE_SIZE];
+		HttpResponse::formatHttpDate(entry.mtime, date);
+		oss << std::string(pad, ' ') << date << "  ";
+		if (entry.isDirectory)
+			oss << std::setw(12) << "-";
+		else
+			oss << std::setw(12) << static_cast<unsigned long>(entry.size);
+		oss << "\r\n";
+	}
+	oss << "</pre><hr>";
+	if (pages > 1) {
+		oss << "<p>";
+		if (page.page > 1)
+			oss << "<a href=\"" << href << "?page=" << page.page - 1 << "&amp;limit=" << page.limit << "\">&laquo; prev</a> ";
+		oss << "page " << page.page << " of " << pages << " (" << total << " entries)";
+		if (page.page < pages)
+			oss << " <a href=\"" << href << "?page=" << page.page + 1 << "&amp;limit=" << page.limit << "\">next &raquo;</a>";
+		oss << "</p>";
+	}
+	oss << "\r\n</body>\r\n</html>\r\n";
+	return oss.str();
+}
+
+std::string renderAutoindexJson(const DirectorySnapshot& snapshot, const std::string& requestPath,
+	const AutoindexPage& page) {
+
+	size_t total = snapshot.entries.size();
+	size_t first = std::min((page.page - 1) * page.limit, total);
+	size_t last = std::min(first + page.limit, total);
+
+	std::ostringstream oss;
+	oss << "{\"path\":\"" << jsonEscape(directoryUrl(requestPath)) << "\""
+		<< ",\"page\":" << page.page
+		<< ",\"limit\":" << page.limit
+		<< ",\"pages\":" << pageCount(total, page.limit)
+		<< ",\"total\":" << total
+		<< ",\"entries\":[";
+	for (size_t i = first; i < last; i++) {
+		const DirectoryEntry& entry = snapshot.entries[i];
+		if (i != first) oss << ",";
+		oss << "{\"name\":\"" << jsonEscape(entry.name) << "\""
+			<< ",\"type\":\"" << (entry.isDirectory ? "directory" : "file") << "\""
+			<< ",\"size\":" << static_cast<unsigned long>(entry.isDirectory ? 0 : entry.size)
+			<< ",\"mtime\":" << static_cast<unsigned long>(entry.mtime) << "}";
+	}
+	oss << "]}\n";
+	return oss.str();
+}
+
+AutoindexCache::AutoindexCache() : _snapshots(), _useCounter(0) {}
+
+AutoindexCache::~AutoindexCache() {}
+
+size_t AutoindexCache::size() const { return _snapshots.size(); }
+
+bool AutoindexCache::scan(int dirFd, DirectorySnapshot& snapshot) {
+
+	// A descriptor of its own: readdir() would move an offset shared with dirFd
+	int fd = openat(dirFd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR* dir = (fd < 0) ? NULL : fdopendir(fd);
+	if (!dir) {
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+
+	snapshot.entries.clear();
+	struct dirent* ent;
+	while ((ent = readdir(dir)) != NULL) {
+		std::string name = ent->d_name;
+		if (name == "." || name == "..")
+			continue;
+		struct stat st;
+		if (fstatat(dirfd(dir), ent->d_name, &st, 0) != 0)
+			continue;
+		DirectoryEntry entry;
+		entry.name = name;
+		entry.isDirectory = S_ISDIR(st.st_mode);
+		entry.size = st.st_size;
+		entry.mtime = st.st_mtime;
+		snapshot.entries.push_back(entry);
+	}
+	closedir(dir);
+	std::sort(snapshot.entries.begin(), snapshot.entries.end(), compareEntries);
+	snapshot.pages.clear();
+	return true;
+}
+
+void AutoindexCache::evict() {
+
+	std::map<std::string, DirectorySnapshot>::iterator oldest = _snapshots.end();
+	for (std::map<std::string, DirectorySnapshot>::iterator it = _snapshots.begin(); it != _snapshots.end(); ++it) {
+		if (oldest == _snapshots.end() || it->second.lastUsed < oldest->second.lastUsed)
+			oldest = it;
+	}
+	if (oldest != _snapshots.end())
+		_snapshots.erase(oldest);
+}
+
+DirectorySnapshot* AutoindexCache::snapshot(int dirFd, const std::string& dirPath, const struct stat& dirStat) {
+
+	std::map<std::string, DirectorySnapshot>::iterator it = _snapshots.find(dirPath);
+	if (it != _snapshots.end()) {
+		DirectorySnapshot& cached = it->second;
+		// A change within the scan's own second may not have moved mtime: rescan then
+		if (cached.dev == dirStat.st_dev && cached.ino == dirStat.st_ino
+			&& cached.mtime == dirStat.st_mtime && cached.scannedAt > cached.mtime) {
+			cached.lastUsed = ++_useCounter;
+			return &cached;
+		}
+	}
+	else if (_snapshots.size() >= AUTOINDEX_MAX_SNAPSHOTS)
+		evict();
+
+	DirectorySnapshot& fresh = _snapshots[dirPath];
+	if (!scan(dirFd, fresh)) {
+		_snapshots.erase(dirPath);
+		return NULL;
+	}
+	fresh.dev = dirStat.st_dev;
+	fresh.ino = dirStat.st_ino;
+	fresh.mtime = dirStat.st_mtime;
+	fresh.scannedAt = Clock::now();
+	fresh.lastUsed = ++_useCounter;
+	std::cout << "[DEBUG] Autoindex scanned " << dirPath << ": " << fresh.entries.size() << " entries" << std::endl;
+	return &fresh;
+}
+
+const std::string* AutoindexCache::render(int dirFd, const std::string& dirPath, const struct stat& dirStat,
+	const std::string& requestPath, const AutoindexPage& page) {
+
+	DirectorySnapshot* snap = snapshot(dirFd, dirPath, dirStat);
+	if (!snap)
+		return NULL;
+
+	std::ostringstream key;
+	key << page.format << ":" << page.page << ":" << page.limit << ":" << requestPath;
+	std::map<std::string, std::string>::iterator it = snap->pages.find(key.str());
+	if (it != snap->pages.end())
+		return &it->second;
+
+	if (snap->pages.size() >= AUTOINDEX_MAX_PAGES)
+		snap->pages.clear();
+	std::string& body = snap->pages[key.str()];
+	body = (page.format == AUTOINDEX_JSON) ? renderAutoindexJson(*snap, requestPath, page)
+		: renderAutoindexHtml(*snap, requestPath, page);
+	return &body;
+}
@@ -0,0 +1,85 @@
+#ifndef AUTOINDEX_HPP
+#define AUTOINDEX_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define AUTOINDEX_DEFAULT_LIMIT		100
+#define AUTOINDEX_MAX_LIMIT			1000
+#define AUTOINDEX_MAX_SNAPSHOTS		64     // directories kept in memory
+#define AUTOINDEX_MAX_PAGES			16     // rendered pages kept per directory
+
+enum AutoindexFormat {
+	AUTOINDEX_HTML,
+	AUTOINDEX_JSON
+};
+
+struct DirectoryEntry {
+	std::string	name;
+	bool		isDirectory;
+	off_t		size;
+	time_t		mtime;
+};
+
+/*
+	One scan of a directory, sorted once (directories first, then by name).
+	It stays valid while the directory's identity and mtime are unchanged;
+	adding, removing or renaming an entry bumps the directory mtime.
+	Sizes and dates of the entries are those seen at scan time.
+*/
+struct DirectorySnapshot {
+	dev_t		dev;
+	ino_t		ino;
+	time_t		mtime;
+	time_t		scannedAt;
+	unsigned long	lastUsed;
+	std::vector<DirectoryEntry>			entries;
+	std::map<std::string, std::string>	pages;   // rendered bodies by "format:page:limit"
+};
+
+struct AutoindexPage {
+	AutoindexFormat	format;
+	size_t			page;    // 1-based
+	size_t			limit;
+};
+
+/*
+	Directory listings served from cached snapshots. The caller has the
+	directory open already (beneath its location root) and fstat()ed; the
+	readdir()/fstatat() scan through that descriptor and the sort only run
+	when the directory changed, and rendering is O(limit) per page
+	(rendered pages are cached too). dirPath only names the snapshot.
+*/
+class AutoindexCache {
+
+	public:
+		AutoindexCache();
+		~AutoindexCache();
+
+		// Body of the requested page, NULL if the directory cannot be read
+		const std::string*	render(int dirFd, const std::string& dirPath, const struct stat& dirStat,
+								const std::string& requestPath, const AutoindexPage& page);
+		size_t				size() const;
+
+	private:
+		DirectorySnapshot*	snapshot(int dirFd, const std::string& dirPath, const struct stat& dirStat);
+		static bool			scan(int dirFd, DirectorySnapshot& snapshot);
+		void				evict();
+
+		std::map<std::string, DirectorySnapshot>	_snapshots;
+		unsigned long								_useCounter;
+};
+
+// page/limit/format from the query string ("page=2&limit=50&format=json")
+AutoindexPage	parseAutoindexQuery(const std::string& query, bool preferJson);
+
+std::string		renderAutoindexHtml(const DirectorySnapshot& snapshot, const std::string& requestPath,
+					const AutoindexPage& page);
+std::string		renderAutoindexJson(const DirectorySnapshot& snapshot, const std::string& requestPath,
+					const AutoindexPage& page);
+
+#endif
@@ -3,20 +3,52 @@
 #define CLIENT_INFO
 
 #include <string>
+#include <vector>
+#include <sys/types.h>
 #include <socket.hpp>
 
+struct StaticResponse;
+class BodyUpload;
+class CgiBackend;
+class ResponseCache;
+class CacheFill;
+
+// Room for the per-request "Date: ...\r\nConnection: ...\r\n\r\n" lines
+#define STATIC_HEADERS_SIZE 96
+
 // Client connection states
 enum ClientState {
 	READING_REQUEST,   // Waiting to read HTTP request
+	READING_BODY,      // Headers handled, body streamed to an upload as it arrives
+	WAITING_TASK,      // Blocking work for this request runs on the worker pool
+	RUNNING_CGI,       // Body piped into a script, its output relayed as it comes
+	WAITING_CACHE,     // Another request is fetching the same response for the proxy_cache
 	SENDING_RESPONSE   // Ready to send HTTP response
 };
 
 
+// Piece of a file-backed response body: optional in-memory prefix
+// (multipart/byteranges part header) followed by a byte range of the file.
+struct FileSegment {
+	FileSegment() : prefix(), offset(0), length(0) {}
+	FileSegment(const std::string& p, off_t o, size_t l) : prefix(p), offset(o), length(l) {}
+
+	std::string	prefix;
+	off_t		offset;
+	size_t		length;
+};
+
 // Structure to track client connection info
 struct ClientInfo {
 
-	ClientInfo() : socket(), state(READING_REQUEST), bytesSent(0), shouldClose(false) {}
-	ClientInfo(int fd) : socket(fd), state(READING_REQUEST), bytesSent(0), shouldClose(false) {}
+	ClientInfo() : socket(), state(READING_REQUEST), bytesSent(0), headOnly(false), upload(NULL), bodyRemaining(0),
+		bodyChecked(false), taskId(0), inlineWork(false), cgi(NULL), cache(NULL), cacheKey(), cacheLock(false),
+		cacheValid(0), cacheFill(NULL), staticResponse(NULL), staticHeadersLength(0), staticSent(0), fileFd(-1),
+		segmentIndex(0), segmentSent(0), shouldClose(false) {}
+	ClientInfo(int fd) : socket(fd), state(READING_REQUEST), bytesSent(0), headOnly(false), upload(NULL), bodyRemaining(0),
+		bodyChecked(false), taskId(0), inlineWork(false), cgi(NULL), cache(NULL), cacheKey(), cacheLock(false),
+		cacheValid(0), cacheFill(NULL), staticResponse(NULL), staticHeadersLength(0), staticSent(0), fileFd(-1),
+		segmentIndex(0), segmentSent(0), shouldClose(false) {}
 
 	//connection data
 	Socket		socket;
@@ -28,9 +60,42 @@ struct ClientInfo {
 	size_t		bytesSent;
 	std::string	requestData;
 	std::string	responseData;
+	bool		headOnly;          // HEAD request: headers only, no body
+
+	//streamed request body (READING_BODY), requestData keeps only the headers
+	BodyUpload*			upload;        // owned, deleted by Server::resetResponse
+	size_t				bodyRemaining;
+	bool				bodyChecked;   // location/size checks done before the body (Expect: 100-continue)
+
+	//offloaded work (WAITING_TASK): a completion only applies if its id still matches
+	unsigned long		taskId;
+	bool				inlineWork;    // pool already ran for this request, finish the rest inline
+
+	//CGI script of this request (RUNNING_CGI), owned, deleted by Server::resetResponse
+	CgiBackend*			cgi;
+
+	//proxy_cache of the request (the Server's), the key it locked (cacheLock) or waits for (WAITING_CACHE)
+	ResponseCache*		cache;
+	std::string			cacheKey;
+	bool				cacheLock;
+	long				cacheValid;    // proxy_cache_valid of the location
+	CacheFill*			cacheFill;     // response being stored, owned, ended by Server::releaseCache
+
+	//pre-rendered response (error pages), borrowed from the Server and sent
+	//as head + staticHeaders + body before responseData
+	const StaticResponse*	staticResponse;
+	char					staticHeaders[STATIC_HEADERS_SIZE];
+	size_t					staticHeadersLength;
+	size_t					staticSent;
+
+	//file body, streamed with sendfile() after responseData
+	int							fileFd;
+	std::vector<FileSegment>	fileSegments;
+	size_t						segmentIndex;     // segment being sent
+	size_t						segmentSent;      // bytes of it already sent (prefix + range)
 
 	//timeout data
-	time_t		lastActivity;        // Last time client sent data
+	unsigned long	lastActivity;    // Clock::monotonicMs() of last send/recv
 	int			keepAliveTimeout;       // Timeout in seconds (default 15)
 
 	//request limits
@@ -0,0 +1,54 @@
+#include "file_metadata.hpp"
+#include "http_response.hpp"
+#include "path_beneath.hpp"
+#include "clock.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+FileMetadataCache::FileMetadataCache() : _entries() {}
+
+FileMetadataCache::~FileMetadataCache() {}
+
+size_t FileMetadataCache::size() const { return _entries.size(); }
+
+const FileMetadata& FileMetadataCache::lookup(int rootFd, const std::string& path) {
+
+	unsigned long now = Clock::monotonicMs();
+	Key key(rootFd, path);
+	std::map<Key, FileMetadata>::iterator it = _entries.find(key);
+	if (it != _entries.end() && now - it->second.checkedAt < METADATA_CACHE_VALID_MS)
+		return it->second;
+
+	if (it == _entries.end()) {
+		if (_entries.size() >= METADATA_CACHE_MAX_ENTRIES)
+			_entries.clear();
+		it = _entries.insert(std::make_pair(key, FileMetadata())).first;
+	}
+
+	FileMetadata& metadata = it->second;
+	struct stat st;
+	// Opened for reading, as GET opens it: a file GET could not read is not reported as there
+	int fd = openBeneath(rootFd, path, O_RDONLY | O_NONBLOCK);
+	bool exists = (fd >= 0 && fstat(fd, &st) == 0);
+	int error = exists ? 0 : errno;
+	if (fd >= 0)
+		close(fd);
+	bool changed = !exists || !metadata.exists || st.st_mtime != metadata.mtime || st.st_size != metadata.size;
+
+	metadata.checkedAt = now;
+	metadata.exists = exists;
+	metadata.error = error;
+	if (!exists || !changed)
+		return metadata;
+	metadata.isDirectory = S_ISDIR(st.st_mode);
+	metadata.isRegular = S_ISREG(st.st_mode);
+	metadata.size = st.st_size;
+	metadata.mtime = st.st_mtime;
+	char etag[ETAG_SIZE];
+	char lastModified[HTTP_DATE_SIZE];
+	metadata.etag.assign(etag, HttpResponse::formatETag(st.st_mtime, st.st_size, etag));
+	metadata.lastModified.assign(lastModified, HttpResponse::formatHttpDate(st.st_mtime, lastModified));
+	return metadata;
+}
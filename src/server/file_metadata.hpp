@@ -0,0 +1,52 @@
+#ifndef FILE_METADATA_HPP
+#define FILE_METADATA_HPP
+
+#include <string>
+#include <map>
+#include <ctime>
+#include <sys/types.h>
+
+#define METADATA_CACHE_VALID_MS		1000    // how long a stat() result is trusted
+#define METADATA_CACHE_MAX_ENTRIES	4096
+
+// stat() result of a path plus the validators derived from it
+struct FileMetadata {
+	FileMetadata() : exists(false), error(0), isDirectory(false), isRegular(false), size(0), mtime(0),
+		etag(), lastModified(), checkedAt(0) {}
+
+	bool			exists;
+	int				error;           // errno when it could not be opened
+	bool			isDirectory;
+	bool			isRegular;
+	off_t			size;
+	time_t			mtime;
+	std::string		etag;            // HttpResponse::formatETag
+	std::string		lastModified;    // HTTP date of mtime
+	unsigned long	checkedAt;       // Clock::monotonicMs() of the stat()
+};
+
+/*
+	Short-lived cache of stat() results (missing files included), used to
+	answer HEAD without reading the file. The path is opened for reading
+	beneath its location root (see path_beneath.hpp) and fstat()ed, so it
+	resolves, and fails, as GET's open does. An entry is trusted for METADATA_CACHE_VALID_MS, after
+	that the next lookup opens the path again, so changes on disk are seen
+	within that window (like nginx's open_file_cache_valid). When full, the
+	cache is simply cleared.
+*/
+class FileMetadataCache {
+
+	public:
+		FileMetadataCache();
+		~FileMetadataCache();
+
+		const FileMetadata&	lookup(int rootFd, const std::string& path);   // path relative to rootFd
+		size_t				size() const;
+
+	private:
+		typedef std::pair<int, std::string>	Key;
+
+		std::map<Key, FileMetadata>	_entries;
+};
+
+#endif
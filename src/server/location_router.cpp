@@ -0,0 +1,161 @@
+#include "location_router.hpp"
+#include "path_beneath.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+LocationRouter::LocationRouter() : _nodes(1), _routes(), _regexes(), _regexLocations() {}
+
+LocationRouter::~LocationRouter() { closeRoots(); }
+
+void LocationRouter::build(const std::vector<LocationConfig>& locations) {
+
+	closeRoots();
+	_nodes.assign(1, Node());
+	_routes.assign(locations.size(), LocationRoute());
+	_regexes = RegexSet();
+	_regexLocations.clear();
+	for (size_t i = 0; i < locations.size(); i++) {
+		std::string error;
+		if (!locations[i].isRegex())
+			insert(locations[i].path, static_cast<int>(i), locations[i].match);
+		else if (_regexes.add(locations[i].path, locations[i].match == LOCATION_REGEX_CASELESS, error))
+			_regexLocations.push_back(static_cast<int>(i));
+		_routes[i].methods = methodMask(locations[i].allow_methods);
+		_routes[i].root = locations[i].root;
+		rootDirectory(i);
+	}
+	_regexes.compile();
+}
+
+int LocationRouter::match(const std::string& path) const {
+
+	int best = -1;
+	bool noRegex = false;
+	size_t node = 0;
+	size_t pos = 0;
+	while (true) {
+		const Node& current = _nodes[node];
+		if (current.location >= 0 && (pos == path.size() || path[pos] == '/' || (pos > 0 && path[pos - 1] == '/'))) {
+			best = current.location;
+			noRegex = current.noRegex;
+		}
+		if (pos == path.size()) {
+			if (current.exact >= 0)
+				return current.exact;
+			break;
+		}
+		size_t next = child(current, path[pos]);
+		if (!next || path.compare(pos, _nodes[next].label.size(), _nodes[next].label) != 0)
+			break;
+		pos += _nodes[next].label.size();
+		node = next;
+	}
+	if (noRegex || _regexLocations.empty())
+		return best;
+	int regex = _regexes.match(path);
+	return (regex >= 0) ? _regexLocations[regex] : best;
+}
+
+bool LocationRouter::allows(size_t location, Methods method) const {
+
+	return (_routes[location].methods & (1u << method)) != 0;
+}
+
+const LocationRoute& LocationRouter::route(size_t location) const { return _routes[location]; }
+
+const RegexSet& LocationRouter::regexes() const { return _regexes; }
+
+int LocationRouter::rootDirectory(size_t location) {
+
+	LocationRoute& route = _routes[location];
+	if (route.rootFd < 0 && !route.root.empty())
+		route.rootFd = open(route.root.c_str(), PATH_BENEATH_DIRECTORY | O_CLOEXEC);
+	return route.rootFd;
+}
+
+void LocationRouter::closeRoots() {
+
+	for (size_t i = 0; i < _routes.size(); i++)
+		if (_routes[i].rootFd >= 0)
+			close(_routes[i].rootFd);
+	_routes.clear();
+}
+
+unsigned int LocationRouter::methodMask(const std::vector<std::string>& methods) {
+
+	unsigned int mask = 1u << OPTIONS;
+	for (size_t i = 0; i < methods.size(); i++) {
+		try {
+			mask |= 1u << stringToEnum(methods[i]);
+		}
+		catch (const std::invalid_argument&) {
+			continue;
+		}
+	}
+	if (mask & (1u << GET))
+		mask |= 1u << HEAD;
+	return mask;
+}
+
+void LocationRouter::insert(const std::string& path, int location, LocationMatch match) {
+
+	size_t node = 0;
+	size_t pos = 0;
+	while (pos < path.size()) {
+		size_t next = child(_nodes[node], path[pos]);
+		if (!next) {
+			Node leaf;
+			leaf.label = path.substr(pos);
+			_nodes.push_back(leaf);
+			addChild(node, _nodes.size() - 1);
+			node = _nodes.size() - 1;
+			break;
+		}
+		size_t labelSize = _nodes[next].label.size();
+		size_t common = 0;
+		while (common < labelSize && pos + common < path.size() && _nodes[next].label[common] == path[pos + common])
+			common++;
+		if (common < labelSize) {
+			// The edge splits: a new node takes the shared bytes, the old one hangs below it with the rest
+			Node middle;
+			middle.label = _nodes[next].label.substr(0, common);
+			_nodes.push_back(middle);
+			size_t split = _nodes.size() - 1;
+			_nodes[next].label.erase(0, common);
+			std::vector<std::pair<unsigned char, size_t> >& siblings = _nodes[node].children;
+			for (size_t i = 0; i < siblings.size(); i++)
+				if (siblings[i].second == next)
+					siblings[i].second = split;
+			addChild(split, next);
+			next = split;
+		}
+		node = next;
+		pos += common;
+	}
+	if (match == LOCATION_EXACT) {
+		if (_nodes[node].exact < 0)
+			_nodes[node].exact = location;
+	}
+	else if (_nodes[node].location < 0) {
+		_nodes[node].location = location;
+		_nodes[node].noRegex = (match == LOCATION_PREFIX_NO_REGEX);
+	}
+}
+
+size_t LocationRouter::child(const Node& node, unsigned char byte) const {
+
+	std::vector<std::pair<unsigned char, size_t> >::const_iterator it
+		= std::lower_bound(node.children.begin(), node.children.end(), std::make_pair(byte, static_cast<size_t>(0)));
+	if (it == node.children.end() || it->first != byte)
+		return 0;
+	return it->second;
+}
+
+void LocationRouter::addChild(size_t parent, size_t node) {
+
+	std::pair<unsigned char, size_t> entry(static_cast<unsigned char>(_nodes[node].label[0]), node);
+	std::vector<std::pair<unsigned char, size_t> >& children = _nodes[parent].children;
+	children.insert(std::lower_bound(children.begin(), children.end(), entry), entry);
+}
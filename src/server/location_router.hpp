@@ -0,0 +1,77 @@
+#ifndef LOCATION_ROUTER_HPP
+#define LOCATION_ROUTER_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include "config.hpp"
+#include "http_request.hpp"
+#include "regex_set.hpp"
+
+// What a request needs of its location, resolved at startup
+struct LocationRoute {
+
+	LocationRoute() : methods(0), rootFd(-1), root() {}
+
+	unsigned int	methods;   // bit (1 << Methods) per method allowed; HEAD with GET, OPTIONS always
+	int				rootFd;    // root opened as a directory, for openBeneath(); -1 until it exists
+	std::string		root;
+};
+
+/*
+	The locations of a server compiled once: their paths in a radix trie
+	for the longest prefix match, walked in one pass over the request path
+	without allocating, plus a LocationRoute per location. A prefix matches
+	at a path boundary: the whole path, before a '/', or when it ends in
+	'/' itself. Of locations with the same path the first one wins.
+
+	Precedence is nginx's. An exact location ("= /path") ends the walk when
+	the whole path lands on it. Otherwise the longest prefix is kept: if it
+	is a "^~" one it wins, else the regex locations ("~", "~*") are tried,
+	all of them in one pass through a single RegexSet, and the first in
+	configuration order that matches wins. The longest prefix is the answer
+	when none does.
+*/
+class LocationRouter {
+
+	public:
+		LocationRouter();
+		~LocationRouter();
+
+		void	build(const std::vector<LocationConfig>& locations);
+
+		int		match(const std::string& path) const;   // location index, -1 = none
+		bool	allows(size_t location, Methods method) const;
+		const LocationRoute&	route(size_t location) const;
+		const RegexSet&			regexes() const;
+		int						rootDirectory(size_t location);   // rootFd, opening a root created since startup
+
+		static unsigned int	methodMask(const std::vector<std::string>& methods);
+
+	private:
+		LocationRouter(const LocationRouter&);
+		LocationRouter& operator=(const LocationRouter&);
+
+		void	closeRoots();
+
+		struct Node {
+			Node() : label(), location(-1), noRegex(false), exact(-1), children() {}
+
+			std::string	label;      // bytes on the edge from the parent
+			int			location;   // prefix ending exactly here, -1 = none
+			bool		noRegex;    // that prefix is a "^~" one
+			int			exact;      // "= path" location ending here, -1 = none
+			std::vector<std::pair<unsigned char, size_t> >	children;   // first label byte -> node, sorted
+		};
+
+		void	insert(const std::string& path, int location, LocationMatch match);
+		size_t	child(const Node& node, unsigned char byte) const;   // 0 = none (the root is nobody's child)
+		void	addChild(size_t parent, size_t node);
+
+		std::vector<Node>			_nodes;    // _nodes[0] is the root
+		std::vector<LocationRoute>	_routes;   // parallel to the locations
+		RegexSet					_regexes;
+		std::vector<int>			_regexLocations;   // regex index -> location index
+};
+
+#endif
@@ -0,0 +1,208 @@
+#include "multipart_parser.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+MultipartParser::MultipartParser(const std::string& boundary, MultipartSink& sink)
+	: _sink(sink), _delimiter("\r\n--" + boundary), _pending("\r\n"), _state(boundary.empty() ? FAILED : PREAMBLE), _part() {
+
+	// The first delimiter has no leading CRLF; the seeded one lets it match like the others
+	size_t m = _delimiter.size();
+	for (size_t i = 0; i < 256; i++)
+		_skip[i] = m;
+	for (size_t i = 0; i + 1 < m; i++)
+		_skip[static_cast<unsigned char>(_delimiter[i])] = m - 1 - i;
+}
+
+MultipartParser::~MultipartParser() {}
+
+bool MultipartParser::finished() const { return _state == EPILOGUE; }
+
+bool MultipartParser::failed() const { return _state == FAILED; }
+
+bool MultipartParser::feed(const char* data, size_t length) {
+
+	while (length > 0 && _state != FAILED) {
+		if (_pending.empty()) {
+			size_t consumed = process(data, length);
+			if (_state != FAILED)
+				_pending.assign(data + consumed, length - consumed);
+			break;
+		}
+		// Join the carried tail with just enough new bytes to settle a split
+		// delimiter, then go back to parsing the chunk in place
+		size_t take = (_state == HEADERS) ? length : std::min(length, _delimiter.size());
+		_pending.append(data, take);
+		data += take;
+		length -= take;
+		size_t consumed = process(_pending.data(), _pending.size());
+		size_t left = _pending.size() - consumed;
+		if (left <= take) {
+			data -= left;
+			length += left;
+			_pending.clear();
+		}
+		else
+			_pending.erase(0, consumed);
+	}
+	return _state != FAILED;
+}
+
+// Parses as far as possible, returns how many bytes were consumed
+size_t MultipartParser::process(const char* data, size_t length) {
+
+	size_t pos = 0;
+	while (pos < length) {
+		const char* p = data + pos;
+		size_t n = length - pos;
+		switch (_state) {
+			case PREAMBLE: {
+				size_t found = findDelimiter(p, n);
+				if (found == std::string::npos)
+					return n >= _delimiter.size() ? pos + n - (_delimiter.size() - 1) : pos;
+				pos += found + _delimiter.size();
+				_state = DELIMITER_TAIL;
+				break;
+			}
+			case DELIMITER_TAIL:
+				if (p[0] == ' ' || p[0] == '\t') {   // transport padding
+					pos++;
+					break;
+				}
+				if (n < 2)
+					return pos;
+				if (p[0] == '-' && p[1] == '-')
+					_state = EPILOGUE;
+				else if (p[0] == '\r' && p[1] == '\n')
+					_state = HEADERS;
+				else {
+					_state = FAILED;
+					return pos;
+				}
+				pos += 2;
+				break;
+			case HEADERS: {
+				size_t end = 0;
+				if (n >= 2 && p[0] == '\r' && p[1] == '\n')
+					end = 0;   // part without headers
+				else {
+					const char* found = std::search(p, p + n, "\r\n\r\n", "\r\n\r\n" + 4);
+					if (found == p + n) {
+						if (n > MULTIPART_HEADERS_MAX)
+							_state = FAILED;
+						return pos;
+					}
+					end = found - p + 2;
+				}
+				if (!parseHeaders(p, end) || !_sink.partBegin(_part)) {
+					_state = FAILED;
+					return pos;
+				}
+				pos += end + 2;
+				_state = BODY;
+				break;
+			}
+			case BODY: {
+				size_t found = findDelimiter(p, n);
+				if (found == std::string::npos) {
+					// Everything but a possible delimiter prefix at the end is part data
+					if (n < _delimiter.size())
+						return pos;
+					size_t safe = n - (_delimiter.size() - 1);
+					if (!_sink.partData(p, safe))
+						_state = FAILED;
+					return pos + safe;
+				}
+				if ((found && !_sink.partData(p, found)) || !_sink.partEnd()) {
+					_state = FAILED;
+					return pos;
+				}
+				pos += found + _delimiter.size();
+				_state = DELIMITER_TAIL;
+				break;
+			}
+			case EPILOGUE:
+				return length;
+			case FAILED:
+				return pos;
+		}
+	}
+	return pos;
+}
+
+size_t MultipartParser::findDelimiter(const char* data, size_t length) const {
+
+	size_t m = _delimiter.size();
+	if (length < m)
+		return std::string::npos;
+	const char* delimiter = _delimiter.data();
+	unsigned char lastByte = static_cast<unsigned char>(delimiter[m - 1]);
+	size_t i = 0;
+	while (i <= length - m) {
+		unsigned char c = static_cast<unsigned char>(data[i + m - 1]);
+		if (c == lastByte && std::memcmp(data + i, delimiter, m - 1) == 0)
+			return i;
+		i += _skip[c];
+	}
+	return std::string::npos;
+}
+
+static std::string quotedParameter(const std::string& line, const std::string& name) {
+
+	size_t pos = 0;
+	while ((pos = line.find(name, pos)) != std::string::npos) {
+		// "name=" must not match the tail of "filename="
+		if (pos == 0 || line[pos - 1] == ' ' || line[pos - 1] == ';' || line[pos - 1] == '\t') {
+			size_t start = pos + name.size();
+			size_t end = line.find('"', start);
+			return end == std::string::npos ? line.substr(start) : line.substr(start, end - start);
+		}
+		pos += name.size();
+	}
+	return "";
+}
+
+bool MultipartParser::parseHeaders(const char* data, size_t length) {
+
+	_part = MultipartPart();
+	size_t pos = 0;
+	while (pos < length) {
+		const char* lineEnd = std::search(data + pos, data + length, "\r\n", "\r\n" + 2);
+		std::string line(data + pos, lineEnd);
+		pos = (lineEnd - data) + 2;
+
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+			return false;
+		std::string name = line.substr(0, colon);
+		for (size_t i = 0; i < name.size(); i++)
+			name[i] = std::tolower(static_cast<unsigned char>(name[i]));
+		size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+		std::string value = valueStart == std::string::npos ? "" : line.substr(valueStart);
+
+		if (name == "content-disposition") {
+			_part.name = quotedParameter(value, "name=\"");
+			_part.filename = quotedParameter(value, "filename=\"");
+		}
+		else if (name == "content-type")
+			_part.contentType = value;
+	}
+	return true;
+}
+
+// boundary=xyz or boundary="xyz", without the leading "--"
+std::string MultipartParser::boundaryFromContentType(const std::string& contentType) {
+
+	size_t pos = contentType.find("boundary=");
+	if (pos == std::string::npos)
+		return "";
+	std::string boundary = contentType.substr(pos + 9);
+	if (!boundary.empty() && boundary[0] == '"') {
+		size_t end = boundary.find('"', 1);
+		return end == std::string::npos ? "" : boundary.substr(1, end - 1);
+	}
+	size_t end = boundary.find_first_of("; \t");
+	if (end != std::string::npos)
+		boundary.erase(end);
+	return boundary.size() > 70 ? "" : boundary;
+}
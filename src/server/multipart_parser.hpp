@@ -0,0 +1,71 @@
+#ifndef MULTIPART_PARSER_HPP
+#define MULTIPART_PARSER_HPP
+
+#include <string>
+#include <cstddef>
+
+// Largest header block of a single part before the body is rejected
+#define MULTIPART_HEADERS_MAX 8192
+
+// Headers of one multipart/form-data part
+struct MultipartPart {
+	std::string name;
+	std::string filename;
+	std::string contentType;
+};
+
+// Receives the parts as the parser finds them. Returning false aborts parsing.
+class MultipartSink {
+
+	public:
+		virtual ~MultipartSink() {}
+
+		virtual bool partBegin(const MultipartPart& part) = 0;
+		virtual bool partData(const char* data, size_t length) = 0;
+		virtual bool partEnd() = 0;
+};
+
+/*
+	Push-style multipart/form-data parser. Chunks are fed as they come off
+	the socket; part bodies are handed to the sink straight from the chunk,
+	only a delimiter-sized tail (or an incomplete header block) is carried
+	over to the next feed. Delimiters are found with Boyer-Moore-Horspool.
+*/
+class MultipartParser {
+
+	public:
+		MultipartParser(const std::string& boundary, MultipartSink& sink);
+		~MultipartParser();
+
+		bool	feed(const char* data, size_t length);   // false once the body is malformed or the sink failed
+		bool	finished() const;                        // closing delimiter seen
+		bool	failed() const;
+
+		static std::string	boundaryFromContentType(const std::string& contentType);
+
+	private:
+		enum State {
+			PREAMBLE,         // before the first delimiter
+			DELIMITER_TAIL,   // after a delimiter: "--" (end) or CRLF (headers follow)
+			HEADERS,
+			BODY,
+			EPILOGUE,
+			FAILED
+		};
+
+		MultipartParser(const MultipartParser&);
+		MultipartParser& operator=(const MultipartParser&);
+
+		size_t	process(const char* data, size_t length);
+		size_t	findDelimiter(const char* data, size_t length) const;
+		bool	parseHeaders(const char* data, size_t length);
+
+		MultipartSink&	_sink;
+		std::string		_delimiter;     // CRLF "--" boundary
+		size_t			_skip[256];     // Horspool shift table of _delimiter
+		std::string		_pending;       // unconsumed bytes carried across feeds
+		State			_state;
+		MultipartPart	_part;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "path_beneath.hpp"
+#include <vector>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#ifdef SYS_openat2
+# include <linux/openat2.h>
+#endif
+
+#ifdef SYS_openat2
+static int callOpenat2(int dirFd, const char* path, int flags, mode_t mode) {
+
+	struct open_how how;
+	how.flags = static_cast<unsigned int>(flags);
+	how.mode = (flags & O_CREAT) ? mode : 0;
+	how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+	return static_cast<int>(syscall(SYS_openat2, dirFd, path, &how, sizeof(how)));
+}
+#endif
+
+// Missing before 5.6, and seccomp filters in some containers answer EPERM or ENOSYS for it
+static bool probeOpenat2() {
+
+#ifdef SYS_openat2
+	int fd = callOpenat2(AT_FDCWD, ".", PATH_BENEATH_DIRECTORY | O_CLOEXEC, 0);
+	if (fd >= 0) {
+		close(fd);
+		return true;
+	}
+#endif
+	return false;
+}
+
+bool openat2Available() {
+
+	static const bool available = probeOpenat2();
+	return available;
+}
+
+static void closeKeepingErrno(int fd) {
+
+	int saved = errno;
+	close(fd);
+	errno = saved;
+}
+
+/*
+	The fallback: ".." is applied to the components already read, which is
+	exact since none of them may be a symlink, and every directory on the
+	way is opened with O_NOFOLLOW from the one before.
+*/
+static int walkBeneath(int rootFd, const std::string& path, int flags, mode_t mode) {
+
+	std::vector<std::string> components;
+	for (size_t start = 0; start <= path.size(); ) {
+		size_t end = path.find('/', start);
+		if (end == std::string::npos)
+			end = path.size();
+		std::string component = path.substr(start, end - start);
+		if (component == "..") {
+			if (components.empty()) {
+				errno = EXDEV;
+				return -1;
+			}
+			components.pop_back();
+		}
+		else if (!component.empty() && component != ".")
+			components.push_back(component);
+		start = end + 1;
+	}
+	int dirFd = rootFd;
+	for (size_t i = 0; i + 1 < components.size(); i++) {
+		int next = openat(dirFd, components[i].c_str(), PATH_BENEATH_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (dirFd != rootFd)
+			closeKeepingErrno(dirFd);
+		if (next < 0)
+			return -1;
+		dirFd = next;
+	}
+	const char* last = components.empty() ? "." : components.back().c_str();
+	int fd = openat(dirFd, last, flags | O_NOFOLLOW | O_CLOEXEC, mode);
+	if (dirFd != rootFd)
+		closeKeepingErrno(dirFd);
+#ifdef O_PATH
+	// O_PATH | O_NOFOLLOW opens a final symlink itself rather than failing on it
+	struct stat st;
+	if (fd >= 0 && (flags & O_PATH) && (fstat(fd, &st) != 0 || S_ISLNK(st.st_mode))) {
+		close(fd);
+		errno = ELOOP;
+		return -1;
+	}
+#endif
+	return fd;
+}
+
+int openBeneath(int rootFd, const std::string& path, int flags, mode_t mode) {
+
+	if (rootFd < 0) {
+		errno = EBADF;
+		return -1;
+	}
+	size_t start = path.find_first_not_of('/');
+	std::string relative = (start == std::string::npos) ? "." : path.substr(start);
+	if (relative.find('\0') != std::string::npos) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!openat2Available())
+		return walkBeneath(rootFd, relative, flags, mode);
+	int fd = -1;
+#ifdef SYS_openat2
+	for (int attempt = 0; attempt < PATH_BENEATH_RETRIES; attempt++) {
+		fd = callOpenat2(rootFd, relative.c_str(), flags | O_CLOEXEC, mode);
+		if (fd >= 0 || (errno != EAGAIN && errno != EINTR))
+			break;
+	}
+#endif
+	return fd;
+}
+
+int unlinkBeneath(int rootFd, const std::string& path) {
+
+	size_t end = path.find_last_not_of('/');
+	size_t slash = (end == std::string::npos) ? std::string::npos : path.rfind('/', end);
+	std::string name = (end == std::string::npos) ? "" : path.substr(slash + 1, end - slash);
+	if (name.empty() || name == "." || name == "..") {
+		errno = EBUSY;   // the root itself, or a name that is not an entry of its parent
+		return -1;
+	}
+	int parentFd = openBeneath(rootFd, (slash == std::string::npos) ? "" : path.substr(0, slash),
+		PATH_BENEATH_DIRECTORY);
+	if (parentFd < 0)
+		return -1;
+	// The last component is never followed: a symlink is removed, not its target
+	int result = unlinkat(parentFd, name.c_str(), 0);
+	if (result != 0 && errno == EISDIR)
+		result = unlinkat(parentFd, name.c_str(), AT_REMOVEDIR);
+	closeKeepingErrno(parentFd);
+	return result;
+}
+
+// Each missing component is made in its parent, itself opened beneath the root
+int mkdirBeneath(int rootFd, const std::string& path, mode_t mode) {
+
+	for (size_t start = 0; start < path.size(); ) {
+		size_t end = path.find('/', start);
+		if (end == std::string::npos)
+			end = path.size();
+		std::string name = path.substr(start, end - start);
+		if (!name.empty() && name != "." && name != "..") {
+			int parentFd = openBeneath(rootFd, path.substr(0, start), PATH_BENEATH_DIRECTORY);
+			if (parentFd < 0)
+				return -1;
+			int result = mkdirat(parentFd, name.c_str(), mode);
+			closeKeepingErrno(parentFd);
+			if (result != 0 && errno != EEXIST)
+				return -1;
+		}
+		start = end + 1;
+	}
+	return 0;
+}
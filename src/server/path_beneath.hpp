@@ -0,0 +1,41 @@
+#ifndef PATH_BENEATH_HPP
+#define PATH_BENEATH_HPP
+
+#include <string>
+#include <fcntl.h>
+#include <sys/types.h>
+
+#define PATH_BENEATH_RETRIES	8   // openat2() gives EAGAIN when a rename races a ".." walk
+
+// Descriptors only resolved from or checked: O_PATH is Linux-only, so
+// elsewhere directories are opened for search and the rest for reading
+#if defined(O_PATH)
+# define PATH_BENEATH_DIRECTORY	(O_PATH | O_DIRECTORY)
+# define PATH_BENEATH_LOOKUP	O_PATH
+#elif defined(O_SEARCH)
+# define PATH_BENEATH_DIRECTORY	(O_SEARCH | O_DIRECTORY)
+# define PATH_BENEATH_LOOKUP	(O_RDONLY | O_NONBLOCK)
+#else
+# define PATH_BENEATH_DIRECTORY	(O_RDONLY | O_DIRECTORY)
+# define PATH_BENEATH_LOOKUP	(O_RDONLY | O_NONBLOCK)
+#endif
+
+/*
+	File access confined to a directory opened once, a location root.
+	Paths are taken relative to it, leading '/' or not, and cannot leave
+	it: not through "..", not through a symlink pointing out or an
+	absolute one, not through /proc magic links.
+
+	With openat2() (Linux 5.6+) that is a single syscall: RESOLVE_BENEATH
+	has the kernel check every component as it walks them, so nothing can
+	be swapped in between a check and the open. Where openat2() is missing
+	or filtered, the path is walked one openat(O_NOFOLLOW) per component,
+	refusing symlinks altogether. Failures set errno as open() does, EXDEV
+	or ELOOP for a path that would escape. File descriptors are O_CLOEXEC.
+*/
+int		openBeneath(int rootFd, const std::string& path, int flags, mode_t mode = 0);
+int		unlinkBeneath(int rootFd, const std::string& path);   // a file or an empty directory, as remove() does
+int		mkdirBeneath(int rootFd, const std::string& path, mode_t mode);   // every missing component, as mkdir -p
+bool	openat2Available();
+
+#endif
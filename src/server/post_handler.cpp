@@ -12,108 +12,43 @@
 
 #include "post_handler.hpp"
 #include "server.hpp"
+#include "mime_types.hpp"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <cstdlib>
-
-PostHandler::PostHandler(const std::string uploadPath)
-    :_uploadPath(uploadPath){
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sys/socket.h>
+
+PostHandler::PostHandler(const std::string uploadPath, const MimeTypes& mimeTypes, UploadStore& store,
+                         UploadDurability durability)
+    :_uploadPath(uploadPath), _mimeTypes(mimeTypes), _store(store), _durability(durability){
     std::cout << "[DEBUG] PostHandler created with uploadPath: '" << _uploadPath << "'" << std::endl;
 }
 
-bool PostHandler::saveRawContent(const std::string& filePath, const std::string& content) {
-    std::ofstream file(filePath.c_str(), std::ios::binary);
-    if (!file.is_open()) {
-        std::cout << "[ERROR] Failed to open file for writing: " << filePath << std::endl;
-        return false;
-    }
-
-    file.write(content.c_str(), content.size());
-    file.close();
-
-    if (file.good()) {
-        std::cout << "[SUCCESS] File saved: " << filePath
-                  << " (" << content.size() << " bytes)" << std::endl;
-        return true;
-    } else {
-        std::cout << "[ERROR] Failed to write to file: " << filePath << std::endl;
-        return false;
-    }
-}
-
 void PostHandler::handleFile(const HttpRequest& request, ClientInfo& client, const std::string& contentType) {
-    std::string extension = getExtensionFromContentType(contentType);
-
-    std::string filename = generateFilename(extension);
-    std::string filePath = _uploadPath + filename;
-    std::cout << "[DEBUG] Saving file to: '" << filePath << "'" << std::endl;
-
-    if (saveRawContent(filePath, request.getBody())) {
-        HttpResponse response(request);
-        response.generateResponse(200);
-        client.responseData = response.getResponse();
-    } else {
-        HttpResponse response(request);
-        response.generateResponse(500);
-        client.responseData = response.getResponse();
-    }
-}
-
-std::string PostHandler::generateFilename(const std::string& extension) {
-    static int counter = 0;
-    counter++;
+    std::string name = rawUploadName(contentType);
+    std::cout << "[DEBUG] Saving file to: '" << _uploadPath << "' as '" << name << "'" << std::endl;
 
-    std::ostringstream filename;
-    filename << "file_" << time(0) << "_" << counter;
+    const std::string& body = request.getBody();
+    RawUpload upload(_store, _uploadPath, name, body.size(), _durability);
+    upload.feed(body.data(), body.size());
 
-    if (!extension.empty()) {
-        filename << "." << extension;
-    }
+    HttpResponse response(request);
+    response.generateResponse(upload.finish() ? 200 : 500);
+    client.responseData = response.getResponse();
+}
 
-    return filename.str();
+std::string PostHandler::rawUploadName(const std::string& contentType) {
+    return _store.uniqueName(getExtensionFromContentType(contentType));
 }
 
 std::string PostHandler::getExtensionFromContentType(const std::string& contentType) {
-    if (contentType.find("text/html") != std::string::npos) {
-        return "html";
-    }
-    else if (contentType.find("text/css") != std::string::npos) {
-        return "css";
-    }
-    else if (contentType.find("text/plain") != std::string::npos) {
-        return "txt";
-    }
-    else if (contentType.find("image/jpeg") != std::string::npos) {
-        return "jpg";
-    }
-    else if (contentType.find("image/png") != std::string::npos) {
-        return "png";
-    }
-    else if (contentType.find("image/gif") != std::string::npos) {
-        return "gif";
-    }
-    else if (contentType.find("image/webp") != std::string::npos) {
-        return "webp";
-    }
-    else if (contentType.find("image/svg+xml") != std::string::npos) {
-        return "svg";
-    }
-    else if (contentType.find("application/javascript") != std::string::npos) {
-        return "js";
-    }
-    else if (contentType.find("application/pdf") != std::string::npos) {
-        return "pdf";
-    }
-    else if (contentType.find("application/json") != std::string::npos) {
-        return "json";
-    }
-    else if (contentType.find("application/octet-stream") != std::string::npos) {
-        return "bin";
-    }
-    else {
-        return "unknown";
-    }
+    const std::string* extension = _mimeTypes.extensionForType(contentType);
+    return extension ? *extension : "unknown";
 }
 
 bool PostHandler::isSupportedContentType(const std::string& contentType)
@@ -141,208 +76,237 @@ void PostHandler::handleMultipart(const HttpRequest& request, ClientInfo& client
 
 		john_doe
 		------WebKitFormBoundary7MA4YWxkTrZu0gW
-		Content-Disposition: form-data; name="email"
-
-		john@example.com
-		------WebKitFormBoundary7MA4YWxkTrZu0gW
 		Content-Disposition: form-data; name="avatar"; filename="photo.jpg"
 		Content-Type: image/jpeg
 
 		[BINARY DATA OF IMAGE]
-		------WebKitFormBoundary7MA4YWxkTrZu0gW
-		Content-Disposition: form-data; name="document"; filename="resume.pdf"
-		Content-Type: application/pdf
-
-		[BINARY DATA OF PDF]
 		------WebKitFormBoundary7MA4YWxkTrZu0gW--
 
+		Bodies that do not fit in the first read are streamed through
+		MultipartUpload by the Server; this handles the ones already in memory.
 	*/
 
-	std::string contentType = request.getContenType();
-	std::string requestBody = request.getBody();
-
-	std::string boundary = extractBoundary(contentType);
-	std::vector<MultipartPart> parts = parseMultipartData(requestBody, boundary);
-	processMultipartParts(parts, request, client);
+	const std::string& body = request.getBody();
+	MultipartUpload upload(_store, _uploadPath, extractBoundary(request.getContenType()), _durability);
+	upload.feed(body.data(), body.size());
 
 	HttpResponse response(request);
-	response.generateResponse(200);
+	response.generateResponse(upload.finish() ? 200 : (upload.diskError() ? 500 : 400));
 	client.responseData = response.getResponse();
 }
 
-std::vector<MultipartPart> PostHandler::parseMultipartData(const std::string& body, const std::string& boundary) {
-	std::vector<MultipartPart> parts;
-
-	std::cout << "[DEBUG] parseMultipartData: body size=" << body.size()
-	          << ", boundary='" << boundary << "'" << std::endl;
-	// Le boundary final a "--" à la fin
-	std::string endBoundary = boundary + "--";
-
-	size_t pos = 0;
-	size_t found = 0;
-	while ((found = body.find(boundary, pos)) != std::string::npos) {
-	// Ignorer le premier boundary (début du multipart)
-		if (found == pos) {
-			pos = found + boundary.length();
-			continue;
-		}
-		// Extraire le contenu entre deux boundaries
-		std::string partData = body.substr(pos, found - pos);
-        // Parser cette partie individuelle AVANT de vérifier la fin
-        MultipartPart part = parseMultipartPart(partData);
-        if (!part.name.empty()) {  // Validation basique
-            parts.push_back(part);
-        }
-		// Vérifier si on atteint la fin (boundary--) APRÈS avoir parsé
-		if (body.substr(found, endBoundary.length()) == endBoundary) {
-            break;
-        }
-		// Avancer la position
-		pos = found + boundary.length();
-    }
-    return parts;
+MultipartUpload::MultipartUpload(UploadStore& store, const std::string& uploadPath, const std::string& boundary,
+                                 UploadDurability durability)
+    : _parser(boundary, *this), _store(store), _uploadPath(uploadPath), _durability(durability), _part(),
+      _file(), _filename(), _fieldValue(), _filesSaved(0), _diskError(false) {
+    if (!_uploadPath.empty() && _uploadPath[_uploadPath.size() - 1] != '/')
+        _uploadPath += '/';
 }
 
-MultipartPart PostHandler::parseMultipartPart(const std::string& partData) {
-	MultipartPart part;
+MultipartUpload::~MultipartUpload() {
+    _store.discard(_file);
+}
 
-	// Séparer headers du contenu avec "\r\n\r\n"
-	size_t headerEnd = partData.find("\r\n\r\n");
-	if (headerEnd == std::string::npos) {
-		return part; // Partie invalide
-	}
+bool MultipartUpload::feed(const char* data, size_t length) {
+    return _parser.feed(data, length);
+}
 
-	std::string headers = partData.substr(0, headerEnd);
-	std::string content = partData.substr(headerEnd + 4);
+bool MultipartUpload::failed() const { return _parser.failed() || _diskError; }
 
-	// Nettoyer le contenu (enlever les \r\n finaux)
-	while (!content.empty() && (content[content.size() - 1] == '\r' || content[content.size() - 1] == '\n')) {
-		content.erase(content.size() - 1);
-	}
+bool MultipartUpload::finish() { return _parser.finished() && !_diskError; }
 
-	// Parser les headers ligne par ligne
-	std::istringstream headerStream(headers);
-	std::string headerLine;
+bool MultipartUpload::diskError() const { return _diskError; }
 
-	while (std::getline(headerStream, headerLine)) {
-	// Nettoyer \r en fin de ligne
-		if (!headerLine.empty() && headerLine[headerLine.size() - 1] == '\r') {
-			headerLine.erase(headerLine.size() - 1);
-        }
+size_t MultipartUpload::filesSaved() const { return _filesSaved; }
 
-		if (headerLine.find("Content-Disposition:") == 0) {
-		// Extraire name et filename
-			parseContentDisposition(headerLine, part.name, part.filename);
-		}
-		else if (headerLine.find("Content-Type:") == 0) {
-            // Extraire content type
-            part.contentType = extractContentTypeFromHeader(headerLine);
-        }
+bool MultipartUpload::partBegin(const MultipartPart& part) {
+    _part = part;
+    _fieldValue.clear();
+    if (_part.filename.empty())
+        return true;
+
+    // Keep only the last path component of the client's file name
+    _filename = _part.filename.substr(_part.filename.find_last_of("/\\") + 1);
+    if (_filename.empty() || _filename == "." || _filename == "..") {
+        std::cout << "[DEBUG] Rejected upload file name: '" << _part.filename << "'" << std::endl;
+        return false;
+    }
+    if (!_store.create(_uploadPath, _file)) {
+        _diskError = true;
+        return false;
     }
-	part.content = content;
-    return part;
+    return true;
 }
 
-void PostHandler::parseContentDisposition(const std::string& headerLine, std::string& name, std::string& filename) {
-	// Exemple: Content-Disposition: form-data; name="avatar"; filename="photo.jpg"
-
-	size_t namePos = headerLine.find("name=\"");
-	if (namePos != std::string::npos) {
-		namePos += 6; // Longueur de "name=\""
-		size_t nameEnd = headerLine.find("\"", namePos);
-		if (nameEnd != std::string::npos) {
-			name = headerLine.substr(namePos, nameEnd - namePos);
-		}
-	}
-
-	// Chercher filename="..." (optionnel)
-	size_t filenamePos = headerLine.find("filename=\"");
-	if (filenamePos != std::string::npos) {
-		filenamePos += 10; // Longueur de "filename=\""
-		size_t filenameEnd = headerLine.find("\"", filenamePos);
-		if (filenameEnd != std::string::npos) {
-			filename = headerLine.substr(filenamePos, filenameEnd - filenamePos);
-		}
+bool MultipartUpload::partData(const char* data, size_t length) {
+    if (_file.fd < 0) {
+        if (_part.filename.empty() && _fieldValue.size() < MULTIPART_FIELD_MAX)
+            _fieldValue.append(data, std::min(length, MULTIPART_FIELD_MAX - _fieldValue.size()));
+        return true;
     }
+    while (length > 0) {
+        ssize_t written = write(_file.fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            std::cout << "[ERROR] Failed to write to file: " << _file.directory << _file.tempName << std::endl;
+            _diskError = true;
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
 }
 
-std::string PostHandler::extractContentTypeFromHeader(const std::string& headerLine) {
-    // Exemple: Content-Type: image/jpeg
-    size_t colonPos = headerLine.find(":");
-    if (colonPos != std::string::npos) {
-        std::string contentType = headerLine.substr(colonPos + 1);
-
-        // Supprimer espaces de début
-        size_t start = contentType.find_first_not_of(" \t");
-        if (start != std::string::npos) {
-            return contentType.substr(start);
+bool MultipartUpload::partEnd() {
+    if (_file.fd < 0) {
+        if (_part.filename.empty() && !_part.name.empty()) {
+            std::cout << "Form field: " << _part.name << " = " << _fieldValue << std::endl;
+            saveFormFieldToLog(_part.name, _fieldValue);
         }
+        return true;
+    }
+    if (!_store.commit(_file, _filename, _durability)) {
+        std::cout << "[ERROR] Failed to save upload: " << _file.directory << _filename << std::endl;
+        _diskError = true;
+        return false;
     }
-    return "";
+    _filesSaved++;
+    std::cout << "[SUCCESS] File saved: " << _uploadPath << _filename << std::endl;
+    return true;
 }
 
-void PostHandler::processMultipartParts(const std::vector<MultipartPart>& parts, const HttpRequest& request, ClientInfo& client) {
+void MultipartUpload::saveFormFieldToLog(const std::string& fieldName, const std::string& fieldValue) {
+    std::string logFile = _uploadPath + "form_data.log";
 
-    std::string uploadDir = _uploadPath;
-    std::cout << "[DEBUG] Upload directory: '" << uploadDir << "'" << std::endl;
+    std::ofstream file(logFile.c_str(), std::ios::app);
+    if (file.is_open()) {
+        file << "Field: " << fieldName << " = " << fieldValue << std::endl;
+        file.close();
+    }
+}
 
-    // Create folder if doesnt existe
-    system(("mkdir -p " + uploadDir).c_str());
+ssize_t BodyUpload::receive(int socketFd, size_t length) {
+    char buffer[BUFFER_SIZE];
+    ssize_t bytes = recv(socketFd, buffer, std::min(length, sizeof(buffer)), 0);
+    if (bytes > 0)
+        feed(buffer, bytes);
+    return bytes;
+}
 
-    // Save every part
-    for (size_t i = 0; i < parts.size(); i++) {
-        const MultipartPart& part = parts[i];
+RawUpload::RawUpload(UploadStore& store, const std::string& directory, const std::string& name,
+                     size_t contentLength, UploadDurability durability)
+    : _store(store), _file(), _name(name), _durability(durability), _expected(contentLength), _written(0),
+      _spliceDisabled(false), _diskError(false), _committed(false) {
+    _pipe[0] = -1;
+    _pipe[1] = -1;
 
-        std::cout << "[DEBUG] Part " << i << ": name='" << part.name
-                  << "', filename='" << part.filename
-                  << "', contentType='" << part.contentType
-                  << "', content size=" << part.content.size() << " bytes" << std::endl;
+    if (!_store.create(directory, _file)) {
+        _diskError = true;
+        return;
+    }
+#ifdef __linux__
+    // Reserve the blocks up front: less fragmentation, ENOSPC before the body is read
+    if (contentLength > 0 && fallocate(_file.fd, 0, 0, contentLength) != 0 && errno == ENOSPC) {
+        std::cout << "[ERROR] No space left for upload of " << contentLength << " bytes" << std::endl;
+        _diskError = true;
+    }
+#endif
+}
 
-        if (!part.filename.empty()) {
-            std::string filePath = uploadDir + part.filename;
+RawUpload::~RawUpload() {
+    if (_pipe[0] >= 0) {
+        close(_pipe[0]);
+        close(_pipe[1]);
+    }
+    _store.discard(_file);
+}
 
-            if (saveFileFromMultipart(filePath, part.content)) {
-                std::cout << "File saved: " << part.filename
-                         << " (" << part.content.size() << " bytes)" << std::endl;
-            } else {
-                std::cout << "ERROR: Failed to save file: " << part.filename << std::endl;
-            }
-        } else {
-            std::cout << "Form field: " << part.name << " = " << part.content << std::endl;
-            saveFormFieldToLog(part.name, part.content);
+bool RawUpload::feed(const char* data, size_t length) {
+    while (length > 0 && !_diskError) {
+        ssize_t written = write(_file.fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            std::cout << "[ERROR] Failed to write to file: " << _file.directory << _file.tempName << std::endl;
+            _diskError = true;
+            break;
         }
+        data += written;
+        length -= written;
+        _written += written;
     }
-    HttpResponse response(request);
-    response.generateResponse(200);
-    client.responseData = response.getResponse();
+    return !_diskError;
 }
 
-bool PostHandler::saveFileFromMultipart(const std::string& filePath, const std::string& content) {
-    std::ofstream file(filePath.c_str(), std::ios::binary);
-    if (!file.is_open()) {
-        return false;
+#ifdef __linux__
+ssize_t RawUpload::receive(int socketFd, size_t length) {
+    if (_spliceDisabled || _diskError)
+        return BodyUpload::receive(socketFd, length);
+    if (_pipe[0] < 0) {
+        if (pipe(_pipe) != 0) {
+            _pipe[0] = -1;
+            _spliceDisabled = true;
+            return BodyUpload::receive(socketFd, length);
+        }
+# ifdef F_SETPIPE_SZ
+        fcntl(_pipe[1], F_SETPIPE_SZ, RAW_UPLOAD_SPLICE_MAX);
+# endif
     }
-    file.write(content.c_str(), content.size());
-    file.close();
 
-    return file.good();
+    ssize_t moved = splice(socketFd, NULL, _pipe[1], NULL, std::min(length, static_cast<size_t>(RAW_UPLOAD_SPLICE_MAX)),
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (moved < 0 && errno == EINVAL) {
+        // Socket or filesystem without splice support
+        _spliceDisabled = true;
+        return BodyUpload::receive(socketFd, length);
+    }
+    size_t left = moved > 0 ? moved : 0;
+    while (left > 0) {
+        loff_t offset = _written;
+        ssize_t n = splice(_pipe[0], NULL, _file.fd, &offset, left, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            std::cout << "[ERROR] Failed to write to file: " << _file.directory << _file.tempName << std::endl;
+            _diskError = true;
+            break;
+        }
+        _written = offset;
+        left -= n;
+    }
+    return moved;
 }
-
-void PostHandler::saveFormFieldToLog(const std::string& fieldName, const std::string& fieldValue) {
-    std::string logFile = _uploadPath + "form_data.log";
-
-    std::ofstream file(logFile.c_str(), std::ios::app);
-    if (file.is_open()) {
-        file << "Field: " << fieldName << " = " << fieldValue << std::endl;
-        file.close();
+#else
+ssize_t RawUpload::receive(int socketFd, size_t length) {
+    return BodyUpload::receive(socketFd, length);
+}
+#endif
+
+bool RawUpload::failed() const { return _diskError; }
+
+bool RawUpload::diskError() const { return _diskError; }
+
+bool RawUpload::finish() {
+    if (_diskError || _committed)
+        return _committed;
+    // Only a short body leaves preallocated space to cut off
+    if (static_cast<size_t>(_written) != _expected && ftruncate(_file.fd, _written) != 0)
+        _diskError = true;
+    if (_diskError || !_store.commit(_file, _name, _durability)) {
+        std::cout << "[ERROR] Failed to save upload: " << _file.directory << _name << std::endl;
+        _store.discard(_file);
+        _diskError = true;
+        return false;
     }
+    _committed = true;
+    std::cout << "[SUCCESS] File saved: " << _file.directory << _name << " (" << _written << " bytes)" << std::endl;
+    return true;
 }
 
+size_t RawUpload::filesSaved() const { return _committed ? 1 : 0; }
+
 std::string PostHandler::extractBoundary(const std::string& contentType) {
-	std::string boundary;
-	size_t boundaryPos = contentType.find("boundary=");
-	if (boundaryPos != std::string::npos) {
-		boundary = "--" + contentType.substr(boundaryPos + 9);
-	}
-	return boundary;
+	return MultipartParser::boundaryFromContentType(contentType);
 }
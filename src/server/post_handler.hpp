@@ -18,48 +18,137 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <sys/types.h>
+
+#include "multipart_parser.hpp"
+#include "upload_store.hpp"
 
 // Forward declarations
 class HttpRequest;
 class HttpResponse;
+class MimeTypes;
 struct ClientInfo;
 
-struct MultipartPart {
-    std::string name;
-    std::string filename;
-    std::string contentType;
-    std::string content;
+// Form field values kept in memory (and logged) are cut at this size
+#define MULTIPART_FIELD_MAX 65536
+// Most bytes moved by one socket -> pipe -> file splice() round
+#define RAW_UPLOAD_SPLICE_MAX 1048576
+
+/*
+    Request body being saved while it is received (READING_BODY). The Server
+    feeds it what was read along with the headers, then lets it pull the rest
+    from the socket with receive().
+*/
+class BodyUpload {
+    public:
+        virtual ~BodyUpload() {}
+
+        virtual bool feed(const char* data, size_t length) = 0;    // false once failed
+        // Moves at most length bytes from the socket into the upload,
+        // returns them like recv(). The default reads into a buffer and feeds it.
+        virtual ssize_t receive(int socketFd, size_t length);
+        virtual bool failed() const = 0;
+        virtual bool diskError() const = 0;     // failed on our side rather than on a malformed body
+        virtual bool finish() = 0;              // whole body received: commit the result
+        virtual size_t filesSaved() const = 0;
+};
+
+/*
+    Saves a multipart/form-data body while it is being received: file parts
+    are written to their own temp file as the parser hands them over and
+    renamed to their (base) file name at the end of the part, form fields
+    go to form_data.log. A file that is cut short is removed.
+*/
+class MultipartUpload : public BodyUpload, public MultipartSink {
+    public:
+        MultipartUpload(UploadStore& store, const std::string& uploadPath, const std::string& boundary,
+                        UploadDurability durability);
+        virtual ~MultipartUpload();
+
+        virtual bool feed(const char* data, size_t length);
+        virtual bool failed() const;
+        virtual bool diskError() const;
+        virtual bool finish();      // closing delimiter reached without errors
+        virtual size_t filesSaved() const;
+
+        virtual bool partBegin(const MultipartPart& part);
+        virtual bool partData(const char* data, size_t length);
+        virtual bool partEnd();
+
+    private:
+        MultipartUpload(const MultipartUpload&);
+        MultipartUpload& operator=(const MultipartUpload&);
+
+        void saveFormFieldToLog(const std::string& fieldName, const std::string& fieldValue);
+
+        MultipartParser _parser;
+        UploadStore& _store;
+        std::string _uploadPath;
+        UploadDurability _durability;
+        MultipartPart _part;
+        StoredFile _file;           // open file part, fd -1 otherwise
+        std::string _filename;
+        std::string _fieldValue;
+        size_t _filesSaved;
+        bool _diskError;
+};
+
+/*
+    Raw (non-multipart) body written to a hidden temp file in its destination
+    directory, preallocated to Content-Length and renamed into place once
+    complete. On Linux the bytes go socket -> pipe -> file with splice() and
+    never enter user space.
+*/
+class RawUpload : public BodyUpload {
+    public:
+        RawUpload(UploadStore& store, const std::string& directory, const std::string& name,
+                  size_t contentLength, UploadDurability durability);
+        virtual ~RawUpload();
+
+        virtual bool feed(const char* data, size_t length);
+        virtual ssize_t receive(int socketFd, size_t length);
+        virtual bool failed() const;
+        virtual bool diskError() const;
+        virtual bool finish();
+        virtual size_t filesSaved() const;
+
+    private:
+        RawUpload(const RawUpload&);
+        RawUpload& operator=(const RawUpload&);
+
+        UploadStore& _store;
+        StoredFile _file;           // temp file, fd -1 once committed
+        std::string _name;
+        UploadDurability _durability;
+        size_t _expected;
+        off_t _written;
+        int _pipe[2];               // splice() staging pipe, opened on first use
+        bool _spliceDisabled;
+        bool _diskError;
+        bool _committed;
 };
 
 class PostHandler {
     public:
-        PostHandler(const std::string uploadPath);
+        PostHandler(const std::string uploadPath, const MimeTypes& mimeTypes, UploadStore& store,
+                    UploadDurability durability);
 
         // Main POST handling methods
         void handlePOST(const HttpRequest& request, ClientInfo& client);
         void handleMultipart(const HttpRequest& request, ClientInfo& client);
 
-        // Multipart parsing methods
-        std::vector<MultipartPart> parseMultipartData(const std::string& body, const std::string& boundary);
-        MultipartPart parseMultipartPart(const std::string& partData);
-        void parseContentDisposition(const std::string& headerLine, std::string& name, std::string& filename);
-        std::string extractContentTypeFromHeader(const std::string& headerLine);
-
-        // Processing and saving methods
-        void processMultipartParts(const std::vector<MultipartPart>& parts, const HttpRequest& request, ClientInfo& client);
-        bool saveFileFromMultipart(const std::string& filePath, const std::string& content);
-        void saveFormFieldToLog(const std::string& fieldName, const std::string& fieldValue);
-
         // Utility methods
         std::string extractBoundary(const std::string& contentType);
         bool isSupportedContentType(const std::string& contentType);
         void handleFile(const HttpRequest& request, ClientInfo& client, const std::string& contentType);
+        std::string rawUploadName(const std::string& contentType);
         std::string getExtensionFromContentType(const std::string& contentType);
-        std::string generateFilename(const std::string& extension);
-        bool saveRawContent(const std::string& filePath, const std::string& content);
 
     private:
         std::string _uploadPath;
+        const MimeTypes& _mimeTypes;
+        UploadStore& _store;
+        UploadDurability _durability;
 };
 
 #endif
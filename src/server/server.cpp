@@ -13,21 +13,123 @@
 #include "server.hpp"
 #include "config.hpp"
 #include "socket.hpp"
+#include "clock.hpp"
+#include "path_beneath.hpp"
 #include <ctime>
+#include <climits>
 #include <fstream>
+#include <iomanip>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+/*
+	Blocking work of one request, run on the worker pool. The completion is
+	dropped if the client went away (or moved on) in the meantime.
+*/
+class ClientTask : public PoolTask {
+
+	public:
+		ClientTask(Server& server) : server(server), fd(-1), taskId(0) {}
+
+		void complete() {
+			ClientInfo* client = server.waitingClient(fd, taskId);
+			if (client)
+				resume(*client);
+			else
+				std::cout << "[DEBUG] Dropped worker pool result for FD " << fd << std::endl;
+		}
+		virtual void resume(ClientInfo& client) = 0;
+
+		Server&			server;
+		int				fd;
+		unsigned long	taskId;
+};
+
+class DeleteTask : public ClientTask {
+
+	public:
+		DeleteTask(Server& server, int rootFd, const std::string& path)
+			: ClientTask(server), _rootFd(rootFd), _path(path), _error(0) {}
+
+		void run() { _error = (unlinkBeneath(_rootFd, _path) == 0) ? 0 : errno; }
+		void resume(ClientInfo& client) {
+			HttpRequest request;
+			request.parseRequest(client.requestData);
+			server.finishDelete(request, client, _error, server.findLocation(request.getPath()));
+			client.bytesSent = 0;
+			client.state = SENDING_RESPONSE;
+		}
+
+	private:
+		int			_rootFd;   // the location's, owned by the router
+		std::string	_path;     // relative to it
+		int			_error;
+};
+
+// Reads and compresses a file off the loop, then replays the request, which hits the cache
+class CompressTask : public ClientTask {
+
+	public:
+		CompressTask(Server& server, int fileFd, size_t size, const CompressionKey& key)
+			: ClientTask(server), _fileFd(fileFd), _size(size), _key(key), _compressed(), _ok(false) {}
+		~CompressTask() { if (_fileFd >= 0) close(_fileFd); }
+
+		void run() {
+			std::string content(_size, '\0');
+			size_t total = 0;
+			while (total < content.size()) {
+				ssize_t bytes = pread(_fileFd, &content[total], content.size() - total, total);
+				if (bytes <= 0)
+					return;
+				total += bytes;
+			}
+			_ok = compressData(content.data(), content.size(), _key.encoding, _key.level, _compressed);
+		}
+		void resume(ClientInfo& client) {
+			if (_ok) {
+				std::cout << "[DEBUG] Compressed " << _size << " -> " << _compressed.size()
+						  << " bytes (" << encodingName(_key.encoding) << ", worker pool)" << std::endl;
+				server._compressionCache.insert(_key, _compressed);
+			}
+			client.inlineWork = true;
+			client.state = READING_REQUEST;
+			server.processRequest(fd);
+		}
+
+	private:
+		int				_fileFd;
+		size_t			_size;
+		CompressionKey	_key;
+		std::string		_compressed;
+		bool			_ok;
+};
+
 Server::Server(const ConfigData& config)
-	:_configData(config){
+	:_configData(config), _compressionCache(config.gzip_cache_size), _workerPool(NULL), _nextTaskId(0), _uploadStore(NULL){
 
 	_listeningSockets.clear();
+	initializeRouting();
+	initializeErrorPages();
+	initializeMimeTypes();
+	initializeRedirects();
+	initializeOptionsResponses();
+	initializeCacheHeaders();
+	initializeUpstreams();
+	initializeResponseCaches();
 	initializeListeningSockets();
 	_clients.clear();
 }
 Server::~Server(){
 	shutdown();
+	// After the clients: their requests leave the pools when deleted
+	for (std::map<std::string, BackendPool*>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it)
+		delete it->second;
+	for (std::map<std::string, ResponseCache*>::iterator it = _responseCaches.begin(); it != _responseCaches.end(); ++it)
+		delete it->second;
 }
 
 void Server::initializeListeningSockets(){
@@ -66,6 +168,18 @@ void Server::initializeListeningSockets(){
 
 void Server::handleEvent(int fd, short revents) {
 
+	std::map<int, int>::iterator pipe = _cgiPipes.find(fd);
+	if (pipe != _cgiPipes.end()) {
+		handleCgiEvent(pipe->second, fd, revents);
+		return;
+	}
+	for (std::map<std::string, BackendPool*>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it) {
+		if (it->second->owns(fd)) {
+			it->second->handleEvent(fd, revents);
+			serviceUpstreams();
+			return;
+		}
+	}
 	int listenFdIndex = isListeningSocket(fd);
 	if (listenFdIndex >= 0) {
 		if (revents & POLLIN) {
@@ -73,6 +187,11 @@ void Server::handleEvent(int fd, short revents) {
 		}
 	} else {
 		// Client socket
+		if (revents & CLIENT_HANGUP_EVENTS) {
+			std::cout << "Client FD " << fd << " closed its end" << std::endl;
+			disconectClient(fd);
+			return;
+		}
 		if (revents & POLLIN) {
 			handleClientRead(fd);
 		}
@@ -102,7 +221,7 @@ void Server::handleListenEvent(int indexOfLinstenSocket){
 
 		_clients[client_fd] = ClientInfo(client_fd);
 		_clients[client_fd].keepAliveTimeout = _configData.keepalive_timeout;
-		_clients[client_fd].lastActivity = time(NULL);
+		_clients[client_fd].lastActivity = Clock::monotonicMs();
 		_clients[client_fd].maxRequests = _configData.keepalive_max_requests;
 		_clients[client_fd].requestCount = 0;
 		_clients[client_fd].ip = inet_ntoa(client_addr.sin_addr);
@@ -140,6 +259,15 @@ void Server::handleClientRead(int fd){
 		disconectClient(fd);
 	}
 
+	if (_clients[fd].state == READING_BODY) {
+		readRequestBody(fd);
+		return;
+	}
+	if (_clients[fd].state == RUNNING_CGI) {
+		readCgiBody(fd);
+		return;
+	}
+
 	if(_clients[fd].state == READING_REQUEST){
 
 		char buffer[BUFFER_SIZE];
@@ -179,116 +307,358 @@ void Server::handleClientRead(int fd){
 
 				std::cout << "[DEBUG] Content-Length: " << contentLength << ", Body received: " << bodyReceived << ", Total data: " << _clients[fd].requestData.length() << std::endl;
 
-				if(bodyReceived < contentLength)
+				if(bodyReceived < contentLength) {
+					// Checked before any body byte; uploads switch to READING_BODY
+					beginRequestBody(fd, tempParser, bodyStart);
 					return;  // Keep receiving body
+				}
 			}
 
 			// Full request is received, prepare response
-			HttpRequest httpRequest;
-			httpRequest.parseRequest(_clients[fd].requestData);
-			if(!httpRequest.getStatus()){
-				HttpResponse errorResponse(httpRequest);
-				errorResponse.generateResponse(400);
-				_clients[fd].responseData = errorResponse.getResponse();
-				_clients[fd].bytesSent = 0;
-				_clients[fd].state = SENDING_RESPONSE;
-				_clients[fd].shouldClose = true;
-				std::cout << "[DEBUG] Switched FD " << fd << " to POLLOUT mode (ready to send error response)" << std::endl;
-				return;
-			}else{
-				updateClientActivity(fd);
-
-				HttpResponse response(httpRequest);
-				std::cout << "\n#######  PATH MATCHING/VALIDATIONr #######" << std::endl;
-				const LocationConfig* matchedLocation = _configData.findMatchingLocation(httpRequest.getPath());
-				if(!matchedLocation){
-					std::cout << "[DEBUG] No matched location in config file" << std::endl;
-					response.generateResponse(404);
-					_clients[fd].responseData = response.getResponse();
-					_clients[fd].bytesSent = 0;
-					_clients[fd].state = SENDING_RESPONSE;
-					std::cout << "[DEBUG] Switched FD " << fd << " to POLLOUT mode (ready to send error response)" << std::endl;
-					return;
-				}
-				if(!validateMethod(httpRequest, matchedLocation)) {
-					std::cout << "[DEBUG] Path validation failed (method not allowed or missing root)" << std::endl;
-					response.generateResponse(403);
-					_clients[fd].responseData = response.getResponse();
-					_clients[fd].bytesSent = 0;
-					_clients[fd].state = SENDING_RESPONSE;
-					std::cout << "[DEBUG] Switched FD " << fd << " to POLLOUT mode (ready to send error response)" << std::endl;
-					return;
-				}
+			processRequest(fd);
+		}
+	}
+		std::cout << "#################################\n" << std::endl;
 
-				std::string mappedPath = mapPath(httpRequest, matchedLocation);
-				if(!isPathSafe(mappedPath, matchedLocation->root)) {
-					response.generateResponse(403);
-					_clients[fd].responseData = response.getResponse();
-					_clients[fd].bytesSent = 0;
-					_clients[fd].state = SENDING_RESPONSE;
-					std::cout << "[DEBUG] Switched FD " << fd << " to POLLOUT mode (ready to send error response)" << std::endl;
-					return;
-				}
-				std::cout << "#################################\n" << std::endl;
+}
+
+/*
+	Parses the buffered request and builds its response. Also re-entered
+	when a worker pool task finishes, so handlers find its result cached.
+*/
+void Server::processRequest(int fd){
+
+	HttpRequest httpRequest;
+	httpRequest.parseRequest(_clients[fd].requestData);
+	if(!httpRequest.getStatus()){
+		_clients[fd].shouldClose = true;
+		setErrorResponse(_clients[fd], 400, NULL);
+		_clients[fd].bytesSent = 0;
+		_clients[fd].state = SENDING_RESPONSE;
+		std::cout << "[DEBUG] Switched FD " << fd << " to POLLOUT mode (ready to send error response)" << std::endl;
+		return;
+	}
+	updateClientActivity(fd);
+	_clients[fd].headOnly = (httpRequest.getMethodEnum() == HEAD);
+
+	const LocationConfig* matchedLocation = NULL;
+	std::string mappedPath;
+	if (routeRequest(httpRequest, _clients[fd], matchedLocation, mappedPath)) {
+
+		std::string script;
+		std::string pathInfo;
+		Methods method = httpRequest.getMethodEnum();
+		if (findCgiTarget(*matchedLocation, mappedPath, script, pathInfo)) {
+			const std::string& body = httpRequest.getBody();
+			startCgi(fd, httpRequest, *matchedLocation, script, pathInfo, body.data(), body.size());
+		}
+		else switch (method){
+			case GET: handleGET(httpRequest, _clients[fd], mappedPath, *matchedLocation); break;
+			case POST: handlePOST(httpRequest, _clients[fd], mappedPath, *matchedLocation); break;
+			case DELETE: handleDELETE(httpRequest, _clients[fd], mappedPath, *matchedLocation); break;
+			case HEAD: handleHEAD(httpRequest, _clients[fd], mappedPath, *matchedLocation); break;
+			case OPTIONS: break;
+			case PURGE: setErrorResponse(_clients[fd], 405, matchedLocation); break;   // nothing cached here
+		}
+	}
+	if (_clients[fd].state == WAITING_TASK) {
+		std::cout << "[DEBUG] FD " << fd << " waiting on worker pool task " << _clients[fd].taskId << std::endl;
+		return;
+	}
+	if (_clients[fd].state == RUNNING_CGI || _clients[fd].state == WAITING_CACHE)
+		return;
 
-				//if cgi -> cgi
+	_clients[fd].bytesSent = 0;
+	_clients[fd].state = SENDING_RESPONSE;
+	std::cout << "[DEBUG] Switched FD " << fd << " to POLLOUT mode (ready to send response)" << std::endl;
+}
 
-				Methods method = httpRequest.getMethodEnum();
-				switch (method){
-					case GET: handleGET(httpRequest, _clients[fd], mappedPath); break;
-					case POST: handlePOST(httpRequest, _clients[fd], mappedPath); break;
-					case DELETE: handleDELETE(httpRequest, _clients[fd], mappedPath); break;
-				}
+/*
+	Location matching, redirects, OPTIONS and the method/path/body checks
+	shared by buffered requests and streamed uploads. Returns false when a
+	response has already been set.
+*/
+bool Server::routeRequest(const HttpRequest& request, ClientInfo& client, const LocationConfig*& location, std::string& mappedPath){
 
-				_clients[fd].bytesSent = 0;
-				_clients[fd].state = SENDING_RESPONSE;
-				std::cout << "[DEBUG] Switched FD " << fd << " to POLLOUT mode (ready to send response)" << std::endl;
-			}
-		}
+	std::cout << "\n#######  PATH MATCHING/VALIDATIONr #######" << std::endl;
+	location = findLocation(request.getPath());
+	if(!location){
+		std::cout << "[DEBUG] No matched location in config file" << std::endl;
+		setErrorResponse(client, 404, NULL);
+		return false;
 	}
+	// Redirect locations answer before any method check, path mapping or disk access
+	const RedirectResponse& redirect = _locationRedirects[locationIndex(*location)];
+	if (redirect.rendered.statusCode) {
+		setRedirectResponse(request, client, redirect);
+		return false;
+	}
+	// OPTIONS (CORS preflight) is answered from the location's allow_methods alone
+	if (request.getMethodEnum() == OPTIONS) {
+		setStaticResponse(client, &_locationOptions[locationIndex(*location)]);
+		return false;
+	}
+	if(!validateMethod(request, location)) {
+		std::cout << "[DEBUG] Path validation failed (method not allowed or missing root)" << std::endl;
+		setErrorResponse(client, 403, location);
+		return false;
+	}
+	// Proxied requests name nothing on this server's disk
+	if (!location->proxy_pass.empty()) {
 		std::cout << "#################################\n" << std::endl;
+		return checkRequestBody(request, client, *location, mappedPath);
+	}
+
+	mappedPath = mapPath(request, location);
+	// A CGI script's PATH_INFO names nothing on disk: the script is what is checked
+	std::string script, pathInfo;
+	if (!findCgiScript(*location, mappedPath, script, pathInfo))
+		script = mappedPath;
+	if(!isPathSafe(script, *location)) {
+		setErrorResponse(client, 403, location);
+		return false;
+	}
+	std::cout << "#################################\n" << std::endl;
+	return checkRequestBody(request, client, *location, mappedPath);
+}
+
+/*
+	Expect, client_max_body_size and the upload content type, checked from
+	the headers alone: for a body still on its way (beginRequestBody) as for
+	one that came in the same read as the headers. Scripts and upstreams get
+	any body as is.
+*/
+bool Server::checkRequestBody(const HttpRequest& request, ClientInfo& client, const LocationConfig& location, const std::string& mappedPath){
+
+	const std::map<std::string, std::string>& headers = request.getHeaders();
+	std::map<std::string, std::string>::const_iterator expect = headers.find("expect");
+	size_t contentLength = request.getContentLength();
+	if (contentLength == 0 && expect == headers.end())
+		return true;
+
+	if (expect != headers.end()) {
+		std::string value = expect->second;
+		std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+		if (value != "100-continue") {
+			setErrorResponse(client, 417, &location);
+			return false;
+		}
+	}
+	if (contentLength > static_cast<size_t>(location.client_max_body_size)) {
+		setErrorResponse(client, 413, &location);
+		return false;
+	}
+	std::string script;
+	std::string pathInfo;
+	if (request.getMethodEnum() != POST || findCgiTarget(location, mappedPath, script, pathInfo))
+		return true;
+	std::string contentType = request.getContenType();
+	if (contentType.find("multipart/form-data") != std::string::npos) {
+		if (MultipartParser::boundaryFromContentType(contentType).empty()) {
+			setErrorResponse(client, 400, &location);
+			return false;
+		}
+	}
+	else if (!PostHandler(mappedPath, _mimeTypes, *_uploadStore, location.upload_durability).isSupportedContentType(contentType)) {
+		setErrorResponse(client, 415, &location);
+		return false;
+	}
+	return true;
+}
+
+// upload_store when the location has one, else the mapped request path
+std::string Server::uploadDirectory(const LocationConfig& location, const std::string& mappedPath) const{
+
+	if (location.upload_store.empty())
+		return mappedPath;
+	if (location.upload_store[location.upload_store.size() - 1] == '/')
+		return location.upload_store;
+	return location.upload_store + "/";
+}
+
+/*
+	Called while the body of a request is still arriving. The request is
+	checked against its location (method, path, body size) first, so a
+	rejected body is never read and an "Expect: 100-continue" client gets
+	its 100 or the final error before sending it. A script gets the body
+	piped as it arrives. A POST hands it to a BodyUpload instead: multipart
+	parts are parsed into their files, raw bodies go to a preallocated temp
+	file (spliced from the socket where possible), so the body is never
+	held in requestData. Other methods keep being buffered.
+*/
+void Server::beginRequestBody(int fd, const HttpRequest& request, size_t bodyStart){
+
+	ClientInfo& client = _clients[fd];
+	if (client.bodyChecked || !request.getStatus())
+		return;
+	client.bodyChecked = true;
+
+	const std::map<std::string, std::string>& headers = request.getHeaders();
+	std::map<std::string, std::string>::const_iterator expect = headers.find("expect");
+	const LocationConfig* location = NULL;
+	std::string mappedPath;
+	if (!routeRequest(request, client, location, mappedPath)) {
+		// The unread body would otherwise be parsed as the next request
+		client.shouldClose = true;
+		client.bytesSent = 0;
+		client.state = SENDING_RESPONSE;
+		return;
+	}
+
+	// Only worth sending while the client is still holding the body back
+	if (expect != headers.end() && client.requestData.size() == bodyStart) {
+		ssize_t sent = send(fd, CONTINUE_RESPONSE, sizeof(CONTINUE_RESPONSE) - 1, 0);
+		std::cout << "[DEBUG] Sent 100 Continue to FD " << fd << " (" << sent << " bytes)" << std::endl;
+	}
+	std::string script;
+	std::string pathInfo;
+	size_t contentLength = request.getContentLength();
+	if (findCgiTarget(*location, mappedPath, script, pathInfo)) {
+		// The rest of the body is piped to the script as it arrives
+		size_t received = client.requestData.size() - bodyStart;
+		client.bodyRemaining = contentLength - received;
+		startCgi(fd, request, *location, script, pathInfo, client.requestData.data() + bodyStart, received);
+		client.requestData.erase(bodyStart);
+		if (client.state != RUNNING_CGI) {
+			client.shouldClose = true;
+			client.bytesSent = 0;
+			client.state = SENDING_RESPONSE;
+		}
+		return;
+	}
+	if (request.getMethodEnum() != POST)
+		return;
+
+	std::string contentType = request.getContenType();
+	bool multipart = contentType.find("multipart/form-data") != std::string::npos;
+	std::string directory = uploadDirectory(*location, mappedPath);
+	std::cout << "[DEBUG] Streaming " << (multipart ? "multipart" : "raw") << " upload of "
+			  << contentLength << " bytes to: " << directory << std::endl;
+	if (multipart)
+		client.upload = new MultipartUpload(*_uploadStore, directory,
+			MultipartParser::boundaryFromContentType(contentType), location->upload_durability);
+	else
+		client.upload = new RawUpload(*_uploadStore, directory,
+			PostHandler(directory, _mimeTypes, *_uploadStore, location->upload_durability).rawUploadName(contentType),
+			contentLength, location->upload_durability);
+	client.bodyRemaining = contentLength;
+	client.state = READING_BODY;
+	size_t received = client.requestData.size() - bodyStart;
+	client.bodyRemaining -= received;
+	client.upload->feed(client.requestData.data() + bodyStart, received);
+	client.requestData.erase(bodyStart);
+	updateBodyUpload(client);
+}
+
+void Server::readRequestBody(int fd){
+
+	ClientInfo& client = _clients[fd];
+	// Never read past this request's body: a pipelined request may follow it
+	ssize_t bytes = client.upload->receive(fd, client.bodyRemaining);
+	if (bytes <= 0) {
+		std::cout << "[DEBUG] Client FD " << fd << " closed during upload" << std::endl;
+		disconectClient(fd);
+		return;
+	}
+	updateClientActivity(fd);
+	client.bodyRemaining -= bytes;
+	updateBodyUpload(client);
+}
+
+// Answers once the body is complete or the upload has failed
+void Server::updateBodyUpload(ClientInfo& client){
+
+	if (!client.upload->failed() && client.bodyRemaining > 0)
+		return;
+
+	// Respond from the headers kept in requestData
+	HttpRequest request;
+	request.ParsePartialRequest(client.requestData);
+	int status = (!client.upload->failed() && client.upload->finish()) ? 200 : (client.upload->diskError() ? 500 : 400);
+	std::cout << "[DEBUG] Upload finished with " << status << ", files saved: "
+			  << client.upload->filesSaved() << std::endl;
+	delete client.upload;   // removes a file left incomplete
+	client.upload = NULL;
+
+	if (status == 200) {
+		HttpResponse response(request);
+		response.generateResponse(200);
+		client.responseData = response.getResponse();
+	}
+	else
+		setErrorResponse(client, status, findLocation(request.getPath()));
+	if (client.bodyRemaining > 0)
+		client.shouldClose = true;
+	client.bytesSent = 0;
+	client.state = SENDING_RESPONSE;
+}
+
+// Hands blocking work to the worker pool; false (task deleted) means do it inline
+bool Server::deferToPool(ClientInfo& client, ClientTask* task){
+
+	task->fd = client.socket.getFd();
+	task->taskId = ++_nextTaskId;
+	if (!_workerPool || !_workerPool->submit(task)) {
+		delete task;
+		return false;
+	}
+	client.taskId = task->taskId;
+	client.state = WAITING_TASK;
+	return true;
+}
+
+ClientInfo* Server::waitingClient(int fd, unsigned long taskId){
 
+	std::map<int, ClientInfo>::iterator it = _clients.find(fd);
+	if (it == _clients.end() || it->second.state != WAITING_TASK || it->second.taskId != taskId)
+		return NULL;
+	return &it->second;
 }
+
 void Server::handleClientWrite(int fd){
 
+	if (_clients[fd].state == RUNNING_CGI) {
+		sendCgiOutput(fd);
+		return;
+	}
 	if (_clients[fd].state == SENDING_RESPONSE){
 
+		ClientInfo& client = _clients[fd];
 		std::cout << "POLLOUT event on client FD " << fd << " (sending response)" << std::endl;
 
-		// Send remaining response data
-		const char* data = _clients[fd].responseData.c_str() + _clients[fd].bytesSent;
-		size_t remainingLean = _clients[fd].responseData.length() - _clients[fd].bytesSent;
-
-		int bytes_sent = send(fd, data, remainingLean, 0);
+		// Send a pre-rendered response or the header/in-memory data first, then the file body
+		ssize_t bytes_sent;
+		if (client.staticResponse && client.staticSent < staticResponseLength(client))
+			bytes_sent = sendStaticResponse(client);
+		else if (client.bytesSent < client.responseData.length()) {
+			const char* data = client.responseData.c_str() + client.bytesSent;
+			size_t remainingLean = client.responseData.length() - client.bytesSent;
+			bytes_sent = send(fd, data, remainingLean, 0);
+			if (bytes_sent > 0)
+				client.bytesSent += bytes_sent;
+		}
+		else if (client.segmentIndex < client.fileSegments.size())
+			bytes_sent = sendFileSegment(client);
+		else
+			bytes_sent = 0;
 		std::cout << "send() returned " << bytes_sent << " bytes to FD " << fd << std::endl;
 
 		if (bytes_sent > 0) {
 
-			_clients[fd].bytesSent += bytes_sent;
-
 			updateClientActivity(fd);
 
-
-			std::cout << "Bytes setn: " << _clients[fd].bytesSent << "    ResponseData length: " << _clients[fd].responseData.length() << std::endl;
+			std::cout << "Bytes setn: " << client.bytesSent << "    ResponseData length: " << client.responseData.length()
+					  << "    File segment: " << client.segmentIndex << "/" << client.fileSegments.size() << std::endl;
 
 			// Check if entire response was sent
-			if (_clients[fd].bytesSent == _clients[fd].responseData.length()) {
-
-				if(_clients[fd].shouldClose){
-					std::cout << "Complete response sent to FD " << fd << ". Closing connection." << std::endl;
-					disconectClient(fd);
-					return;
-				}
+			if ((!client.staticResponse || client.staticSent == staticResponseLength(client))
+				&& client.bytesSent == client.responseData.length()
+				&& client.segmentIndex == client.fileSegments.size()) {
 
-				// Reset client state for next request
-				_clients[fd].state = READING_REQUEST;
-				_clients[fd].bytesSent = 0;
-				_clients[fd].responseData.clear();
-				_clients[fd].requestData.clear();
-				updateClientActivity(fd);
+				completeResponse(fd);
 
 			} else {
-				std::cout << "Partial send: " << _clients[fd].bytesSent << "/" << _clients[fd].responseData.length() << " bytes sent" << std::endl;
+				std::cout << "Partial send: " << client.bytesSent << "/" << client.responseData.length() << " bytes sent" << std::endl;
 			}
 		} else {
 
@@ -299,71 +669,555 @@ void Server::handleClientWrite(int fd){
 	}
 }
 
-void Server::handleGET(const HttpRequest& request, ClientInfo& client, std::string mappedPath){
+// Sends the next chunk of the current file segment: its in-memory prefix
+// (multipart part header) first, then the byte range through sendfile().
+ssize_t Server::sendFileSegment(ClientInfo& client){
 
-	std::ifstream file(mappedPath.c_str());
+	FileSegment& segment = client.fileSegments[client.segmentIndex];
+	ssize_t bytes;
+
+	if (client.segmentSent < segment.prefix.length()) {
+		bytes = send(client.socket.getFd(), segment.prefix.c_str() + client.segmentSent,
+					segment.prefix.length() - client.segmentSent, 0);
+	}
+	else {
+		size_t rangeSent = client.segmentSent - segment.prefix.length();
+		off_t offset = segment.offset + rangeSent;
+		bytes = client.socket.sendFile(client.fileFd, &offset, segment.length - rangeSent);
+	}
+	if (bytes > 0) {
+		client.segmentSent += bytes;
+		if (client.segmentSent == segment.prefix.length() + segment.length) {
+			client.segmentIndex++;
+			client.segmentSent = 0;
+		}
+	}
+	return bytes;
+}
+
+size_t Server::staticResponseLength(const ClientInfo& client) const {
+
+	size_t bodyLength = client.headOnly ? 0 : client.staticResponse->body.length();
+	return client.staticResponse->head.length() + client.staticHeadersLength + bodyLength;
+}
+
+// Sends head, the per-request Date/Connection lines and body of a
+// pre-rendered response in one writev(), resuming after partial sends.
+ssize_t Server::sendStaticResponse(ClientInfo& client){
+
+	const StaticResponse& response = *client.staticResponse;
+	const char* parts[3] = { response.head.data(), client.staticHeaders, response.body.data() };
+	size_t sizes[3] = { response.head.length(), client.staticHeadersLength, client.headOnly ? 0 : response.body.length() };
+
+	struct iovec iov[3];
+	int count = 0;
+	size_t skip = client.staticSent;
+	for (int i = 0; i < 3; i++) {
+		if (skip >= sizes[i]) {
+			skip -= sizes[i];
+			continue;
+		}
+		iov[count].iov_base = const_cast<char*>(parts[i]) + skip;
+		iov[count].iov_len = sizes[i] - skip;
+		skip = 0;
+		count++;
+	}
+	ssize_t bytes = writev(client.socket.getFd(), iov, count);
+	if (bytes > 0)
+		client.staticSent += bytes;
+	return bytes;
+}
+
+// Points the client at a pre-rendered response. Only the Date and
+// Connection lines are written per request (into the client's own buffer).
+void Server::setStaticResponse(ClientInfo& client, const StaticResponse* response){
+
+	static const char connectionClose[] = "\r\nConnection: close\r\n\r\n";
+	static const char connectionKeepAlive[] = "\r\nConnection: keep-alive\r\n\r\n";
+	const char* connection = client.shouldClose ? connectionClose : connectionKeepAlive;
+	size_t connectionLength = client.shouldClose ? sizeof(connectionClose) - 1 : sizeof(connectionKeepAlive) - 1;
+	const std::string& date = Clock::httpDate();
+
+	size_t length = 0;
+	std::memcpy(client.staticHeaders, "Date: ", 6);
+	length += 6;
+	std::memcpy(client.staticHeaders + length, date.data(), date.length());
+	length += date.length();
+	std::memcpy(client.staticHeaders + length, connection, connectionLength);
+	length += connectionLength;
+
+	client.staticResponse = response;
+	client.staticHeadersLength = length;
+	client.staticSent = 0;
+	client.responseData.clear();
+}
+
+size_t Server::locationIndex(const LocationConfig& location) const {
+
+	return &location - &_configData.locations[0];
+}
+
+const LocationConfig* Server::findLocation(const std::string& path) const {
+
+	int index = _router.match(path);
+	if (index < 0) {
+		std::cout << "[DEBUG] No location matches " << path << std::endl;
+		return NULL;
+	}
+	std::cout << "[DEBUG] " << path << " -> location " << _configData.locations[index].path << std::endl;
+	return &_configData.locations[index];
+}
+
+// Location paths, allowed methods and canonical roots, compiled once
+void Server::initializeRouting(){
+
+	_router.build(_configData.locations);
+	std::cout << "[DEBUG] Files opened beneath location roots with "
+			  << (openat2Available() ? "openat2(RESOLVE_BENEATH)" : "an O_NOFOLLOW walk (no openat2)") << std::endl;
+	for (size_t i = 0; i < _configData.locations.size(); i++)
+		if (_router.route(i).rootFd < 0 && _configData.locations[i].proxy_pass.empty())
+			std::cout << "[DEBUG] Root of location " << _configData.locations[i].path
+					  << " does not resolve yet: " << _configData.locations[i].root << std::endl;
+	const RegexSet& regexes = _router.regexes();
+	if (regexes.size() > 0)
+		std::cout << "[DEBUG] " << regexes.size() << " regex locations compiled to one "
+				  << (regexes.deterministic() ? "DFA" : "NFA (too many DFA states)") << std::endl;
+}
+
+const ErrorPages& Server::errorPagesFor(const LocationConfig* location) const {
+
+	if (!location || _configData.locations.empty())
+		return _serverErrorPages;
+	return _locationErrorPages[locationIndex(*location)];
+}
+
+void Server::setRedirectResponse(const HttpRequest& request, ClientInfo& client, const RedirectResponse& redirect){
+
+	if (!redirect.dynamic) {
+		setStaticResponse(client, &redirect.rendered);
+		return;
+	}
+	std::string location = redirect.before + request.getPath();
+	if (!request.getQuery().empty())
+		location += "?" + request.getQuery();
+	location += redirect.after;
 
 	HttpResponse response(request);
-	response.setPath(mappedPath);
-	if (file.is_open()){
+	response.setContentType("text/html");
+	response.setHeader("Location", location);
+	response.generateHeaders(redirect.rendered.statusCode, redirect.rendered.body.length(), client.responseData);
+	if (!client.headOnly)
+		client.responseData.append(redirect.rendered.body);
+}
 
-		response.generateResponse(200);
-		client.responseData = response.getResponse();
+// expires / cache_control of every location, compiled once
+void Server::initializeCacheHeaders(){
+
+	_locationCacheHeaders.resize(_configData.locations.size());
+	for (size_t i = 0; i < _configData.locations.size(); i++)
+		_locationCacheHeaders[i].build(_configData.locations[i].cache, _configData.locations[i].cache_types);
+}
+
+void Server::applyCacheHeaders(HttpResponse& response, const LocationConfig& location){
+
+	const CacheHeaderTemplate* tmpl = _locationCacheHeaders[locationIndex(location)].find(response.getContentType());
+	if (tmpl)
+		response.setCacheHeaders(tmpl->cacheControl.empty() ? NULL : &tmpl->cacheControl,
+			tmpl->expires ? &tmpl->expiresHeader() : NULL);
+}
+
+// One entry per location (statusCode 0 = no redirect), rendered at startup
+void Server::initializeRedirects(){
+
+	_locationRedirects.resize(_configData.locations.size());
+	for (size_t i = 0; i < _configData.locations.size(); i++) {
+		const LocationConfig& location = _configData.locations[i];
+		if (!location.redirect.empty())
+			_locationRedirects[i] = renderRedirectResponse(location.redirect_code, location.redirect);
 	}
-	else{
-		std::cout << "Error: 404 path is not found" << std::endl;
-		response.generateResponse(404);
-		client.responseData = response.getResponse();
+}
+
+void Server::setErrorResponse(ClientInfo& client, int statusCode, const LocationConfig* location){
+
+	const StaticResponse* page = errorPagesFor(location).find(statusCode);
+	if (!page) {
+		std::cerr << "[ERROR] No error page rendered for " << statusCode << ", sending 500" << std::endl;
+		page = errorPagesFor(location).find(500);
 	}
+	setStaticResponse(client, page);
+}
 
-	/*
-	The GET method finds the directory/file, reads it, and uses HttpResponse methods to
-	properly format the HTTP response with headers, status codes, etc.
+// Renders every location's error pages once, so error paths never touch the disk
+void Server::initializeErrorPages(){
 
-	1. Parse the request path → /index.html, /images/logo.png (done in httpRequest)
-	2. Map to file system path → /var/www/html/index.html
-	3. Check if file exists and is readable
-	4. Read file contents (if it exists)
-	5. Use HttpResponse to build response
+	_serverErrorPages.build(_configData.error_pages);
+	_locationErrorPages.resize(_configData.locations.size());
+	for (size_t i = 0; i < _configData.locations.size(); i++)
+		_locationErrorPages[i].build(_configData.locations[i].error_pages);
+}
 
+/*
+	Directory listing for "autoindex on" locations without an index file.
+	?page=N&limit=M selects a slice of the sorted snapshot; ?format=json or
+	an Accept header preferring application/json returns JSON instead of HTML.
+*/
+void Server::handleAutoindex(const HttpRequest& request, ClientInfo& client, const std::string& dirPath,
+	int dirFd, const struct stat& dirStat, const LocationConfig& location){
+
+	const std::map<std::string, std::string>& headers = request.getHeaders();
+	std::map<std::string, std::string>::const_iterator acceptIt = headers.find("accept");
+	bool preferJson = acceptIt != headers.end() && acceptIt->second.find("application/json") != std::string::npos
+		&& acceptIt->second.find("text/html") == std::string::npos;
+	AutoindexPage page = parseAutoindexQuery(request.getQuery(), preferJson);
+
+	const std::string* body = _autoindexCache.render(dirFd, dirPath, dirStat, request.getPath(), page);
+	if (!body) {
+		setErrorResponse(client, 403, &location);
+		return;
+	}
+	HttpResponse response(request);
+	response.setContentType(page.format == AUTOINDEX_JSON ? "application/json" : "text/html");
+	response.setHeader("Cache-Control", "no-cache");
+	response.generateHeaders(200, body->length(), client.responseData);
+	client.responseData.append(*body);
+}
 
-	//example of the get function
+// Built-in table, then types_file, then the types {} block (later entries win)
+void Server::initializeMimeTypes(){
 
-	void Server::handleGET(const HttpRequest& request, ClientInfo& client) {
-	std::string requestedPath = request.getPath();  // "/index.html"
-	std::string filePath = _documentRoot + requestedPath;  // "/var/www/html/index.html"
+	_mimeTypes.addDefaults();
+	if (!_configData.types_file.empty())
+		_mimeTypes.loadFile(_configData.types_file);
+	for (size_t i = 0; i < _configData.types.size(); i++)
+		_mimeTypes.add(_configData.types[i].first, _configData.types[i].second);
+	std::cout << "[DEBUG] MIME registry: " << _mimeTypes.size() << " extensions" << std::endl;
+}
 
-	HttpResponse response;
+// "Allow" for OPTIONS: allow_methods plus the implied HEAD (with GET) and OPTIONS
+static std::string allowedMethods(const LocationConfig& location){
 
-	// Try to read file
-	std::ifstream file(filePath);
-	if (file.is_open()) {
-		// File exists - read content
-		std::string content((std::istreambuf_iterator<char>(file)),
-							std::istreambuf_iterator<char>());
+	std::vector<std::string> methods = location.allow_methods;
+	if (std::find(methods.begin(), methods.end(), "GET") != methods.end()
+		&& std::find(methods.begin(), methods.end(), "HEAD") == methods.end())
+		methods.push_back("HEAD");
+	if (std::find(methods.begin(), methods.end(), "OPTIONS") == methods.end())
+		methods.push_back("OPTIONS");
 
-		response.setStatusCode(200);
-		response.setReasonPhrase("OK");
-		response.setContentType("text/html");  // or detect from extension
-		response.setBody(content);
-	} else {
-		// File not found
-		response.setStatusCode(404);
-		response.setReasonPhrase("Not Found");
-		response.setContentType("text/html");
-		response.setBody("<h1>404 - File Not Found</h1>");
+	std::string allow;
+	for (size_t i = 0; i < methods.size(); i++)
+		allow += (i ? ", " : "") + methods[i];
+	return allow;
+}
+
+/*
+	Pre-rendered 204 per location. No Access-Control-Allow-Origin is sent:
+	the server has no origin policy to apply, so a cross-origin preflight
+	learns the methods but is not granted access.
+*/
+void Server::initializeOptionsResponses(){
+
+	_locationOptions.resize(_configData.locations.size());
+	for (size_t i = 0; i < _configData.locations.size(); i++) {
+		std::string allow = allowedMethods(_configData.locations[i]);
+		std::string headers = "Allow: " + allow + "\r\n"
+			+ "Access-Control-Allow-Methods: " + allow + "\r\n"
+			+ "Access-Control-Max-Age: " + OPTIONS_MAX_AGE + "\r\n";
+		_locationOptions[i] = renderStaticResponse(204, headers, "", "");
+	}
+}
+
+// Drops the body of a response built by handleGET so it can answer a HEAD
+void Server::discardBody(ClientInfo& client){
+
+	size_t headerEnd = client.responseData.find("\r\n\r\n");
+	if (headerEnd != std::string::npos)
+		client.responseData.erase(headerEnd + 4);
+	if (client.fileFd >= 0)
+		close(client.fileFd);
+	client.fileFd = -1;
+	client.fileSegments.clear();
+	client.segmentIndex = 0;
+	client.segmentSent = 0;
+}
+
+// Whole response sent: close, or get ready for the next request
+void Server::completeResponse(int fd){
+
+	ClientInfo& client = _clients[fd];
+	if(client.shouldClose){
+		std::cout << "Complete response sent to FD " << fd << ". Closing connection." << std::endl;
+		disconectClient(fd);
+		return;
 	}
 
-	client.responseData = response.toString();
+	// Reset client state for next request
+	resetResponse(client);
+	client.state = READING_REQUEST;
+	client.bytesSent = 0;
+	client.responseData.clear();
+	client.requestData.clear();
+	updateClientActivity(fd);
+}
+
+void Server::resetResponse(ClientInfo& client){
+
+	releaseCache(client, false);
+	if (client.cgi) {
+		delete client.cgi;   // kills a script still running
+		client.cgi = NULL;
+		trackCgiPipes(client);
 	}
+	client.headOnly = false;
+	client.inlineWork = false;
+	client.bodyChecked = false;
+	delete client.upload;
+	client.upload = NULL;
+	client.bodyRemaining = 0;
+	client.staticResponse = NULL;
+	client.staticHeadersLength = 0;
+	client.staticSent = 0;
+	if (client.fileFd >= 0)
+		close(client.fileFd);
+	client.fileFd = -1;
+	client.fileSegments.clear();
+	client.segmentIndex = 0;
+	client.segmentSent = 0;
+}
+
+/*
+	HEAD for a plain file is answered from the metadata cache: no read,
+	usually not even an open(). The cache opens files for reading as GET
+	does, so an unreadable or escaping path gets GET's 403, and a current
+	copy gets GET's 304. Whenever GET would pick a different
+	representation (ranges, precompressed sidecars, on-the-fly compression)
+	or the path is a directory, the GET response is built and its body
+	dropped, so the headers still match what GET would send.
 */
+void Server::handleHEAD(const HttpRequest& request, ClientInfo& client, std::string mappedPath, const LocationConfig& location){
+
+	const FileMetadata& metadata = _metadataCache.lookup(_router.route(locationIndex(location)).rootFd,
+		rootRelative(location, mappedPath));
+	if (!metadata.exists) {
+		bool missing = (metadata.error == ENOENT || metadata.error == ENOTDIR);
+		setErrorResponse(client, missing ? 404 : 403, &location);
+		return;
+	}
+
+	const std::map<std::string, std::string>& headers = request.getHeaders();
+	std::map<std::string, std::string>::const_iterator acceptIt = headers.find("accept-encoding");
+	std::string acceptEncoding = acceptIt != headers.end() ? acceptIt->second : "";
+	bool staticVariants = (location.gzip_static && acceptsEncoding(acceptEncoding, ENCODING_GZIP))
+		|| (location.brotli_static && acceptsEncoding(acceptEncoding, ENCODING_BROTLI));
+
+	HttpResponse response(request);
+	response.setPath(mappedPath);
+	response.setMimeTypes(&_mimeTypes);
+	bool compressible = metadata.isRegular && isCompressible(location, response.getContentType(), metadata.size);
+
+	if (!metadata.isRegular || headers.count("range") || staticVariants
+		|| (compressible && negotiateEncoding(acceptEncoding) != ENCODING_IDENTITY)) {
+		handleGET(request, client, mappedPath, location);
+		if (client.state != WAITING_TASK)
+			discardBody(client);
+		return;
+	}
+
+	response.setETag(metadata.etag.c_str(), false);
+	response.setLastModified(metadata.lastModified.c_str());
+	applyCacheHeaders(response, location);
+	if (compressible || location.gzip_static || location.brotli_static)
+		response.setHeader("Vary", "Accept-Encoding");
+	if (notModified(headers, metadata.etag.c_str(), metadata.lastModified.c_str())) {
+		response.generateHeaders(304, 0, client.responseData);
+		return;
+	}
+	response.setAcceptRanges();
+	response.generateHeaders(200, metadata.size, client.responseData);
 }
-void Server::handlePOST(const HttpRequest& request, ClientInfo& client, std::string mappedPath){
+
+/*
+	The GET method maps the request to a file, stats it and answers with the
+	header block in responseData while the body itself is streamed from the
+	open file with sendfile() (see handleClientWrite). Nothing is read into
+	memory, which also makes byte ranges cheap:
+
+	- Accept-Ranges/ETag/Last-Modified are always advertised
+	- Range: bytes=... -> 206 with one range or multipart/byteranges
+	- If-Range not matching the current ETag/Last-Modified -> full 200
+	- no satisfiable range -> 416 with Content-Range: bytes * /size
+*/
+void Server::handleGET(const HttpRequest& request, ClientInfo& client, std::string mappedPath, const LocationConfig& location){
 
 	HttpResponse response(request);
 
+	// Opened beneath the location root and checked through the descriptor: what is served is what was checked
+	struct stat fileStat;
+	int fileFd = openInRoot(location, mappedPath, O_RDONLY | O_NONBLOCK);
+	if (fileFd < 0 || fstat(fileFd, &fileStat) != 0) {
+		int openError = errno;
+		std::cout << "[DEBUG] Cannot open " << mappedPath << ": " << strerror(openError) << std::endl;
+		if (fileFd >= 0) close(fileFd);
+		setErrorResponse(client, (openError == ENOENT || openError == ENOTDIR) ? 404 : 403, &location);
+		return;
+	}
+	if (S_ISDIR(fileStat.st_mode)) {
+		// Directory: serve the location's index file from inside it, else list it through its fd
+		int dirFd = fileFd;
+		std::string indexPath = mappedPath;
+		if (indexPath.empty() || indexPath[indexPath.length() - 1] != '/')
+			indexPath += '/';
+		indexPath += location.index.substr(location.index.find_last_of('/') + 1);
+		struct stat indexStat;
+		fileFd = location.index.empty() ? -1 : openInRoot(location, indexPath, O_RDONLY | O_NONBLOCK);
+		if (fileFd < 0 || fstat(fileFd, &indexStat) != 0 || !S_ISREG(indexStat.st_mode)) {
+			if (fileFd >= 0) close(fileFd);
+			if (location.autoindex)
+				handleAutoindex(request, client, mappedPath, dirFd, fileStat, location);
+			else {
+				std::cout << "[DEBUG] Directory without index: " << mappedPath << std::endl;
+				setErrorResponse(client, 403, &location);
+			}
+			close(dirFd);
+			return;
+		}
+		close(dirFd);
+		mappedPath = indexPath;
+		fileStat = indexStat;
+	}
+	if (!S_ISREG(fileStat.st_mode)) {
+		std::cout << "[DEBUG] Not a regular file: " << mappedPath << std::endl;
+		close(fileFd);
+		setErrorResponse(client, 403, &location);
+		return;
+	}
+
+	// A fresh precompressed sidecar (file.br / file.gz) is served in place of the file
+	const std::map<std::string, std::string>& headers = request.getHeaders();
+	std::map<std::string, std::string>::const_iterator acceptIt = headers.find("accept-encoding");
+	std::string acceptEncoding = acceptIt != headers.end() ? acceptIt->second : "";
+	StaticVariant variant = selectStaticVariant(_router.route(locationIndex(location)).rootFd,
+		rootRelative(location, mappedPath), location, acceptEncoding, fileStat);
+	if (variant.fd >= 0) {
+		close(fileFd);
+		fileFd = variant.fd;
+	}
+
+	off_t fileSize = fileStat.st_size;
+	char etag[ETAG_SIZE];
+	char lastModified[HTTP_DATE_SIZE];
+	HttpResponse::formatETag(fileStat.st_mtime, fileSize, etag);
+	HttpResponse::formatHttpDate(fileStat.st_mtime, lastModified);
+	response.setPath(mappedPath);
+	response.setMimeTypes(&_mimeTypes);
+	response.setETag(etag, false);
+	response.setLastModified(lastModified);
+	if (variant.vary)
+		response.setHeader("Vary", "Accept-Encoding");
+	if (variant.encoding != ENCODING_IDENTITY) {
+		std::cout << "[DEBUG] Serving precompressed " << variant.path << std::endl;
+		response.setHeader("Content-Encoding", encodingName(variant.encoding));
+	}
+	bool compressible = variant.encoding == ENCODING_IDENTITY
+		&& isCompressible(location, response.getContentType(), fileSize);
+	if (compressible)
+		response.setHeader("Vary", "Accept-Encoding");
+	// The client's copy is still current: confirm it instead of sending it again
+	if (notModified(headers, etag, lastModified)) {
+		applyCacheHeaders(response, location);
+		response.generateHeaders(304, 0, client.responseData);
+		close(fileFd);
+		return;
+	}
+
+	std::vector<ByteRange> ranges;
+	RangeStatus rangeStatus = RANGE_NONE;
+	std::map<std::string, std::string>::const_iterator rangeIt = headers.find("range");
+	if (rangeIt != headers.end()) {
+		std::map<std::string, std::string>::const_iterator ifRangeIt = headers.find("if-range");
+		if (ifRangeIt == headers.end() || ifRangeMatches(ifRangeIt->second, etag, lastModified))
+			rangeStatus = parseRangeHeader(rangeIt->second, fileSize, ranges);
+		std::cout << "[DEBUG] Range: " << rangeIt->second << " -> " << ranges.size() << " range(s)" << std::endl;
+	}
+
+	// Full-body requests for compressible types may get a cached gzip/deflate variant
+	if (compressible) {
+		ContentEncoding encoding = negotiateEncoding(acceptEncoding);
+		const std::string* compressed = NULL;
+		if (rangeStatus == RANGE_NONE && encoding != ENCODING_IDENTITY)
+			compressed = compressedVariant(client, fileFd, fileStat, etag, encoding, location.gzip_comp_level);
+		if (client.state == WAITING_TASK) {
+			close(fileFd);
+			return;
+		}
+		if (compressed) {
+			response.setHeader("Content-Encoding", encodingName(encoding));
+			response.setETag(etag, true);
+			applyCacheHeaders(response, location);
+			response.generateHeaders(200, compressed->length(), client.responseData);
+			client.responseData.append(*compressed);
+			close(fileFd);
+			return;
+		}
+	}
+	response.setAcceptRanges();
+
+	// Filled in place: a kept-alive connection reuses the vector's capacity
+	std::vector<FileSegment>& segments = client.fileSegments;
+	segments.clear();
+	if (rangeStatus == RANGE_UNSATISFIABLE) {
+		std::ostringstream oss;
+		oss << "bytes */" << fileSize;
+		response.setHeader("Content-Range", oss.str());
+		response.generateHeaders(416, 0, client.responseData);
+		close(fileFd);
+		return;
+	}
+	// Like nginx's expires, caching headers only go on a representation (200/206/304)
+	applyCacheHeaders(response, location);
+	if (rangeStatus == RANGE_NONE) {
+		if (fileSize > 0)
+			segments.push_back(FileSegment("", 0, fileSize));
+		response.generateHeaders(200, fileSize, client.responseData);
+	}
+	else if (ranges.size() == 1) {
+		response.setHeader("Content-Range", formatContentRange(ranges[0], fileSize));
+		segments.push_back(FileSegment("", ranges[0].first, ranges[0].length()));
+		response.generateHeaders(206, ranges[0].length(), client.responseData);
+	}
+	else {
+		static unsigned long boundaryCounter = 0;
+		std::ostringstream boundaryStream;
+		boundaryStream << std::setfill('0') << std::setw(10) << Clock::now() << std::setw(10) << ++boundaryCounter;
+		std::string boundary = boundaryStream.str();
+		std::string partType = response.getContentType();
+
+		unsigned long totalLength = 0;
+		for (size_t i = 0; i < ranges.size(); i++) {
+			std::string prefix = "\r\n--" + boundary + "\r\nContent-Type: " + partType
+				+ "\r\nContent-Range: " + formatContentRange(ranges[i], fileSize) + "\r\n\r\n";
+			segments.push_back(FileSegment(prefix, ranges[i].first, ranges[i].length()));
+			totalLength += prefix.length() + ranges[i].length();
+		}
+		std::string closing = "\r\n--" + boundary + "--\r\n";
+		segments.push_back(FileSegment(closing, 0, 0));
+		totalLength += closing.length();
+
+		response.setContentType("multipart/byteranges; boundary=" + boundary);
+		response.generateHeaders(206, totalLength, client.responseData);
+	}
+
+	if (segments.empty()) {
+		close(fileFd);
+		return;
+	}
+	client.fileFd = fileFd;
+	client.segmentIndex = 0;
+	client.segmentSent = 0;
+}
+void Server::handlePOST(const HttpRequest& request, ClientInfo& client, std::string mappedPath, const LocationConfig& location){
+
 	std::cout << "[DEBUG] UploadPath: " << mappedPath << std::endl;
-	PostHandler post(mappedPath);
+	PostHandler post(uploadDirectory(location, mappedPath), _mimeTypes, *_uploadStore, location.upload_durability);
 
 	std::string contentType = request.getContenType();
 	std::cout << "[DEBUG] POST Content-Type: '" << contentType << "'" << std::endl;
@@ -377,31 +1231,34 @@ void Server::handlePOST(const HttpRequest& request, ClientInfo& client, std::str
 	}
 	else {
 		std::cout << "[DEBUG] Unsupported Content-Type: " << contentType << std::endl;
-		response.generateResponse(415);
-		client.responseData = response.getResponse();
+		setErrorResponse(client, 415, &location);
 	}
 }
-void Server::handleDELETE(const HttpRequest& request, ClientInfo& client, std::string mappedPath) {
+void Server::handleDELETE(const HttpRequest& request, ClientInfo& client, std::string mappedPath, const LocationConfig& location) {
+
+	// unlink() may block on a busy disk: run it on the pool when there is one
+	int rootFd = _router.route(locationIndex(location)).rootFd;
+	std::string relative = rootRelative(location, mappedPath);
+	if (deferToPool(client, new DeleteTask(*this, rootFd, relative)))
+		return;
+	finishDelete(request, client, (unlinkBeneath(rootFd, relative) == 0) ? 0 : errno, &location);
+}
 
-	HttpResponse response(request);
-	std::ifstream file(mappedPath.c_str());
-	if (file.is_open()){
-		file.close();
-		if(std::remove(mappedPath.c_str()) == 0){
-			response.generateResponse(204);
-			client.responseData = response.getResponse();
-			std::cout << "[DEBUG] Succes: 204 file deleted" << std::endl;
-		}
-		else{
-			response.generateResponse(403);
-			client.responseData = response.getResponse();
-			std::cout << "[DEBUG] Error: 403 permission denied" << std::endl;
-		}
+void Server::finishDelete(const HttpRequest& request, ClientInfo& client, int error, const LocationConfig* location) {
+
+	if (!error) {
+		HttpResponse response(request);
+		response.generateResponse(204);
+		client.responseData = response.getResponse();
+		std::cout << "[DEBUG] Succes: 204 file deleted" << std::endl;
 	}
-	else{
+	else if (error == ENOENT || error == ENOTDIR) {
 		std::cout << "Error: 404 path is not found" << std::endl;
-		response.generateResponse(404);
-		client.responseData = response.getResponse();
+		setErrorResponse(client, 404, location);
+	}
+	else {
+		setErrorResponse(client, 403, location);
+		std::cout << "[DEBUG] Error: 403 permission denied" << std::endl;
 	}
 /*
 	DELETE Method Purpose
@@ -476,49 +1333,90 @@ void Server::handleDELETE(const HttpRequest& request, ClientInfo& client, std::s
   */
 }
 
-bool Server::validateMethod(const HttpRequest& request, const LocationConfig*& location){
+bool Server::isCompressible(const LocationConfig& location, const std::string& contentType, off_t fileSize) const {
 
-	bool methodAllowed = false;
-	for (size_t i = 0; i < location->allow_methods.size(); ++i) {
-		if (location->allow_methods[i] == request.getMethod()) {
-			methodAllowed = true;
-			break;
-		}
+	if (!location.gzip || fileSize < location.gzip_min_length)
+		return false;
+	std::string mimeType = contentType.substr(0, contentType.find(';'));
+	for (size_t i = 0; i < location.gzip_types.size(); i++) {
+		if (location.gzip_types[i] == "*" || location.gzip_types[i] == mimeType)
+			return true;
 	}
+	return false;
+}
 
-	if (!methodAllowed) {
+// Returns the compressed body of an open file, compressing it only on a
+// cache miss. NULL means "send identity" (too large, read or zlib error).
+const std::string* Server::compressedVariant(ClientInfo& client, int fileFd, const struct stat& fileStat,
+	const std::string& etag, ContentEncoding encoding, int level){
+
+	CompressionKey key(fileStat.st_dev, fileStat.st_ino, etag, encoding, level);
+	const std::string* cached = _compressionCache.find(key);
+	if (cached) {
+		std::cout << "[DEBUG] Compression cache hit (" << encodingName(encoding) << ")" << std::endl;
+		return cached;
+	}
+	if (static_cast<size_t>(fileStat.st_size) > _compressionCache.maxEntrySize())
+		return NULL;
+	// Miss: compress on the worker pool and come back for the cached copy
+	if (!client.inlineWork && deferToPool(client, new CompressTask(*this, dup(fileFd), fileStat.st_size, key)))
+		return NULL;
+
+	std::string content(fileStat.st_size, '\0');
+	size_t total = 0;
+	while (total < content.size()) {
+		ssize_t bytes = pread(fileFd, &content[total], content.size() - total, total);
+		if (bytes <= 0)
+			return NULL;
+		total += bytes;
+	}
+	std::string compressed;
+	if (!compressData(content.data(), content.size(), encoding, level, compressed))
+		return NULL;
+	std::cout << "[DEBUG] Compressed " << content.size() << " -> " << compressed.size()
+			  << " bytes (" << encodingName(encoding) << ")" << std::endl;
+	return _compressionCache.insert(key, compressed);
+}
+
+bool Server::validateMethod(const HttpRequest& request, const LocationConfig*& location){
+
+	// HEAD is implied by GET, OPTIONS is always answered (see LocationRouter::methodMask)
+	if (!_router.allows(locationIndex(*location), request.getMethodEnum())) {
 		std::cout << "[DEBUG] Method " << request.getMethod() << " not allowed for this location" << std::endl;
 		return false;
 	}
-
 	return true;
 }
-std::string Server::mapPath(const HttpRequest& request, const LocationConfig*& matchedLocation){
 
-	std::string locationRoot = matchedLocation->root;
-	std::string locationPath = matchedLocation->path;
-	std::string requestPath = request.getPath();
-	std::string relativePath;
+// Location root + the request path past the location's prefix
+std::string Server::mapPath(const HttpRequest& request, const LocationConfig*& matchedLocation){
 
-	if(requestPath.compare(0, locationPath.length(), locationPath) == 0)
-		relativePath = requestPath.substr(locationPath.length());
-	else{
+	const std::string& locationRoot = matchedLocation->root;
+	const std::string& requestPath = request.getPath();
+	// A regex location has no prefix to take off: the whole path goes under its root
+	size_t relative = matchedLocation->isRegex() ? 0 : matchedLocation->path.length();
+	if (requestPath.compare(0, relative, matchedLocation->path, 0, relative) != 0) {
 		std::cerr << "[ERROR] mapPath called with non-matching paths!" << std::endl;
-		relativePath = requestPath;  // Fallback
+		relative = 0;  // Fallback
 	}
-
-	if(!locationRoot.empty() && locationRoot[locationRoot.length() - 1 ] == '/'
-		&& !relativePath.empty() && relativePath[0] == '/')
-		relativePath = relativePath.substr(1);
-
-	std::cout << "[DEBUG] LocationRoot: " << locationRoot << std::endl;
-	std::cout << "[DEBUG] LocationPath: " << locationPath << std::endl;
-	std::cout << "[DEBUG] RequestPath : " << requestPath << std::endl;
-	std::cout << "[DEBUG] RelativePath : " << relativePath << std::endl;
-	std::cout << "[DEBUG] MappedPath : " << locationRoot + relativePath << std::endl;
-	return locationRoot + relativePath;
+	if (!locationRoot.empty() && locationRoot[locationRoot.length() - 1] == '/'
+		&& relative < requestPath.length() && requestPath[relative] == '/')
+		relative++;
+
+	std::string mappedPath;
+	mappedPath.reserve(locationRoot.length() + requestPath.length() - relative);
+	mappedPath.append(locationRoot).append(requestPath, relative, std::string::npos);
+	std::cout << "[DEBUG] MappedPath : " << mappedPath << std::endl;
+	return mappedPath;
 }
-bool Server::isPathSafe(const std::string& mappedPath, const std::string& allowedRoot){
+/*
+	The mapped path is checked against the root by opening it beneath the
+	root's directory descriptor (see path_beneath.hpp), the kernel refusing
+	anything that resolves outside, symlinks included. A target that does
+	not exist yet (an upload) is checked through its parent directory. The
+	handlers open files the same way, so the check cannot be raced.
+*/
+bool Server::isPathSafe(const std::string& mappedPath, const LocationConfig& location){
 
 	if(mappedPath.find("../") != std::string::npos || mappedPath.find("/..") != std::string::npos) {
 		std::cout << "[SECURITY] Path traversal attempt detected: " << mappedPath << std::endl;
@@ -530,52 +1428,50 @@ bool Server::isPathSafe(const std::string& mappedPath, const std::string& allowe
 		return false;
 	}
 
-	// Canonical path check (strongest defense)
-	char resolvedPath[PATH_MAX];
-	char resolvedRoot[PATH_MAX];
-
-	// Resolve the mapped path to canonical form
-	// Note: realpath() returns NULL if file doesn't exist yet (important for POST/upload)
-	if (realpath(mappedPath.c_str(), resolvedPath) == NULL) {
-
-		// File doesn't exist - for POST this is expected
-		// Validate the parent directory instead
-		std::string parentDir = mappedPath.substr(0, mappedPath.find_last_of('/'));
-		if (parentDir.empty()) parentDir = ".";
-
-		if (realpath(parentDir.c_str(), resolvedPath) == NULL) {
-			std::cout << "[SECURITY] Invalid path or parent directory: " << mappedPath << std::endl;
-			return false;
-		}
-		// Add back the filename for comparison
-		std::string filename = mappedPath.substr(mappedPath.find_last_of('/'));
-		std::string fullPath = std::string(resolvedPath) + filename;
-		strncpy(resolvedPath, fullPath.c_str(), PATH_MAX - 1);
-		resolvedPath[PATH_MAX - 1] = '\0';
+	// The root was opened at startup; one created since is opened now
+	int rootFd = _router.rootDirectory(locationIndex(location));
+	if (rootFd < 0) {
+		std::cout << "[SECURITY] Invalid allowed root: " << location.root << std::endl;
+		return false;
 	}
-
-	// Resolve the allowed root
-	if (realpath(allowedRoot.c_str(), resolvedRoot) == NULL) {
-		std::cout << "[SECURITY] Invalid allowed root: " << allowedRoot << std::endl;
+	std::string relative = rootRelative(location, mappedPath);
+	int fd = openBeneath(rootFd, relative, PATH_BENEATH_LOOKUP);
+	if (fd < 0 && errno == ENOENT) {
+		size_t slash = relative.find_last_of('/');
+		fd = openBeneath(rootFd, (slash == std::string::npos) ? "" : relative.substr(0, slash), PATH_BENEATH_DIRECTORY);
+	}
+	if (fd < 0 && (errno == ENOENT || errno == ENOTDIR)) {
+		std::cout << "[SECURITY] Invalid path or parent directory: " << mappedPath << std::endl;
 		return false;
 	}
-
-	// Check if resolved path starts with resolved root
-	std::string canonicalPath(resolvedPath);
-	std::string canonicalRoot(resolvedRoot);
-
-	if (canonicalPath.compare(0, canonicalRoot.length(), canonicalRoot) != 0) {
+	if (fd < 0) {
 		std::cout << "[SECURITY] Path escape attempt!" << std::endl;
 		std::cout << "[SECURITY] Requested: " << mappedPath << std::endl;
-		std::cout << "[SECURITY] Resolved:  " << canonicalPath << std::endl;
-		std::cout << "[SECURITY] Root:      " << canonicalRoot << std::endl;
+		std::cout << "[SECURITY] Root:      " << location.root << " (" << strerror(errno) << ")" << std::endl;
 		return false;
 	}
+	close(fd);
 	return true;
 }
 
+// mapPath() puts the root in front of every path it maps; the rest is what is opened beneath it
+std::string Server::rootRelative(const LocationConfig& location, const std::string& mappedPath) const {
+
+	if (mappedPath.compare(0, location.root.size(), location.root) != 0)
+		return "..";   // above the root, so openBeneath() refuses it
+	return mappedPath.substr(location.root.size());
+}
+
+int Server::openInRoot(const LocationConfig& location, const std::string& mappedPath, int flags) const {
+
+	return openBeneath(_router.route(locationIndex(location)).rootFd, rootRelative(location, mappedPath), flags);
+}
+
 void Server::disconectClient(short fd){
 
+	std::map<int, ClientInfo>::iterator it = _clients.find(fd);
+	if (it != _clients.end())
+		resetResponse(it->second);
 	close(fd);
 	_clients.erase(fd);
 }
@@ -591,7 +1487,7 @@ int Server::isListeningSocket(int fd) const {
 }
 void Server::updateClientActivity(int fd){
 
-	_clients[fd].lastActivity = time(NULL);
+	_clients[fd].lastActivity = Clock::monotonicMs();
 }
 void Server::shutdown(){
 
@@ -604,6 +1500,7 @@ void Server::shutdown(){
 
 	// Close all client connections
 	for (std::map<int, ClientInfo>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+		resetResponse(it->second);
 		close(it->first);
 	}
 
@@ -612,4 +1509,13 @@ void Server::shutdown(){
 	std::cout << "Server " << _configData.server_names[0] <<  " stopped" << std::endl;
 }
 const std::vector<Socket>& Server::getListeningSockets() const { return _listeningSockets;}
+void Server::setWorkerPool(WorkerPool* pool) { _workerPool = pool; }
+
+// Uploads into a location root are created beneath its fd, as served files are opened
+void Server::setUploadStore(UploadStore* store) {
+
+	_uploadStore = store;
+	for (size_t i = 0; i < _configData.locations.size(); i++)
+		_uploadStore->addRoot(_configData.locations[i].root, _router.rootDirectory(i));
+}
 std::map<int, ClientInfo>& Server::getClients() {return _clients;}
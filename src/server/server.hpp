@@ -22,8 +22,34 @@
 #include "client_info.hpp"
 #include "http_request.hpp"
 #include "http_response.hpp"
+#include "byte_range.hpp"
+#include "compression.hpp"
+#include "static_response.hpp"
+#include "cache_headers.hpp"
 #include "post_handler.hpp"
+#include "upload_store.hpp"
+#include "autoindex.hpp"
+#include "file_metadata.hpp"
+#include "static_variant.hpp"
 #include "config.hpp"
+#include "worker_pool.hpp"
+#include "cgi_process.hpp"
+#include "fastcgi_upstream.hpp"
+#include "proxy_upstream.hpp"
+#include "response_cache.hpp"
+#include "location_router.hpp"
+
+#define OPTIONS_MAX_AGE "86400"   // seconds a preflight result may be cached
+#define CONTINUE_RESPONSE "HTTP/1.1 100 Continue\r\n\r\n"
+
+// A client closing its end while a script runs: reported without reading the socket
+#ifdef POLLRDHUP
+# define CLIENT_HANGUP_EVENTS POLLRDHUP
+#else
+# define CLIENT_HANGUP_EVENTS 0
+#endif
+
+class ClientTask;
 
 class Server {
 
@@ -37,22 +63,113 @@ class Server {
 
 		const std::vector<Socket>& getListeningSockets() const;
 		std::map<int, ClientInfo>& getClients();
+		void setWorkerPool(WorkerPool* pool);
+		void setUploadStore(UploadStore* store);
+
+		// CGI pipes and upstream connections are polled next to the client sockets
+		bool isCgiPipe(int fd) const;
+		bool isUpstreamFd(int fd) const;
+		bool hasRunningCgi() const;
+		void addCgiPollFds(const ClientInfo& client, std::vector<struct pollfd>& fds) const;
+		void addUpstreamPollFds(std::vector<struct pollfd>& fds) const;
+		void checkCgiTimeouts();
 
 	private:
+		friend class ClientTask;
+		friend class DeleteTask;
+		friend class CompressTask;
 
 
 
 		void handleListenEvent(int fd);
 		void handleClientRead(int indexOfLinstenSocket);
 		void handleClientWrite(int fd);
+		void processRequest(int fd);
+		bool deferToPool(ClientInfo& client, ClientTask* task);
+		ClientInfo* waitingClient(int fd, unsigned long taskId);
+		void finishDelete(const HttpRequest& request, ClientInfo& client, int error, const LocationConfig* location);
+		bool routeRequest(const HttpRequest& request, ClientInfo& client, const LocationConfig*& location, std::string& mappedPath);
+		bool checkRequestBody(const HttpRequest& request, ClientInfo& client, const LocationConfig& location, const std::string& mappedPath);
+		std::string uploadDirectory(const LocationConfig& location, const std::string& mappedPath) const;
+		void beginRequestBody(int fd, const HttpRequest& request, size_t bodyStart);
+		void readRequestBody(int fd);
+		void updateBodyUpload(ClientInfo& client);
+		ssize_t sendFileSegment(ClientInfo& client);
+		ssize_t sendStaticResponse(ClientInfo& client);
+		size_t staticResponseLength(const ClientInfo& client) const;
+		void resetResponse(ClientInfo& client);
+		void completeResponse(int fd);
+
+		bool isRegularInRoot(const LocationConfig& location, const std::string& path) const;
+		std::string cgiScriptPath(const LocationConfig& location, const std::string& script) const;
+		bool findCgiScript(const LocationConfig& location, const std::string& mappedPath,
+			std::string& script, std::string& pathInfo) const;
+		bool findCgiTarget(const LocationConfig& location, const std::string& mappedPath,
+			std::string& script, std::string& pathInfo) const;
+		void startCgi(int fd, const HttpRequest& request, const LocationConfig& location,
+			const std::string& script, const std::string& pathInfo, const char* body, size_t bodyLength);
+		CgiBackend* startCgiProcess(int fd, const HttpRequest& request, const LocationConfig& location,
+			const std::string& script, const std::string& pathInfo);
+		CgiBackend* startFastCgi(int fd, const HttpRequest& request, const LocationConfig& location,
+			const std::string& script, const std::string& pathInfo);
+		CgiBackend* startProxy(int fd, const HttpRequest& request, const LocationConfig& location);
+		std::string proxyRequestHead(const HttpRequest& request, const ClientInfo& client,
+			const LocationConfig& location) const;
+		std::string proxyHashKey(const HttpRequest& request, const ClientInfo& client, const std::string& pattern) const;
+		std::vector<std::string> cgiEnvironment(const HttpRequest& request, const ClientInfo& client,
+			const std::string& script, const std::string& pathInfo) const;
+		void trackCgiPipes(ClientInfo& client);
+		void handleCgiEvent(int clientFd, int pipeFd, short revents);
+		void readCgiBody(int fd);
+		bool readCgiOutput(ClientInfo& client);
+		void drainCgiOutput(ClientInfo& client);
+		bool spliceCgiBody(ClientInfo& client);
+		void serviceUpstreams();
+		void relayCgiOutput(ClientInfo& client, const char* data, size_t length);
+		void writeCgiHead(ClientInfo& client, const CgiHeaders& headers);
+		void appendCgiBody(ClientInfo& client, const char* data, size_t length);
+		void sendCgiOutput(int fd);
+		void finishCgi(ClientInfo& client);
+		void failCgi(ClientInfo& client, int statusCode);
+		bool serveCached(int fd, const HttpRequest& request, const LocationConfig& location, size_t bodyLength);
+		bool sendCachedResponse(ClientInfo& client, const HttpRequest& request, const CacheEntry& entry, bool stale);
+		void storeCgiHead(ClientInfo& client, const CgiHeaders& headers);
+		void releaseCache(ClientInfo& client, bool store);
+		void resumeCacheWaiters();
+
+		void initializeErrorPages();
+		void initializeMimeTypes();
+		void initializeRedirects();
+		void initializeRouting();
+		void initializeOptionsResponses();
+		void initializeCacheHeaders();
+		void initializeUpstreams();
+		void initializeResponseCaches();
+		void applyCacheHeaders(HttpResponse& response, const LocationConfig& location);
+		void discardBody(ClientInfo& client);
+		size_t locationIndex(const LocationConfig& location) const;
+		const LocationConfig* findLocation(const std::string& path) const;
+		void setRedirectResponse(const HttpRequest& request, ClientInfo& client, const RedirectResponse& redirect);
+		void handleAutoindex(const HttpRequest& request, ClientInfo& client, const std::string& dirPath,
+			int dirFd, const struct stat& dirStat, const LocationConfig& location);
+		const ErrorPages& errorPagesFor(const LocationConfig* location) const;
+		void setStaticResponse(ClientInfo& client, const StaticResponse* response);
+		void setErrorResponse(ClientInfo& client, int statusCode, const LocationConfig* location);
+
+		void handleGET(const HttpRequest& request, ClientInfo& client, std::string mappedPath, const LocationConfig& location);
+		void handlePOST(const HttpRequest& request, ClientInfo& client, std::string mappedPath, const LocationConfig& location);
+		void handleDELETE(const HttpRequest& request, ClientInfo& client, std::string mappedPath, const LocationConfig& location);
+		void handleHEAD(const HttpRequest& request, ClientInfo& client, std::string mappedPath, const LocationConfig& location);
 
-		void handleGET(const HttpRequest& request, ClientInfo& client, std::string mappedPath);
-		void handlePOST(const HttpRequest& request, ClientInfo& client, std::string mappedPath);
-		void handleDELETE(const HttpRequest& request, ClientInfo& client, std::string mappedPath);
+		bool isCompressible(const LocationConfig& location, const std::string& contentType, off_t fileSize) const;
+		const std::string* compressedVariant(ClientInfo& client, int fileFd, const struct stat& fileStat,
+			const std::string& etag, ContentEncoding encoding, int level);
 
 		bool validateMethod(const HttpRequest& request, const LocationConfig*& location);
 		std::string mapPath(const HttpRequest& request, const LocationConfig*& matchedLocation);
-		bool isPathSafe(const std::string& mappedPath, const std::string& allowedRoot);
+		bool isPathSafe(const std::string& mappedPath, const LocationConfig& location);
+		std::string rootRelative(const LocationConfig& location, const std::string& mappedPath) const;
+		int openInRoot(const LocationConfig& location, const std::string& mappedPath, int flags) const;
 
 		void initializeListeningSockets();
 		int isListeningSocket(int fd) const;
@@ -64,6 +181,23 @@ class Server {
 		std::vector<Socket>			_listeningSockets;
 		std::map<int, ClientInfo>	_clients;
 		const ConfigData			_configData;
+		LocationRouter				_router;       // compiled from _configData.locations
+		CompressionCache			_compressionCache;
+		ErrorPages					_serverErrorPages;
+		std::vector<ErrorPages>		_locationErrorPages;   // parallel to _configData.locations
+		std::vector<RedirectResponse>	_locationRedirects;    // parallel to _configData.locations
+		std::vector<StaticResponse>	_locationOptions;      // OPTIONS 204, parallel to _configData.locations
+		FileMetadataCache			_metadataCache;
+		std::vector<CacheHeaders>	_locationCacheHeaders;  // parallel to _configData.locations
+		MimeTypes					_mimeTypes;
+		AutoindexCache				_autoindexCache;
+		WorkerPool*					_workerPool;   // owned by the ServerController, NULL = run inline
+		unsigned long				_nextTaskId;
+		UploadStore*				_uploadStore;  // owned by the ServerController, shared by all servers
+		std::map<int, int>			_cgiPipes;     // script stdin/stdout fd -> client fd
+		std::map<std::string, BackendPool*>	_upstreams;   // by upstreamKey(): fastcgi_pass address, "pool:<location>", "proxy:<upstream>"
+		std::map<std::string, ResponseCache*>	_responseCaches;   // by proxy_cache directory
+		std::vector<int>			_cacheResumes;   // WAITING_CACHE clients whose key was unlocked
 };
 
 #endif
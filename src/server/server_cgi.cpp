@@ -0,0 +1,938 @@
+#include "server.hpp"
+#include "clock.hpp"
+#include "header_writer.hpp"
+#include "path_beneath.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+	CGI/1.1 for the locations with cgi_ext. The script runs as a child whose
+	stdin/stdout pipes sit in the poll vector next to the client sockets:
+	the request body is relayed into stdin as it arrives (the socket is only
+	read while the pipe keeps up), the output is relayed to the client as
+	the script writes it, chunked unless the script sent a Content-Length.
+	Scripts are killed when they run past cgi_timeout or the client leaves.
+
+	Locations with fastcgi_pass send the same request to an application
+	server over a pooled FastCGI connection instead of forking; its output
+	goes through the same relay. Locations with cgi_pool_worker do the same
+	with interpreter processes of their own, started ahead of requests.
+	Locations with proxy_pass forward the request over HTTP/1.1 to a server
+	of an upstream group (see ProxyUpstream); its response, unframed,
+	goes through the same relay too.
+
+	Any of them can have a proxy_cache (see ResponseCache): cacheable
+	responses are copied to it as they are relayed, and later GET/HEAD
+	requests for them never reach the backend.
+
+	Only the header block is parsed. A body the client gets as the
+	backend sent it (not chunked, not cached, not a HEAD) is spliced from
+	the script's stdout or the upstream socket to the client socket
+	through kernel pipes once the head is out, never entering user space.
+*/
+
+static std::string absolutePath(const std::string& path){
+
+	char resolved[PATH_MAX];
+	if (!realpath(path.c_str(), resolved))
+		return "";
+	return resolved;
+}
+
+// The upstream serving a location: its fastcgi_pass address, its worker pool, its proxy group, or none
+static std::string upstreamKey(const LocationConfig& location){
+
+	if (!location.proxy_pass.empty())
+		return "proxy:" + location.proxy_upstream;
+	if (!location.fastcgi_pass.empty())
+		return location.fastcgi_pass;
+	if (!location.cgi_pool_worker.empty())
+		return "pool:" + location.path;
+	return "";
+}
+
+void Server::initializeUpstreams(){
+
+	for (size_t i = 0; i < _configData.locations.size(); i++) {
+		const LocationConfig& location = _configData.locations[i];
+		std::string key = upstreamKey(location);
+		if (key.empty() || _upstreams.count(key))
+			continue;
+		if (!location.proxy_pass.empty()) {
+			// A host:port that names no upstream block is a group of its own
+			const UpstreamConfig* group = _configData.findUpstream(location.proxy_upstream);
+			UpstreamConfig single;
+			if (!group) {
+				single.name = location.proxy_upstream;
+				single.servers.push_back(UpstreamServerConfig());
+				single.servers.back().address = location.proxy_upstream;
+				group = &single;
+			}
+			_upstreams[key] = new ProxyUpstream(*group);
+			continue;
+		}
+		if (!location.fastcgi_pass.empty()) {
+			_upstreams[key] = new FastCgiUpstream(location.fastcgi_pass,
+				location.fastcgi_connections, location.fastcgi_multiplex);
+			continue;
+		}
+		// Workers outlive requests, so they get no working directory of their own
+		std::vector<std::string> command(1, absolutePath(location.cgi_pool_worker));
+		_upstreams[key] = new FastCgiUpstream(key, command, location.cgi_pool_min,
+			location.cgi_pool_max, location.cgi_pool_requests);
+	}
+}
+
+// One cache per proxy_cache directory, whichever locations name it; the first one's max size applies
+void Server::initializeResponseCaches(){
+
+	for (size_t i = 0; i < _configData.locations.size(); i++) {
+		const LocationConfig& location = _configData.locations[i];
+		if (!location.proxy_cache.empty() && !_responseCaches.count(location.proxy_cache))
+			_responseCaches[location.proxy_cache] = new ResponseCache(location.proxy_cache, location.proxy_cache_max_size);
+	}
+}
+
+// "Connection: close", or HTTP/1.0 without "Connection: keep-alive"
+static bool requestCloses(const HttpRequest& request){
+
+	std::string connection;
+	std::map<std::string, std::string>::const_iterator it = request.getHeaders().find("connection");
+	if (it != request.getHeaders().end())
+		connection = it->second;
+	std::transform(connection.begin(), connection.end(), connection.begin(), ::tolower);
+	return connection == "close" || (request.getVersion() != "HTTP/1.1" && connection != "keep-alive");
+}
+
+// A regular file beneath the location root, found without leaving it
+bool Server::isRegularInRoot(const LocationConfig& location, const std::string& path) const{
+
+	struct stat st;
+	int fd = openInRoot(location, path, PATH_BENEATH_LOOKUP);
+	if (fd < 0)
+		return false;
+	bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+	close(fd);
+	return regular;
+}
+
+/*
+	execve() and interpreters take the script by name, so it is run through
+	its canonical path. That path must still name the file found beneath
+	the root, or the script is refused: a symlink swapped in on the way is
+	not followed out of it.
+*/
+std::string Server::cgiScriptPath(const LocationConfig& location, const std::string& script) const{
+
+	struct stat opened;
+	struct stat named;
+	int fd = openInRoot(location, script, PATH_BENEATH_LOOKUP);
+	if (fd < 0)
+		return "";
+	bool regular = fstat(fd, &opened) == 0 && S_ISREG(opened.st_mode);
+	close(fd);
+	std::string path = absolutePath(script);
+	if (!regular || path.empty() || stat(path.c_str(), &named) != 0
+		|| named.st_dev != opened.st_dev || named.st_ino != opened.st_ino)
+		return "";
+	return path;
+}
+
+// The first path component with one of the location's cgi_ext that is a
+// regular file is the script, whatever follows it is PATH_INFO.
+bool Server::findCgiScript(const LocationConfig& location, const std::string& mappedPath,
+	std::string& script, std::string& pathInfo) const{
+
+	if (location.cgi_ext.empty())
+		return false;
+	size_t end = 0;
+	while (end != std::string::npos) {
+		end = mappedPath.find('/', end + 1);
+		std::string candidate = mappedPath.substr(0, end);
+		size_t dot = candidate.find_last_of('.');
+		if (dot == std::string::npos || candidate.find('/', dot) != std::string::npos)
+			continue;
+		if (std::find(location.cgi_ext.begin(), location.cgi_ext.end(), candidate.substr(dot)) == location.cgi_ext.end())
+			continue;
+		if (!isRegularInRoot(location, candidate))
+			continue;
+		script = candidate;
+		pathInfo = (end == std::string::npos) ? "" : mappedPath.substr(end);
+		return true;
+	}
+	return false;
+}
+
+// proxy_pass takes every request of its location, fastcgi_pass too unless cgi_ext narrows it down to scripts
+bool Server::findCgiTarget(const LocationConfig& location, const std::string& mappedPath,
+	std::string& script, std::string& pathInfo) const{
+
+	if (!location.proxy_pass.empty() || (!location.fastcgi_pass.empty() && location.cgi_ext.empty())) {
+		script = mappedPath;
+		pathInfo.clear();
+		return true;
+	}
+	return findCgiScript(location, mappedPath, script, pathInfo);
+}
+
+// cgi_path entries pair with cgi_ext by position when both lists are the
+// same length, otherwise the first one serves every extension. A directory
+// (the cgi-bin itself) means the script is executed directly.
+static std::string cgiInterpreter(const LocationConfig& location, const std::string& script){
+
+	std::string extension = script.substr(script.find_last_of('.'));
+	size_t index = 0;
+	if (location.cgi_path.size() == location.cgi_ext.size())
+		index = std::find(location.cgi_ext.begin(), location.cgi_ext.end(), extension) - location.cgi_ext.begin();
+	if (index >= location.cgi_path.size())
+		return "";
+	struct stat st;
+	if (stat(location.cgi_path[index].c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+		return "";
+	return location.cgi_path[index];
+}
+
+std::vector<std::string> Server::cgiEnvironment(const HttpRequest& request, const ClientInfo& client,
+	const std::string& script, const std::string& pathInfo) const{
+
+	std::vector<std::string> env;
+	std::ostringstream oss;
+	const std::map<std::string, std::string>& headers = request.getHeaders();
+	std::string path = request.getPath();
+	std::string scriptName = path;
+	if (!pathInfo.empty() && path.size() >= pathInfo.size()
+		&& path.compare(path.size() - pathInfo.size(), pathInfo.size(), pathInfo) == 0)
+		scriptName = path.substr(0, path.size() - pathInfo.size());
+
+	std::string serverName = _configData.server_names.empty() ? "localhost" : _configData.server_names[0];
+	std::map<std::string, std::string>::const_iterator host = headers.find("host");
+	if (host != headers.end())
+		serverName = host->second.substr(0, host->second.find(':'));
+	struct sockaddr_in local;
+	socklen_t localLength = sizeof(local);
+	unsigned short serverPort = 0;
+	if (getsockname(client.socket.getFd(), reinterpret_cast<struct sockaddr*>(&local), &localLength) == 0)
+		serverPort = ntohs(local.sin_port);
+
+	env.push_back("GATEWAY_INTERFACE=CGI/1.1");
+	env.push_back("SERVER_SOFTWARE=" SERVER_SOFTWARE);
+	env.push_back("SERVER_PROTOCOL=" + request.getVersion());
+	env.push_back("SERVER_NAME=" + serverName);
+	oss << "SERVER_PORT=" << serverPort;
+	env.push_back(oss.str());
+	env.push_back("REQUEST_METHOD=" + request.getMethod());
+	env.push_back("REQUEST_URI=" + path + (request.getQuery().empty() ? "" : "?" + request.getQuery()));
+	env.push_back("SCRIPT_NAME=" + scriptName);
+	env.push_back("SCRIPT_FILENAME=" + script);
+	env.push_back("PATH_INFO=" + pathInfo);
+	env.push_back("QUERY_STRING=" + request.getQuery());
+	env.push_back("REMOTE_ADDR=" + client.ip);
+	oss.str("");
+	oss << "REMOTE_PORT=" << client.port;
+	env.push_back(oss.str());
+	if (request.getContentLength() > 0) {
+		oss.str("");
+		oss << "CONTENT_LENGTH=" << request.getContentLength();
+		env.push_back(oss.str());
+	}
+	if (!request.getContenType().empty())
+		env.push_back("CONTENT_TYPE=" + request.getContenType());
+	env.push_back("REDIRECT_STATUS=200");   // php-cgi refuses to run without it
+	env.push_back(CGI_ENV_PATH);
+
+	for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+		// Already above; "Proxy:" would become HTTP_PROXY (httpoxy)
+		if (it->first == "content-type" || it->first == "content-length" || it->first == "proxy")
+			continue;
+		std::string name = "HTTP_" + it->first;
+		for (size_t i = 0; i < name.size(); i++)
+			name[i] = (name[i] == '-') ? '_' : static_cast<char>(std::toupper(name[i]));
+		env.push_back(name + "=" + it->second);
+	}
+	return env;
+}
+
+/*
+	Starts the script (or its FastCGI request) with whatever part of the
+	body has been received; the caller has set bodyRemaining for the rest.
+	On failure an error response is set and the state is left alone.
+*/
+void Server::startCgi(int fd, const HttpRequest& request, const LocationConfig& location,
+	const std::string& script, const std::string& pathInfo, const char* body, size_t bodyLength){
+
+	ClientInfo& client = _clients[fd];
+	if (!location.proxy_cache.empty() && serveCached(fd, request, location, bodyLength))
+		return;
+	CgiBackend* cgi;
+	if (!location.proxy_pass.empty())
+		cgi = startProxy(fd, request, location);
+	else if (upstreamKey(location).empty())
+		cgi = startCgiProcess(fd, request, location, script, pathInfo);
+	else
+		cgi = startFastCgi(fd, request, location, script, pathInfo);
+	if (!cgi)
+		return;
+
+	// Persistence is decided now, framing once the script's headers are in
+	cgi->chunked = (request.getVersion() == "HTTP/1.1");
+	if (requestCloses(request))
+		client.shouldClose = true;
+
+	client.cgi = cgi;
+	client.state = RUNNING_CGI;
+	client.bytesSent = 0;
+	client.responseData.clear();
+	if (bodyLength > 0)
+		cgi->queueInput(body, bodyLength);
+	if (client.bodyRemaining == 0)
+		cgi->endInput();
+	cgi->writeInput();
+	trackCgiPipes(client);
+	serviceUpstreams();   // an application server that could not be reached fails it right away
+}
+
+CgiBackend* Server::startCgiProcess(int fd, const HttpRequest& request, const LocationConfig& location,
+	const std::string& script, const std::string& pathInfo){
+
+	ClientInfo& client = _clients[fd];
+	std::string scriptPath = cgiScriptPath(location, script);
+	std::string interpreter = cgiInterpreter(location, script);
+	std::vector<std::string> args;
+	if (!interpreter.empty())
+		args.push_back(absolutePath(interpreter));
+	args.push_back(scriptPath);
+	if (scriptPath.empty() || args[0].empty() || (interpreter.empty() && access(scriptPath.c_str(), X_OK) != 0)) {
+		std::cout << "[DEBUG] CGI script not executable: " << script << std::endl;
+		setErrorResponse(client, 403, &location);
+		return NULL;
+	}
+
+	CgiProcess* cgi = new CgiProcess(Clock::monotonicMs() + static_cast<unsigned long>(location.cgi_timeout) * 1000);
+	std::string workDir = scriptPath.substr(0, scriptPath.find_last_of('/') + 1);
+	if (!cgi->start(args[0], args, cgiEnvironment(request, client, scriptPath, pathInfo), workDir)) {
+		std::cout << "[ERROR] Failed to start CGI: " << scriptPath << " (" << strerror(errno) << ")" << std::endl;
+		delete cgi;
+		setErrorResponse(client, 502, &location);
+		return NULL;
+	}
+	std::cout << "[DEBUG] CGI " << scriptPath << " started, pid " << cgi->pid() << " for FD " << fd << std::endl;
+	return cgi;
+}
+
+CgiBackend* Server::startFastCgi(int fd, const HttpRequest& request, const LocationConfig& location,
+	const std::string& script, const std::string& pathInfo){
+
+	// The script may only exist on the application server's side
+	std::string scriptPath = absolutePath(script);
+	if (scriptPath.empty())
+		scriptPath = script;
+	FastCgiRequest* cgi = new FastCgiRequest(*static_cast<FastCgiUpstream*>(_upstreams[upstreamKey(location)]),
+		cgiEnvironment(request, _clients[fd], scriptPath, pathInfo), fd,
+		Clock::monotonicMs() + static_cast<unsigned long>(location.cgi_timeout) * 1000);
+	std::cout << "[DEBUG] " << cgi->describe() << " for " << scriptPath << " queued for FD " << fd << std::endl;
+	return cgi;
+}
+
+/*
+	The request as the upstream gets it: the location prefix swapped for
+	the proxy_pass URI when it has one, the client's end-to-end headers,
+	and the client's address in X-Forwarded-For. Connections to upstreams
+	are kept alive, so the body is always sent with its length.
+*/
+std::string Server::proxyRequestHead(const HttpRequest& request, const ClientInfo& client,
+	const LocationConfig& location) const{
+
+	std::string uri = request.getPath();
+	if (!location.proxy_uri.empty())
+		uri = location.proxy_uri + uri.substr(std::min(location.path.size(), uri.size()));
+	if (!request.getQuery().empty())
+		uri += "?" + request.getQuery();
+
+	std::ostringstream head;
+	head << request.getMethod() << " " << uri << " HTTP/1.1\r\n";
+	head << "Host: " << location.proxy_upstream << "\r\n";
+	const std::map<std::string, std::string>& headers = request.getHeaders();
+	std::string forwardedFor = client.ip;
+	for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+		const std::string& name = it->first;
+		if (name == "x-forwarded-for")
+			forwardedFor = it->second + ", " + client.ip;
+		else if (name != "host" && name != "connection" && name != "keep-alive" && name != "proxy-connection"
+			&& name != "te" && name != "trailer" && name != "transfer-encoding" && name != "upgrade"
+			&& name != "expect" && name != "content-length")
+			head << name << ": " << it->second << "\r\n";
+	}
+	head << "X-Forwarded-For: " << forwardedFor << "\r\n";
+	head << "X-Forwarded-Proto: http\r\n";
+	if (request.getContentLength() > 0)
+		head << "Content-Length: " << request.getContentLength() << "\r\n";
+	head << "Connection: keep-alive\r\n\r\n";
+	return head.str();
+}
+
+// The group's hash key with $request_uri, $uri, $args, $remote_addr and $host filled in
+std::string Server::proxyHashKey(const HttpRequest& request, const ClientInfo& client, const std::string& pattern) const{
+
+	std::map<std::string, std::string> variables;
+	variables["uri"] = request.getPath();
+	variables["args"] = request.getQuery();
+	variables["request_uri"] = request.getPath() + (request.getQuery().empty() ? "" : "?" + request.getQuery());
+	variables["remote_addr"] = client.ip;
+	std::map<std::string, std::string>::const_iterator host = request.getHeaders().find("host");
+	variables["host"] = (host == request.getHeaders().end()) ? "" : host->second;
+
+	std::string key;
+	for (size_t i = 0; i < pattern.size();) {
+		size_t end = i + 1;
+		while (pattern[i] == '$' && end < pattern.size() && (std::isalnum(pattern[end]) || pattern[end] == '_'))
+			end++;
+		std::map<std::string, std::string>::const_iterator variable = variables.find(pattern.substr(i + 1, end - i - 1));
+		if (pattern[i] == '$' && variable != variables.end())
+			key += variable->second;
+		else
+			key.append(pattern, i, end - i);
+		i = end;
+	}
+	return key;
+}
+
+// cgi_timeout bounds the time without progress here, not the whole exchange
+CgiBackend* Server::startProxy(int fd, const HttpRequest& request, const LocationConfig& location){
+
+	const ClientInfo& client = _clients[fd];
+	const UpstreamConfig* group = _configData.findUpstream(location.proxy_upstream);
+	ProxyRequest* proxy = new ProxyRequest(*static_cast<ProxyUpstream*>(_upstreams[upstreamKey(location)]),
+		proxyRequestHead(request, client, location),
+		group ? proxyHashKey(request, client, group->hash_key) : std::string(),
+		client.headOnly, fd, static_cast<unsigned long>(location.cgi_timeout) * 1000);
+	std::cout << "[DEBUG] " << proxy->describe() << " for " << request.getMethod() << " " << request.getPath()
+			  << " from FD " << fd << std::endl;
+	return proxy;
+}
+
+// Keeps _cgiPipes in step with the pipes the client's script still has open
+void Server::trackCgiPipes(ClientInfo& client){
+
+	int fd = client.socket.getFd();
+	for (std::map<int, int>::iterator it = _cgiPipes.begin(); it != _cgiPipes.end();) {
+		if (it->second == fd)
+			_cgiPipes.erase(it++);
+		else
+			++it;
+	}
+	if (!client.cgi)
+		return;
+	if (client.cgi->inputFd() >= 0)
+		_cgiPipes[client.cgi->inputFd()] = fd;
+	if (client.cgi->outputFd() >= 0)
+		_cgiPipes[client.cgi->outputFd()] = fd;
+}
+
+bool Server::isCgiPipe(int fd) const { return _cgiPipes.find(fd) != _cgiPipes.end(); }
+
+bool Server::isUpstreamFd(int fd) const{
+
+	for (std::map<std::string, BackendPool*>::const_iterator it = _upstreams.begin(); it != _upstreams.end(); ++it)
+		if (it->second->owns(fd))
+			return true;
+	return false;
+}
+
+bool Server::hasRunningCgi() const{
+
+	if (!_cgiPipes.empty() || !_cacheResumes.empty())
+		return true;
+	for (std::map<std::string, BackendPool*>::const_iterator it = _upstreams.begin(); it != _upstreams.end(); ++it)
+		if (it->second->busy() || it->second->needsMaintenance())
+			return true;
+	return false;
+}
+
+void Server::addUpstreamPollFds(std::vector<struct pollfd>& fds) const{
+
+	for (std::map<std::string, BackendPool*>::const_iterator it = _upstreams.begin(); it != _upstreams.end(); ++it)
+		it->second->addPollFds(fds);
+}
+
+/*
+	Poll entries of a RUNNING_CGI client. Each direction stops being polled
+	once CGI_BUFFER_MAX bytes wait on its slower side, so a slow script or a
+	slow client throttles the other end instead of growing a buffer. Spliced
+	output waits for the head to be sent and for room in the client socket.
+*/
+void Server::addCgiPollFds(const ClientInfo& client, std::vector<struct pollfd>& fds) const{
+
+	struct pollfd entry;
+	entry.fd = client.socket.getFd();
+	entry.events = CLIENT_HANGUP_EVENTS;
+	entry.revents = 0;
+	if (client.bodyRemaining > 0 && client.cgi->inputPending() < CGI_BUFFER_MAX)
+		entry.events |= POLLIN;
+	if (client.bytesSent < client.responseData.size() || client.cgi->spliceBlocked)
+		entry.events |= POLLOUT;
+	fds.push_back(entry);
+
+	if (client.cgi->inputFd() >= 0 && client.cgi->inputPending() > 0) {
+		entry.fd = client.cgi->inputFd();
+		entry.events = POLLOUT;
+		fds.push_back(entry);
+	}
+	bool clientFull = client.cgi->splicing
+		? client.bytesSent < client.responseData.size() || client.cgi->spliceBlocked
+		: client.responseData.size() - client.bytesSent >= CGI_BUFFER_MAX;
+	if (client.cgi->outputFd() >= 0 && !clientFull) {
+		entry.fd = client.cgi->outputFd();
+		entry.events = POLLIN;
+		fds.push_back(entry);
+	}
+}
+
+void Server::handleCgiEvent(int clientFd, int pipeFd, short revents){
+
+	ClientInfo& client = _clients[clientFd];
+	if (pipeFd == client.cgi->inputFd()) {
+		client.cgi->writeInput();
+		trackCgiPipes(client);
+	}
+	else if (revents & (POLLIN | POLLHUP | POLLERR))
+		readCgiOutput(client);
+}
+
+// Request body bytes while the script runs: straight into its stdin queue
+void Server::readCgiBody(int fd){
+
+	ClientInfo& client = _clients[fd];
+	char buffer[BUFFER_SIZE];
+	ssize_t bytes = recv(fd, buffer, std::min(client.bodyRemaining, sizeof(buffer)), 0);
+	if (bytes <= 0) {
+		std::cout << "[DEBUG] Client FD " << fd << " closed while its CGI ran" << std::endl;
+		disconectClient(fd);
+		return;
+	}
+	updateClientActivity(fd);
+	client.bodyRemaining -= bytes;
+	client.cgi->queueInput(buffer, bytes);
+	if (client.bodyRemaining == 0)
+		client.cgi->endInput();
+	client.cgi->writeInput();
+	trackCgiPipes(client);
+	serviceUpstreams();
+}
+
+// false once nothing more could be read for now
+bool Server::readCgiOutput(ClientInfo& client){
+
+	if (client.cgi->splicing)
+		return spliceCgiBody(client);
+	char buffer[BUFFER_SIZE];
+	ssize_t bytes = client.cgi->readOutput(buffer, sizeof(buffer));
+	if (bytes > 0) {
+		relayCgiOutput(client, buffer, bytes);
+		return true;
+	}
+	if (client.cgi->outputClosed())
+		finishCgi(client);
+	return false;
+}
+
+/*
+	Backends without a pipe of their own (FastCGI) hold their output until
+	the client has room for it; spliced output goes on while the socket
+	takes it.
+*/
+void Server::drainCgiOutput(ClientInfo& client){
+
+	while (client.state == RUNNING_CGI && client.cgi && (client.cgi->outputFd() < 0 || client.cgi->splicing)
+		&& client.responseData.size() - client.bytesSent < CGI_BUFFER_MAX && readCgiOutput(client))
+		;
+}
+
+/*
+	Body bytes from the backend straight into the client socket, once
+	everything before them was sent; false once nothing more moves for
+	now. At the end of a Content-Length body the relay reads again, so
+	whatever the backend writes past it is dropped as usual.
+*/
+bool Server::spliceCgiBody(ClientInfo& client){
+
+	CgiBackend& cgi = *client.cgi;
+	int fd = client.socket.getFd();
+	if (client.bytesSent < client.responseData.size())
+		return false;
+	size_t size = CGI_SPLICE_MAX;
+	if (cgi.bodyLeft >= 0)
+		size = std::min(size, static_cast<size_t>(cgi.bodyLeft));
+	ssize_t moved = cgi.spliceOutput(fd, size);
+	cgi.spliceBlocked = (moved == CGI_SPLICE_CLIENT_FULL);
+	if (moved > 0) {
+		updateClientActivity(fd);
+		if (cgi.bodyLeft >= 0 && (cgi.bodyLeft -= moved) == 0)
+			cgi.splicing = false;
+		return true;
+	}
+	if (moved == 0) {
+		finishCgi(client);
+		return false;
+	}
+	if (moved == CGI_SPLICE_FAILED) {
+		cgi.splicing = false;
+		if (errno == EINVAL) {
+			std::cout << "[DEBUG] No splice() for " << cgi.describe() << ", copying its output" << std::endl;
+			return true;
+		}
+		// Left to the hangup the shutdown causes: the client can't be removed from under its caller
+		std::cout << "Splice failed for FD " << fd << ". Stopping its CGI." << std::endl;
+		::shutdown(fd, SHUT_RDWR);
+	}
+	return false;
+}
+
+// Clients whose FastCGI requests got output or ended in the meantime
+void Server::serviceUpstreams(){
+
+	std::vector<int> owners;
+	for (std::map<std::string, BackendPool*>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it)
+		it->second->takeUpdated(owners);
+	for (size_t i = 0; i < owners.size(); i++) {
+		std::map<int, ClientInfo>::iterator client = _clients.find(owners[i]);
+		if (client != _clients.end())
+			drainCgiOutput(client->second);
+	}
+}
+
+void Server::relayCgiOutput(ClientInfo& client, const char* data, size_t length){
+
+	CgiBackend& cgi = *client.cgi;
+	if (cgi.headersSent) {
+		appendCgiBody(client, data, length);
+		return;
+	}
+	cgi.headerBuffer.append(data, length);
+	size_t bodyStart = CgiHeaders::bodyStart(cgi.headerBuffer);
+	if (bodyStart == std::string::npos) {
+		if (cgi.headerBuffer.size() > CGI_HEADERS_MAX)
+			failCgi(client, 502);
+		return;
+	}
+	CgiHeaders headers;
+	if (bodyStart > CGI_HEADERS_MAX || !CgiHeaders::parse(cgi.headerBuffer.substr(0, bodyStart), headers)) {
+		std::cout << "[DEBUG] Malformed CGI headers from " << cgi.describe() << std::endl;
+		failCgi(client, 502);
+		return;
+	}
+	writeCgiHead(client, headers);
+	std::string body = cgi.headerBuffer.substr(bodyStart);
+	cgi.headerBuffer.clear();
+	appendCgiBody(client, body.data(), body.size());
+	// The rest of a body nothing has to be done to can skip user space
+	if (!cgi.chunked && cgi.bodyLeft != 0 && !client.headOnly && !client.cacheFill)
+		cgi.splicing = cgi.startSplice();
+}
+
+void Server::writeCgiHead(ClientInfo& client, const CgiHeaders& headers){
+
+	CgiBackend& cgi = *client.cgi;
+	if (client.cacheLock)
+		storeCgiHead(client, headers);
+	HeaderWriter writer(client.responseData);
+	writer.statusLine(headers.status);
+	writer.header("Date", Clock::httpDate());
+	writer.header("Server", SERVER_SOFTWARE);
+	for (size_t i = 0; i < headers.headers.size(); i++)
+		writer.header(headers.headers[i].first.c_str(), headers.headers[i].second);
+	if (headers.status == 204 || headers.status == 304) {
+		// No body follows these, whatever else the headers say
+		cgi.bodyLeft = 0;
+		cgi.chunked = false;
+	}
+	else if (headers.contentLength >= 0) {
+		writer.header("Content-Length", static_cast<unsigned long>(headers.contentLength));
+		cgi.bodyLeft = headers.contentLength;
+		cgi.chunked = false;
+	}
+	else if (cgi.chunked)
+		writer.header("Transfer-Encoding", "chunked");
+	else
+		client.shouldClose = true;   // the body ends when the connection does
+	writer.header("Connection", client.shouldClose ? "close" : "keep-alive");
+	writer.end();
+	client.bytesSent = 0;
+	cgi.headersSent = true;
+}
+
+void Server::appendCgiBody(ClientInfo& client, const char* data, size_t length){
+
+	CgiBackend& cgi = *client.cgi;
+	if (cgi.bodyLeft >= 0) {
+		// Anything past the announced Content-Length is dropped
+		length = std::min(length, static_cast<size_t>(cgi.bodyLeft));
+		cgi.bodyLeft -= length;
+	}
+	if (client.cacheFill && length > 0)
+		client.cacheFill->write(data, length);   // a fill that failed is dropped when the response ends
+	if (length == 0 || client.headOnly)
+		return;
+	if (client.bytesSent == client.responseData.size()) {
+		client.responseData.clear();
+		client.bytesSent = 0;
+	}
+	if (cgi.chunked) {
+		char size[32];
+		std::sprintf(size, "%lx\r\n", static_cast<unsigned long>(length));
+		client.responseData.append(size);
+		client.responseData.append(data, length);
+		client.responseData.append("\r\n", 2);
+	}
+	else
+		client.responseData.append(data, length);
+}
+
+void Server::sendCgiOutput(int fd){
+
+	ClientInfo& client = _clients[fd];
+	if (client.bytesSent < client.responseData.size()) {
+		ssize_t bytes = send(fd, client.responseData.data() + client.bytesSent,
+			client.responseData.size() - client.bytesSent, 0);
+		if (bytes <= 0) {
+			std::cout << "Send failed for FD " << fd << ". Stopping its CGI." << std::endl;
+			disconectClient(fd);
+			return;
+		}
+		updateClientActivity(fd);
+		client.bytesSent += bytes;
+		if (client.bytesSent == client.responseData.size()) {
+			client.responseData.clear();
+			client.bytesSent = 0;
+		}
+	}
+	drainCgiOutput(client);
+}
+
+// Script output ended: the rest of the response goes out as usual
+void Server::finishCgi(ClientInfo& client){
+
+	CgiBackend& cgi = *client.cgi;
+	if (!cgi.headersSent || cgi.failed()) {
+		std::cout << "[DEBUG] " << cgi.describe() << " ended without a complete response" << std::endl;
+		failCgi(client, 502);
+		return;
+	}
+	if (cgi.chunked && !client.headOnly)
+		client.responseData.append("0\r\n\r\n");
+	// Short of its Content-Length, or a body nobody read: the connection can't be reused
+	if ((cgi.bodyLeft > 0 && !client.headOnly) || client.bodyRemaining > 0)
+		client.shouldClose = true;
+	std::cout << "[DEBUG] " << cgi.describe() << " done" << std::endl;
+	releaseCache(client, cgi.bodyLeft <= 0);
+	delete client.cgi;
+	client.cgi = NULL;
+	trackCgiPipes(client);
+
+	client.state = SENDING_RESPONSE;
+	if (client.bytesSent == client.responseData.size())
+		completeResponse(client.socket.getFd());
+}
+
+// Error instead of the script's response; once its head is out only closing is left
+void Server::failCgi(ClientInfo& client, int statusCode){
+
+	int fd = client.socket.getFd();
+	bool headersSent = client.cgi->headersSent;
+	releaseCache(client, false);
+	client.cgi->terminate();
+	delete client.cgi;
+	client.cgi = NULL;
+	trackCgiPipes(client);
+	if (headersSent) {
+		disconectClient(fd);
+		return;
+	}
+	HttpRequest request;
+	request.ParsePartialRequest(client.requestData);
+	client.responseData.clear();
+	setErrorResponse(client, statusCode, findLocation(request.getPath()));
+	if (client.bodyRemaining > 0)
+		client.shouldClose = true;
+	client.bytesSent = 0;
+	client.state = SENDING_RESPONSE;
+}
+
+void Server::checkCgiTimeouts(){
+
+	std::vector<int> expired;
+	for (std::map<int, ClientInfo>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+		if (it->second.cgi && it->second.cgi->expired(Clock::monotonicMs()))
+			expired.push_back(it->first);
+	}
+	for (size_t i = 0; i < expired.size(); i++) {
+		std::cout << "[DEBUG] CGI for FD " << expired[i] << " timed out" << std::endl;
+		failCgi(_clients[expired[i]], 504);
+	}
+	for (std::map<std::string, BackendPool*>::iterator it = _upstreams.begin(); it != _upstreams.end(); ++it)
+		it->second->maintain();
+	resumeCacheWaiters();
+}
+
+/*
+	proxy_cache in front of the backend, for GET and HEAD requests without
+	a body or credentials. A fresh entry answers right away, a stale one
+	too while another request refreshes it. Otherwise the first GET for the
+	key goes on to the backend and stores what it gets; the ones arriving
+	meanwhile wait for it (WAITING_CACHE) and run again once it is done.
+	PURGE drops the key instead. True when the request is answered or waits.
+*/
+bool Server::serveCached(int fd, const HttpRequest& request, const LocationConfig& location, size_t bodyLength){
+
+	ClientInfo& client = _clients[fd];
+	ResponseCache& cache = *_responseCaches[location.proxy_cache];
+	const std::map<std::string, std::string>& headers = request.getHeaders();
+	std::map<std::string, std::string>::const_iterator host = headers.find("host");
+	std::string key = _configData.server_names.empty() ? "localhost" : _configData.server_names[0];
+	if (host != headers.end())
+		key = host->second;
+	std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+	key = "GET " + key + request.getPath() + (request.getQuery().empty() ? "" : "?" + request.getQuery());
+
+	Methods method = request.getMethodEnum();
+	if (method == PURGE) {
+		bool purged = cache.purge(key);
+		std::cout << "[DEBUG] PURGE " << key << (purged ? ": removed" : ": not cached") << std::endl;
+		if (!purged) {
+			setErrorResponse(client, 404, &location);
+			return true;
+		}
+		if (requestCloses(request))
+			client.shouldClose = true;
+		HeaderWriter writer(client.responseData);
+		writer.statusLine(200);
+		writer.header("Date", Clock::httpDate());
+		writer.header("Server", SERVER_SOFTWARE);
+		writer.header("Content-Length", 0UL);
+		writer.header("Connection", client.shouldClose ? "close" : "keep-alive");
+		writer.end();
+		return true;
+	}
+	if ((method != GET && method != HEAD) || bodyLength > 0 || client.bodyRemaining > 0 || headers.count("authorization"))
+		return false;
+
+	time_t now = Clock::now();
+	const CacheEntry* entry = cache.find(key, now);
+	bool fresh = entry && entry->expires > now;
+	if (entry && (fresh || cache.locked(key)) && sendCachedResponse(client, request, *entry, !fresh)) {
+		std::cout << "[DEBUG] Cache " << (fresh ? "hit" : "stale hit") << " for FD " << fd << ": " << key << std::endl;
+		return true;
+	}
+	// Only GET fills; a HEAD miss just goes to the backend
+	if (method == HEAD || cache.passing(key, now))
+		return false;
+	client.cache = &cache;
+	client.cacheKey = key;
+	client.cacheValid = location.proxy_cache_valid;
+	if (cache.lock(key)) {
+		client.cacheLock = true;
+		std::cout << "[DEBUG] Cache miss for FD " << fd << ": " << key << std::endl;
+		return false;
+	}
+	cache.wait(key, fd);
+	client.state = WAITING_CACHE;
+	std::cout << "[DEBUG] FD " << fd << " waits for the response to " << key << std::endl;
+	return true;
+}
+
+// A stored response: the head from the index, the body sent from its file like a static one
+bool Server::sendCachedResponse(ClientInfo& client, const HttpRequest& request, const CacheEntry& entry, bool stale){
+
+	int fileFd = -1;
+	if (!client.headOnly && entry.bodyLength > 0) {
+		fileFd = open(entry.file.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fileFd < 0)
+			return false;
+	}
+	if (requestCloses(request))
+		client.shouldClose = true;
+	HeaderWriter writer(client.responseData);
+	writer.statusLine(entry.status);
+	writer.header("Date", Clock::httpDate());
+	writer.header("Server", SERVER_SOFTWARE);
+	writer.lines(entry.headers);
+	if (entry.status != 204)
+		writer.header("Content-Length", static_cast<unsigned long>(entry.bodyLength));
+	writer.header("Age", static_cast<unsigned long>(std::max(static_cast<time_t>(0), Clock::now() - entry.date)));
+	writer.header("X-Cache", stale ? "STALE" : "HIT");
+	writer.header("Connection", client.shouldClose ? "close" : "keep-alive");
+	writer.end();
+	if (fileFd >= 0) {
+		client.fileFd = fileFd;
+		client.fileSegments.push_back(FileSegment("", entry.bodyOffset, entry.bodyLength));
+		client.segmentIndex = 0;
+		client.segmentSent = 0;
+	}
+	client.bytesSent = 0;
+	return true;
+}
+
+// The filling request's response: copied to the cache when it may be, else its key skips the lock for a while
+void Server::storeCgiHead(ClientInfo& client, const CgiHeaders& headers){
+
+	time_t now = Clock::now();
+	time_t expires = 0;
+	time_t staleUntil = 0;
+	if (!ResponseCache::freshness(headers.status, headers.headers, now, client.cacheValid, expires, staleUntil)) {
+		std::cout << "[DEBUG] Response to " << client.cacheKey << " is not cacheable" << std::endl;
+		client.cache->pass(client.cacheKey, now);
+		return;
+	}
+	client.cacheFill = client.cache->open(client.cacheKey, headers.status, headers.headers, now, expires, staleUntil);
+}
+
+/*
+	Ends the request's part in its proxy_cache: the response it copied is
+	stored when store is set (a complete response) and dropped otherwise,
+	then the clients waiting on its key are queued to run again. A waiting
+	client just leaves the queue.
+*/
+void Server::releaseCache(ClientInfo& client, bool store){
+
+	if (!client.cache)
+		return;
+	if (client.cacheFill) {
+		if (store && client.cache->commit(client.cacheFill))
+			std::cout << "[DEBUG] Stored " << client.cacheKey << " (" << client.cache->count() << " entries, "
+					  << client.cache->size() << " bytes)" << std::endl;
+		else if (store)
+			std::cout << "[DEBUG] Response to " << client.cacheKey << " not stored" << std::endl;
+		else
+			client.cache->abort(client.cacheFill);
+		client.cacheFill = NULL;
+	}
+	if (client.cacheLock)
+		client.cache->unlock(client.cacheKey, _cacheResumes);
+	else
+		client.cache->stopWaiting(client.socket.getFd());
+	client.cache = NULL;
+	client.cacheKey.clear();
+	client.cacheLock = false;
+}
+
+// Clients whose key was unlocked run their request again: a hit now, or the next fill
+void Server::resumeCacheWaiters(){
+
+	std::vector<int> resumes;
+	resumes.swap(_cacheResumes);
+	for (size_t i = 0; i < resumes.size(); i++) {
+		std::map<int, ClientInfo>::iterator it = _clients.find(resumes[i]);
+		if (it == _clients.end() || it->second.state != WAITING_CACHE)
+			continue;
+		it->second.cache = NULL;
+		it->second.cacheKey.clear();
+		it->second.state = READING_REQUEST;
+		processRequest(resumes[i]);
+	}
+}
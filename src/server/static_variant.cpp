@@ -0,0 +1,35 @@
+#include "static_variant.hpp"
+#include "path_beneath.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+
+static int openFreshSidecar(int rootFd, const std::string& path, struct stat& fileStat) {
+
+	struct stat sidecar;
+	int fd = openBeneath(rootFd, path, O_RDONLY | O_NONBLOCK);
+	if (fd >= 0 && fstat(fd, &sidecar) == 0 && S_ISREG(sidecar.st_mode) && sidecar.st_mtime >= fileStat.st_mtime) {
+		fileStat = sidecar;
+		return fd;
+	}
+	if (fd >= 0)
+		close(fd);
+	return -1;
+}
+
+StaticVariant selectStaticVariant(int rootFd, const std::string& path, const LocationConfig& location,
+	const std::string& acceptEncoding, struct stat& fileStat) {
+
+	StaticVariant variant;
+	variant.vary = location.gzip_static || location.brotli_static;
+	if (location.brotli_static && acceptsEncoding(acceptEncoding, ENCODING_BROTLI)
+		&& (variant.fd = openFreshSidecar(rootFd, path + ".br", fileStat)) >= 0) {
+		variant.encoding = ENCODING_BROTLI;
+		variant.path = path + ".br";
+	}
+	else if (location.gzip_static && acceptsEncoding(acceptEncoding, ENCODING_GZIP)
+		&& (variant.fd = openFreshSidecar(rootFd, path + ".gz", fileStat)) >= 0) {
+		variant.encoding = ENCODING_GZIP;
+		variant.path = path + ".gz";
+	}
+	return variant;
+}
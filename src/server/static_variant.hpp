@@ -0,0 +1,30 @@
+#ifndef STATIC_VARIANT_HPP
+#define STATIC_VARIANT_HPP
+
+#include "compression.hpp"
+#include "config.hpp"
+#include <string>
+#include <sys/stat.h>
+
+// The representation of a static file picked for one request
+struct StaticVariant {
+	StaticVariant() : encoding(ENCODING_IDENTITY), fd(-1), path(), vary(false) {}
+
+	ContentEncoding	encoding;   // ENCODING_IDENTITY = the original file
+	int				fd;         // opened sidecar, -1 when the original is served
+	std::string		path;       // of the sidecar, relative to the root
+	bool			vary;       // another Accept-Encoding may get another file
+};
+
+/*
+	gzip_static / brotli_static: file.br or file.gz is sent in place of
+	file when the client accepts that encoding, brotli first. A sidecar is
+	only trusted when it is at least as new as the original, so a stale
+	.gz left behind by an old build is never served. path is relative to
+	rootFd and the sidecar is opened beneath it; fileStat becomes the
+	sidecar's when one is chosen.
+*/
+StaticVariant	selectStaticVariant(int rootFd, const std::string& path, const LocationConfig& location,
+					const std::string& acceptEncoding, struct stat& fileStat);
+
+#endif
@@ -0,0 +1,262 @@
+#include "upload_store.hpp"
+#include "path_beneath.hpp"
+#include "worker_pool.hpp"
+#include "clock.hpp"
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifndef O_DIRECTORY
+# define O_DIRECTORY 0
+#endif
+#ifndef O_CLOEXEC
+# define O_CLOEXEC 0
+#endif
+
+namespace {
+
+// Data of the files first, then the directory entries that name them
+void syncAll(const std::vector<int>& files, const std::map<std::string, int>& directories) {
+
+	for (size_t i = 0; i < files.size(); i++)
+		fdatasync(files[i]);
+	for (std::map<std::string, int>::const_iterator it = directories.begin(); it != directories.end(); ++it)
+		fsync(it->second);
+}
+
+void closeAll(std::vector<int>& files, std::map<std::string, int>& directories) {
+
+	for (size_t i = 0; i < files.size(); i++)
+		close(files[i]);
+	for (std::map<std::string, int>::iterator it = directories.begin(); it != directories.end(); ++it)
+		close(it->second);
+	files.clear();
+	directories.clear();
+}
+
+// One group sync of a batch of uploads. Owns their fds; a task dropped by
+// the pool on shutdown still syncs them when deleted.
+class SyncBatchTask : public PoolTask {
+
+	public:
+		SyncBatchTask(std::vector<int>& files, std::map<std::string, int>& directories) : _synced(false) {
+			_files.swap(files);
+			_directories.swap(directories);
+		}
+		virtual ~SyncBatchTask() {
+			if (!_synced)
+				syncAll(_files, _directories);
+			closeAll(_files, _directories);
+		}
+
+		virtual void run() {
+			syncAll(_files, _directories);
+			_synced = true;
+		}
+		virtual void complete() {
+			std::cout << "[DEBUG] Upload batch synced: " << _files.size() << " files" << std::endl;
+		}
+
+	private:
+		std::vector<int>			_files;
+		std::map<std::string, int>	_directories;
+		bool						_synced;
+};
+
+}
+
+UploadStore::UploadStore()
+	: _directories(), _roots(), _namePrefix(), _sequence(0), _batchFiles(), _batchDirectories(),
+	_batchSince(0), _workerPool(NULL) {
+
+	std::ostringstream prefix;
+	prefix << getpid() << "_" << Clock::now() << "_";
+	_namePrefix = prefix.str();
+}
+
+UploadStore::~UploadStore() {
+
+	_workerPool = NULL;
+	flush(true);
+	for (std::map<std::string, int>::iterator it = _directories.begin(); it != _directories.end(); ++it)
+		close(it->second);
+}
+
+void UploadStore::setWorkerPool(WorkerPool* pool) { _workerPool = pool; }
+
+void UploadStore::addRoot(const std::string& root, int rootFd) {
+
+	if (!root.empty() && rootFd >= 0)
+		_roots.insert(std::make_pair(root, rootFd));
+}
+
+// pid + start time tell processes apart, the sequence the uploads of one
+std::string UploadStore::uniqueName(const std::string& extension) {
+
+	std::ostringstream name;
+	name << "file_" << _namePrefix << ++_sequence;
+	if (!extension.empty())
+		name << "." << extension;
+	return name.str();
+}
+
+// mkdir -p without the shell: every missing component, EEXIST is fine
+bool UploadStore::makeDirectories(const std::string& directory) {
+
+	for (size_t pos = directory.find('/', 1); ; pos = directory.find('/', pos + 1)) {
+		std::string component = directory.substr(0, pos);
+		if (!component.empty() && mkdir(component.c_str(), 0755) != 0 && errno != EEXIST) {
+			std::cout << "[ERROR] Failed to create upload directory: " << component << std::endl;
+			return false;
+		}
+		if (pos == std::string::npos || pos + 1 >= directory.size())
+			return true;
+	}
+}
+
+// Beneath the longest registered root it is in, by path when there is none
+int UploadStore::openDirectory(const std::string& directory) {
+
+	std::map<std::string, int>::const_iterator root = _roots.end();
+	for (std::map<std::string, int>::const_iterator it = _roots.begin(); it != _roots.end(); ++it) {
+		const std::string& path = it->first;
+		bool inside = directory.compare(0, path.size(), path) == 0
+			&& (path[path.size() - 1] == '/' || directory.size() == path.size() || directory[path.size()] == '/');
+		if (inside && (root == _roots.end() || path.size() > root->first.size()))
+			root = it;
+	}
+	if (root == _roots.end()) {
+		if (!makeDirectories(directory))
+			return -1;
+		return open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	}
+	std::string relative = directory.substr(root->first.size());
+	int fd = openBeneath(root->second, relative, O_RDONLY | O_DIRECTORY);
+	if (fd < 0 && errno == ENOENT) {
+		if (mkdirBeneath(root->second, relative, 0755) != 0) {
+			std::cout << "[ERROR] Failed to create upload directory: " << directory << std::endl;
+			return -1;
+		}
+		fd = openBeneath(root->second, relative, O_RDONLY | O_DIRECTORY);
+	}
+	return fd;
+}
+
+int UploadStore::directoryFd(const std::string& directory) {
+
+	std::map<std::string, int>::iterator it = _directories.find(directory);
+	if (it != _directories.end()) {
+		struct stat st;
+		// Removed behind our back: files created through the old fd would vanish
+		if (fstat(it->second, &st) == 0 && st.st_nlink > 0)
+			return it->second;
+		close(it->second);
+		_directories.erase(it);
+	}
+	int fd = openDirectory(directory);
+	if (fd < 0)
+		return -1;
+	if (_directories.size() >= UPLOAD_DIRECTORY_CACHE_MAX) {
+		for (it = _directories.begin(); it != _directories.end(); ++it)
+			close(it->second);
+		_directories.clear();
+	}
+	_directories[directory] = fd;
+	std::cout << "[DEBUG] Upload directory opened: " << directory << " (FD " << fd << ")" << std::endl;
+	return fd;
+}
+
+bool UploadStore::create(const std::string& directory, StoredFile& file) {
+
+	file.directory = directory;
+	if (!file.directory.empty() && file.directory[file.directory.size() - 1] != '/')
+		file.directory += '/';
+	int dirFd = directoryFd(file.directory.empty() ? "./" : file.directory);
+	if (dirFd < 0)
+		return false;
+	file.directoryFd = dup(dirFd);
+	if (file.directoryFd < 0)
+		return false;
+	file.tempName = "." + uniqueName("part");
+	file.fd = openat(file.directoryFd, file.tempName.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (file.fd < 0) {
+		std::cout << "[ERROR] Failed to open file for writing: " << file.directory << file.tempName << std::endl;
+		close(file.directoryFd);
+		file.directoryFd = -1;
+		return false;
+	}
+	return true;
+}
+
+void UploadStore::discard(StoredFile& file) {
+
+	if (file.fd >= 0) {
+		close(file.fd);
+		unlinkat(file.directoryFd, file.tempName.c_str(), 0);
+		std::cout << "[DEBUG] Removed incomplete upload: " << file.directory << file.tempName << std::endl;
+	}
+	if (file.directoryFd >= 0)
+		close(file.directoryFd);
+	file.fd = -1;
+	file.directoryFd = -1;
+}
+
+/*
+	Renames the temp file to name. The file's data is synced before the
+	rename when the policy asks for it, so the new name never points at
+	missing blocks after a crash; the directory is synced after it so the
+	name itself survives.
+*/
+bool UploadStore::commit(StoredFile& file, const std::string& name, UploadDurability durability) {
+
+	if (file.fd < 0)
+		return false;
+	if (durability == UPLOAD_DURABILITY_FDATASYNC && fdatasync(file.fd) != 0) {
+		discard(file);
+		return false;
+	}
+	if (renameat(file.directoryFd, file.tempName.c_str(), file.directoryFd, name.c_str()) != 0) {
+		discard(file);
+		return false;
+	}
+	int fd = file.fd;
+	int dirFd = file.directoryFd;
+	file.fd = -1;
+	file.directoryFd = -1;
+
+	if (durability == UPLOAD_DURABILITY_BATCH) {
+		if (_batchFiles.empty())
+			_batchSince = Clock::monotonicMs();
+		_batchFiles.push_back(fd);
+		if (!_batchDirectories.insert(std::make_pair(file.directory, dirFd)).second)
+			close(dirFd);
+		if (_batchFiles.size() >= UPLOAD_SYNC_BATCH)
+			flush(true);
+		return true;
+	}
+	bool ok = true;
+	if (durability == UPLOAD_DURABILITY_FDATASYNC && fsync(dirFd) != 0)
+		ok = false;
+	if (close(fd) != 0)
+		ok = false;
+	close(dirFd);
+	return ok;
+}
+
+bool UploadStore::syncPending() const { return !_batchFiles.empty(); }
+
+void UploadStore::flush(bool force) {
+
+	if (_batchFiles.empty())
+		return;
+	if (!force && Clock::monotonicMs() - _batchSince < UPLOAD_SYNC_INTERVAL_MS)
+		return;
+	std::cout << "[DEBUG] Syncing upload batch: " << _batchFiles.size() << " files" << std::endl;
+	SyncBatchTask* task = new SyncBatchTask(_batchFiles, _batchDirectories);
+	if (!_workerPool || !_workerPool->submit(task))
+		delete task;   // syncs inline
+}
@@ -0,0 +1,73 @@
+#ifndef UPLOAD_STORE_HPP
+#define UPLOAD_STORE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include "config.hpp"
+
+class WorkerPool;
+
+#define UPLOAD_SYNC_BATCH		64     // committed files that trigger a group sync right away
+#define UPLOAD_SYNC_INTERVAL_MS	100    // longest a batched upload waits for its sync
+#define UPLOAD_DIRECTORY_CACHE_MAX	64  // open directory fds kept; the cache restarts when full
+
+// Upload being written: a hidden temp file in its destination directory
+struct StoredFile {
+
+	StoredFile() : fd(-1), directoryFd(-1), directory(), tempName() {}
+
+	int			fd;            // temp file, -1 once committed or discarded
+	int			directoryFd;   // dup of the cached one, owned
+	std::string	directory;     // with trailing '/'
+	std::string	tempName;
+};
+
+/*
+	Where uploads land. Destination directories are created once (mkdir per
+	component, no shell) and kept open; one inside a registered location
+	root is opened and created beneath the root's fd (see path_beneath.hpp),
+	so neither ".." nor a symlink takes it out. Files are created under a name unique
+	to this process (pid, start time, sequence) and renamed into place once
+	complete, so a reader never sees half an upload. commit() applies the
+	location's upload_durability: nothing, fdatasync() of file and directory
+	before answering, or a group sync of every file committed in the last
+	UPLOAD_SYNC_INTERVAL_MS, run on the worker pool.
+*/
+class UploadStore {
+
+	public:
+		UploadStore();
+		~UploadStore();
+
+		void		setWorkerPool(WorkerPool* pool);
+		void		addRoot(const std::string& root, int rootFd);   // fd stays the caller's
+
+		std::string	uniqueName(const std::string& extension);
+		bool		create(const std::string& directory, StoredFile& file);
+		bool		commit(StoredFile& file, const std::string& name, UploadDurability durability);
+		void		discard(StoredFile& file);
+
+		bool		syncPending() const;
+		void		flush(bool force);   // group sync once due (or now), on the pool when there is one
+
+	private:
+		UploadStore(const UploadStore&);
+		UploadStore& operator=(const UploadStore&);
+
+		int			directoryFd(const std::string& directory);
+		bool		makeDirectories(const std::string& directory);
+
+		int			openDirectory(const std::string& directory);
+
+		std::map<std::string, int>	_directories;   // path -> open directory fd
+		std::map<std::string, int>	_roots;         // location root -> its fd (not owned)
+		std::string					_namePrefix;    // "<pid>_<start time>_"
+		unsigned long				_sequence;
+		std::vector<int>			_batchFiles;    // renamed, not yet synced (owned)
+		std::map<std::string, int>	_batchDirectories;   // owned dups
+		unsigned long				_batchSince;    // Clock::monotonicMs() of the oldest
+		WorkerPool*					_workerPool;    // owned by the ServerController, NULL = sync inline
+};
+
+#endif
@@ -11,13 +11,18 @@
 /* ************************************************************************** */
 
 #include "server_controller.hpp"
+#include "clock.hpp"
 #include <csignal>
 #include <cerrno>
 
 extern volatile sig_atomic_t g_shutdown;
 
 ServerController::ServerController(Config& config)
-	:_configs(config.getServers()), _listeningSocketCount(), _running(true){}
+	:_configs(config.getServers()), _listeningSocketCount(), _running(true),
+	_workerPool(WORKER_POOL_THREADS, WORKER_POOL_QUEUE_MAX), _uploadStore(){
+
+	_uploadStore.setWorkerPool(&_workerPool);
+}
 
 ServerController::~ServerController(){
 
@@ -26,6 +31,10 @@ ServerController::~ServerController(){
 
 void ServerController::stop(){
 
+	// Workers first: no task may outlive the servers it reports to
+	_workerPool.shutdown();
+	_uploadStore.setWorkerPool(NULL);
+	_uploadStore.flush(true);
 	for (size_t i = 0; i < _servers.size(); i++){
 		delete(_servers[i]);
 		_servers[i] = NULL;
@@ -36,8 +45,8 @@ void ServerController::stop(){
 
 bool ServerController::isClientTimedOut(std::map<int, ClientInfo>& clients, int fd){
 
-	time_t now = time(NULL);
-	return (now - clients[fd].lastActivity > clients[fd].keepAliveTimeout) ;
+	unsigned long idleMs = Clock::monotonicMs() - clients[fd].lastActivity;
+	return (idleMs > static_cast<unsigned long>(clients[fd].keepAliveTimeout) * 1000);
 }
 
 void ServerController::checkClientTimeouts(Server& server){
@@ -48,7 +57,8 @@ void ServerController::checkClientTimeouts(Server& server){
 	for (; it != clients.end();){
 
 		int currentFd = it->first;
-		if(isClientTimedOut(clients, currentFd)){
+		// A running script is bounded by its cgi_timeout instead, so is a client waiting on another one's
+		if(it->second.state != RUNNING_CGI && it->second.state != WAITING_CACHE && isClientTimedOut(clients, currentFd)){
 			std::cout << "Client: " << currentFd << " timed out." << std::endl;
 			int fdToDisconnect = currentFd;
 			++it;
@@ -57,6 +67,7 @@ void ServerController::checkClientTimeouts(Server& server){
 		else
 			++it;
 	}
+	server.checkCgiTimeouts();
 }
 
 Server* ServerController::findServerForFd(int fd){
@@ -64,6 +75,7 @@ Server* ServerController::findServerForFd(int fd){
 	for(size_t i = 0; i < _servers.size(); i++){
 
 		Server* srv = _servers[i];
+		if (srv->isCgiPipe(fd) || srv->isUpstreamFd(fd)) return srv;
 		std::vector<Socket> listeners = srv->getListeningSockets();
 		std::map<int, ClientInfo>& clients = srv->getClients();
 
@@ -91,15 +103,25 @@ void ServerController::rebuildPollFds(){
 		std::map<int, ClientInfo>::iterator it = clients.begin();
 		for(; it != clients.end(); ++it)
 		{
+			// Socket and script pipes, polled by what the relay can take
+			if (it->second.state == RUNNING_CGI) {
+				_servers[i]->addCgiPollFds(it->second, _pollFds);
+				continue;
+			}
 			// Add client socket to poll array
 			struct pollfd client;
 			client.fd = it->first;
-			client.events = it->second.state == READING_REQUEST? POLLIN : POLLOUT;
+			// Waiting on the worker pool or a cache fill: only hangups matter until it completes
+			if (it->second.state == WAITING_TASK || it->second.state == WAITING_CACHE)
+				client.events = 0;
+			else
+				client.events = it->second.state == SENDING_RESPONSE? POLLOUT : POLLIN;
 			client.revents = 0;
 			_pollFds.push_back(client);
 
 			std::cout << "Added client socket FD " << client.fd << " to poll vector at index: " << (_pollFds.size() - 1) << std::endl;
 		}
+		_servers[i]->addUpstreamPollFds(_pollFds);
 	}
 }
 
@@ -124,6 +146,17 @@ void ServerController::initListeningSockets(){
 			std::cout << "Added listening socket FD " << listeningSocket.fd << " to poll vector at index: " << (_pollFds.size() - 1) << std::endl;
 		}
 	}
+
+	// Worker pool completions share the fixed part of the poll vector
+	if (_workerPool.notifyFd() >= 0) {
+		struct pollfd notify;
+		notify.fd = _workerPool.notifyFd();
+		notify.events = POLLIN;
+		notify.revents = 0;
+		_pollFds.push_back(notify);
+		_listeningSocketCount++;
+		std::cout << "[DEBUG] Worker pool: " << _workerPool.threads() << " threads, notify FD " << notify.fd << std::endl;
+	}
 }
 
 void ServerController::addServers(){
@@ -131,12 +164,15 @@ void ServerController::addServers(){
 	for (size_t i = 0; i < _configs.size(); i++)
 	{
 		Server* server = new Server(_configs[i]);
+		server->setWorkerPool(&_workerPool);
+		server->setUploadStore(&_uploadStore);
 		_servers.push_back(server);
 	}
 }
 
 void ServerController::run(){
 
+	Clock::update();
 	addServers();
 	initListeningSockets();
 
@@ -144,7 +180,15 @@ void ServerController::run(){
 
 		rebuildPollFds();
 
-		int ret = poll(_pollFds.data(), _pollFds.size(), -1);
+		// Batched uploads waiting for their group sync, running scripts and worker pools being resized need the loop to wake up
+		int timeout = _uploadStore.syncPending() ? UPLOAD_SYNC_INTERVAL_MS : -1;
+		for (size_t i = 0; i < _servers.size() && timeout < 0; i++)
+			if (_servers[i]->hasRunningCgi())
+				timeout = CGI_CHECK_MS;
+		int ret = poll(_pollFds.data(), _pollFds.size(), timeout);
+
+		// One clock read per iteration, shared by every handler below
+		Clock::update();
 
 		//errno != EINTR check for interrupted poll
 		if (ret < 0 && errno != EINTR) {
@@ -164,6 +208,11 @@ void ServerController::run(){
 				int fd = _pollFds[i].fd;
 				short revent = _pollFds[i].revents;
 
+				if (fd == _workerPool.notifyFd()) {
+					_workerPool.drainCompletions();
+					continue;
+				}
+
 				Server* srv = findServerForFd(fd);
 				if (srv) srv->handleEvent(fd, revent);
 			}
@@ -173,5 +222,7 @@ void ServerController::run(){
 		{
 			checkClientTimeouts(*(_servers[i]));
 		}
+		_uploadStore.flush(false);
+		CgiProcess::reapOrphans();
 	}
 }
@@ -15,6 +15,8 @@
 
 #include "server.hpp"
 #include "config.hpp"
+#include "worker_pool.hpp"
+#include "upload_store.hpp"
 
 class ServerController{
 
@@ -38,8 +40,10 @@ class ServerController{
 		std::vector<struct pollfd> _pollFds;
 		std::vector<ConfigData> _configs;
 
-		size_t _listeningSocketCount;
+		size_t _listeningSocketCount;   // fixed poll entries: listeners + worker pool notify fd
 		bool _running;
+		WorkerPool _workerPool;
+		UploadStore _uploadStore;
 };
 
 #endif
@@ -11,6 +11,11 @@
 /* ************************************************************************** */
 
 #include "socket.hpp"
+#if defined(__linux__)
+# include <sys/sendfile.h>
+#elif defined(__APPLE__)
+# include <sys/uio.h>
+#endif
 
 Socket::Socket():_fd(-1){ }
 
@@ -38,7 +43,9 @@ void Socket::createDefault() {
 
 void Socket::setReuseAddr(bool enable) {
 
-	setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	// The option is an int: a one-byte bool is rejected with EINVAL
+	int value = enable ? 1 : 0;
+	setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
 	std::cout << "Set SO_REUSEADDR option on FD " << _fd << std::endl;
 }
 
@@ -96,6 +103,29 @@ void Socket::closing(short fd) {
 	}
 }
 
+// Zero-copy transfer of count bytes of fileFd starting at *offset.
+// *offset is advanced by the number of bytes sent, like pread/send.
+ssize_t Socket::sendFile(int fileFd, off_t* offset, size_t count) {
+
+#if defined(__linux__)
+	return ::sendfile(_fd, fileFd, offset, count);
+#elif defined(__APPLE__)
+	off_t len = count;
+	if (::sendfile(fileFd, _fd, *offset, &len, NULL, 0) < 0 && len == 0)
+		return -1;
+	*offset += len;
+	return len;
+#else
+	char buffer[BUFFER_SIZE];
+	if (count > sizeof(buffer)) count = sizeof(buffer);
+	ssize_t bytes = pread(fileFd, buffer, count, *offset);
+	if (bytes <= 0) return bytes;
+	ssize_t sent = send(_fd, buffer, bytes, 0);
+	if (sent > 0) *offset += sent;
+	return sent;
+#endif
+}
+
 int Socket::getFd() const {
 
 	return _fd;
@@ -44,6 +44,7 @@ class Socket{
 		void listening(int backlog);
 		int accepting(sockaddr_in& client_addr);
 		void closing(short fd);
+		ssize_t sendFile(int fileFd, off_t* offset, size_t count);
 
 		// Getters
 		int getFd() const;
@@ -0,0 +1,222 @@
+#include "worker_pool.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+# include <sys/eventfd.h>
+# include <stdint.h>
+#endif
+
+WorkerPool::WorkerPool(size_t threads, size_t maxQueued)
+	: _workers(), _maxQueued(maxQueued), _nextWorker(0), _queued(0), _completions(NULL), _stopping(false) {
+
+	pthread_mutex_init(&_sleepLock, NULL);
+	pthread_cond_init(&_wake, NULL);
+#ifdef __linux__
+	_notifyFds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	_notifyFds[1] = _notifyFds[0];
+#else
+	if (pipe(_notifyFds) == 0) {
+		for (int i = 0; i < 2; i++) {
+			fcntl(_notifyFds[i], F_SETFL, O_NONBLOCK);
+			fcntl(_notifyFds[i], F_SETFD, FD_CLOEXEC);
+		}
+	}
+	else {
+		_notifyFds[0] = -1;
+		_notifyFds[1] = -1;
+	}
+#endif
+	if (_notifyFds[0] < 0)
+		return;   // no wakeup channel: submit() refuses and work stays inline
+
+	// Workers index _workers (stealing), so it is complete before any thread starts
+	for (size_t i = 0; i < threads; i++) {
+		Worker* worker = new Worker();
+		worker->pool = this;
+		worker->index = i;
+		pthread_mutex_init(&worker->lock, NULL);
+		_workers.push_back(worker);
+	}
+	size_t started = 0;
+	while (started < _workers.size()
+		&& pthread_create(&_workers[started]->thread, NULL, workerMain, _workers[started]) == 0)
+		started++;
+	if (started < _workers.size()) {
+		// Partial start: stop the ones running, submit() then refuses and work stays inline
+		pthread_mutex_lock(&_sleepLock);
+		_stopping = true;
+		pthread_cond_broadcast(&_wake);
+		pthread_mutex_unlock(&_sleepLock);
+		for (size_t i = 0; i < started; i++)
+			pthread_join(_workers[i]->thread, NULL);
+		for (size_t i = 0; i < _workers.size(); i++) {
+			pthread_mutex_destroy(&_workers[i]->lock);
+			delete _workers[i];
+		}
+		_workers.clear();
+		_stopping = false;
+	}
+}
+
+WorkerPool::~WorkerPool() {
+
+	shutdown();
+	pthread_cond_destroy(&_wake);
+	pthread_mutex_destroy(&_sleepLock);
+	if (_notifyFds[0] >= 0)
+		close(_notifyFds[0]);
+	if (_notifyFds[1] >= 0 && _notifyFds[1] != _notifyFds[0])
+		close(_notifyFds[1]);
+}
+
+void WorkerPool::shutdown() {
+
+	pthread_mutex_lock(&_sleepLock);
+	_stopping = true;
+	pthread_cond_broadcast(&_wake);
+	pthread_mutex_unlock(&_sleepLock);
+
+	for (size_t i = 0; i < _workers.size(); i++)
+		pthread_join(_workers[i]->thread, NULL);
+	for (size_t i = 0; i < _workers.size(); i++) {
+		for (size_t j = 0; j < _workers[i]->tasks.size(); j++)
+			delete _workers[i]->tasks[j];
+		pthread_mutex_destroy(&_workers[i]->lock);
+		delete _workers[i];
+	}
+	_workers.clear();
+
+	// Nobody is left to complete them
+	PoolTask* task = __sync_lock_test_and_set(&_completions, static_cast<PoolTask*>(NULL));
+	while (task) {
+		PoolTask* next = task->next;
+		delete task;
+		task = next;
+	}
+}
+
+size_t WorkerPool::threads() const { return _workers.size(); }
+
+int WorkerPool::notifyFd() const { return _notifyFds[0]; }
+
+bool WorkerPool::submit(PoolTask* task) {
+
+	if (_workers.empty() || _stopping || _queued >= static_cast<long>(_maxQueued))
+		return false;
+
+	Worker* worker = _workers[_nextWorker];
+	_nextWorker = (_nextWorker + 1) % _workers.size();
+	pthread_mutex_lock(&worker->lock);
+	worker->tasks.push_back(task);
+	pthread_mutex_unlock(&worker->lock);
+
+	// Counted after the push so a worker that sees it can find the task
+	__sync_fetch_and_add(&_queued, 1);
+	pthread_mutex_lock(&_sleepLock);
+	pthread_cond_signal(&_wake);
+	pthread_mutex_unlock(&_sleepLock);
+	return true;
+}
+
+// Own deque newest-first (still warm), then the oldest task of the others
+PoolTask* WorkerPool::take(size_t self) {
+
+	PoolTask* task = NULL;
+	Worker* own = _workers[self];
+	pthread_mutex_lock(&own->lock);
+	if (!own->tasks.empty()) {
+		task = own->tasks.back();
+		own->tasks.pop_back();
+	}
+	pthread_mutex_unlock(&own->lock);
+
+	for (size_t i = 1; !task && i < _workers.size(); i++) {
+		Worker* victim = _workers[(self + i) % _workers.size()];
+		if (pthread_mutex_trylock(&victim->lock) != 0)
+			continue;
+		if (!victim->tasks.empty()) {
+			task = victim->tasks.front();
+			victim->tasks.pop_front();
+		}
+		pthread_mutex_unlock(&victim->lock);
+	}
+	if (task)
+		__sync_fetch_and_sub(&_queued, 1);
+	return task;
+}
+
+void* WorkerPool::workerMain(void* arg) {
+
+	Worker* worker = static_cast<Worker*>(arg);
+	WorkerPool* pool = worker->pool;
+	while (true) {
+		PoolTask* task = pool->take(worker->index);
+		if (task) {
+			task->run();
+			pool->pushCompletion(task);
+			continue;
+		}
+		pthread_mutex_lock(&pool->_sleepLock);
+		while (!pool->_stopping && pool->_queued <= 0)
+			pthread_cond_wait(&pool->_wake, &pool->_sleepLock);
+		bool stop = pool->_stopping;
+		pthread_mutex_unlock(&pool->_sleepLock);
+		if (stop)
+			break;
+	}
+	return NULL;
+}
+
+// Treiber push; only the push onto an empty stack has to wake the loop
+void WorkerPool::pushCompletion(PoolTask* task) {
+
+	PoolTask* head;
+	do {
+		head = _completions;
+		task->next = head;
+	} while (!__sync_bool_compare_and_swap(&_completions, head, task));
+	if (!head)
+		wakeLoop();
+}
+
+void WorkerPool::wakeLoop() {
+
+#ifdef __linux__
+	uint64_t one = 1;
+	ssize_t written = write(_notifyFds[1], &one, sizeof(one));
+#else
+	char one = 1;
+	ssize_t written = write(_notifyFds[1], &one, 1);
+#endif
+	(void)written;   // a full pipe already means "wake up"
+}
+
+size_t WorkerPool::drainCompletions() {
+
+	// Clear the wakeup first: a task pushed after this read rings again
+	char buffer[64];
+	while (read(_notifyFds[0], buffer, sizeof(buffer)) > 0)
+		;
+
+	PoolTask* task = __sync_lock_test_and_set(&_completions, static_cast<PoolTask*>(NULL));
+	__sync_synchronize();
+
+	// Stack order is newest first, complete in finishing order
+	PoolTask* ordered = NULL;
+	while (task) {
+		PoolTask* next = task->next;
+		task->next = ordered;
+		ordered = task;
+		task = next;
+	}
+	size_t count = 0;
+	while (ordered) {
+		PoolTask* next = ordered->next;
+		ordered->complete();
+		delete ordered;
+		ordered = next;
+		count++;
+	}
+	return count;
+}
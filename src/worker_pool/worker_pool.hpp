@@ -0,0 +1,77 @@
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <vector>
+#include <deque>
+#include <cstddef>
+#include <pthread.h>
+
+#define WORKER_POOL_THREADS		4      // blocking filesystem / CPU-heavy work
+#define WORKER_POOL_QUEUE_MAX	1024   // queued tasks before submit() refuses
+
+/*
+	Unit of work for the pool. run() executes on a worker thread and must
+	only touch the task's own data; complete() executes afterwards on the
+	event loop thread, where the Server state can be used again.
+*/
+class PoolTask {
+
+	public:
+		PoolTask() : next(NULL) {}
+		virtual ~PoolTask() {}
+
+		virtual void	run() = 0;
+		virtual void	complete() = 0;
+
+		PoolTask*		next;   // completion queue link
+};
+
+/*
+	Bounded thread pool for blocking work (unlink, file reads, compression)
+	so a slow disk never stalls the poll() loop. Every worker owns a deque:
+	it pops its own newest task and, when empty, steals the oldest one of
+	another worker. Finished tasks are pushed on a lock-free MPSC stack and
+	the loop is woken through notifyFd() (an eventfd, a pipe elsewhere).
+*/
+class WorkerPool {
+
+	public:
+		WorkerPool(size_t threads, size_t maxQueued);
+		~WorkerPool();
+
+		bool	submit(PoolTask* task);      // false when full or stopped: run the work inline
+		int		notifyFd() const;            // POLLIN when completions are waiting
+		size_t	drainCompletions();          // event loop: complete() and delete finished tasks
+		void	shutdown();                  // joins the workers, drops unfinished tasks
+
+		size_t	threads() const;
+
+	private:
+		struct Worker {
+			WorkerPool*				pool;
+			size_t					index;
+			pthread_t				thread;
+			pthread_mutex_t			lock;
+			std::deque<PoolTask*>	tasks;
+		};
+
+		WorkerPool(const WorkerPool&);
+		WorkerPool& operator=(const WorkerPool&);
+
+		static void*	workerMain(void* arg);
+		PoolTask*		take(size_t self);
+		void			pushCompletion(PoolTask* task);
+		void			wakeLoop();
+
+		std::vector<Worker*>	_workers;
+		size_t					_maxQueued;
+		size_t					_nextWorker;     // round-robin submit target
+		volatile long			_queued;         // submitted, not yet taken by a worker
+		PoolTask* volatile		_completions;    // MPSC stack, newest first
+		pthread_mutex_t			_sleepLock;
+		pthread_cond_t			_wake;
+		bool					_stopping;
+		int						_notifyFds[2];   // [0] polled, [1] written (same fd for eventfd)
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+#include "cgi_process.hpp"
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+TEST(CgiHeadersTest, FindsBlankLine) {
+	EXPECT_EQ(CgiHeaders::bodyStart("Content-Type: text/plain\r\n"), std::string::npos);
+	EXPECT_EQ(CgiHeaders::bodyStart("Content-Type: text/plain\r\n\r\nbody"), 28u);
+	EXPECT_EQ(CgiHeaders::bodyStart("Content-Type: text/plain\n\nbody"), 26u);
+}
+
+TEST(CgiHeadersTest, ParsesStatusAndPassesHeadersOn) {
+	CgiHeaders headers;
+	ASSERT_TRUE(CgiHeaders::parse("Status: 404 Not Found\r\nContent-Type: text/html\r\n"
+		"Connection: keep-alive\r\nX-Custom:  yes\r\n\r\n", headers));
+
+	EXPECT_EQ(headers.status, 404);
+	EXPECT_EQ(headers.contentLength, -1);
+	ASSERT_EQ(headers.headers.size(), 2u);
+	EXPECT_EQ(headers.headers[0].first, "Content-Type");
+	EXPECT_EQ(headers.headers[1].second, "yes");
+}
+
+TEST(CgiHeadersTest, LocationWithoutStatusRedirects) {
+	CgiHeaders headers;
+	ASSERT_TRUE(CgiHeaders::parse("Location: /elsewhere\nContent-Length: 0\n\n", headers));
+	EXPECT_EQ(headers.status, 302);
+	EXPECT_EQ(headers.contentLength, 0);
+}
+
+TEST(CgiHeadersTest, RejectsMalformedBlocks) {
+	CgiHeaders headers;
+	EXPECT_FALSE(CgiHeaders::parse("no colon here\r\n\r\n", headers));
+	EXPECT_FALSE(CgiHeaders::parse("Status: abc\r\n\r\n", headers));
+	EXPECT_FALSE(CgiHeaders::parse("Status: 99\r\n\r\n", headers));
+	EXPECT_FALSE(CgiHeaders::parse("Content-Length: -4\r\n\r\n", headers));
+}
+
+// Runs the relay loop the Server runs: stdin fed as it drains, stdout read to EOF
+static std::string relay(CgiProcess& cgi) {
+	std::string output;
+	char buffer[4096];
+	while (cgi.outputFd() >= 0) {
+		struct pollfd fds[2];
+		nfds_t count = 0;
+		if (cgi.inputFd() >= 0 && cgi.inputPending() > 0) {
+			fds[count].fd = cgi.inputFd();
+			fds[count++].events = POLLOUT;
+		}
+		fds[count].fd = cgi.outputFd();
+		fds[count++].events = POLLIN;
+		if (poll(fds, count, 5000) <= 0)
+			break;
+		cgi.writeInput();
+		ssize_t bytes = cgi.readOutput(buffer, sizeof(buffer));
+		if (bytes > 0)
+			output.append(buffer, bytes);
+	}
+	return output;
+}
+
+static std::vector<std::string> shell(const std::string& command) {
+	std::vector<std::string> args;
+	args.push_back("/bin/sh");
+	args.push_back("-c");
+	args.push_back(command);
+	return args;
+}
+
+TEST(CgiProcessTest, StreamsBodyThroughScript) {
+	std::vector<std::string> env;
+	env.push_back("GREETING=hi");
+	CgiProcess cgi(~0UL);
+	ASSERT_TRUE(cgi.start("/bin/sh", shell("printf '%s ' \"$GREETING\"; tr a-z A-Z"), env, "/tmp"));
+
+	std::string body(200000, 'x');   // more than a pipe holds
+	cgi.queueInput(body.data(), body.size());
+	cgi.endInput();
+
+	std::string output = relay(cgi);
+	EXPECT_EQ(output, "hi " + std::string(200000, 'X'));
+	EXPECT_EQ(cgi.inputFd(), -1);
+}
+
+TEST(CgiProcessTest, ScriptIgnoringStdinLosesBody) {
+	signal(SIGPIPE, SIG_IGN);   // as in main()
+	CgiProcess cgi(~0UL);
+	ASSERT_TRUE(cgi.start("/bin/sh", shell("exec 0<&-; echo done"), std::vector<std::string>(), ""));
+
+	std::string body(200000, 'x');
+	cgi.queueInput(body.data(), body.size());
+	cgi.endInput();
+	EXPECT_EQ(relay(cgi), "done\n");
+}
+
+TEST(CgiProcessTest, SplicesOutputIntoSocket) {
+	int sockets[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+	fcntl(sockets[0], F_SETFL, O_NONBLOCK);
+	CgiProcess cgi(~0UL);
+	ASSERT_TRUE(cgi.start("/bin/sh", shell("head -c 300000 /dev/zero | tr '\\0' z"), std::vector<std::string>(), ""));
+	cgi.endInput();
+	ASSERT_TRUE(cgi.startSplice());
+
+	// The reading side stays away until the socket fills up, so both ends get to hold the splice up
+	std::string received;
+	bool sawFull = false;
+	ssize_t moved = CGI_SPLICE_WAIT_OUTPUT;
+	for (int round = 0; round < 10000 && moved != 0; round++) {
+		moved = cgi.spliceOutput(sockets[0], CGI_SPLICE_MAX);
+		ASSERT_NE(moved, CGI_SPLICE_FAILED);
+		if (moved == CGI_SPLICE_WAIT_OUTPUT) {
+			struct pollfd entry = { cgi.outputFd(), POLLIN, 0 };
+			poll(&entry, 1, 5000);
+		}
+		if (moved == CGI_SPLICE_CLIENT_FULL) {
+			sawFull = true;
+			char buffer[65536];
+			ssize_t bytes = read(sockets[1], buffer, sizeof(buffer));
+			ASSERT_GT(bytes, 0);
+			received.append(buffer, bytes);
+		}
+	}
+	EXPECT_EQ(moved, 0);
+	EXPECT_TRUE(cgi.outputClosed());
+	close(sockets[0]);
+	char buffer[65536];
+	ssize_t bytes;
+	while ((bytes = read(sockets[1], buffer, sizeof(buffer))) > 0)
+		received.append(buffer, bytes);
+	close(sockets[1]);
+	EXPECT_TRUE(sawFull);
+	EXPECT_EQ(received, std::string(300000, 'z'));
+}
+
+TEST(CgiProcessTest, UnfinishedScriptIsKilledAndReaped) {
+	pid_t pid;
+	{
+		CgiProcess cgi(0);
+		ASSERT_TRUE(cgi.start("/bin/sh", shell("sleep 30"), std::vector<std::string>(), ""));
+		pid = cgi.pid();
+		EXPECT_TRUE(cgi.expired(1));
+	}
+	for (int i = 0; i < 100 && kill(pid, 0) == 0; i++) {
+		usleep(10000);
+		CgiProcess::reapOrphans();
+	}
+	EXPECT_EQ(kill(pid, 0), -1);
+	EXPECT_EQ(errno, ESRCH);
+}
@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+#include "fastcgi.hpp"
+#include "fastcgi_upstream.hpp"
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+TEST(FastCgiTest, ParamsRoundTrip) {
+	std::vector<std::string> params;
+	params.push_back("SCRIPT_FILENAME=/srv/index.php");
+	params.push_back("HTTP_COOKIE=" + std::string(300, 'c'));   // four-byte length
+	params.push_back("QUERY_STRING=");
+
+	std::string out;
+	FastCgi::appendParams(out, 7, params);
+	FastCgiRecord record;
+	ASSERT_EQ(FastCgi::nextRecord(out, record), 1);
+	EXPECT_EQ(record.type, FCGI_PARAMS);
+	EXPECT_EQ(record.requestId, 7);
+	std::map<std::string, std::string> pairs;
+	ASSERT_TRUE(FastCgi::parsePairs(record.content, pairs));
+	EXPECT_EQ(pairs["SCRIPT_FILENAME"], "/srv/index.php");
+	EXPECT_EQ(pairs["HTTP_COOKIE"], std::string(300, 'c'));
+	EXPECT_TRUE(pairs.count("QUERY_STRING"));
+
+	ASSERT_EQ(FastCgi::nextRecord(out, record), 1);   // empty record ends the stream
+	EXPECT_TRUE(record.content.empty());
+	EXPECT_TRUE(out.empty());
+}
+
+TEST(FastCgiTest, StdinIsSplitAndPadded) {
+	std::string body(70000, 'x');
+	std::string out;
+	FastCgi::appendStdin(out, 1, body.data(), body.size());
+	EXPECT_EQ(out.size() % 8, 0u);
+
+	std::string partial = out.substr(0, 100);
+	FastCgiRecord record;
+	EXPECT_EQ(FastCgi::nextRecord(partial, record), 0);
+	ASSERT_EQ(FastCgi::nextRecord(out, record), 1);
+	EXPECT_EQ(record.content.size(), static_cast<size_t>(FCGI_MAX_CONTENT));
+	ASSERT_EQ(FastCgi::nextRecord(out, record), 1);
+	EXPECT_EQ(record.content.size(), 70000u - FCGI_MAX_CONTENT);
+
+	std::string garbage("HTTP/1.1 200 OK\r\n");
+	EXPECT_EQ(FastCgi::nextRecord(garbage, record), -1);
+}
+
+// Blocking stand-in for an application server: one request in, a fixed response out
+static unsigned short serveOne(int fd, std::map<std::string, std::string>& params, std::string& body) {
+	std::string in;
+	FastCgiRecord record;
+	bool done = false;
+	while (!done) {
+		char buffer[4096];
+		ssize_t bytes = read(fd, buffer, sizeof(buffer));
+		if (bytes <= 0)
+			return 0;
+		in.append(buffer, bytes);
+		while (FastCgi::nextRecord(in, record) > 0) {
+			if (record.type == FCGI_PARAMS)
+				FastCgi::parsePairs(record.content, params);
+			else if (record.type == FCGI_STDIN && record.content.empty())
+				done = true;
+			else if (record.type == FCGI_STDIN)
+				body += record.content;
+		}
+	}
+	std::string out;
+	std::string response = "Content-Type: text/plain\r\n\r\n" + body;
+	FastCgi::appendRecord(out, FCGI_STDOUT, record.requestId, response.data(), response.size());
+	char end[8] = {0, 0, 0, 0, FCGI_REQUEST_COMPLETE, 0, 0, 0};
+	FastCgi::appendRecord(out, FCGI_END_REQUEST, record.requestId, end, sizeof(end));
+	write(fd, out.data(), out.size());
+	return record.requestId;
+}
+
+static std::string collect(FastCgiUpstream& upstream, FastCgiRequest& request) {
+	std::string output;
+	char buffer[4096];
+	while (!request.outputClosed()) {
+		std::vector<struct pollfd> fds;
+		upstream.addPollFds(fds);
+		if (fds.empty() || poll(&fds[0], fds.size(), 5000) <= 0)
+			break;
+		for (size_t i = 0; i < fds.size(); i++)
+			if (fds[i].revents)
+				upstream.handleEvent(fds[i].fd, fds[i].revents);
+		ssize_t bytes;
+		while ((bytes = request.readOutput(buffer, sizeof(buffer))) > 0)
+			output.append(buffer, bytes);
+	}
+	return output;
+}
+
+TEST(FastCgiUpstreamTest, KeepsConnectionAcrossRequests) {
+	char path[64];
+	std::snprintf(path, sizeof(path), "/tmp/webserv_fcgi_%d.sock", getpid());
+	unlink(path);
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	struct sockaddr_un address;
+	std::memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	std::strcpy(address.sun_path, path);
+	ASSERT_EQ(bind(listener, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)), 0);
+	ASSERT_EQ(listen(listener, 4), 0);
+
+	FastCgiUpstream upstream(std::string("unix:") + path, 2, 1);
+	std::vector<std::string> params;
+	params.push_back("REQUEST_METHOD=POST");
+	int connection = -1;
+	for (int round = 0; round < 2; round++) {
+		FastCgiRequest request(upstream, params, 42, ~0UL);
+		request.queueInput("hello", 5);
+		request.endInput();
+		request.writeInput();
+		if (round == 0)
+			connection = accept(listener, NULL, NULL);
+		ASSERT_GE(connection, 0);
+
+		std::map<std::string, std::string> received;
+		std::string body;
+		EXPECT_GT(serveOne(connection, received, body), 0);
+		EXPECT_EQ(received["REQUEST_METHOD"], "POST");
+		EXPECT_EQ(body, "hello");
+		EXPECT_EQ(collect(upstream, request), "Content-Type: text/plain\r\n\r\nhello");
+		EXPECT_FALSE(request.failed());
+
+		std::vector<int> owners;
+		upstream.takeUpdated(owners);
+		ASSERT_FALSE(owners.empty());
+		EXPECT_EQ(owners[0], 42);
+	}
+	// The second request went over the first connection
+	fcntl(listener, F_SETFL, O_NONBLOCK);
+	EXPECT_LT(accept(listener, NULL, NULL), 0);
+	EXPECT_FALSE(upstream.busy());
+
+	close(connection);
+	close(listener);
+	unlink(path);
+}
+
+TEST(FastCgiUpstreamTest, UnreachableServerFailsRequest) {
+	FastCgiUpstream upstream("unix:/nonexistent/webserv.sock", 1, 1);
+	FastCgiRequest request(upstream, std::vector<std::string>(), 3, ~0UL);
+	EXPECT_TRUE(request.outputClosed());
+	EXPECT_TRUE(request.failed());
+	EXPECT_FALSE(upstream.busy());
+}
+
+// The shipped Python worker, run from tests/: two requests per worker, then a fresh one
+TEST(FastCgiUpstreamTest, PoolRecyclesWorkers) {
+	const char* worker = "../runtime/cgi-workers/python_worker.py";
+	if (access(worker, X_OK) != 0 || system("python3 -c '' 2>/dev/null") != 0)
+		GTEST_SKIP() << "python3 worker unavailable";
+	char script[64];
+	std::snprintf(script, sizeof(script), "/tmp/webserv_pool_%d.py", getpid());
+	FILE* file = std::fopen(script, "w");
+	ASSERT_TRUE(file != NULL);
+	std::fputs("import os, sys\nprint('Content-Type: text/plain\\n')\nprint(os.getpid(), sys.stdin.read())\n", file);
+	std::fclose(file);
+
+	FastCgiUpstream pool("pool:/test", std::vector<std::string>(1, worker), 1, 1, 2);
+	EXPECT_FALSE(pool.needsMaintenance());   // the minimum is up before any request
+	std::vector<std::string> params(1, std::string("SCRIPT_FILENAME=") + script);
+	std::string pids[3];
+	for (int round = 0; round < 3; round++) {
+		FastCgiRequest request(pool, params, round, ~0UL);
+		request.queueInput("ping", 4);
+		request.endInput();
+		request.writeInput();
+		std::string output = collect(pool, request);
+		EXPECT_FALSE(request.failed());
+		size_t body = output.find("\n\n");
+		ASSERT_NE(body, std::string::npos) << output;
+		EXPECT_EQ(output.substr(output.find(' ', body)), " ping\n");
+		pids[round] = output.substr(body + 2, output.find(' ', body) - body - 2);
+	}
+	EXPECT_EQ(pids[0], pids[1]);
+	EXPECT_NE(pids[1], pids[2]);
+	unlink(script);
+}
@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+#include "compression.hpp"
+
+TEST(Compression, negotiateEncoding){
+
+	EXPECT_EQ(ENCODING_GZIP, negotiateEncoding("gzip, deflate, br"));
+	EXPECT_EQ(ENCODING_DEFLATE, negotiateEncoding("gzip;q=0.5, deflate"));
+	EXPECT_EQ(ENCODING_DEFLATE, negotiateEncoding("gzip;q=0, *"));
+	EXPECT_EQ(ENCODING_GZIP, negotiateEncoding("*;q=0.3"));
+	EXPECT_EQ(ENCODING_IDENTITY, negotiateEncoding("br, identity"));
+	EXPECT_EQ(ENCODING_IDENTITY, negotiateEncoding("gzip;q=0, deflate;q=0.000"));
+	EXPECT_EQ(ENCODING_IDENTITY, negotiateEncoding(""));
+}
+
+TEST(Compression, acceptsEncoding){
+
+	EXPECT_TRUE(acceptsEncoding("gzip, deflate, br", ENCODING_BROTLI));
+	EXPECT_FALSE(acceptsEncoding("gzip, deflate", ENCODING_BROTLI));
+	EXPECT_FALSE(acceptsEncoding("br;q=0, *", ENCODING_BROTLI));
+	EXPECT_TRUE(acceptsEncoding("x-gzip", ENCODING_GZIP));
+	EXPECT_TRUE(acceptsEncoding("", ENCODING_IDENTITY));
+}
+
+TEST(Compression, cacheEvictsLeastRecentlyUsed){
+
+	CompressionCache cache(400);
+	std::string body(100, 'x');
+
+	ASSERT_TRUE(cache.insert(CompressionKey(1, 1, "\"a\"", ENCODING_GZIP, 6), body) != NULL);
+	ASSERT_TRUE(cache.insert(CompressionKey(1, 2, "\"b\"", ENCODING_GZIP, 6), body) != NULL);
+	ASSERT_TRUE(cache.insert(CompressionKey(1, 3, "\"c\"", ENCODING_GZIP, 6), body) != NULL);
+	ASSERT_TRUE(cache.insert(CompressionKey(1, 4, "\"d\"", ENCODING_GZIP, 6), body) != NULL);
+	// Touch the first entry so the second becomes the eviction candidate
+	EXPECT_TRUE(cache.find(CompressionKey(1, 1, "\"a\"", ENCODING_GZIP, 6)) != NULL);
+	ASSERT_TRUE(cache.insert(CompressionKey(1, 5, "\"e\"", ENCODING_GZIP, 6), body) != NULL);
+
+	EXPECT_EQ(4u, cache.size());
+	EXPECT_EQ(400u, cache.bytes());
+	EXPECT_TRUE(cache.find(CompressionKey(1, 1, "\"a\"", ENCODING_GZIP, 6)) != NULL);
+	EXPECT_TRUE(cache.find(CompressionKey(1, 2, "\"b\"", ENCODING_GZIP, 6)) == NULL);
+	// A new ETag for the same file is a different variant
+	EXPECT_TRUE(cache.find(CompressionKey(1, 1, "\"a2\"", ENCODING_GZIP, 6)) == NULL);
+	// Entries over a quarter of the budget are not admitted
+	EXPECT_TRUE(cache.insert(CompressionKey(1, 6, "\"f\"", ENCODING_GZIP, 6), std::string(101, 'x')) == NULL);
+}
@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include "config.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+// Config::parseConfig() reads conf/<name> from the working directory
+class ConfigTest : public ::testing::Test {
+
+	protected:
+		void SetUp() {
+			char tmpl[] = "/tmp/config_testXXXXXX";
+			base = mkdtemp(tmpl);
+			system(("mkdir -p " + base + "/conf " + base + "/www/static " + base + "/logs"
+				+ " && touch " + base + "/www/index.html").c_str());
+			char cwd[4096];
+			previous = getcwd(cwd, sizeof(cwd)) ? cwd : ".";
+			ASSERT_EQ(0, chdir(base.c_str()));
+		}
+		void TearDown() {
+			EXPECT_EQ(0, chdir(previous.c_str()));
+			system(("rm -rf " + base).c_str());
+		}
+		// One server block around the given directives
+		ConfigData parse(const std::string& directives) {
+			std::ofstream file("conf/test.conf");
+			file << "server {\n"
+				"    listen 127.0.0.1:8080\n"
+				"    backlog 16\n"
+				"    max_clients 16\n"
+				"    access_log logs/access.log\n"
+				"    error_log logs/error.log\n"
+				"    root www/\n"
+				"    index www/index.html\n"
+				"    client_max_body_size 1024\n"
+				<< directives << "}\n";
+			file.close();
+			Config config;
+			char name[] = "test.conf";
+			config.parseConfig(name);
+			return config.getServers()[0];
+		}
+		const LocationConfig& location(const ConfigData& server, const std::string& path) {
+			for (size_t i = 0; i < server.locations.size(); i++)
+				if (server.locations[i].path == path)
+					return server.locations[i];
+			ADD_FAILURE() << "no location " << path;
+			return server.locations[0];
+		}
+
+		std::string base;
+		std::string previous;
+};
+
+TEST_F(ConfigTest, LocationGzipOffOverridesServerGzipOn) {
+	ConfigData server = parse(
+		"    gzip on\n"
+		"    location / {\n"
+		"        root www/\n"
+		"    }\n"
+		"    location /static {\n"
+		"        root www/\n"
+		"        gzip off\n"
+		"    }\n");
+	EXPECT_TRUE(location(server, "/").gzip);
+	EXPECT_FALSE(location(server, "/static").gzip);
+}
+
+TEST_F(ConfigTest, LocationGzipOnOverridesServerGzipOff) {
+	ConfigData server = parse(
+		"    location / {\n"
+		"        root www/\n"
+		"        gzip on\n"
+		"    }\n"
+		"    location /static {\n"
+		"        root www/\n"
+		"    }\n");
+	EXPECT_TRUE(location(server, "/").gzip);
+	EXPECT_FALSE(location(server, "/static").gzip);
+}
+
+TEST_F(ConfigTest, LocationStaticVariantsOverrideServer) {
+	ConfigData server = parse(
+		"    gzip_static on\n"
+		"    location / {\n"
+		"        root www/\n"
+		"        brotli_static on\n"
+		"    }\n"
+		"    location /static {\n"
+		"        root www/\n"
+		"        gzip_static off\n"
+		"    }\n");
+	EXPECT_TRUE(location(server, "/").gzip_static);
+	EXPECT_TRUE(location(server, "/").brotli_static);
+	EXPECT_FALSE(location(server, "/static").gzip_static);
+	EXPECT_FALSE(location(server, "/static").brotli_static);
+}
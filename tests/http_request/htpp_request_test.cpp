@@ -68,3 +68,18 @@ TEST_F(HttpRequestTestPOST, parseBody){
 
 	EXPECT_STREQ("{\"name\":\"John\",\"age\":30}", request->getBody().c_str());
 }
+
+TEST(HttpRequestMethods, headAndOptionsAreAccepted){
+
+	HttpRequest head;
+	head.parseRequest("HEAD /health HTTP/1.1\r\nHost: localhost\r\n\r\n");
+	EXPECT_TRUE(head.getStatus());
+	EXPECT_EQ(HEAD, head.getMethodEnum());
+
+	HttpRequest options;
+	options.parseRequest("OPTIONS /api?x=1 HTTP/1.1\r\nHost: localhost\r\n\r\n");
+	EXPECT_TRUE(options.getStatus());
+	EXPECT_EQ(OPTIONS, options.getMethodEnum());
+	EXPECT_EQ("/api", options.getPath());
+	EXPECT_EQ("x=1", options.getQuery());
+}
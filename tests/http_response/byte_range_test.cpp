@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include "byte_range.hpp"
+
+TEST(ByteRange, singleRanges){
+
+	std::vector<ByteRange> ranges;
+
+	EXPECT_EQ(RANGE_SATISFIABLE, parseRangeHeader("bytes=0-499", 1000, ranges));
+	ASSERT_EQ(1u, ranges.size());
+	EXPECT_EQ(0, ranges[0].first);
+	EXPECT_EQ(499, ranges[0].last);
+
+	EXPECT_EQ(RANGE_SATISFIABLE, parseRangeHeader("bytes=900-", 1000, ranges));
+	EXPECT_EQ(900, ranges[0].first);
+	EXPECT_EQ(999, ranges[0].last);
+
+	EXPECT_EQ(RANGE_SATISFIABLE, parseRangeHeader("bytes=-100", 1000, ranges));
+	EXPECT_EQ(900, ranges[0].first);
+	EXPECT_EQ(100, ranges[0].length());
+
+	// Last position past the end is clamped
+	EXPECT_EQ(RANGE_SATISFIABLE, parseRangeHeader("bytes=500-5000", 1000, ranges));
+	EXPECT_EQ(999, ranges[0].last);
+}
+
+TEST(ByteRange, multipleRangesAreCoalescedWhenOverlapping){
+
+	std::vector<ByteRange> ranges;
+
+	EXPECT_EQ(RANGE_SATISFIABLE, parseRangeHeader("bytes=500-599, 0-99", 1000, ranges));
+	ASSERT_EQ(2u, ranges.size());
+	EXPECT_EQ(500, ranges[0].first);
+
+	EXPECT_EQ(RANGE_SATISFIABLE, parseRangeHeader("bytes=50-150,0-99,151-200", 1000, ranges));
+	ASSERT_EQ(1u, ranges.size());
+	EXPECT_EQ(0, ranges[0].first);
+	EXPECT_EQ(200, ranges[0].last);
+}
+
+TEST(ByteRange, invalidAndUnsatisfiable){
+
+	std::vector<ByteRange> ranges;
+
+	EXPECT_EQ(RANGE_NONE, parseRangeHeader("items=0-1", 1000, ranges));
+	EXPECT_EQ(RANGE_NONE, parseRangeHeader("bytes=5-1", 1000, ranges));
+	EXPECT_EQ(RANGE_NONE, parseRangeHeader("bytes=abc", 1000, ranges));
+	EXPECT_EQ(RANGE_NONE, parseRangeHeader("bytes=-", 1000, ranges));
+	EXPECT_EQ(RANGE_UNSATISFIABLE, parseRangeHeader("bytes=1000-", 1000, ranges));
+	EXPECT_EQ(RANGE_UNSATISFIABLE, parseRangeHeader("bytes=-0", 1000, ranges));
+}
+
+TEST(ByteRange, ifRange){
+
+	EXPECT_TRUE(ifRangeMatches("\"abc-10\"", "\"abc-10\"", "Tue, 24 Sep 2025 16:00:00 GMT"));
+	EXPECT_FALSE(ifRangeMatches("\"abc-11\"", "\"abc-10\"", "Tue, 24 Sep 2025 16:00:00 GMT"));
+	EXPECT_FALSE(ifRangeMatches("W/\"abc-10\"", "\"abc-10\"", "Tue, 24 Sep 2025 16:00:00 GMT"));
+	EXPECT_TRUE(ifRangeMatches("Tue, 24 Sep 2025 16:00:00 GMT", "\"abc-10\"", "Tue, 24 Sep 2025 16:00:00 GMT"));
+	EXPECT_FALSE(ifRangeMatches("Tue, 24 Sep 2025 16:00:01 GMT", "\"abc-10\"", "Tue, 24 Sep 2025 16:00:00 GMT"));
+}
+
+TEST(ByteRange, notModified){
+
+	std::map<std::string, std::string> headers;
+	const char* etag = "\"abc-10\"";
+	const char* date = "Tue, 24 Sep 2025 16:00:00 GMT";
+	EXPECT_FALSE(notModified(headers, etag, date));
+
+	headers["if-modified-since"] = date;
+	EXPECT_TRUE(notModified(headers, etag, date));
+	headers["if-modified-since"] = "Tue, 24 Sep 2025 16:00:01 GMT";
+	EXPECT_FALSE(notModified(headers, etag, date));
+
+	// If-None-Match decides alone, with a weak comparison
+	headers["if-none-match"] = "\"other\", W/\"abc-10\"";
+	EXPECT_TRUE(notModified(headers, etag, date));
+	EXPECT_TRUE(notModified(headers, "W/\"abc-10\"", date));
+	headers["if-modified-since"] = date;
+	headers["if-none-match"] = "\"abc-11\"";
+	EXPECT_FALSE(notModified(headers, etag, date));
+	headers["if-none-match"] = " * ";
+	EXPECT_TRUE(notModified(headers, etag, date));
+}
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include "cache_headers.hpp"
+#include "helpers.hpp"
+
+TEST(CacheHeaders, expiresRendersMaxAgeAndExtraDirectives) {
+
+	CachePolicy policy;
+	policy.expires_mode = EXPIRES_SECONDS;
+	policy.expires = 3600;
+	policy.cache_control.push_back("public");
+	policy.cache_control.push_back("immutable");
+
+	CacheHeaderTemplate tmpl = CacheHeaders::compile(policy, CachePolicy());
+	EXPECT_EQ("max-age=3600, public, immutable", tmpl.cacheControl);
+	EXPECT_TRUE(tmpl.expires);
+	EXPECT_EQ(29u, tmpl.expiresHeader().size());
+}
+
+TEST(CacheHeaders, negativeEpochAndMaxFollowNginx) {
+
+	CachePolicy policy;
+	policy.expires_mode = EXPIRES_SECONDS;
+	policy.expires = -1;
+	EXPECT_EQ("no-cache", CacheHeaders::compile(policy, CachePolicy()).cacheControl);
+
+	policy.expires_mode = EXPIRES_EPOCH;
+	CacheHeaderTemplate epoch = CacheHeaders::compile(policy, CachePolicy());
+	EXPECT_EQ("no-cache", epoch.cacheControl);
+	EXPECT_EQ(EXPIRES_EPOCH_DATE, epoch.expiresHeader());
+
+	policy.expires_mode = EXPIRES_MAX;
+	EXPECT_EQ("max-age=315360000", CacheHeaders::compile(policy, CachePolicy()).cacheControl);
+
+	policy.expires_mode = EXPIRES_OFF;
+	CacheHeaderTemplate off = CacheHeaders::compile(policy, CachePolicy());
+	EXPECT_FALSE(off.expires);
+	EXPECT_TRUE(off.cacheControl.empty());
+}
+
+TEST(CacheHeaders, typeOverridesFallBackToDefaultAndWildcards) {
+
+	CachePolicy defaults;
+	defaults.expires_mode = EXPIRES_SECONDS;
+	defaults.expires = 60;
+	std::map<std::string, CachePolicy> byType;
+	byType["image/*"].expires_mode = EXPIRES_SECONDS;
+	byType["image/*"].expires = 86400;
+	byType["text/css"].cache_control.push_back("immutable");
+
+	CacheHeaders headers;
+	headers.build(defaults, byType);
+	ASSERT_TRUE(headers.find("image/png") != NULL);
+	EXPECT_EQ("max-age=86400", headers.find("image/png")->cacheControl);
+	EXPECT_EQ("max-age=60, immutable", headers.find("text/css; charset=utf-8")->cacheControl);
+	EXPECT_EQ("max-age=60", headers.find("text/html")->cacheControl);
+
+	CacheHeaders empty;
+	empty.build(CachePolicy(), std::map<std::string, CachePolicy>());
+	EXPECT_TRUE(empty.find("text/html") == NULL);
+}
+
+TEST(CacheHeaders, parseTimeValueUnits) {
+
+	long seconds = 0;
+	EXPECT_TRUE(parseTimeValue("30d", seconds));
+	EXPECT_EQ(30L * 86400, seconds);
+	EXPECT_TRUE(parseTimeValue("-1", seconds));
+	EXPECT_EQ(-1, seconds);
+	EXPECT_FALSE(parseTimeValue("12x", seconds));
+	EXPECT_FALSE(parseTimeValue("20y", seconds));
+}
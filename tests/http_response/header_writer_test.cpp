@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include "header_writer.hpp"
+#include "http_response.hpp"
+
+TEST(HeaderWriter, formatUnsigned) {
+
+	char digits[ULONG_DIGITS_MAX];
+	EXPECT_EQ(1u, HeaderWriter::formatUnsigned(0, digits));
+	EXPECT_STREQ("0", digits);
+	EXPECT_EQ(7u, HeaderWriter::formatUnsigned(1048576, digits));
+	EXPECT_STREQ("1048576", digits);
+}
+
+TEST(HeaderWriter, writesHeadIntoReusedBuffer) {
+
+	std::string buffer = "stale data from the previous response";
+	HeaderWriter writer(buffer);
+	writer.statusLine(206);
+	writer.header("Content-Length", 500ul);
+	writer.header("Content-Range", std::string("bytes 0-499/1234"));
+	writer.end();
+
+	EXPECT_EQ("HTTP/1.1 206 Partial Content\r\n"
+			"Content-Length: 500\r\n"
+			"Content-Range: bytes 0-499/1234\r\n"
+			"\r\n", buffer);
+}
+
+TEST(HeaderWriter, responseHeadersMatchRequestConnection) {
+
+	HttpRequest request;
+	request.parseRequest("GET /index.html HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+	HttpResponse response(request);
+	std::string path = "/www/index.html";
+	response.setPath(path);
+
+	std::string buffer;
+	response.generateHeaders(200, 42, buffer);
+	EXPECT_EQ(0u, buffer.find("HTTP/1.1 200 OK\r\n"));
+	EXPECT_NE(std::string::npos, buffer.find("Server: WebServ/1.0\r\n"));
+	EXPECT_NE(std::string::npos, buffer.find("Content-Type: text/html\r\n"));
+	EXPECT_NE(std::string::npos, buffer.find("Content-Length: 42\r\n"));
+	EXPECT_NE(std::string::npos, buffer.find("Connection: close\r\n\r\n"));
+}
+
+TEST(HeaderWriter, fileHeadersComeFromFixedSlots) {
+
+	HttpRequest request;
+	request.parseRequest("GET /app.css HTTP/1.1\r\nHost: localhost\r\n\r\n");
+	HttpResponse response(request);
+	std::string path = "/www/app.css";
+	std::string cacheControl = "max-age=60";
+	response.setPath(path);
+
+	char etag[ETAG_SIZE];
+	char lastModified[HTTP_DATE_SIZE];
+	EXPECT_EQ(15u, HttpResponse::formatETag(0x6718a2c4, 0x1f40, etag));
+	EXPECT_EQ(29u, HttpResponse::formatHttpDate(0, lastModified));
+	response.setETag(etag, true);
+	response.setLastModified(lastModified);
+	response.setCacheHeaders(&cacheControl, NULL);
+	response.setAcceptRanges();
+
+	std::string buffer;
+	response.generateHeaders(200, 10, buffer);
+	EXPECT_NE(std::string::npos, buffer.find("Content-Type: text/css\r\n"));
+	EXPECT_NE(std::string::npos, buffer.find("ETag: W/\"6718a2c4-1f40\"\r\n"));
+	EXPECT_NE(std::string::npos, buffer.find("Last-Modified: Thu, 01 Jan 1970 00:00:00 GMT\r\n"));
+	EXPECT_NE(std::string::npos, buffer.find("Cache-Control: max-age=60\r\n"));
+	EXPECT_EQ(std::string::npos, buffer.find("Expires:"));
+	EXPECT_NE(std::string::npos, buffer.find("Accept-Ranges: bytes\r\n"));
+}
@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+#include "static_response.hpp"
+
+TEST(StaticResponse, fixedRedirectIsFullyRendered) {
+
+	RedirectResponse redirect = renderRedirectResponse(301, "https://example.com/new");
+	EXPECT_FALSE(redirect.dynamic);
+	EXPECT_EQ(301, redirect.rendered.statusCode);
+	EXPECT_EQ(0u, redirect.rendered.head.find("HTTP/1.1 301 Moved Permanently\r\n"));
+	EXPECT_NE(std::string::npos, redirect.rendered.head.find("Server: WebServ/1.0\r\n"));
+	EXPECT_NE(std::string::npos, redirect.rendered.head.find("Location: https://example.com/new\r\n"));
+	EXPECT_EQ(std::string::npos, redirect.rendered.head.find("\r\n\r\n"));
+}
+
+TEST(StaticResponse, requestUriRedirectKeepsBothHalves) {
+
+	RedirectResponse redirect = renderRedirectResponse(308, "https://example.com$request_uri#top");
+	EXPECT_TRUE(redirect.dynamic);
+	EXPECT_EQ("https://example.com", redirect.before);
+	EXPECT_EQ("#top", redirect.after);
+	EXPECT_FALSE(redirect.rendered.body.empty());
+}
+
+TEST(StaticResponse, builtinPagesCoverPreBodyRejections) {
+
+	ErrorPages pages;
+	pages.build(std::map<int, std::string>());
+	const int codes[] = {403, 413, 415, 417};
+	for (size_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++) {
+		const StaticResponse* page = pages.find(codes[i]);
+		ASSERT_TRUE(page != NULL) << codes[i];
+		EXPECT_EQ(codes[i], page->statusCode);
+	}
+	EXPECT_EQ(0u, pages.find(417)->head.find("HTTP/1.1 417 Expectation Failed\r\n"));
+}
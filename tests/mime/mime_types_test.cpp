@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include "mime_types.hpp"
+
+TEST(MimeTypes, typeForPathIsCaseInsensitive) {
+
+	MimeTypes types;
+	types.addDefaults();
+	EXPECT_EQ("text/css", types.typeForPath("/static/site.css"));
+	EXPECT_EQ("image/svg+xml", types.typeForPath("/img/Logo.SVG"));
+	EXPECT_EQ("font/woff2", types.typeForPath("font.woff2"));
+	EXPECT_EQ(DEFAULT_MIME_TYPE, types.typeForPath("/archive.unknownext"));
+	EXPECT_EQ(DEFAULT_MIME_TYPE, types.typeForPath("/dir.d/README"));
+	EXPECT_EQ(DEFAULT_MIME_TYPE, types.typeForPath("/trailing."));
+}
+
+TEST(MimeTypes, extensionForTypeUsesFirstListedAndIgnoresParameters) {
+
+	MimeTypes types;
+	types.addDefaults();
+	ASSERT_TRUE(types.extensionForType("image/jpeg") != NULL);
+	EXPECT_EQ("jpg", *types.extensionForType("image/jpeg"));
+	ASSERT_TRUE(types.extensionForType(" Text/Plain; charset=utf-8") != NULL);
+	EXPECT_EQ("txt", *types.extensionForType(" Text/Plain; charset=utf-8"));
+	EXPECT_TRUE(types.extensionForType("application/x-nothing") == NULL);
+}
+
+TEST(MimeTypes, loadFileOverridesAndGrowsTable) {
+
+	const char* path = "mime_types_test.types";
+	{
+		std::ofstream out(path);
+		out << "# comment\n"
+			<< "types {\n"
+			<< "    application/javascript  js;\n"
+			<< "    model/gltf+json         gltf;\n"
+			<< "}\n"
+			<< "text/x-apache-style   apc\n";
+		for (int i = 0; i < 200; i++)
+			out << "application/x-test" << i << " t" << i << ";\n";
+	}
+	MimeTypes types;
+	types.addDefaults();
+	ASSERT_TRUE(types.loadFile(path));
+	std::remove(path);
+
+	EXPECT_EQ("application/javascript", types.typeForPath("app.js"));
+	EXPECT_EQ("model/gltf+json", types.typeForPath("scene.gltf"));
+	EXPECT_EQ("text/x-apache-style", types.typeForPath("x.apc"));
+	EXPECT_EQ("application/x-test123", types.typeForPath("file.t123"));
+	EXPECT_EQ("text/html", types.typeForPath("index.html"));
+}
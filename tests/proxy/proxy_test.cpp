@@ -0,0 +1,357 @@
+#include <gtest/gtest.h>
+#include "proxy_response.hpp"
+#include "proxy_upstream.hpp"
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static std::string feedAll(ProxyResponse& response, const std::string& data, bool oneByteAtATime) {
+	std::string out;
+	if (!oneByteAtATime) {
+		EXPECT_TRUE(response.feed(data.data(), data.size(), out));
+	}
+	for (size_t i = 0; oneByteAtATime && i < data.size(); i++) {
+		EXPECT_TRUE(response.feed(data.data() + i, 1, out));
+	}
+	return out;
+}
+
+TEST(ProxyResponseTest, ContentLengthBodyInAnyPieces) {
+	std::string upstream = "HTTP/1.1 201 Created\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\nhello";
+	for (int pieces = 0; pieces < 2; pieces++) {
+		ProxyResponse response(false);
+		EXPECT_EQ(feedAll(response, upstream, pieces == 1),
+			"Status: 201\r\nContent-Length: 5\r\nContent-Type: text/plain\r\n\r\nhello");
+		EXPECT_TRUE(response.complete());
+		EXPECT_TRUE(response.reusable());
+	}
+}
+
+TEST(ProxyResponseTest, ChunkedBodyIsUnframed) {
+	ProxyResponse response(false);
+	std::string out = feedAll(response, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+		"3;ext=1\r\nabc\r\n0A\r\n0123456789\r\n0\r\nX-Trailer: 1\r\n\r\n", true);
+	EXPECT_EQ(out, "Status: 200\r\n\r\nabc0123456789");
+	EXPECT_TRUE(response.reusable());
+}
+
+TEST(ProxyResponseTest, BodyUntilCloseEndsWithConnection) {
+	ProxyResponse response(false);
+	EXPECT_EQ(feedAll(response, "HTTP/1.0 200 OK\r\n\r\npartial", false), "Status: 200\r\n\r\npartial");
+	EXPECT_FALSE(response.complete());
+	response.closed();
+	EXPECT_TRUE(response.complete());
+	EXPECT_FALSE(response.reusable());
+}
+
+TEST(ProxyResponseTest, RawBodyCanBypassTheParser) {
+	ProxyResponse response(false);
+	std::string out;
+	std::string head = "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nabc";
+	EXPECT_EQ(response.rawBodyLeft(), 0u);
+	ASSERT_TRUE(response.feed(head.data(), head.size(), out));
+	EXPECT_EQ(response.rawBodyLeft(), 7u);
+	response.rawBodyMoved(4);
+	EXPECT_EQ(response.rawBodyLeft(), 3u);
+	EXPECT_TRUE(response.feed("def", 3, out));
+	EXPECT_TRUE(response.complete());
+	EXPECT_TRUE(response.reusable());
+	EXPECT_EQ(response.rawBodyLeft(), 0u);
+
+	// Chunked bodies have to be unframed: always parsed
+	ProxyResponse chunked(false);
+	head = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nab";
+	ASSERT_TRUE(chunked.feed(head.data(), head.size(), out));
+	EXPECT_EQ(chunked.rawBodyLeft(), 0u);
+
+	ProxyResponse untilClose(false);
+	head = "HTTP/1.0 200 OK\r\n\r\n";
+	ASSERT_TRUE(untilClose.feed(head.data(), head.size(), out));
+	EXPECT_EQ(untilClose.rawBodyLeft(), ~0UL);
+}
+
+TEST(ProxyResponseTest, SkipsInterimResponsesAndHopByHopHeaders) {
+	ProxyResponse response(false);
+	std::string out = feedAll(response, "HTTP/1.1 100 Continue\r\n\r\n"
+		"HTTP/1.1 200 OK\r\nConnection: close\r\nKeep-Alive: timeout=5\r\nServer: app\r\n"
+		"Set-Cookie: a=1\r\nContent-Length: 0\r\n\r\n", false);
+	EXPECT_EQ(out, "Status: 200\r\nContent-Length: 0\r\nSet-Cookie: a=1\r\n\r\n");
+	EXPECT_TRUE(response.complete());
+	EXPECT_FALSE(response.reusable());
+}
+
+TEST(ProxyResponseTest, HeadResponseEndsAfterHeaders) {
+	ProxyResponse response(true);
+	feedAll(response, "HTTP/1.1 200 OK\r\nContent-Length: 100\r\n\r\n", false);
+	EXPECT_TRUE(response.complete());
+	EXPECT_TRUE(response.reusable());
+}
+
+TEST(ProxyResponseTest, RejectsMalformedResponses) {
+	const char* malformed[] = {
+		"SSH-2.0-OpenSSH\r\n",
+		"HTTP/1.1 20 OK\r\n",
+		"HTTP/1.1 200 OK\r\nno colon\r\n",
+		"HTTP/1.1 200 OK\r\nContent-Length: 1\r\nContent-Length: 2\r\n",
+		"HTTP/1.1 101 Switching Protocols\r\n\r\n",
+		"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+	};
+	for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+		ProxyResponse response(false);
+		std::string out;
+		EXPECT_FALSE(response.feed(malformed[i], std::strlen(malformed[i]), out)) << malformed[i];
+	}
+}
+
+// A listening socket on a free loopback port, non-blocking so tests can check for pending connects
+static int listenLoopback(std::string& address) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in bound;
+	std::memset(&bound, 0, sizeof(bound));
+	bound.sin_family = AF_INET;
+	bound.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t length = sizeof(bound);
+	if (bind(fd, reinterpret_cast<struct sockaddr*>(&bound), sizeof(bound)) != 0 || listen(fd, 8) != 0
+		|| getsockname(fd, reinterpret_cast<struct sockaddr*>(&bound), &length) != 0) {
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	char text[32];
+	std::snprintf(text, sizeof(text), "127.0.0.1:%u", ntohs(bound.sin_port));
+	address = text;
+	return fd;
+}
+
+// Reads one request head off the connection and answers it with a keep-alive response
+static std::string serveOne(int fd, const std::string& body) {
+	std::string in;
+	char buffer[4096];
+	while (in.find("\r\n\r\n") == std::string::npos) {
+		ssize_t bytes = read(fd, buffer, sizeof(buffer));
+		if (bytes <= 0)
+			return "";
+		in.append(buffer, bytes);
+	}
+	char head[64];
+	std::snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\n\r\n",
+		static_cast<unsigned long>(body.size()));
+	std::string out = head + body;
+	write(fd, out.data(), out.size());
+	return in.substr(0, in.find("\r\n"));
+}
+
+// One round of the group's events, as the event loop would run it; false when nothing happened
+static bool step(ProxyUpstream& upstream, int timeoutMs) {
+	std::vector<struct pollfd> fds;
+	upstream.addPollFds(fds);
+	if (fds.empty() || poll(&fds[0], fds.size(), timeoutMs) <= 0)
+		return false;
+	for (size_t i = 0; i < fds.size(); i++)
+		if (fds[i].revents)
+			upstream.handleEvent(fds[i].fd, fds[i].revents);
+	return true;
+}
+
+static std::string collect(ProxyUpstream& upstream, ProxyRequest& request) {
+	std::string output;
+	char buffer[4096];
+	while (!request.outputClosed() && step(upstream, 5000)) {
+		ssize_t bytes;
+		while ((bytes = request.readOutput(buffer, sizeof(buffer))) > 0)
+			output.append(buffer, bytes);
+	}
+	return output;
+}
+
+// Which listener the request connected to: its index, the accepted fd in connection.
+// Runs the group meanwhile, so connects complete (or fail over) and the head goes out.
+static int acceptFrom(ProxyUpstream& upstream, const std::vector<int>& listeners, int& connection) {
+	for (int attempt = 0; attempt < 20; attempt++) {
+		while (step(upstream, 10))
+			;
+		for (size_t i = 0; i < listeners.size(); i++) {
+			connection = accept(listeners[i], NULL, NULL);
+			if (connection >= 0) {
+				fcntl(connection, F_SETFL, 0);
+				while (step(upstream, 10))
+					;
+				return static_cast<int>(i);
+			}
+		}
+	}
+	return -1;
+}
+
+class ProxyUpstreamTest : public ::testing::Test {
+	protected:
+		virtual void SetUp() {
+			for (int i = 0; i < 2; i++) {
+				std::string address;
+				listeners.push_back(listenLoopback(address));
+				ASSERT_GE(listeners.back(), 0);
+				config.servers.push_back(UpstreamServerConfig());
+				config.servers.back().address = address;
+			}
+			config.name = "test";
+		}
+		virtual void TearDown() {
+			for (size_t i = 0; i < listeners.size(); i++)
+				close(listeners[i]);
+		}
+
+		// Runs one GET through the group; the index of the server that got it
+		int roundTrip(ProxyUpstream& upstream, const std::string& hashKey, int& connection) {
+			ProxyRequest request(upstream, "GET / HTTP/1.1\r\nHost: test\r\n\r\n", hashKey, false, 7, ~0UL);
+			request.endInput();
+			int fresh = -1;
+			int index = acceptFrom(upstream, listeners, fresh);
+			if (index >= 0)
+				connection = fresh;
+			EXPECT_EQ(serveOne(connection, "ok"), "GET / HTTP/1.1");
+			EXPECT_EQ(collect(upstream, request), "Status: 200\r\nContent-Length: 2\r\n\r\nok");
+			EXPECT_FALSE(request.failed());
+			return index;
+		}
+
+		UpstreamConfig		config;
+		std::vector<int>	listeners;
+};
+
+TEST_F(ProxyUpstreamTest, RoundRobinFollowsWeights) {
+	config.servers[0].weight = 2;
+	config.keepalive = 0;
+	ProxyUpstream upstream(config);
+	int counts[2] = {0, 0};
+	for (int i = 0; i < 6; i++) {
+		int connection = -1;
+		int index = roundTrip(upstream, "", connection);
+		ASSERT_GE(index, 0);
+		counts[index]++;
+		close(connection);
+	}
+	EXPECT_EQ(counts[0], 4);
+	EXPECT_EQ(counts[1], 2);
+}
+
+TEST_F(ProxyUpstreamTest, KeepsConnectionForNextRequest) {
+	config.servers.pop_back();
+	ProxyUpstream upstream(config);
+	int connection = -1;
+	EXPECT_EQ(roundTrip(upstream, "", connection), 0);
+	// Served over the same connection: nothing new to accept
+	EXPECT_EQ(roundTrip(upstream, "", connection), -1);
+	EXPECT_FALSE(upstream.busy());
+	close(connection);
+}
+
+TEST_F(ProxyUpstreamTest, HashKeepsKeyOnItsServer) {
+	config.balance = BALANCE_HASH;
+	config.keepalive = 0;
+	ProxyUpstream upstream(config);
+	int seen[2] = {0, 0};
+	for (int key = 0; key < 8; key++) {
+		char text[16];
+		std::snprintf(text, sizeof(text), "/user/%d", key);
+		int connection = -1;
+		int first = roundTrip(upstream, text, connection);
+		close(connection);
+		EXPECT_EQ(roundTrip(upstream, text, connection), first);
+		close(connection);
+		ASSERT_GE(first, 0);
+		seen[first]++;
+	}
+	EXPECT_GT(seen[0], 0);
+	EXPECT_GT(seen[1], 0);
+}
+
+TEST_F(ProxyUpstreamTest, FailedServerIsMarkedDownAndRequestRetried) {
+	close(listeners[0]);
+	listeners[0] = socket(AF_INET, SOCK_STREAM, 0);   // nothing listens on its port any more
+	config.servers[0].fail_timeout = 30;
+	ProxyUpstream upstream(config);
+	for (int i = 0; i < 2; i++) {
+		int connection = -1;
+		EXPECT_EQ(roundTrip(upstream, "", connection), 1);
+		close(connection);
+	}
+	EXPECT_TRUE(upstream.serverDown(0));
+	EXPECT_FALSE(upstream.serverDown(1));
+}
+
+TEST_F(ProxyUpstreamTest, SplicesBodyToClientSocket) {
+	config.servers.pop_back();
+	ProxyUpstream upstream(config);
+	ProxyRequest request(upstream, "GET / HTTP/1.1\r\nHost: test\r\n\r\n", "", false, 7, ~0UL);
+	request.endInput();
+	int connection = -1;
+	ASSERT_EQ(acceptFrom(upstream, listeners, connection), 0);
+	std::string body(300000, 'y');
+	std::string in;
+	char buffer[65536];
+	while (in.find("\r\n\r\n") == std::string::npos) {
+		ssize_t bytes = read(connection, buffer, sizeof(buffer));
+		ASSERT_GT(bytes, 0);
+		in.append(buffer, bytes);
+	}
+	std::string head = "HTTP/1.1 200 OK\r\nContent-Length: 300000\r\n\r\n";
+	ASSERT_EQ(write(connection, head.data(), head.size()), static_cast<ssize_t>(head.size()));
+
+	// Head through the parser, as the relay reads it; the body is spliced from there
+	std::string output;
+	while (output.find("\r\n\r\n") == std::string::npos && step(upstream, 5000)) {
+		ssize_t bytes;
+		while ((bytes = request.readOutput(buffer, sizeof(buffer))) > 0)
+			output.append(buffer, bytes);
+	}
+	EXPECT_EQ(output, "Status: 200\r\nContent-Length: 300000\r\n\r\n");
+	ASSERT_TRUE(request.startSplice());
+	fcntl(connection, F_SETFL, O_NONBLOCK);
+	int sockets[2];
+	ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+	fcntl(sockets[0], F_SETFL, O_NONBLOCK);
+	fcntl(sockets[1], F_SETFL, O_NONBLOCK);
+
+	size_t written = 0;
+	std::string received;
+	for (int round = 0; round < 10000 && received.size() < body.size(); round++) {
+		if (written < body.size()) {
+			ssize_t bytes = write(connection, body.data() + written, body.size() - written);
+			if (bytes > 0)
+				written += bytes;
+		}
+		step(upstream, 10);
+		ssize_t moved;
+		while ((moved = request.spliceOutput(sockets[0], CGI_SPLICE_MAX)) > 0)
+			;
+		ASSERT_NE(moved, CGI_SPLICE_FAILED);
+		ssize_t bytes;
+		while ((bytes = read(sockets[1], buffer, sizeof(buffer))) > 0)
+			received.append(buffer, bytes);
+	}
+	EXPECT_EQ(received, body);
+	EXPECT_EQ(request.spliceOutput(sockets[0], CGI_SPLICE_MAX), 0);
+	EXPECT_TRUE(request.outputClosed());
+	EXPECT_FALSE(request.failed());
+	EXPECT_FALSE(upstream.busy());   // complete and back with the idle connections
+	close(sockets[0]);
+	close(sockets[1]);
+	close(connection);
+}
+
+TEST(ProxyUpstreamSingleTest, UnreachableServerFailsRequest) {
+	UpstreamConfig config;
+	config.name = "gone";
+	config.servers.push_back(UpstreamServerConfig());
+	config.servers.back().address = "unix:/nonexistent/webserv.sock";
+	ProxyUpstream upstream(config);
+	ProxyRequest request(upstream, "GET / HTTP/1.1\r\n\r\n", "", false, 3, ~0UL);
+	EXPECT_TRUE(request.outputClosed());
+	EXPECT_TRUE(request.failed());
+	EXPECT_FALSE(upstream.busy());
+}
@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+#include "response_cache.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <fcntl.h>
+
+static CacheHeaderList headerList(const char* name, const char* value) {
+	CacheHeaderList headers;
+	headers.push_back(std::make_pair(std::string("Content-Type"), std::string("text/plain")));
+	if (name)
+		headers.push_back(std::make_pair(std::string(name), std::string(value)));
+	return headers;
+}
+
+TEST(ResponseCacheFreshnessTest, CacheControlExpiresAndDefault) {
+	const time_t now = 1000000;
+	time_t expires = 0;
+	time_t staleUntil = 0;
+
+	EXPECT_TRUE(ResponseCache::freshness(200, headerList("Cache-Control", "public, max-age=60"), now, 0, expires, staleUntil));
+	EXPECT_EQ(expires, now + 60);
+	EXPECT_EQ(staleUntil, now + 60);
+	EXPECT_TRUE(ResponseCache::freshness(200, headerList("Cache-Control", "max-age=60, s-maxage=\"5\""), now, 0, expires, staleUntil));
+	EXPECT_EQ(expires, now + 5);
+	EXPECT_TRUE(ResponseCache::freshness(200, headerList("Cache-Control", "max-age=10, stale-while-revalidate=30"),
+		now, 0, expires, staleUntil));
+	EXPECT_EQ(staleUntil, now + 40);
+
+	CacheHeaderList dated = headerList("Date", "Sun, 06 Nov 1994 08:49:37 GMT");
+	dated.push_back(std::make_pair(std::string("Expires"), std::string("Sun, 06 Nov 1994 08:59:37 GMT")));
+	EXPECT_TRUE(ResponseCache::freshness(200, dated, now, 0, expires, staleUntil));
+	EXPECT_EQ(expires, now + 600);
+
+	// proxy_cache_valid only for 200/301/302 without freshness of their own
+	EXPECT_TRUE(ResponseCache::freshness(302, headerList(NULL, NULL), now, 30, expires, staleUntil));
+	EXPECT_EQ(expires, now + 30);
+	EXPECT_FALSE(ResponseCache::freshness(404, headerList(NULL, NULL), now, 30, expires, staleUntil));
+	EXPECT_FALSE(ResponseCache::freshness(200, headerList(NULL, NULL), now, 0, expires, staleUntil));
+	EXPECT_TRUE(ResponseCache::freshness(404, headerList("Cache-Control", "max-age=5"), now, 0, expires, staleUntil));
+	EXPECT_FALSE(ResponseCache::freshness(500, headerList("Cache-Control", "max-age=5"), now, 0, expires, staleUntil));
+}
+
+TEST(ResponseCacheFreshnessTest, UncacheableResponses) {
+	const char* headers[][2] = {
+		{"Cache-Control", "no-store"}, {"Cache-Control", "private, max-age=60"}, {"cache-control", "No-Cache"},
+		{"Cache-Control", "max-age=0"}, {"Expires", "0"}, {"Set-Cookie", "session=1"}, {"Vary", "Accept-Encoding"},
+	};
+	for (size_t i = 0; i < sizeof(headers) / sizeof(headers[0]); i++) {
+		time_t expires = 0;
+		time_t staleUntil = 0;
+		EXPECT_FALSE(ResponseCache::freshness(200, headerList(headers[i][0], headers[i][1]), 1000, 60, expires, staleUntil))
+			<< headers[i][0] << ": " << headers[i][1];
+	}
+}
+
+class ResponseCacheTest : public ::testing::Test {
+
+	protected:
+		void SetUp() {
+			char tmpl[] = "/tmp/response_cache_testXXXXXX";
+			directory = mkdtemp(tmpl);
+		}
+		void TearDown() {
+			std::string cmd = "rm -rf " + directory;
+			system(cmd.c_str());
+		}
+
+		bool store(ResponseCache& cache, const std::string& key, const std::string& body, time_t now, time_t expires) {
+			CacheFill* fill = cache.open(key, 200, headerList("X-Key", key.c_str()), now, expires, expires);
+			if (!fill)
+				return false;
+			fill->write(body.data(), body.size());
+			return cache.commit(fill);
+		}
+
+		std::string body(const CacheEntry& entry) {
+			std::ifstream file(entry.file.c_str(), std::ios::binary);
+			std::stringstream content;
+			content << file.rdbuf();
+			return content.str().substr(entry.bodyOffset, entry.bodyLength);
+		}
+
+		std::string directory;
+};
+
+TEST_F(ResponseCacheTest, StoresFindsAndPurges) {
+	ResponseCache cache(directory, 1 << 20);
+	EXPECT_TRUE(cache.find("GET host/a", 100) == NULL);
+	ASSERT_TRUE(store(cache, "GET host/a", "hello", 100, 160));
+
+	const CacheEntry* entry = cache.find("GET host/a", 150);
+	ASSERT_TRUE(entry != NULL);
+	EXPECT_EQ(entry->status, 200);
+	EXPECT_EQ(entry->headers, "Content-Type: text/plain\r\nX-Key: GET host/a\r\n");
+	EXPECT_EQ(body(*entry), "hello");
+	EXPECT_TRUE(cache.find("GET host/b", 150) == NULL);
+
+	// Past its stale window the entry is gone, file and all
+	EXPECT_TRUE(cache.find("GET host/a", 160) == NULL);
+	EXPECT_EQ(cache.count(), 0u);
+	EXPECT_EQ(cache.size(), 0u);
+
+	ASSERT_TRUE(store(cache, "GET host/a", "again", 100, 160));
+	EXPECT_TRUE(cache.purge("GET host/a"));
+	EXPECT_FALSE(cache.purge("GET host/a"));
+	EXPECT_NE(access((directory + "/" + ResponseCache::fileName("GET host/a")).c_str(), F_OK), 0);
+}
+
+TEST_F(ResponseCacheTest, AbortedAndOversizedFillsLeaveNothing) {
+	ResponseCache cache(directory, 200);
+	CacheFill* fill = cache.open("GET host/a", 200, headerList(NULL, NULL), 100, 160, 160);
+	ASSERT_TRUE(fill != NULL);
+	fill->write("partial", 7);
+	cache.abort(fill);
+
+	fill = cache.open("GET host/b", 200, headerList(NULL, NULL), 100, 160, 160);
+	ASSERT_TRUE(fill != NULL);
+	EXPECT_FALSE(fill->write(std::string(300, 'x').data(), 300));
+	EXPECT_FALSE(cache.commit(fill));
+	EXPECT_EQ(cache.count(), 0u);
+	EXPECT_EQ(system(("test -z \"$(ls -A " + directory + ")\"").c_str()), 0);
+}
+
+TEST_F(ResponseCacheTest, ReloadsDirectoryAtStartup) {
+	time_t now = time(NULL);
+	{
+		ResponseCache cache(directory, 1 << 20);
+		ASSERT_TRUE(store(cache, "GET host/kept", "body", now, now + 600));
+		ASSERT_TRUE(store(cache, "GET host/expired", "old", now - 600, now - 1));
+		CacheFill* unfinished = cache.open("GET host/interrupted", 200, headerList(NULL, NULL), now, now + 600, now + 600);
+		ASSERT_TRUE(unfinished != NULL);
+		delete unfinished;
+	}
+	ResponseCache cache(directory, 1 << 20);
+	EXPECT_EQ(cache.count(), 1u);
+	const CacheEntry* entry = cache.find("GET host/kept", now);
+	ASSERT_TRUE(entry != NULL);
+	EXPECT_EQ(body(*entry), "body");
+	EXPECT_EQ(entry->expires, now + 600);
+	// The expired entry and the temporary file of the unfinished one were deleted
+	EXPECT_EQ(system(("test $(ls -A " + directory + " | wc -l) -eq 1").c_str()), 0);
+}
+
+TEST_F(ResponseCacheTest, EvictsLeastRecentlyUsed) {
+	std::string payload(100, 'x');
+	ResponseCache cache(directory, 600);
+	ASSERT_TRUE(store(cache, "GET host/1", payload, 100, 200));
+	ASSERT_TRUE(store(cache, "GET host/2", payload, 100, 200));
+	ASSERT_TRUE(store(cache, "GET host/3", payload, 100, 200));
+	ASSERT_TRUE(cache.find("GET host/1", 150) != NULL);   // now more recent than 2
+	ASSERT_TRUE(store(cache, "GET host/4", payload, 100, 200));
+
+	EXPECT_LE(cache.size(), 600u);
+	EXPECT_TRUE(cache.find("GET host/2", 150) == NULL);
+	EXPECT_TRUE(cache.find("GET host/1", 150) != NULL);
+	EXPECT_TRUE(cache.find("GET host/4", 150) != NULL);
+}
+
+TEST_F(ResponseCacheTest, CoalescesMissesOnALock) {
+	ResponseCache cache(directory, 1 << 20);
+	EXPECT_TRUE(cache.lock("GET host/a"));
+	EXPECT_FALSE(cache.lock("GET host/a"));
+	EXPECT_TRUE(cache.locked("GET host/a"));
+	cache.wait("GET host/a", 7);
+	cache.wait("GET host/a", 8);
+	cache.wait("GET host/a", 9);
+	cache.stopWaiting(8);
+
+	std::vector<int> waiters;
+	cache.unlock("GET host/a", waiters);
+	ASSERT_EQ(waiters.size(), 2u);
+	EXPECT_EQ(waiters[0], 7);
+	EXPECT_EQ(waiters[1], 9);
+	EXPECT_FALSE(cache.locked("GET host/a"));
+	EXPECT_TRUE(cache.lock("GET host/a"));
+
+	cache.pass("GET host/b", 100);
+	EXPECT_TRUE(cache.passing("GET host/b", 100 + RESPONSE_CACHE_PASS_SECONDS - 1));
+	EXPECT_FALSE(cache.passing("GET host/b", 100 + RESPONSE_CACHE_PASS_SECONDS));
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include "regex_set.hpp"
+
+static RegexSet compiled(const char* const* patterns, size_t count, bool caseless = false) {
+
+	RegexSet set;
+	std::string error;
+	for (size_t i = 0; i < count; i++)
+		EXPECT_TRUE(set.add(patterns[i], caseless, error)) << patterns[i] << ": " << error;
+	set.compile();
+	return set;
+}
+
+TEST(RegexSet, firstPatternInOrderWins) {
+
+	const char* patterns[] = { "\\.php$", "^/images/", "\\.(jpe?g|png|gif)$", "^/a{2,3}b$", "/(?:v\\d+)/[^/]+$", "^$" };
+	RegexSet set = compiled(patterns, 6);
+	EXPECT_TRUE(set.deterministic());
+	EXPECT_EQ(6u, set.size());
+
+	EXPECT_EQ(0, set.match("/index.php"));
+	EXPECT_EQ(0, set.match("/images/x.php"));   // both match: the first added wins
+	EXPECT_EQ(1, set.match("/images/x.png"));
+	EXPECT_EQ(2, set.match("/photo.jpeg"));
+	EXPECT_EQ(-1, set.match("/index.php5"));
+	EXPECT_EQ(-1, set.match("/x/images/"));
+	EXPECT_EQ(3, set.match("/aab"));
+	EXPECT_EQ(3, set.match("/aaab"));
+	EXPECT_EQ(-1, set.match("/aaaab"));
+	EXPECT_EQ(4, set.match("/api/v12/users"));
+	EXPECT_EQ(-1, set.match("/api/v12/users/1/"));
+	EXPECT_EQ(5, set.match(""));
+	EXPECT_EQ(-1, RegexSet().match("/anything"));
+}
+
+TEST(RegexSet, caselessAndClasses) {
+
+	const char* patterns[] = { "\\.JPG$", "^/[[:digit:]]+[-_.]x\\x41$", "[]]", "(?i)^/static/" };
+	RegexSet caseless = compiled(patterns, 1, true);
+	EXPECT_EQ(0, caseless.match("/a.jpg"));
+	EXPECT_EQ(0, caseless.match("/a.JpG"));
+
+	RegexSet set = compiled(patterns, 4);
+	EXPECT_EQ(-1, set.match("/a.jpg"));
+	EXPECT_EQ(1, set.match("/2024-xA"));
+	EXPECT_EQ(-1, set.match("/2024:xA"));
+	EXPECT_EQ(2, set.match("/a]b"));
+	EXPECT_EQ(3, set.match("/STATIC/app.js"));
+}
+
+TEST(RegexSet, refusesWhatItCannotMatch) {
+
+	const char* patterns[] = { "(a", "a)", "*a", "a**", "\\1", "(?=x)", "(?<!x)y", "\\bword", "a++",
+		"[z-a]", "[abc", "a{3,2}", "a{300}", "[[:nope:]]", "((a{200}){200}){200}", "x\\" };
+	for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+		RegexSet set;
+		std::string error;
+		EXPECT_FALSE(set.add(patterns[i], false, error)) << patterns[i];
+		EXPECT_FALSE(error.empty()) << patterns[i];
+	}
+	// A '{' that is no quantifier is a literal, and a named group a plain one
+	const char* literal[] = { "a{,2}", "(?<name>x)y", "(?P<n>z)" };
+	RegexSet set = compiled(literal, 3);
+	EXPECT_EQ(0, set.match("a{,2}"));
+	EXPECT_EQ(1, set.match("-xy-"));
+	EXPECT_EQ(2, set.match("z"));
+}
+
+// Past REGEX_DFA_STATES_MAX the NFA is run instead, with the same answers
+TEST(RegexSet, largeSetFallsBackToNfa) {
+
+	RegexSet set;
+	std::string error;
+	ASSERT_TRUE(set.add("a.{14}$", false, error));
+	ASSERT_TRUE(set.add("b[^/]*$", false, error));
+	set.compile();
+	EXPECT_FALSE(set.deterministic());
+	EXPECT_EQ(0, set.match("xa12345678901234"));
+	EXPECT_EQ(-1, set.match("xa1234567890123"));
+	EXPECT_EQ(1, set.match("/b/cb"));
+	EXPECT_EQ(-1, set.match("/b/c"));
+}
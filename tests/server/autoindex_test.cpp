@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include "autoindex.hpp"
+
+static DirectoryEntry makeEntry(const std::string& name, bool isDirectory, off_t size) {
+
+	DirectoryEntry entry;
+	entry.name = name;
+	entry.isDirectory = isDirectory;
+	entry.size = size;
+	entry.mtime = 0;
+	return entry;
+}
+
+TEST(Autoindex, parseQueryClampsAndDefaults) {
+
+	AutoindexPage page = parseAutoindexQuery("page=3&limit=5000&format=json", false);
+	EXPECT_EQ(AUTOINDEX_JSON, page.format);
+	EXPECT_EQ(3u, page.page);
+	EXPECT_EQ(static_cast<size_t>(AUTOINDEX_MAX_LIMIT), page.limit);
+
+	page = parseAutoindexQuery("page=0&limit=abc", false);
+	EXPECT_EQ(AUTOINDEX_HTML, page.format);
+	EXPECT_EQ(1u, page.page);
+	EXPECT_EQ(static_cast<size_t>(AUTOINDEX_DEFAULT_LIMIT), page.limit);
+}
+
+TEST(Autoindex, jsonPageSlicesSnapshot) {
+
+	DirectorySnapshot snapshot;
+	snapshot.entries.push_back(makeEntry("docs", true, 4096));
+	snapshot.entries.push_back(makeEntry("a.txt", false, 10));
+	snapshot.entries.push_back(makeEntry("b \"quoted\".txt", false, 20));
+
+	AutoindexPage page = parseAutoindexQuery("page=2&limit=2", true);
+	std::string json = renderAutoindexJson(snapshot, "/uploads", page);
+	EXPECT_EQ("{\"path\":\"/uploads/\",\"page\":2,\"limit\":2,\"pages\":2,\"total\":3,\"entries\":["
+		"{\"name\":\"b \\\"quoted\\\".txt\",\"type\":\"file\",\"size\":20,\"mtime\":0}]}\n", json);
+}
+
+TEST(Autoindex, htmlEscapesNamesAndEncodesLinks) {
+
+	DirectorySnapshot snapshot;
+	snapshot.entries.push_back(makeEntry("<x> y.txt", false, 1));
+
+	std::string html = renderAutoindexHtml(snapshot, "/files/", parseAutoindexQuery("", false));
+	EXPECT_NE(std::string::npos, html.find("<a href=\"/files/%3Cx%3E%20y.txt\">&lt;x&gt; y.txt</a>"));
+	EXPECT_NE(std::string::npos, html.find("<a href=\"../\">../</a>"));
+}
+
+TEST(Autoindex, htmlEscapesTheRequestPathInLinks) {
+
+	DirectorySnapshot snapshot;
+	for (int i = 0; i < 3; i++)
+		snapshot.entries.push_back(makeEntry(std::string(1, static_cast<char>('a' + i)), false, 1));
+
+	std::string html = renderAutoindexHtml(snapshot, "/x\"><script>/", parseAutoindexQuery("page=2&limit=1", false));
+	EXPECT_EQ(std::string::npos, html.find("<script>"));
+	EXPECT_EQ(std::string::npos, html.find("href=\"/x\">"));
+	EXPECT_NE(std::string::npos, html.find("<a href=\"/x&quot;&gt;&lt;script&gt;/b\">b</a>"));
+	EXPECT_NE(std::string::npos, html.find("<a href=\"/x&quot;&gt;&lt;script&gt;/?page=1&amp;limit=1\">"));
+	EXPECT_NE(std::string::npos, html.find("<a href=\"/x&quot;&gt;&lt;script&gt;/?page=3&amp;limit=1\">"));
+}
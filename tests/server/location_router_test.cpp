@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include "location_router.hpp"
+#include <cstdio>
+#include <cstring>
+
+static LocationConfig makeLocation(const std::string& path, const char* methods) {
+
+	LocationConfig location;
+	location.path = path;
+	location.root = "/tmp";
+	location.allow_methods.clear();
+	char copy[64];
+	std::snprintf(copy, sizeof(copy), "%s", methods);
+	for (char* method = std::strtok(copy, " "); method; method = std::strtok(NULL, " "))
+		location.allow_methods.push_back(method);
+	return location;
+}
+
+// The linear scan the trie replaces, boundary rule included
+static int linearMatch(const std::vector<LocationConfig>& locations, const std::string& path) {
+
+	int best = -1;
+	size_t longest = 0;
+	for (size_t i = 0; i < locations.size(); i++) {
+		const std::string& prefix = locations[i].path;
+		if (path.compare(0, prefix.size(), prefix) != 0 || (best >= 0 && prefix.size() <= longest))
+			continue;
+		if (path.size() == prefix.size() || path[prefix.size()] == '/' || prefix[prefix.size() - 1] == '/') {
+			best = static_cast<int>(i);
+			longest = prefix.size();
+		}
+	}
+	return best;
+}
+
+TEST(LocationRouter, longestPrefixAtPathBoundary) {
+
+	std::vector<LocationConfig> locations;
+	locations.push_back(makeLocation("/", "GET"));
+	locations.push_back(makeLocation("/api", "GET"));
+	locations.push_back(makeLocation("/api/v1", "GET"));
+	locations.push_back(makeLocation("/apiary/", "GET"));
+	locations.push_back(makeLocation("/api", "POST"));   // same path again: the first one wins
+	LocationRouter router;
+	router.build(locations);
+
+	EXPECT_EQ(0, router.match("/"));
+	EXPECT_EQ(0, router.match("/index.html"));
+	EXPECT_EQ(1, router.match("/api"));
+	EXPECT_EQ(1, router.match("/api/users"));
+	EXPECT_EQ(0, router.match("/apix"));
+	EXPECT_EQ(2, router.match("/api/v1/users"));
+	EXPECT_EQ(1, router.match("/api/v10"));
+	EXPECT_EQ(3, router.match("/apiary/hive"));
+	EXPECT_EQ(0, router.match("/apiary"));
+	EXPECT_EQ(-1, router.match(""));
+
+	LocationRouter empty;
+	empty.build(std::vector<LocationConfig>());
+	EXPECT_EQ(-1, empty.match("/anything"));
+}
+
+TEST(LocationRouter, agreesWithLinearScanOnManyLocations) {
+
+	std::vector<LocationConfig> locations;
+	char path[64];
+	for (int i = 0; i < 2000; i++) {
+		std::snprintf(path, sizeof(path), "/t%d/s%d%s", i % 37, i, (i % 5 == 0) ? "/" : "");
+		locations.push_back(makeLocation(path, "GET"));
+		if (i % 37 == i)
+			locations.push_back(makeLocation(std::string(path, path + std::string(path).find('/', 1)), "GET"));
+	}
+	LocationRouter router;
+	router.build(locations);
+	const char* requests[] = { "/t3/s3", "/t3/s39", "/t3/s40/x", "/t5/s5/", "/t5/s5/deep/file", "/t5/s55x", "/t36",
+		"/t36/unknown", "/t1/s1000/a", "/t0/s0", "/t0/s0x", "/nowhere", "/t12/s1197/" };
+	for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++)
+		EXPECT_EQ(linearMatch(locations, requests[i]), router.match(requests[i])) << requests[i];
+}
+
+TEST(LocationRouter, methodMasks) {
+
+	std::vector<LocationConfig> locations;
+	locations.push_back(makeLocation("/read", "GET"));
+	locations.push_back(makeLocation("/write", "POST DELETE"));
+	LocationRouter router;
+	router.build(locations);
+
+	EXPECT_TRUE(router.allows(0, GET));
+	EXPECT_TRUE(router.allows(0, HEAD));      // implied by GET
+	EXPECT_TRUE(router.allows(0, OPTIONS));   // always answered
+	EXPECT_FALSE(router.allows(0, POST));
+	EXPECT_TRUE(router.allows(1, DELETE));
+	EXPECT_FALSE(router.allows(1, HEAD));
+	EXPECT_FALSE(router.allows(1, PURGE));
+	EXPECT_GE(router.route(0).rootFd, 0);
+	EXPECT_EQ(router.route(0).rootFd, router.rootDirectory(0));
+}
+
+TEST(LocationRouter, nginxPrecedence) {
+
+	std::vector<LocationConfig> locations;
+	locations.push_back(makeLocation("/", "GET"));
+	locations.push_back(makeLocation("/static", "GET"));
+	locations.back().match = LOCATION_PREFIX_NO_REGEX;
+	locations.push_back(makeLocation("/app", "GET"));
+	locations.push_back(makeLocation("/app/status", "GET"));
+	locations.back().match = LOCATION_EXACT;
+	locations.push_back(makeLocation("\\.php$", "GET POST"));
+	locations.back().match = LOCATION_REGEX;
+	locations.push_back(makeLocation("\\.(png|JPG)$", "GET"));
+	locations.back().match = LOCATION_REGEX_CASELESS;
+	locations.push_back(makeLocation("^/app/.*\\.php$", "GET"));   // after \.php$: never reached
+	locations.back().match = LOCATION_REGEX;
+	LocationRouter router;
+	router.build(locations);
+
+	EXPECT_EQ(3, router.match("/app/status"));        // exact beats everything
+	EXPECT_EQ(2, router.match("/app/status/more"));   // exact is the whole path only
+	EXPECT_EQ(4, router.match("/app/index.php"));     // regex beats the longest prefix, first regex wins
+	EXPECT_EQ(1, router.match("/static/run.php"));    // ^~ stops the regexes
+	EXPECT_EQ(5, router.match("/img/a.jpg"));
+	EXPECT_EQ(5, router.match("/img/a.PNG"));
+	EXPECT_EQ(2, router.match("/app/page"));
+	EXPECT_EQ(0, router.match("/other"));
+	EXPECT_EQ(4, router.match("nothing-prefixed.php"));
+	EXPECT_TRUE(router.allows(4, POST));
+	EXPECT_EQ(3u, router.regexes().size());
+}
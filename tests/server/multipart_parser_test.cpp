@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include "multipart_parser.hpp"
+#include <vector>
+
+class RecordingSink : public MultipartSink {
+
+	public:
+		bool partBegin(const MultipartPart& part) { parts.push_back(part); bodies.push_back(""); return true; }
+		bool partData(const char* data, size_t length) { bodies.back().append(data, length); return true; }
+		bool partEnd() { ended++; return true; }
+
+		RecordingSink() : ended(0) {}
+		std::vector<MultipartPart>	parts;
+		std::vector<std::string>	bodies;
+		int							ended;
+};
+
+static const std::string BODY =
+	"preamble\r\n"
+	"--XyZ\r\n"
+	"Content-Disposition: form-data; name=\"user\"\r\n"
+	"\r\n"
+	"bob\r\n"
+	"--XyZ\r\n"
+	"content-disposition: form-data; name=\"file\"; filename=\"a.bin\"\r\n"
+	"Content-Type: application/octet-stream\r\n"
+	"\r\n"
+	"\r\n--XyA-not-yet\r\n--Xy\r\n"
+	"--XyZ--\r\n"
+	"epilogue";
+
+static void expectParsed(const RecordingSink& sink) {
+
+	ASSERT_EQ(2u, sink.parts.size());
+	EXPECT_EQ(2, sink.ended);
+	EXPECT_EQ("user", sink.parts[0].name);
+	EXPECT_EQ("", sink.parts[0].filename);
+	EXPECT_EQ("bob", sink.bodies[0]);
+	EXPECT_EQ("file", sink.parts[1].name);
+	EXPECT_EQ("a.bin", sink.parts[1].filename);
+	EXPECT_EQ("application/octet-stream", sink.parts[1].contentType);
+	EXPECT_EQ("\r\n--XyA-not-yet\r\n--Xy", sink.bodies[1]);
+}
+
+TEST(MultipartParser, parsesWholeBody) {
+
+	RecordingSink sink;
+	MultipartParser parser("XyZ", sink);
+	EXPECT_TRUE(parser.feed(BODY.data(), BODY.size()));
+	EXPECT_TRUE(parser.finished());
+	expectParsed(sink);
+}
+
+TEST(MultipartParser, delimitersSplitAcrossEveryChunkSize) {
+
+	for (size_t chunk = 1; chunk < BODY.size(); chunk++) {
+		RecordingSink sink;
+		MultipartParser parser("XyZ", sink);
+		for (size_t pos = 0; pos < BODY.size(); pos += chunk)
+			ASSERT_TRUE(parser.feed(BODY.data() + pos, std::min(chunk, BODY.size() - pos)));
+		ASSERT_TRUE(parser.finished()) << "chunk size " << chunk;
+		expectParsed(sink);
+	}
+}
+
+TEST(MultipartParser, rejectsMalformedDelimiterAndMissingEnd) {
+
+	RecordingSink sink;
+	MultipartParser parser("XyZ", sink);
+	std::string body = "--XyZ\r\nContent-Disposition: form-data; name=\"a\"\r\n\r\nx\r\n--XyZjunk";
+	EXPECT_FALSE(parser.feed(body.data(), body.size()));
+	EXPECT_TRUE(parser.failed());
+
+	RecordingSink truncated;
+	MultipartParser open("XyZ", truncated);
+	std::string partial = "--XyZ\r\n\r\nabc";
+	EXPECT_TRUE(open.feed(partial.data(), partial.size()));
+	EXPECT_FALSE(open.finished());
+}
+
+TEST(MultipartParser, boundaryFromContentType) {
+
+	EXPECT_EQ("abc", MultipartParser::boundaryFromContentType("multipart/form-data; boundary=abc"));
+	EXPECT_EQ("a b", MultipartParser::boundaryFromContentType("multipart/form-data; boundary=\"a b\"; charset=x"));
+	EXPECT_EQ("", MultipartParser::boundaryFromContentType("multipart/form-data"));
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include "path_beneath.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+class PathBeneathTest : public ::testing::Test {
+
+	protected:
+		void SetUp() {
+			char tmpl[] = "/tmp/path_beneath_testXXXXXX";
+			base = mkdtemp(tmpl);
+			system(("mkdir -p " + base + "/root/dir/sub && echo inside > " + base + "/root/dir/file.txt"
+				+ " && echo outside > " + base + "/secret.txt").c_str());
+			rootFd = open((base + "/root").c_str(), PATH_BENEATH_DIRECTORY);
+		}
+		void TearDown() {
+			close(rootFd);
+			system(("rm -rf " + base).c_str());
+		}
+		std::string read(int fd) {
+			char buffer[64];
+			ssize_t n = ::read(fd, buffer, sizeof(buffer));
+			close(fd);
+			return (n > 0) ? std::string(buffer, n) : "";
+		}
+		// errno of a refused open, 0 when it opened
+		int refused(const std::string& path, int flags = O_RDONLY) {
+			int fd = openBeneath(rootFd, path, flags);
+			if (fd >= 0) {
+				close(fd);
+				return 0;
+			}
+			return errno;
+		}
+
+		std::string base;
+		int rootFd;
+};
+
+TEST_F(PathBeneathTest, OpensInsideTheRoot) {
+	EXPECT_EQ("inside\n", read(openBeneath(rootFd, "/dir/file.txt", O_RDONLY)));
+	EXPECT_EQ("inside\n", read(openBeneath(rootFd, "dir//sub/../file.txt", O_RDONLY)));
+	EXPECT_EQ(0, refused("", PATH_BENEATH_DIRECTORY));
+	EXPECT_EQ(ENOENT, refused("/dir/missing.txt"));
+	EXPECT_EQ(ENOTDIR, refused("/dir/file.txt/x"));
+
+	int fd = openBeneath(rootFd, "/dir/file.txt", O_RDONLY);
+	ASSERT_GE(fd, 0);
+	EXPECT_TRUE(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+	close(fd);
+}
+
+TEST_F(PathBeneathTest, RefusesEveryWayOut) {
+	ASSERT_EQ(0, symlink((base + "/secret.txt").c_str(), (base + "/root/absolute").c_str()));
+	ASSERT_EQ(0, symlink("../../secret.txt", (base + "/root/dir/relative").c_str()));
+	ASSERT_EQ(0, symlink("/proc/self/root", (base + "/root/magic").c_str()));
+
+	EXPECT_NE(0, refused("../secret.txt"));
+	EXPECT_NE(0, refused("dir/../../secret.txt"));
+	EXPECT_NE(0, refused("absolute"));
+	EXPECT_NE(0, refused("absolute", PATH_BENEATH_LOOKUP));
+	EXPECT_NE(0, refused("dir/relative"));
+	EXPECT_NE(0, refused("magic/etc/hostname"));
+	EXPECT_EQ(-1, openBeneath(-1, "dir/file.txt", O_RDONLY));   // a root that never opened
+	EXPECT_EQ(EBADF, errno);
+}
+
+TEST_F(PathBeneathTest, UnlinksWithoutFollowing) {
+	ASSERT_EQ(0, symlink((base + "/secret.txt").c_str(), (base + "/root/link").c_str()));
+
+	EXPECT_EQ(0, unlinkBeneath(rootFd, "/link"));
+	EXPECT_EQ(0, access((base + "/secret.txt").c_str(), F_OK));   // the link went, not its target
+	EXPECT_EQ(0, unlinkBeneath(rootFd, "dir/file.txt"));
+	EXPECT_EQ(0, unlinkBeneath(rootFd, "dir/sub/"));
+	EXPECT_NE(0, access((base + "/root/dir/sub").c_str(), F_OK));
+	EXPECT_EQ(-1, unlinkBeneath(rootFd, "dir/missing"));
+	EXPECT_EQ(ENOENT, errno);
+	EXPECT_EQ(-1, unlinkBeneath(rootFd, "/"));
+	EXPECT_EQ(-1, unlinkBeneath(rootFd, "../secret.txt"));
+	EXPECT_EQ(0, access((base + "/secret.txt").c_str(), F_OK));
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include "server.hpp"
+#include "config.hpp"
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <fstream>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define REQUEST_BODY_TEST_PORT 18472
+
+// A Server on a loopback port, driven one event at a time without a poll loop
+class RequestBodyTest : public ::testing::Test {
+
+	protected:
+		void SetUp() {
+			client = -1;
+			char tmpl[] = "/tmp/request_body_testXXXXXX";
+			base = mkdtemp(tmpl);
+			system(("mkdir -p " + base + "/conf " + base + "/www/uploads " + base + "/logs"
+				+ " && touch " + base + "/www/index.html").c_str());
+			char cwd[4096];
+			previous = getcwd(cwd, sizeof(cwd)) ? cwd : ".";
+			ASSERT_EQ(0, chdir(base.c_str()));
+
+			std::ofstream file("conf/test.conf");
+			file << "server {\n"
+				"    listen 127.0.0.1:" << REQUEST_BODY_TEST_PORT << "\n"
+				"    server_name localhost\n"
+				"    backlog 16\n"
+				"    max_clients 16\n"
+				"    access_log logs/access.log\n"
+				"    error_log logs/error.log\n"
+				"    root www/\n"
+				"    index www/index.html\n"
+				"    client_max_body_size 1024\n"
+				"    location /uploads {\n"
+				"        root www/uploads/\n"
+				"        allow_methods GET POST\n"
+				"    }\n"
+				"}\n";
+			file.close();
+			Config config;
+			char name[] = "test.conf";
+			config.parseConfig(name);
+			server = new Server(config.getServers()[0]);
+		}
+		void TearDown() {
+			if (client >= 0)
+				close(client);
+			delete server;
+			EXPECT_EQ(0, chdir(previous.c_str()));
+			system(("rm -rf " + base).c_str());
+		}
+
+		// Connects and lets the server accept; returns the server side fd
+		int connectClient() {
+			client = socket(AF_INET, SOCK_STREAM, 0);
+			sockaddr_in address = sockaddr_in();
+			address.sin_family = AF_INET;
+			address.sin_port = htons(REQUEST_BODY_TEST_PORT);
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			if (connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+				return -1;
+			server->handleEvent(server->getListeningSockets()[0].getFd(), POLLIN);
+			return server->getClients().empty() ? -1 : server->getClients().begin()->first;
+		}
+
+		// Sends raw in one write, then runs one read and one write event
+		std::string exchange(int fd, const std::string& raw) {
+			EXPECT_EQ(static_cast<ssize_t>(raw.size()), send(client, raw.data(), raw.size(), 0));
+			struct pollfd ready = {fd, POLLIN, 0};
+			EXPECT_EQ(1, poll(&ready, 1, 1000));
+			server->handleEvent(fd, POLLIN);
+			server->handleEvent(fd, POLLOUT);
+			char buffer[4096];
+			ssize_t bytes = recv(client, buffer, sizeof(buffer), 0);
+			return bytes > 0 ? std::string(buffer, bytes) : "";
+		}
+
+		std::string base;
+		std::string previous;
+		Server* server;
+		int client;
+};
+
+TEST_F(RequestBodyTest, oversizedBodySentWithTheHeadersIsRejected) {
+
+	int fd = connectClient();
+	ASSERT_GE(fd, 0);
+	std::string body(2048, 'x');
+	std::string response = exchange(fd, "POST /uploads/ HTTP/1.1\r\nHost: localhost\r\n"
+		"Content-Type: text/plain\r\nContent-Length: 2048\r\n\r\n" + body);
+	EXPECT_EQ(0u, response.find("HTTP/1.1 413 "));
+}
@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include "static_variant.hpp"
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+class StaticVariantTest : public ::testing::Test {
+
+	protected:
+		void SetUp() {
+			char tmpl[] = "/tmp/static_variant_testXXXXXX";
+			base = mkdtemp(tmpl);
+			system(("echo original > " + base + "/app.js && echo gz > " + base + "/app.js.gz"
+				+ " && echo br > " + base + "/app.js.br").c_str());
+			rootFd = open(base.c_str(), O_RDONLY | O_DIRECTORY);
+			location.gzip_static = 1;
+			location.brotli_static = 0;
+			age("app.js", 1000);
+		}
+		void TearDown() {
+			close(rootFd);
+			system(("rm -rf " + base).c_str());
+		}
+		void age(const std::string& name, time_t mtime) {
+			struct timeval times[2];
+			times[0].tv_sec = times[1].tv_sec = mtime;
+			times[0].tv_usec = times[1].tv_usec = 0;
+			utimes((base + "/" + name).c_str(), times);
+		}
+		StaticVariant select(const std::string& acceptEncoding) {
+			stat((base + "/app.js").c_str(), &fileStat);
+			StaticVariant variant = selectStaticVariant(rootFd, "/app.js", location, acceptEncoding, fileStat);
+			if (variant.fd >= 0)
+				close(variant.fd);
+			return variant;
+		}
+
+		std::string base;
+		int rootFd;
+		LocationConfig location;
+		struct stat fileStat;
+};
+
+TEST_F(StaticVariantTest, FreshSidecarIsChosen) {
+	age("app.js.gz", 2000);
+	StaticVariant variant = select("gzip, deflate");
+	EXPECT_EQ(ENCODING_GZIP, variant.encoding);
+	EXPECT_EQ("/app.js.gz", variant.path);
+	EXPECT_EQ(2000, fileStat.st_mtime);
+	EXPECT_EQ(3, fileStat.st_size);
+	EXPECT_TRUE(variant.vary);
+}
+
+TEST_F(StaticVariantTest, StaleSidecarIsIgnored) {
+	age("app.js.gz", 500);
+	StaticVariant variant = select("gzip");
+	EXPECT_EQ(ENCODING_IDENTITY, variant.encoding);
+	EXPECT_EQ(-1, variant.fd);
+	EXPECT_EQ(1000, fileStat.st_mtime);
+	EXPECT_TRUE(variant.vary);
+}
+
+TEST_F(StaticVariantTest, BrotliPreferredOnlyWhenEnabledAndAccepted) {
+	age("app.js.gz", 2000);
+	age("app.js.br", 2000);
+	EXPECT_EQ(ENCODING_GZIP, select("br, gzip").encoding);
+	location.brotli_static = 1;
+	EXPECT_EQ(ENCODING_BROTLI, select("br, gzip").encoding);
+	EXPECT_EQ(ENCODING_GZIP, select("gzip").encoding);
+	EXPECT_EQ(ENCODING_IDENTITY, select("identity").encoding);
+}
+
+TEST_F(StaticVariantTest, NoVaryWithoutStaticVariants) {
+	age("app.js.gz", 2000);
+	location.gzip_static = 0;
+	StaticVariant variant = select("gzip");
+	EXPECT_EQ(ENCODING_IDENTITY, variant.encoding);
+	EXPECT_FALSE(variant.vary);
+}
@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+#include "upload_store.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+class UploadStoreTest : public ::testing::Test {
+
+	protected:
+		void SetUp() {
+			char tmpl[] = "/tmp/upload_store_testXXXXXX";
+			root = mkdtemp(tmpl);
+			root += "/";
+		}
+		void TearDown() {
+			std::string cmd = "rm -rf " + root;
+			system(cmd.c_str());
+		}
+		bool exists(const std::string& path) {
+			struct stat st;
+			return stat(path.c_str(), &st) == 0;
+		}
+		size_t entries(const std::string& dir) {
+			size_t count = 0;
+			DIR* d = opendir(dir.c_str());
+			while (struct dirent* e = readdir(d))
+				if (std::string(e->d_name) != "." && std::string(e->d_name) != "..")
+					count++;
+			closedir(d);
+			return count;
+		}
+
+		std::string root;
+};
+
+TEST_F(UploadStoreTest, UniqueNamesCarryPidAndSequence) {
+	UploadStore store;
+	std::string first = store.uniqueName("txt");
+	std::string second = store.uniqueName("txt");
+
+	EXPECT_NE(first, second);
+	EXPECT_EQ(first.find("file_" + std::to_string(getpid()) + "_"), 0u);
+	EXPECT_EQ(first.substr(first.size() - 4), ".txt");
+	EXPECT_EQ(store.uniqueName("").find('.'), std::string::npos);
+}
+
+TEST_F(UploadStoreTest, CommitCreatesDirectoriesAndRenames) {
+	UploadStore store;
+	StoredFile file;
+	std::string dir = root + "a/b/c";
+
+	ASSERT_TRUE(store.create(dir, file));
+	EXPECT_EQ(file.directory, dir + "/");
+	EXPECT_EQ(write(file.fd, "hello", 5), 5);
+	EXPECT_FALSE(exists(dir + "/out.txt"));
+	EXPECT_EQ(entries(dir), 1u);   // only the hidden temp file
+
+	ASSERT_TRUE(store.commit(file, "out.txt", UPLOAD_DURABILITY_FDATASYNC));
+	EXPECT_EQ(file.fd, -1);
+	EXPECT_TRUE(exists(dir + "/out.txt"));
+	EXPECT_EQ(entries(dir), 1u);
+}
+
+TEST_F(UploadStoreTest, DiscardRemovesTempFile) {
+	UploadStore store;
+	StoredFile file;
+
+	ASSERT_TRUE(store.create(root, file));
+	EXPECT_EQ(entries(root), 1u);
+	store.discard(file);
+	EXPECT_EQ(file.fd, -1);
+	EXPECT_EQ(entries(root), 0u);
+	store.discard(file);   // harmless twice
+}
+
+TEST_F(UploadStoreTest, RemovedDirectoryIsRecreated) {
+	UploadStore store;
+	StoredFile file;
+	std::string dir = root + "gone/";
+
+	ASSERT_TRUE(store.create(dir, file));
+	store.discard(file);
+	rmdir(dir.c_str());
+
+	ASSERT_TRUE(store.create(dir, file));
+	ASSERT_TRUE(store.commit(file, "back", UPLOAD_DURABILITY_NONE));
+	EXPECT_TRUE(exists(dir + "back"));
+}
+
+TEST_F(UploadStoreTest, BatchSyncsOnFlush) {
+	UploadStore store;
+
+	for (int i = 0; i < 3; i++) {
+		StoredFile file;
+		ASSERT_TRUE(store.create(root, file));
+		ASSERT_TRUE(store.commit(file, store.uniqueName("bin"), UPLOAD_DURABILITY_BATCH));
+	}
+	EXPECT_TRUE(store.syncPending());
+	EXPECT_EQ(entries(root), 3u);   // visible before the sync
+
+	store.flush(true);
+	EXPECT_FALSE(store.syncPending());
+}
+
+TEST_F(UploadStoreTest, FullBatchSyncsRightAway) {
+	UploadStore store;
+
+	for (int i = 0; i < UPLOAD_SYNC_BATCH; i++) {
+		StoredFile file;
+		ASSERT_TRUE(store.create(root, file));
+		ASSERT_TRUE(store.commit(file, store.uniqueName(""), UPLOAD_DURABILITY_BATCH));
+	}
+	EXPECT_FALSE(store.syncPending());
+}
+
+TEST_F(UploadStoreTest, DirectoriesUnderARootStayBeneathIt) {
+	UploadStore store;
+	std::string outside = root + "outside";
+	mkdir((root + "www").c_str(), 0755);
+	mkdir(outside.c_str(), 0755);
+	ASSERT_EQ(0, symlink(outside.c_str(), (root + "www/out").c_str()));
+	int rootFd = open((root + "www").c_str(), O_RDONLY | O_DIRECTORY);
+	store.addRoot(root + "www/", rootFd);
+
+	StoredFile file;
+	ASSERT_TRUE(store.create(root + "www/a/b/", file));
+	ASSERT_TRUE(store.commit(file, "kept.txt", UPLOAD_DURABILITY_NONE));
+	EXPECT_TRUE(exists(root + "www/a/b/kept.txt"));
+
+	StoredFile escaping;
+	EXPECT_FALSE(store.create(root + "www/out/", escaping));
+	EXPECT_FALSE(store.create(root + "www/out/sub/", escaping));
+	EXPECT_FALSE(store.create(root + "www/../outside/", escaping));
+	EXPECT_EQ(0u, entries(outside));
+	close(rootFd);
+}
@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include "worker_pool.hpp"
+#include <poll.h>
+
+class CountingTask : public PoolTask {
+
+	public:
+		CountingTask(int* ran, int* completed) : _ran(ran), _completed(completed) {}
+
+		void run() { __sync_fetch_and_add(_ran, 1); }
+		void complete() { (*_completed)++; }
+
+	private:
+		int*	_ran;
+		int*	_completed;
+};
+
+// Polls the notify fd like the event loop until every completion is in
+static int drainAll(WorkerPool& pool, int expected) {
+
+	int done = 0;
+	for (int attempts = 0; done < expected && attempts < 200; attempts++) {
+		struct pollfd pfd;
+		pfd.fd = pool.notifyFd();
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 50) > 0)
+			done += pool.drainCompletions();
+	}
+	return done;
+}
+
+TEST(WorkerPool, completesEveryTaskOnTheLoopThread) {
+
+	WorkerPool pool(4, 1024);
+	ASSERT_EQ(4u, pool.threads());
+	ASSERT_GE(pool.notifyFd(), 0);
+
+	int ran = 0;
+	int completed = 0;
+	for (int i = 0; i < 500; i++)
+		ASSERT_TRUE(pool.submit(new CountingTask(&ran, &completed)));
+	EXPECT_EQ(500, drainAll(pool, 500));
+	EXPECT_EQ(500, ran);
+	EXPECT_EQ(500, completed);
+}
+
+TEST(WorkerPool, refusesWhenStoppedOrWithoutThreads) {
+
+	int ran = 0;
+	int completed = 0;
+	WorkerPool empty(0, 16);
+	CountingTask task(&ran, &completed);
+	EXPECT_FALSE(empty.submit(&task));
+
+	WorkerPool pool(2, 16);
+	pool.shutdown();
+	EXPECT_FALSE(pool.submit(&task));
+	EXPECT_EQ(0, ran);
+}